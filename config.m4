@@ -53,6 +53,8 @@ if test "$PHP_ASYNC" != "no"; then
       LDFLAGS="$LDFLAGS -z now"
   esac
   
+  AC_CHECK_FUNCS([sendmmsg])
+  
   if test "$PHP_VALGRIND" != "no"; then
     AC_MSG_CHECKING([for valgrind header])
 
@@ -87,12 +89,16 @@ if test "$PHP_ASYNC" != "no"; then
 
   async_source_files="php_async.c \
     src/awaitable.c \
+    src/bcrypt.c \
     src/context.c \
     src/deferred.c \
     src/dns.c \
     src/fiber.c \
     src/fiber/stack.c \
+    src/file_watcher.c \
     src/filesystem.c \
+    src/filesystem_batch.c \
+    src/mmap.c \
     src/process.c \
     src/signal_watcher.c \
     src/socket.c \
@@ -101,9 +107,12 @@ if test "$PHP_ASYNC" != "no"; then
     src/stream_watcher.c \
     src/task.c \
     src/task_scheduler.c \
+    src/thread_pool.c \
     src/tcp.c \
     src/timer.c \
+    src/uring.c \
     src/udp.c \
+    src/worker.c \
     src/xp/socket.c \
     src/xp/tcp.c \
     src/xp/udp.c
@@ -180,6 +189,22 @@ if test "$PHP_ASYNC" != "no"; then
     ])
   fi
   
+  if test "$async_os" = 'LINUX'; then
+    AC_CHECK_HEADER(liburing.h, [
+      PHP_CHECK_LIBRARY(uring, io_uring_get_probe_ring, [
+        PHP_ADD_LIBRARY(uring,, ASYNC_SHARED_LIBADD)
+        AC_DEFINE(HAVE_ASYNC_URING, 1, [ ])
+      ])
+    ])
+  fi
+  
+  AC_CHECK_HEADER(zlib.h, [
+    PHP_CHECK_LIBRARY(z, deflate, [
+      PHP_ADD_LIBRARY(z,, ASYNC_SHARED_LIBADD)
+      AC_DEFINE(HAVE_ASYNC_ZLIB, 1, [ ])
+    ])
+  ])
+  
   PHP_NEW_EXTENSION(async, $async_source_files, $ext_shared,, \\$(ASYNC_CFLAGS))
   PHP_SUBST(ASYNC_CFLAGS)
   PHP_SUBST(ASYNC_SHARED_LIBADD)
@@ -0,0 +1,54 @@
+<?php
+
+namespace Concurrent;
+
+// Compares removing many files one by one with a single batched call.
+//
+// php -d async.filesystem=1 examples/filesystem-batch.php
+
+$count = (int) ($argv[1] ?? 10000);
+$dir = \sys_get_temp_dir() . '/async-batch-' . \getmypid();
+
+\mkdir($dir);
+
+function create(string $dir, int $count): array
+{
+    $files = [];
+    
+    for ($i = 0; $i < $count; $i++) {
+        \touch($files[] = $dir . '/' . $i);
+    }
+    
+    return $files;
+}
+
+try {
+    $files = create($dir, $count);
+    $start = \microtime(true);
+    
+    foreach ($files as $file) {
+        \clearstatcache();
+        
+        if (\is_file($file)) {
+            \unlink($file);
+        }
+    }
+    
+    $time = \microtime(true) - $start;
+    
+    \printf("single: %10.0f files/s\n", $count / $time);
+    
+    $files = create($dir, $count);
+    $start = \microtime(true);
+    
+    $files = \array_keys(\array_filter(Filesystem::stat($files), 'is_array'));
+    
+    Filesystem::unlink($files);
+    
+    $time = \microtime(true) - $start;
+    
+    \printf("batch:  %10.0f files/s\n", $count / $time);
+} finally {
+    \array_map('unlink', \glob($dir . '/*'));
+    \rmdir($dir);
+}
@@ -0,0 +1,78 @@
+<?php
+
+namespace Concurrent;
+
+// Measures throughput of the async file stream wrapper, compare both backends:
+//
+// php -d async.filesystem=1 -d async.filesystem_uring=1 examples/filesystem-throughput.php
+// php -d async.filesystem=1 -d async.filesystem_uring=0 examples/filesystem-throughput.php
+
+$size = (int) ($argv[1] ?? 64) * 1024 * 1024;
+$concurrency = (int) ($argv[2] ?? 8);
+
+if (!\ini_get('async.filesystem')) {
+    echo "Enable async.filesystem to benchmark the async file stream wrapper\n";
+}
+
+$file = \tempnam(\sys_get_temp_dir(), 'async');
+$chunk = \str_repeat('A', 8192);
+
+try {
+    $start = \microtime(true);
+    
+    $fp = \fopen($file, 'wb');
+    \stream_set_write_buffer($fp, 0);
+    
+    for ($i = 0; $i < $size; $i += \strlen($chunk)) {
+        \fwrite($fp, $chunk);
+    }
+    
+    \fclose($fp);
+    
+    $time = \microtime(true) - $start;
+    
+    \printf("write: %8.2f MB/s %10.0f ops/s\n", $size / $time / 1024 / 1024, $size / \strlen($chunk) / $time);
+    
+    $start = \microtime(true);
+    $tasks = [];
+    
+    for ($i = 0; $i < $concurrency; $i++) {
+        $tasks[] = Task::async(function () use ($file) {
+            $fp = \fopen($file, 'rb');
+            $len = 0;
+            
+            try {
+                while (!\feof($fp)) {
+                    $len += \strlen(\fread($fp, 0x8000));
+                }
+            } finally {
+                \fclose($fp);
+            }
+            
+            return $len;
+        });
+    }
+    
+    $len = 0;
+    
+    foreach ($tasks as $task) {
+        $len += Task::await($task);
+    }
+    
+    $time = \microtime(true) - $start;
+    
+    \printf("read:  %8.2f MB/s %10.0f ops/s (%d readers)\n", $len / $time / 1024 / 1024, $len / 0x8000 / $time, $concurrency);
+    
+    $start = \microtime(true);
+    $fp = \fopen($file, 'rb');
+    
+    for ($i = 0; $i < 10000; $i++) {
+        \fstat($fp);
+    }
+    
+    \fclose($fp);
+    
+    \printf("fstat: %10.0f ops/s\n", 10000 / (\microtime(true) - $start));
+} finally {
+    \unlink($file);
+}
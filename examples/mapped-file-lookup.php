@@ -0,0 +1,55 @@
+<?php
+
+namespace Concurrent;
+
+// Compares random record lookups using fseek() + fread() with a MappedFile.
+
+$size = (int) ($argv[1] ?? 256) * 1024 * 1024;
+$lookups = (int) ($argv[2] ?? 100000);
+$record = 64;
+
+$file = \tempnam(\sys_get_temp_dir(), 'async');
+$fp = \fopen($file, 'wb');
+
+for ($i = 0; $i < $size; $i += 0x100000) {
+    \fwrite($fp, \random_bytes(0x100000));
+}
+
+\fclose($fp);
+
+$offsets = [];
+
+for ($i = 0; $i < $lookups; $i++) {
+    $offsets[] = \mt_rand(0, ($size / $record) - 1) * $record;
+}
+
+try {
+    $start = \microtime(true);
+    $fp = \fopen($file, 'rb');
+    
+    foreach ($offsets as $offset) {
+        \fseek($fp, $offset);
+        \fread($fp, $record);
+    }
+    
+    \fclose($fp);
+    
+    $time = \microtime(true) - $start;
+    
+    \printf("fread: %10.0f lookups/s\n", $lookups / $time);
+    
+    $start = \microtime(true);
+    $map = MappedFile::open($file, MappedFile::ADVICE_RANDOM);
+    
+    foreach ($offsets as $offset) {
+        $map->read($offset, $record);
+    }
+    
+    $map->close();
+    
+    $time = \microtime(true) - $start;
+    
+    \printf("mmap:  %10.0f lookups/s\n", $lookups / $time);
+} finally {
+    \unlink($file);
+}
@@ -0,0 +1,96 @@
+<?php
+
+namespace Concurrent\Network;
+
+use Concurrent\Task;
+
+// Compares serving a large file using reads + writes vs. TcpSocket::sendFile().
+
+$size = (int) ($argv[1] ?? 256) * 1024 * 1024;
+$count = (int) ($argv[2] ?? 4);
+
+$file = tempnam(sys_get_temp_dir(), 'async');
+$fp = fopen($file, 'wb');
+
+for ($i = 0; $i < $size; $i += 0x100000) {
+    fwrite($fp, random_bytes(0x100000));
+}
+
+fclose($fp);
+
+function serve(string $label, int $count, callable $send): void
+{
+    $server = TcpServer::listen('127.0.0.1', 0);
+    
+    try {
+        $clients = [];
+        
+        for ($i = 0; $i < $count; $i++) {
+            $clients[] = Task::async(function () use ($server) {
+                $socket = TcpSocket::connect($server->getAddress(), $server->getPort());
+                $received = 0;
+                
+                try {
+                    while (null !== ($chunk = $socket->read())) {
+                        $received += strlen($chunk);
+                    }
+                } finally {
+                    $socket->close();
+                }
+                
+                return $received;
+            });
+        }
+        
+        $start = microtime(true);
+        $handlers = [];
+        
+        for ($i = 0; $i < $count; $i++) {
+            $socket = $server->accept();
+            
+            $handlers[] = Task::async(function () use ($socket, $send) {
+                try {
+                    $send($socket);
+                } finally {
+                    $socket->close();
+                }
+            });
+        }
+        
+        $received = 0;
+        
+        foreach ($clients as $client) {
+            $received += Task::await($client);
+        }
+        
+        foreach ($handlers as $handler) {
+            Task::await($handler);
+        }
+        
+        $time = microtime(true) - $start;
+        
+        printf("%-9s %8.2f MB/s (%d clients, %d MB)\n", $label, $received / $time / 1024 / 1024, $count, $received / 1024 / 1024);
+    } finally {
+        $server->close();
+    }
+}
+
+try {
+    serve('copy', $count, function (TcpSocket $socket) use ($file) {
+        $fp = fopen($file, 'rb');
+        
+        try {
+            while (!feof($fp)) {
+                $socket->write(fread($fp, 0x10000));
+            }
+        } finally {
+            fclose($fp);
+        }
+    });
+    
+    serve('sendfile', $count, function (TcpSocket $socket) use ($file) {
+        $socket->sendFile($file);
+    });
+} finally {
+    unlink($file);
+}
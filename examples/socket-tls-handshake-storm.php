@@ -0,0 +1,85 @@
+<?php
+
+namespace Concurrent\Network;
+
+use Concurrent\Task;
+use Concurrent\Timer;
+
+$file = __DIR__ . '/cert/localhost.';
+$count = (int) ($argv[1] ?? 200);
+
+function storm(TlsServerEncryption $tls, TlsClientEncryption $client, int $count): array
+{
+    $server = TcpServer::listen('127.0.0.1', 0, $tls);
+    
+    $lag = 0;
+    $done = false;
+    
+    $probe = Task::async(function () use (& $lag, & $done) {
+        $timer = new Timer(1);
+        
+        while (!$done) {
+            $time = microtime(true);
+            $timer->awaitTimeout();
+            
+            $lag = max($lag, microtime(true) - $time - .001);
+        }
+    });
+    
+    $start = microtime(true);
+    
+    try {
+        $clients = [];
+        
+        for ($i = 0; $i < $count; $i++) {
+            $clients[] = Task::async(function () use ($server, $client) {
+                $socket = TcpSocket::connect($server->getAddress(), $server->getPort(), $client);
+                
+                try {
+                    $socket->encrypt();
+                    $socket->read();
+                } finally {
+                    $socket->close();
+                }
+            });
+        }
+        
+        $handlers = [];
+        
+        for ($i = 0; $i < $count; $i++) {
+            $socket = $server->accept();
+            
+            $handlers[] = Task::async(function () use ($socket) {
+                try {
+                    $socket->encrypt();
+                    $socket->write('A');
+                } finally {
+                    $socket->close();
+                }
+            });
+        }
+        
+        foreach (array_merge($clients, $handlers) as $t) {
+            Task::await($t);
+        }
+    } finally {
+        $server->close();
+    }
+    
+    $time = microtime(true) - $start;
+    $done = true;
+    
+    Task::await($probe);
+    
+    return [$count / $time, $lag * 1000];
+}
+
+$tls = new TlsServerEncryption();
+$tls = $tls->withDefaultCertificate($file . 'crt', $file . 'key', 'localhost');
+
+$client = new TlsClientEncryption();
+$client = $client->withPeerName('localhost');
+$client = $client->withAllowSelfSigned(true);
+
+vprintf("Inline handshakes:    %8.1f / sec, max loop lag %6.2f ms\n", storm($tls, $client, $count));
+vprintf("Offloaded handshakes: %8.1f / sec, max loop lag %6.2f ms\n", storm($tls->withHandshakeOffload(true), $client, $count));
@@ -0,0 +1,63 @@
+<?php
+
+namespace Concurrent\Network;
+
+use Concurrent\Task;
+
+$file = __DIR__ . '/cert/localhost.';
+$count = (int) ($argv[1] ?? 500);
+
+function handshakes(TlsServerEncryption $tls, TlsClientEncryption $client, int $count): float
+{
+    $server = TcpServer::listen('127.0.0.1', 0, $tls);
+    
+    $start = microtime(true);
+    
+    try {
+        for ($i = 0; $i < $count; $i++) {
+            $t = Task::async(function () use ($server, $client) {
+                $socket = TcpSocket::connect($server->getAddress(), $server->getPort(), $client);
+                
+                try {
+                    $socket->encrypt();
+                    $socket->read();
+                } finally {
+                    $socket->close();
+                }
+            });
+            
+            $socket = $server->accept();
+            
+            try {
+                $socket->encrypt();
+                $socket->write('A');
+                
+                while (null !== $socket->read()) {}
+            } finally {
+                $socket->close();
+            }
+            
+            Task::await($t);
+        }
+    } finally {
+        $server->close();
+    }
+    
+    return $count / (microtime(true) - $start);
+}
+
+$tls = new TlsServerEncryption();
+$tls = $tls->withDefaultCertificate($file . 'crt', $file . 'key', 'localhost');
+
+$client = new TlsClientEncryption();
+$client = $client->withPeerName('localhost');
+$client = $client->withAllowSelfSigned(true);
+
+printf("Full handshakes:    %8.1f / sec\n", handshakes($tls, $client, $count));
+
+$tls = $tls->withSessionCache(1024)->withSessionTickets(true);
+$client = $client->withSessionReuse(true);
+
+printf("Resumed handshakes: %8.1f / sec\n", handshakes($tls, $client, $count));
+
+print_r($client->getSessionStats());
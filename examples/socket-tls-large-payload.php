@@ -0,0 +1,60 @@
+<?php
+
+namespace Concurrent\Network;
+
+use Concurrent\Task;
+
+$file = __DIR__ . '/cert/localhost.';
+$total = 128 * 1024 * 1024;
+
+$tls = new TlsServerEncryption();
+$tls = $tls->withDefaultCertificate($file . 'crt', $file . 'key', 'localhost');
+
+$client = new TlsClientEncryption();
+$client = $client->withPeerName('localhost');
+$client = $client->withAllowSelfSigned(true);
+
+foreach ([1024, 16 * 1024, 64 * 1024, 1024 * 1024] as $len) {
+    $server = TcpServer::listen('127.0.0.1', 0, $tls);
+    
+    try {
+        $t = Task::async(function () use ($server, $client, $len, $total) {
+            $socket = TcpSocket::connect($server->getAddress(), $server->getPort(), $client);
+            
+            try {
+                $socket->encrypt();
+                
+                $chunk = str_repeat('A', $len);
+                
+                for ($i = 0; $i < $total; $i += $len) {
+                    $socket->write($chunk);
+                }
+            } finally {
+                $socket->close();
+            }
+        });
+        
+        $socket = $server->accept();
+        $received = 0;
+        
+        try {
+            $socket->encrypt();
+            
+            $start = microtime(true);
+            
+            while (null !== ($chunk = $socket->read())) {
+                $received += strlen($chunk);
+            }
+            
+            $time = microtime(true) - $start;
+        } finally {
+            $socket->close();
+        }
+        
+        Task::await($t);
+    } finally {
+        $server->close();
+    }
+    
+    printf("%8d byte writes: %8.1f MB/s, %d bytes received\n", $len, $received / $time / 1024 / 1024, $received);
+}
@@ -0,0 +1,64 @@
+<?php
+
+namespace Concurrent\Network;
+
+use Concurrent\Task;
+
+$file = __DIR__ . '/cert/localhost.';
+$size = (int) ($argv[1] ?? 256) * 1024 * 1024;
+
+function throughput(TlsServerEncryption $tls, TlsClientEncryption $client, int $size): float
+{
+    $server = TcpServer::listen('127.0.0.1', 0, $tls);
+    
+    try {
+        $t = Task::async(function () use ($server, $client, $size) {
+            $socket = TcpSocket::connect($server->getAddress(), $server->getPort(), $client);
+            
+            try {
+                $socket->encrypt();
+                
+                $chunk = str_repeat('A', 0x10000);
+                
+                for ($i = 0; $i < $size; $i += strlen($chunk)) {
+                    $socket->write($chunk);
+                }
+            } finally {
+                $socket->close();
+            }
+        });
+        
+        $socket = $server->accept();
+        $received = 0;
+        
+        try {
+            $socket->encrypt();
+            
+            $start = microtime(true);
+            
+            while (null !== ($chunk = $socket->read())) {
+                $received += strlen($chunk);
+            }
+            
+            $time = microtime(true) - $start;
+        } finally {
+            $socket->close();
+        }
+        
+        Task::await($t);
+    } finally {
+        $server->close();
+    }
+    
+    return $received / $time / 1024 / 1024;
+}
+
+$tls = new TlsServerEncryption();
+$tls = $tls->withDefaultCertificate($file . 'crt', $file . 'key', 'localhost');
+
+$client = new TlsClientEncryption();
+$client = $client->withPeerName('localhost');
+$client = $client->withAllowSelfSigned(true);
+
+printf("Userland TLS: %8.1f MB/s\n", throughput($tls, $client, $size));
+printf("Kernel TLS:   %8.1f MB/s\n", throughput($tls->withKernelTls(true), $client->withKernelTls(true), $size));
@@ -0,0 +1,80 @@
+<?php
+
+namespace Concurrent\Network;
+
+use Concurrent\Task;
+
+$count = (int) ($argv[1] ?? 200000);
+$batch = (int) ($argv[2] ?? 64);
+
+function measure(int $count, ?int $batch, bool $tuples = false): array
+{
+    $receiver = UdpSocket::bind('127.0.0.1', 0);
+    
+    $t = Task::async(function () use ($receiver, $count) {
+        $sender = UdpSocket::bind('127.0.0.1', 0);
+        $datagram = new UdpDatagram('metric.name:1|c', $receiver->getAddress(), $receiver->getPort());
+        
+        try {
+            for ($i = 1; $i <= $count; $i++) {
+                if ($i % 64) {
+                    $sender->sendAsync($datagram);
+                } else {
+                    $sender->send($datagram);
+                }
+            }
+            
+            for ($i = 0; $i < 3; $i++) {
+                $sender->send($datagram->withData('STOP'));
+            }
+        } finally {
+            $sender->close();
+        }
+    });
+    
+    $received = 0;
+    $wakeups = 0;
+    
+    $start = microtime(true);
+    
+    try {
+        while (true) {
+            $wakeups++;
+            
+            if ($tuples) {
+                $buffer = [];
+                $receiver->receiveInto($buffer, $batch);
+                
+                foreach ($buffer as list ($data)) {
+                    if ($data === 'STOP') {
+                        break 2;
+                    }
+                    
+                    $received++;
+                }
+                
+                continue;
+            }
+            
+            foreach (($batch === null) ? [$receiver->receive()] : $receiver->receiveMany($batch) as $datagram) {
+                if ($datagram->data === 'STOP') {
+                    break 2;
+                }
+                
+                $received++;
+            }
+        }
+    } finally {
+        $receiver->close();
+    }
+    
+    $time = microtime(true) - $start;
+    
+    Task::await($t);
+    
+    return [$received / $time, $received, $wakeups];
+}
+
+vprintf("receive():         %10.0f datagrams / sec (%u received, %u wakeups)\n", measure($count, null));
+vprintf("receiveMany(%3u):  %10.0f datagrams / sec (%u received, %u wakeups)\n", array_merge([$batch], measure($count, $batch)));
+vprintf("receiveInto(%3u):  %10.0f datagrams / sec (%u received, %u wakeups)\n", array_merge([$batch], measure($count, $batch, true)));
@@ -0,0 +1,45 @@
+<?php
+
+namespace Concurrent\Network;
+
+$count = (int) ($argv[1] ?? 200000);
+$batch = (int) ($argv[2] ?? 64);
+
+// Datagrams are not read by the receiver, the benchmark only measures the sender side.
+$receiver = UdpSocket::bind('127.0.0.1', 0);
+$datagram = new UdpDatagram(str_repeat('x', 1200), $receiver->getAddress(), $receiver->getPort());
+
+function measure(UdpSocket $socket, UdpDatagram $datagram, int $count, int $batch): float
+{
+    $start = microtime(true);
+    
+    if ($batch < 2) {
+        for ($i = 0; $i < $count; $i++) {
+            $socket->send($datagram);
+        }
+    } else {
+        $datagrams = array_fill(0, $batch, $datagram);
+        
+        for ($i = 0; $i < $count; $i += $batch) {
+            $socket->sendMany($datagrams);
+        }
+    }
+    
+    return $count / (microtime(true) - $start);
+}
+
+$sender = UdpSocket::bind('127.0.0.1', 0);
+
+try {
+    printf("send():                %10.0f datagrams / sec\n", measure($sender, $datagram, $count, 1));
+    printf("sendMany(%3u):         %10.0f datagrams / sec\n", $batch, measure($sender, $datagram, $count, $batch));
+    
+    if ($sender->setOption(UdpSocket::SEGMENTATION, true)) {
+        printf("sendMany(%3u) + GSO:   %10.0f datagrams / sec\n", $batch, measure($sender, $datagram, $count, $batch));
+    } else {
+        echo "GSO is not supported by the kernel\n";
+    }
+} finally {
+    $sender->close();
+    $receiver->close();
+}
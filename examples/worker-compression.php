@@ -0,0 +1,60 @@
+<?php
+
+namespace Concurrent;
+
+// Compares event loop latency while compressing data inline vs. in the thread pool.
+
+$count = (int) ($argv[1] ?? 50);
+$data = \random_bytes(1024 * 256) . \str_repeat('Hello World ', 1024 * 64);
+
+function measure(string $label, int $count, callable $job): void
+{
+    $lag = 0;
+    $done = false;
+    
+    $probe = Task::async(function () use (& $lag, & $done) {
+        $timer = new Timer(1);
+        
+        while (!$done) {
+            $time = \microtime(true);
+            $timer->awaitTimeout();
+            
+            $lag = \max($lag, \microtime(true) - $time - .001);
+        }
+    });
+    
+    $start = \microtime(true);
+    
+    try {
+        $tasks = [];
+        
+        for ($i = 0; $i < $count; $i++) {
+            $tasks[] = Task::async($job);
+        }
+        
+        Task::await(all($tasks));
+    } finally {
+        $done = true;
+        
+        Task::await($probe);
+    }
+    
+    \printf("%-8s %8.2f ms total, %8.2f ms max loop lag\n", $label, (\microtime(true) - $start) * 1000, $lag * 1000);
+}
+
+function all(array $tasks): Awaitable
+{
+    return Task::async(function () use ($tasks) {
+        foreach ($tasks as $task) {
+            Task::await($task);
+        }
+    });
+}
+
+measure('inline', $count, function () use ($data) {
+    return \gzdeflate($data, 6);
+});
+
+measure('worker', $count, function () use ($data) {
+    return Worker::compress($data, Worker::ENCODING_RAW, 6);
+});
@@ -24,6 +24,10 @@
 
 #define ASYNC_SSL_DEFAULT_VERIFY_DEPTH 9
 
+#define ASYNC_SSL_DEFAULT_SESSION_TIMEOUT 300
+#define ASYNC_SSL_DEFAULT_TICKET_LIFETIME 3600
+#define ASYNC_SSL_MAX_CLIENT_SESSIONS 256
+
 #ifndef OPENSSL_NO_TLSEXT
 #define ASYNC_TLS_SNI 1
 #if OPENSSL_VERSION_NUMBER >= 0x10002000L
@@ -31,6 +35,48 @@
 #endif
 #endif
 
+#if defined(HAVE_ASYNC_SSL) && OPENSSL_VERSION_NUMBER >= 0x10100000L
+#define ASYNC_TLS_OFFLOAD 1
+#endif
+
+#if defined(HAVE_ASYNC_SSL) && defined(__linux__) && OPENSSL_VERSION_NUMBER >= 0x30000000L && defined(SSL_OP_ENABLE_KTLS)
+#define ASYNC_TLS_KTLS 1
+#endif
+
+typedef struct {
+	/* Name of the key as being transmitted within a session ticket. */
+	unsigned char name[16];
+
+	/* Key being used to encrypt session tickets. */
+	unsigned char aes[32];
+
+	/* Key being used to authenticate session tickets. */
+	unsigned char hmac[32];
+} async_ssl_ticket_key;
+
+typedef struct {
+	/* Refcount, session state is shared between all derived encryption objects. */
+	uint32_t refcount;
+
+	/* Number of handshakes that resumed a previous session. */
+	zend_ulong resumed;
+
+	/* Number of full handshakes that negotiated a new session. */
+	zend_ulong full;
+
+	/* Client sessions keyed by "host:port". */
+	HashTable sessions;
+
+	/* Current (index 0) and previous (index 1) session ticket key. */
+	async_ssl_ticket_key keys[2];
+
+	/* Timestamp of the last ticket key rotation. */
+	time_t rotated;
+
+	/* Guards ticket keys, offloaded handshakes access them from worker threads. */
+	uv_mutex_t lock;
+} async_ssl_session_cache;
+
 typedef struct {
 	/* SSL mode (ASYNC_SSL_MODE_SERVER or ASYNC_SSL_MODE_CLIENT). */
 	zend_bool mode;
@@ -43,6 +89,30 @@ typedef struct {
 
 	/* Maximum verification cert chain length */
 	int verify_depth;
+
+	/* Session cache and handshake stats, NULL if session resumption is disabled. */
+	async_ssl_session_cache *sessions;
+
+	/* Lookup key of a cached client session (host:port). */
+	zend_string *session_key;
+
+	/* Max number of sessions in the server-side session cache, 0 disables the cache. */
+	int cache_size;
+
+	/* Server-side session cache timeout in seconds. */
+	int cache_timeout;
+
+	/* Lifetime of a session ticket key in seconds, 0 disables session tickets. */
+	int ticket_lifetime;
+
+	/* Supported ALPN protocols (encoded in wire format). */
+	zend_string *alpn;
+
+	/* Attempt to offload record encryption to the kernel (kTLS). */
+	zend_bool ktls;
+
+	/* Perform server handshake steps (private key operations) in the libuv thread pool. */
+	zend_bool offload;
 } async_ssl_settings;
 
 typedef struct {
@@ -54,6 +124,10 @@ typedef struct {
 typedef struct {
 	const char *host;
 	zend_bool allow_self_signed;
+	zend_bool ktls;
+	zend_bool offload;
+	/* Object owning the settings of an offloaded handshake, referenced while a worker is running. */
+	zend_object *owner;
 	int uv_error;
 	int ssl_error;
 	zend_string *error;
@@ -82,6 +156,9 @@ typedef struct {
 	/* Current handshake operation. */
 	async_ssl_op *handshake;
 
+	/* Set if writes are encrypted by the kernel (kTLS), plaintext is written to the socket. */
+	zend_bool ktls;
+
 	/* SSL connection and encryption settings. */
 	async_ssl_settings settings;
 #endif
@@ -119,6 +196,9 @@ typedef struct {
 
 	async_tls_cert cert;
 	async_tls_cert_queue certs;
+
+	/* Session resumption settings. */
+	async_ssl_settings settings;
 } async_tls_server_encryption;
 
 #ifdef HAVE_ASYNC_SSL
@@ -129,6 +209,11 @@ void async_ssl_dispose_engine(async_ssl_engine *engine, zend_bool ctx);
 void async_ssl_setup_sni(SSL_CTX *ctx, async_tls_server_encryption *encryption);
 void async_ssl_setup_verify_callback(SSL_CTX *ctx, async_ssl_settings *settings);
 int async_ssl_setup_encryption(SSL *ssl, async_ssl_settings *settings);
+
+void async_ssl_setup_server_sessions(SSL_CTX *ctx, async_ssl_settings *settings);
+void async_ssl_setup_client_session(SSL_CTX *ctx, SSL *ssl, async_ssl_settings *settings);
+void async_ssl_update_session_stats(SSL *ssl, async_ssl_settings *settings);
+void async_ssl_rotate_ticket_keys(async_ssl_settings *settings);
 #endif
 
 async_tls_client_encryption *async_clone_client_encryption(async_tls_client_encryption *encryption);
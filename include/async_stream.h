@@ -26,6 +26,7 @@
 #define ASYNC_STREAM_SHUT_RD (1 << 2)
 #define ASYNC_STREAM_SHUT_WR (1 << 3)
 #define ASYNC_STREAM_READING (1 << 4)
+#define ASYNC_STREAM_SENDING_FILE (1 << 5)
 
 #define ASYNC_STREAM_SHUT_RDWR ASYNC_STREAM_SHUT_RD | ASYNC_STREAM_SHUT_WR
 
@@ -53,6 +54,8 @@ typedef struct {
 	async_ssl_engine ssl;
 	async_stream_read_op *read;
 	async_op_queue writes;
+	/* Tasks waiting for a file transfer to finish before they can write. */
+	async_op_queue senders;
 	zval read_error;
 	zval write_error;
 } async_stream;
@@ -63,8 +66,14 @@ typedef struct {
 	async_context *context;
 	int code;
 	uv_write_t req;
-	uv_buf_t bufs[1];
-	char *data;
+	/* Buffers that still need to be written. */
+	uv_buf_t *bufs;
+	unsigned int nbufs;
+	/* Inline buffer used by unencrypted writes. */
+	uv_buf_t buf;
+	/* Pooled TLS record buffers, released when the write has completed. */
+	uv_buf_t *records;
+	unsigned int nrecords;
 	zend_string *str;
 	async_stream_write_cb cb;
 	void *arg;
@@ -78,6 +87,8 @@ int async_stream_read(async_stream *stream, char *buf, size_t len);
 int async_stream_read_string(async_stream *stream, zend_string **str, size_t len);
 void async_stream_write(async_stream *stream, char *buf, size_t len);
 void async_stream_async_write_string(async_stream *stream, zend_string *str, async_stream_write_cb cb, void *arg);
+void async_stream_dispose_write_op(async_stream_write_op *op);
+int async_stream_sendfile(async_stream *stream, uv_file file, int64_t offset, size_t length, size_t *sent);
 
 #ifdef HAVE_ASYNC_SSL
 int async_stream_ssl_handshake(async_stream *stream, async_ssl_handshake_data *data);
@@ -56,6 +56,9 @@ static void async_execute_ex(zend_execute_data *exec)
 
 void async_init()
 {
+	async_dns_cache_init();
+	async_thread_pool_init();
+
 	if (ASYNC_G(fs_enabled)) {
 		async_filesystem_init();
 	}
@@ -228,8 +231,22 @@ static PHP_INI_MH(OnUpdateFiberStackSize)
 
 PHP_INI_BEGIN()
 	STD_PHP_INI_ENTRY("async.dns", "0", PHP_INI_SYSTEM | PHP_INI_PERDIR, OnUpdateBool, dns_enabled, zend_async_globals, async_globals)
+	STD_PHP_INI_ENTRY("async.dns_cache_size", "1024", PHP_INI_ALL, OnUpdateLong, dns_cache_size, zend_async_globals, async_globals)
+	STD_PHP_INI_ENTRY("async.dns_cache_ttl", "60", PHP_INI_ALL, OnUpdateLong, dns_cache_ttl, zend_async_globals, async_globals)
+	STD_PHP_INI_ENTRY("async.dns_cache_negative_ttl", "5", PHP_INI_ALL, OnUpdateLong, dns_cache_negative_ttl, zend_async_globals, async_globals)
+	STD_PHP_INI_ENTRY("async.dns_nameservers", "", PHP_INI_SYSTEM | PHP_INI_PERDIR, OnUpdateString, dns_nameservers, zend_async_globals, async_globals)
+	STD_PHP_INI_ENTRY("async.dns_native", "0", PHP_INI_SYSTEM | PHP_INI_PERDIR, OnUpdateBool, dns_native, zend_async_globals, async_globals)
 	STD_PHP_INI_ENTRY("async.filesystem", "0", PHP_INI_SYSTEM | PHP_INI_PERDIR, OnUpdateBool, fs_enabled, zend_async_globals, async_globals)
+	STD_PHP_INI_ENTRY("async.filesystem_read_buffer_size", "32768", PHP_INI_ALL, OnUpdateLong, fs_read_buffer_size, zend_async_globals, async_globals)
+	STD_PHP_INI_ENTRY("async.filesystem_write_buffer_size", "0", PHP_INI_ALL, OnUpdateLong, fs_write_buffer_size, zend_async_globals, async_globals)
+	STD_PHP_INI_ENTRY("async.filesystem_include", "0", PHP_INI_SYSTEM | PHP_INI_PERDIR, OnUpdateBool, fs_include, zend_async_globals, async_globals)
+	STD_PHP_INI_ENTRY("async.filesystem_dir_batch_size", "256", PHP_INI_ALL, OnUpdateLong, fs_dir_batch_size, zend_async_globals, async_globals)
+	STD_PHP_INI_ENTRY("async.filesystem_uring", "1", PHP_INI_SYSTEM | PHP_INI_PERDIR, OnUpdateBool, fs_uring, zend_async_globals, async_globals)
 	STD_PHP_INI_ENTRY("async.stack_size", "0", PHP_INI_SYSTEM, OnUpdateFiberStackSize, stack_size, zend_async_globals, async_globals)
+	STD_PHP_INI_ENTRY("async.threadpool_size", "0", PHP_INI_SYSTEM, OnUpdateLong, threadpool_size, zend_async_globals, async_globals)
+	STD_PHP_INI_ENTRY("async.threadpool_dns", "0", PHP_INI_SYSTEM, OnUpdateLong, threadpool_dns, zend_async_globals, async_globals)
+	STD_PHP_INI_ENTRY("async.threadpool_fs", "0", PHP_INI_SYSTEM, OnUpdateLong, threadpool_fs, zend_async_globals, async_globals)
+	STD_PHP_INI_ENTRY("async.threadpool_work", "0", PHP_INI_SYSTEM, OnUpdateLong, threadpool_work, zend_async_globals, async_globals)
 	STD_PHP_INI_ENTRY("async.timer", "0", PHP_INI_SYSTEM | PHP_INI_PERDIR, OnUpdateBool, timer_enabled, zend_async_globals, async_globals)
 	STD_PHP_INI_ENTRY("async.tcp", "0", PHP_INI_SYSTEM | PHP_INI_PERDIR, OnUpdateBool, tcp_enabled, zend_async_globals, async_globals)
 	STD_PHP_INI_ENTRY("async.udp", "0", PHP_INI_SYSTEM | PHP_INI_PERDIR, OnUpdateBool, udp_enabled, zend_async_globals, async_globals)
@@ -285,6 +302,9 @@ PHP_MINIT_FUNCTION(async)
 	async_deferred_ce_register();
 	async_dns_ce_register();
 	async_fiber_ce_register();
+	async_file_watcher_ce_register();
+	async_filesystem_ce_register();
+	async_mapped_file_ce_register();
 	async_process_ce_register();
 	async_signal_watcher_ce_register();
 	async_ssl_ce_register();
@@ -294,9 +314,12 @@ PHP_MINIT_FUNCTION(async)
 	async_tcp_ce_register();
 	async_timer_ce_register();
 	async_udp_socket_ce_register();
+	async_worker_ce_register();
 
 	REGISTER_INI_ENTRIES();
 
+	async_thread_pool_startup();
+
 	orig_execute_ex = zend_execute_ex;
 	zend_execute_ex = async_execute_ex;
 
@@ -351,6 +374,9 @@ PHP_RSHUTDOWN_FUNCTION(async)
 	
 	async_context_shutdown();
 	async_fiber_shutdown();
+	
+	async_stream_pool_shutdown();
+	async_dns_cache_shutdown();
 
 	return SUCCESS;
 }
@@ -118,8 +118,12 @@ ASYNC_API extern zend_class_entry *async_context_ce;
 ASYNC_API extern zend_class_entry *async_context_var_ce;
 ASYNC_API extern zend_class_entry *async_deferred_ce;
 ASYNC_API extern zend_class_entry *async_deferred_awaitable_ce;
+ASYNC_API extern zend_class_entry *async_dns_ce;
 ASYNC_API extern zend_class_entry *async_duplex_stream_ce;
 ASYNC_API extern zend_class_entry *async_fiber_ce;
+ASYNC_API extern zend_class_entry *async_file_watcher_ce;
+ASYNC_API extern zend_class_entry *async_filesystem_ce;
+ASYNC_API extern zend_class_entry *async_mapped_file_ce;
 ASYNC_API extern zend_class_entry *async_pending_read_exception_ce;
 ASYNC_API extern zend_class_entry *async_process_builder_ce;
 ASYNC_API extern zend_class_entry *async_process_ce;
@@ -140,6 +144,7 @@ ASYNC_API extern zend_class_entry *async_tcp_socket_ce;
 ASYNC_API extern zend_class_entry *async_tls_client_encryption_ce;
 ASYNC_API extern zend_class_entry *async_tls_server_encryption_ce;
 ASYNC_API extern zend_class_entry *async_timer_ce;
+ASYNC_API extern zend_class_entry *async_worker_ce;
 ASYNC_API extern zend_class_entry *async_writable_pipe_ce;
 ASYNC_API extern zend_class_entry *async_writable_stream_ce;
 
@@ -149,6 +154,9 @@ void async_context_ce_register();
 void async_deferred_ce_register();
 void async_dns_ce_register();
 void async_fiber_ce_register();
+void async_file_watcher_ce_register();
+void async_filesystem_ce_register();
+void async_mapped_file_ce_register();
 void async_process_ce_register();
 void async_signal_watcher_ce_register();
 void async_socket_ce_register();
@@ -160,6 +168,7 @@ void async_task_scheduler_ce_register();
 void async_tcp_ce_register();
 void async_timer_ce_register();
 void async_udp_socket_ce_register();
+void async_worker_ce_register();
 
 void async_fiber_ce_unregister();
 
@@ -167,14 +176,19 @@ void async_init();
 void async_shutdown();
 
 void async_dns_init();
+void async_dns_cache_init();
+void async_thread_pool_startup();
 void async_filesystem_init();
 void async_tcp_socket_init();
+void async_thread_pool_init();
 void async_timer_init();
 void async_udp_socket_init();
 
 void async_context_shutdown();
 void async_dns_shutdown();
+void async_dns_cache_shutdown();
 void async_fiber_shutdown();
+void async_stream_pool_shutdown();
 void async_filesystem_shutdown();
 void async_tcp_socket_shutdown();
 void async_timer_shutdown();
@@ -192,10 +206,13 @@ typedef struct _async_context_var                   async_context_var;
 typedef struct _async_deferred                      async_deferred;
 typedef struct _async_deferred_awaitable            async_deferred_awaitable;
 typedef struct _async_deferred_state                async_deferred_state;
+typedef struct _async_dns_config                    async_dns_config;
+typedef struct _async_dns_resolver                  async_dns_resolver;
 typedef struct _async_fiber                         async_fiber;
 typedef struct _async_op                            async_op;
 typedef struct _async_task                          async_task;
 typedef struct _async_task_scheduler                async_task_scheduler;
+typedef struct _async_uring                         async_uring;
 
 typedef void *async_fiber_context;
 typedef void (* async_fiber_func)();
@@ -462,6 +479,25 @@ typedef struct {
 	int code;
 } async_uv_op;
 
+#define ASYNC_THREAD_POOL_DNS 0
+#define ASYNC_THREAD_POOL_FS 1
+#define ASYNC_THREAD_POOL_WORK 2
+#define ASYNC_THREAD_POOL_COUNT 3
+
+typedef struct {
+	/* Max number of jobs running in the libuv thread pool. */
+	uint32_t limit;
+	
+	/* Number of running jobs. */
+	uint32_t active;
+	
+	/* Number of jobs that had to wait for a free slot. */
+	zend_ulong queued;
+	
+	/* Operations waiting for a free slot. */
+	async_op_queue waiting;
+} async_thread_pool;
+
 typedef struct {
 	/* Base pointer being used to allocate and free buffer memory. */
 	char *base;
@@ -541,6 +577,12 @@ struct _async_task_scheduler {
 	uv_timer_t busy;
 	zend_ulong busy_count;
 	
+	/* Native DNS resolver (created on demand). */
+	async_dns_resolver *resolver;
+	
+	/* io_uring instance used by the file stream wrapper (created on demand). */
+	async_uring *uring;
+	
 	async_fiber_context fiber;
 	async_fiber_context current;
 	async_fiber_context caller;
@@ -564,6 +606,26 @@ ASYNC_API void async_ring_buffer_write_move(async_ring_buffer *buffer, size_t of
 ASYNC_API int async_dns_lookup_ipv4(char *name, struct sockaddr_in *dest, int proto);
 ASYNC_API int async_dns_lookup_ipv6(char *name, struct sockaddr_in6 *dest, int proto);
 
+ASYNC_API char *async_bcrypt(const char *key, const char *setting, char *output, size_t size);
+
+ASYNC_API int async_thread_pool_acquire(int pool);
+ASYNC_API int async_thread_pool_try_acquire(int pool);
+ASYNC_API void async_thread_pool_release(int pool);
+
+ASYNC_API int async_filesystem_get_file(php_stream *stream, uv_file *file);
+ASYNC_API int async_filesystem_open(const char *path, int flags, int mode);
+ASYNC_API int async_filesystem_fstat(uv_file file, uv_stat_t *stat);
+ASYNC_API int async_filesystem_read(uv_file file, uv_buf_t bufs[], unsigned int nbufs, int64_t offset);
+ASYNC_API int async_filesystem_sendfile(uv_file out, uv_file in, int64_t offset, size_t length);
+ASYNC_API int async_filesystem_close(uv_file file);
+
+ASYNC_API async_uring *async_uring_get(async_task_scheduler *scheduler);
+ASYNC_API int async_uring_open(async_uring *ring, const char *path, int flags, int mode);
+ASYNC_API int async_uring_read(async_uring *ring, uv_file file, char *buf, size_t len, int64_t offset);
+ASYNC_API int async_uring_write(async_uring *ring, uv_file file, const char *buf, size_t len, int64_t offset);
+ASYNC_API int async_uring_fstat(async_uring *ring, uv_file file, uv_stat_t *stat);
+ASYNC_API int async_uring_close(async_uring *ring, uv_file file);
+
 
 ZEND_BEGIN_MODULE_GLOBALS(async)
 	/* Root fiber context (main thread). */
@@ -591,10 +653,57 @@ ZEND_BEGIN_MODULE_GLOBALS(async)
 
 	/* Default fiber C stack size. */
 	zend_long stack_size;
+
+	/* Pooled TLS record buffers (free list linked through the first bytes of each buffer). */
+	char *tls_records;
+
+	/* Number of buffers in the TLS record pool. */
+	uint32_t tls_record_count;
+	
+	/* Resolved host names (and failed lookups) keyed by lowercase name. */
+	HashTable dns_cache;
+	
+	/* In-flight lookups keyed by lowercase name, concurrent lookups of the same name share a single request. */
+	HashTable dns_pending;
+	
+	/* DNS cache stats. */
+	zend_ulong dns_hits;
+	zend_ulong dns_negative_hits;
+	zend_ulong dns_misses;
+	zend_ulong dns_coalesced;
+	zend_ulong dns_evictions;
+	
+	/* Name servers, search domains and static host names of the native resolver (loaded on demand). */
+	async_dns_config *dns_config;
+	
+	/* Job limits of DNS, filesystem and work requests within the libuv thread pool. */
+	async_thread_pool thread_pools[ASYNC_THREAD_POOL_COUNT];
+	
+	/* Set if io_uring could not be initialized, file operations use the thread pool instead. */
+	zend_bool fs_uring_failed;
+	
+	/* Number of included files read in the thread pool / on the loop thread and time spent in blocking reads (ns). */
+	zend_ulong fs_include_async;
+	zend_ulong fs_include_sync;
+	uint64_t fs_include_sync_time;
 	
 	/* INI settings. */
+	zend_long dns_cache_size;
+	zend_long dns_cache_ttl;
+	zend_long dns_cache_negative_ttl;
+	char *dns_nameservers;
+	zend_bool dns_native;
+	zend_long threadpool_size;
+	zend_long threadpool_dns;
+	zend_long threadpool_fs;
+	zend_long threadpool_work;
 	zend_bool dns_enabled;
 	zend_bool fs_enabled;
+	zend_bool fs_uring;
+	zend_bool fs_include;
+	zend_long fs_read_buffer_size;
+	zend_long fs_write_buffer_size;
+	zend_long fs_dir_batch_size;
 	zend_bool tcp_enabled;
 	zend_bool timer_enabled;
 	zend_bool udp_enabled;
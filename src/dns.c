@@ -18,6 +18,225 @@
 
 #include "php_async.h"
 
+#include "ext/standard/php_random.h"
+
+zend_class_entry *async_dns_ce;
+
+#define ASYNC_DNS_CONST(const_name, value) \
+	zend_declare_class_constant_long(async_dns_ce, const_name, sizeof(const_name)-1, (zend_long)value);
+
+typedef union {
+	struct sockaddr addr;
+	struct sockaddr_in ipv4;
+	struct sockaddr_in6 ipv6;
+} async_dns_address;
+
+typedef struct {
+	/* Refcount, entries are shared between the cache and running lookups. */
+	uint32_t refcount;
+	
+	/* Error code of a failed lookup (negative cache entry), 0 on success. */
+	int code;
+	
+	/* Expiration time (milliseconds as returned by uv_hrtime()). */
+	uint64_t expires;
+	
+	/* Number of resolved addresses. */
+	uint32_t count;
+	
+	/* Resolved IPv4 and IPv6 addresses (without duplicates). */
+	async_dns_address *addresses;
+} async_dns_entry;
+
+typedef struct {
+	/* Lowercase host name being resolved. */
+	zend_string *key;
+	
+	/* Tasks waiting for the result of the lookup. */
+	async_op_queue waiters;
+	
+	/* Set if the lookup is performed by the native resolver. */
+	zend_bool native;
+	
+	/* Number of pending native queries (A and AAAA), error code of the A query. */
+	int pending;
+	int code;
+	
+	/* Addresses and min TTL collected by native queries. */
+	async_dns_entry *entry;
+	uint32_t ttl;
+	
+	uv_getaddrinfo_t req;
+} async_dns_lookup;
+
+typedef struct {
+	async_op base;
+	int code;
+	async_dns_entry *entry;
+} async_dns_lookup_op;
+
+typedef struct _async_dns_query async_dns_query;
+
+typedef struct {
+	async_op base;
+	int code;
+	async_dns_query *query;
+} async_dns_query_op;
+
+#define ASYNC_DNS_RESOLV_CONF "/etc/resolv.conf"
+#define ASYNC_DNS_HOSTS "/etc/hosts"
+
+#define ASYNC_DNS_PORT 53
+#define ASYNC_DNS_MAX_SERVERS 3
+#define ASYNC_DNS_MAX_SEARCH 6
+#define ASYNC_DNS_MAX_NAME 256
+#define ASYNC_DNS_MAX_POINTERS 64
+#define ASYNC_DNS_MAX_PACKET 512
+#define ASYNC_DNS_MAX_QUERIES 32768
+#define ASYNC_DNS_DEFAULT_TIMEOUT 5000
+#define ASYNC_DNS_DEFAULT_ATTEMPTS 2
+
+#define ASYNC_DNS_UDP_SIZE 1232
+#define ASYNC_DNS_UDP_BUFFER_SIZE 4096
+#define ASYNC_DNS_TCP_BUFFER_SIZE (65535 + 2)
+
+#define ASYNC_DNS_CLASS_IN 1
+
+#define ASYNC_DNS_TYPE_A 1
+#define ASYNC_DNS_TYPE_NS 2
+#define ASYNC_DNS_TYPE_CNAME 5
+#define ASYNC_DNS_TYPE_PTR 12
+#define ASYNC_DNS_TYPE_MX 15
+#define ASYNC_DNS_TYPE_TXT 16
+#define ASYNC_DNS_TYPE_AAAA 28
+#define ASYNC_DNS_TYPE_SRV 33
+#define ASYNC_DNS_TYPE_OPT 41
+
+#define ASYNC_DNS_RCODE_OK 0
+#define ASYNC_DNS_RCODE_SERVFAIL 2
+#define ASYNC_DNS_RCODE_NXDOMAIN 3
+
+#define ASYNC_DNS_SOCKET_FLAG(family) (((family) == AF_INET6) ? 2 : 1)
+
+struct _async_dns_config {
+	/* Name servers being queried (in order). */
+	async_dns_address servers[ASYNC_DNS_MAX_SERVERS];
+	int count;
+	
+	/* Search domains (without trailing dot). */
+	zend_string *search[ASYNC_DNS_MAX_SEARCH];
+	int search_count;
+	
+	/* Min number of dots in a name that is queried before search domains are applied. */
+	int ndots;
+	
+	/* Timeout of a single query in milliseconds. */
+	int timeout;
+	
+	/* Number of attempts per name server. */
+	int attempts;
+	
+	/* Static host names keyed by lowercase name. */
+	HashTable hosts;
+};
+
+typedef struct {
+	/* Record type (ASYNC_DNS_TYPE_*). */
+	uint16_t type;
+	
+	/* TTL of the record in seconds. */
+	uint32_t ttl;
+	
+	/* Priority (SRV and MX), weight and port (SRV). */
+	uint16_t priority;
+	uint16_t weight;
+	uint16_t port;
+	
+	/* Address of A and AAAA records. */
+	async_dns_address address;
+	
+	/* Target name (SRV, MX, CNAME, NS, PTR), text (TXT) or raw record data. */
+	zend_string *data;
+} async_dns_record;
+
+typedef struct _async_dns_tcp async_dns_tcp;
+
+typedef void (* async_dns_query_cb)(async_dns_query *query, int code);
+
+struct _async_dns_resolver {
+	async_task_scheduler *scheduler;
+	async_dns_config *config;
+	
+	/* Shutdown callback registered with the scheduler. */
+	async_cancel_cb cancel;
+	
+	/* Sockets being used to query IPv4 and IPv6 name servers (created on demand). */
+	uv_udp_t udp4;
+	uv_udp_t udp6;
+	
+	/* Number of open socket handles and sockets that could not be bound. */
+	uint8_t handles;
+	uint8_t failed;
+	
+	/* Pending queries keyed by query ID. */
+	HashTable queries;
+	
+	/* Receive buffer shared by both sockets. */
+	char buffer[ASYNC_DNS_UDP_BUFFER_SIZE];
+};
+
+struct _async_dns_query {
+	async_dns_resolver *resolver;
+	
+	uint16_t id;
+	uint16_t type;
+	
+	/* Names to be queried (search domains applied) and index of the current name. */
+	zend_string *names[ASYNC_DNS_MAX_SEARCH + 1];
+	int name_count;
+	int name;
+	
+	/* Index of the current name server and number of attempts made for the current name. */
+	int server;
+	int tries;
+	
+	/* Set if a name has been found without records of the queried type. */
+	zend_bool nodata;
+	
+	/* Encoded query message. */
+	unsigned char packet[ASYNC_DNS_MAX_PACKET];
+	size_t length;
+	
+	/* Timer being used to detect lost queries. */
+	uv_timer_t timer;
+	
+	/* TCP connection being used to repeat a truncated query. */
+	async_dns_tcp *tcp;
+	
+	/* Records of the queried type and their min TTL. */
+	async_dns_record *records;
+	uint32_t count;
+	uint32_t ttl;
+	
+	async_dns_query_cb callback;
+	void *data;
+};
+
+struct _async_dns_tcp {
+	uv_tcp_t handle;
+	uv_connect_t connect;
+	uv_write_t write;
+	
+	/* Query being processed, NULL if the connection is being closed. */
+	async_dns_query *query;
+	
+	/* Length prefix of the query message. */
+	unsigned char prefix[2];
+	
+	/* Received length prefixed response. */
+	char *buffer;
+	size_t length;
+};
 
 static zend_function *orig_gethostbyname;
 static zif_handler orig_gethostbyname_handler;
@@ -26,143 +245,1665 @@ static zend_function *orig_gethostbynamel;
 static zif_handler orig_gethostbynamel_handler;
 
 
-static void dns_gethostbyname_cb(uv_getaddrinfo_t *req, int status, struct addrinfo *addr)
+static int dns_gethostbyname(uv_getaddrinfo_t *req, char *name, int proto)
+{
+	async_task_scheduler *scheduler;
+	
+	struct addrinfo hints;
+	int code;
+	
+	scheduler = async_task_scheduler_get();
+	
+	ZEND_SECURE_ZERO(&hints, sizeof(struct addrinfo));
+	
+	if (proto > 0) {
+		hints.ai_protocol = proto;
+	}
+
+	code = uv_getaddrinfo(&scheduler->loop, req, NULL, name, NULL, &hints);
+	
+	if (UNEXPECTED(code < 0)) {
+		uv_freeaddrinfo(req->addrinfo);
+		
+		return code;
+	}
+	
+	return 0;
+}
+
+static inline uint64_t dns_now()
+{
+	return uv_hrtime() / 1000000;
+}
+
+static async_dns_entry *create_entry(uint32_t count)
+{
+	async_dns_entry *entry;
+	
+	entry = emalloc(sizeof(async_dns_entry));
+	ZEND_SECURE_ZERO(entry, sizeof(async_dns_entry));
+	
+	entry->refcount = 1;
+	
+	if (count > 0) {
+		entry->addresses = emalloc(sizeof(async_dns_address) * count);
+	}
+	
+	return entry;
+}
+
+static void release_entry(async_dns_entry *entry)
+{
+	if (--entry->refcount == 0) {
+		if (entry->addresses != NULL) {
+			efree(entry->addresses);
+		}
+		
+		efree(entry);
+	}
+}
+
+static void cache_entry_dtor(zval *data)
+{
+	release_entry((async_dns_entry *) Z_PTR_P(data));
+}
+
+static zend_bool is_same_address(async_dns_address *a, struct sockaddr *b)
+{
+	if (a->addr.sa_family != b->sa_family) {
+		return 0;
+	}
+	
+	if (b->sa_family == AF_INET) {
+		return a->ipv4.sin_addr.s_addr == ((struct sockaddr_in *) b)->sin_addr.s_addr;
+	}
+	
+	return memcmp(&a->ipv6.sin6_addr, &((struct sockaddr_in6 *) b)->sin6_addr, sizeof(struct in6_addr)) == 0;
+}
+
+/* Collects all distinct IP addresses, getaddrinfo() returns an address for every socket type. */
+static async_dns_entry *create_entry_from_addrinfo(struct addrinfo *list)
+{
+	async_dns_entry *entry;
+	struct addrinfo *info;
+	
+	uint32_t count;
+	uint32_t i;
+	
+	count = 0;
+	
+	for (info = list; info != NULL; info = info->ai_next) {
+		count++;
+	}
+	
+	entry = create_entry(count);
+	
+	for (info = list; info != NULL; info = info->ai_next) {
+		if (info->ai_family != AF_INET && info->ai_family != AF_INET6) {
+			continue;
+		}
+		
+		for (i = 0; i < entry->count; i++) {
+			if (is_same_address(&entry->addresses[i], info->ai_addr)) {
+				break;
+			}
+		}
+		
+		if (i == entry->count) {
+			memcpy(&entry->addresses[entry->count++], info->ai_addr, (info->ai_family == AF_INET) ? sizeof(struct sockaddr_in) : sizeof(struct sockaddr_in6));
+		}
+	}
+	
+	return entry;
+}
+
+/* Creates an entry without DNS lookup if the given name is an IP address. */
+static async_dns_entry *create_entry_from_ip(const char *name)
+{
+	async_dns_entry *entry;
+	async_dns_address addr;
+	
+	if (0 == uv_ip4_addr(name, 0, &addr.ipv4)) {
+		entry = create_entry(1);
+		entry->addresses[entry->count++].ipv4 = addr.ipv4;
+		
+		return entry;
+	}
+	
+	if (0 == uv_ip6_addr(name, 0, &addr.ipv6)) {
+		entry = create_entry(1);
+		entry->addresses[entry->count++].ipv6 = addr.ipv6;
+		
+		return entry;
+	}
+	
+	return NULL;
+}
+
+static void cache_entry(zend_string *key, async_dns_entry *entry, zend_long ttl)
+{
+	HashTable *cache;
+	async_dns_entry *current;
+	zend_string *k;
+	zend_ulong index;
+	uint64_t now;
+	
+	if (ttl < 1 || ASYNC_G(dns_cache_size) < 1) {
+		return;
+	}
+	
+	cache = &ASYNC_G(dns_cache);
+	now = dns_now();
+	
+	if (zend_hash_num_elements(cache) >= (uint32_t) ASYNC_G(dns_cache_size)) {
+		ZEND_HASH_FOREACH_STR_KEY_PTR(cache, k, current) {
+			if (current->expires <= now) {
+				zend_hash_del(cache, k);
+				ASYNC_G(dns_evictions)++;
+			}
+		} ZEND_HASH_FOREACH_END();
+		
+		// Evict the least recently cached entry if no entry has expired.
+		while (zend_hash_num_elements(cache) >= (uint32_t) ASYNC_G(dns_cache_size)) {
+			zend_hash_internal_pointer_reset(cache);
+			zend_hash_get_current_key(cache, &k, &index);
+			
+			k = zend_string_copy(k);
+			zend_hash_del(cache, k);
+			zend_string_release(k);
+			
+			ASYNC_G(dns_evictions)++;
+		}
+	}
+	
+	entry->expires = now + (uint64_t) ttl * 1000;
+	entry->refcount++;
+	
+	zend_hash_update_ptr(cache, key, entry);
+}
+
+static void entry_add_address(async_dns_entry *entry, struct sockaddr *addr)
+{
+	uint32_t i;
+	
+	for (i = 0; i < entry->count; i++) {
+		if (is_same_address(&entry->addresses[i], addr)) {
+			return;
+		}
+	}
+	
+	if (entry->addresses == NULL) {
+		entry->addresses = emalloc(sizeof(async_dns_address));
+	} else {
+		entry->addresses = erealloc(entry->addresses, sizeof(async_dns_address) * (entry->count + 1));
+	}
+	
+	memcpy(&entry->addresses[entry->count++], addr, (addr->sa_family == AF_INET) ? sizeof(struct sockaddr_in) : sizeof(struct sockaddr_in6));
+}
+
+/* Parses "ip", "ip:port" or "[ipv6]:port" into a name server address. */
+static int parse_server(char *str, async_dns_address *dest)
+{
+	char buf[INET6_ADDRSTRLEN + 1];
+	char *sep;
+	
+	size_t len;
+	int port;
+	
+	port = ASYNC_DNS_PORT;
+	len = strlen(str);
+	
+	if (str[0] == '[') {
+		sep = strchr(str, ']');
+		
+		if (sep == NULL) {
+			return FAILURE;
+		}
+		
+		len = sep - str - 1;
+		str++;
+		
+		if (sep[1] == ':') {
+			port = atoi(sep + 2);
+		}
+	} else {
+		sep = strchr(str, ':');
+		
+		if (sep != NULL && strchr(sep + 1, ':') == NULL) {
+			len = sep - str;
+			port = atoi(sep + 1);
+		}
+	}
+	
+	if (len == 0 || len > INET6_ADDRSTRLEN || port < 1 || port > 65535) {
+		return FAILURE;
+	}
+	
+	memcpy(buf, str, len);
+	buf[len] = '\0';
+	
+	if (0 == uv_ip4_addr(buf, port, &dest->ipv4) || 0 == uv_ip6_addr(buf, port, &dest->ipv6)) {
+		return SUCCESS;
+	}
+	
+	return FAILURE;
+}
+
+static void add_server(async_dns_config *config, char *str)
+{
+	if (config->count < ASYNC_DNS_MAX_SERVERS && SUCCESS == parse_server(str, &config->servers[config->count])) {
+		config->count++;
+	}
+}
+
+static void parse_resolv_conf(async_dns_config *config, zend_bool servers)
+{
+	FILE *fp;
+	char line[1024];
+	char *token;
+	char *last;
+	char *val;
+	
+	fp = fopen(ASYNC_DNS_RESOLV_CONF, "r");
+	
+	if (fp == NULL) {
+		return;
+	}
+	
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		line[strcspn(line, "#;\r\n")] = '\0';
+		
+		token = php_strtok_r(line, " \t", &last);
+		
+		if (token == NULL) {
+			continue;
+		}
+		
+		if (strcmp(token, "nameserver") == 0) {
+			if (servers && NULL != (token = php_strtok_r(NULL, " \t", &last))) {
+				add_server(config, token);
+			}
+		} else if (strcmp(token, "search") == 0 || strcmp(token, "domain") == 0) {
+			while (config->search_count > 0) {
+				zend_string_release(config->search[--config->search_count]);
+			}
+			
+			while (config->search_count < ASYNC_DNS_MAX_SEARCH && NULL != (token = php_strtok_r(NULL, " \t", &last))) {
+				config->search[config->search_count++] = zend_string_init(token, strlen(token) - (token[strlen(token) - 1] == '.'), 0);
+			}
+		} else if (strcmp(token, "options") == 0) {
+			while (NULL != (token = php_strtok_r(NULL, " \t", &last))) {
+				if (NULL == (val = strchr(token, ':'))) {
+					continue;
+				}
+				
+				*val++ = '\0';
+				
+				if (strcmp(token, "ndots") == 0) {
+					config->ndots = MAX(0, MIN(15, atoi(val)));
+				} else if (strcmp(token, "timeout") == 0) {
+					config->timeout = MAX(1, MIN(30, atoi(val))) * 1000;
+				} else if (strcmp(token, "attempts") == 0) {
+					config->attempts = MAX(1, MIN(5, atoi(val)));
+				}
+			}
+		}
+	}
+	
+	fclose(fp);
+}
+
+static void parse_hosts(async_dns_config *config)
+{
+	async_dns_entry *entry;
+	async_dns_address addr;
+	zend_string *key;
+	
+	FILE *fp;
+	char line[1024];
+	char *token;
+	char *last;
+	
+	fp = fopen(ASYNC_DNS_HOSTS, "r");
+	
+	if (fp == NULL) {
+		return;
+	}
+	
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		line[strcspn(line, "#\r\n")] = '\0';
+		
+		token = php_strtok_r(line, " \t", &last);
+		
+		if (token == NULL) {
+			continue;
+		}
+		
+		if (0 != uv_ip4_addr(token, 0, &addr.ipv4) && 0 != uv_ip6_addr(token, 0, &addr.ipv6)) {
+			continue;
+		}
+		
+		while (NULL != (token = php_strtok_r(NULL, " \t", &last))) {
+			key = zend_string_init(token, strlen(token), 0);
+			zend_str_tolower(ZSTR_VAL(key), ZSTR_LEN(key));
+			
+			entry = (async_dns_entry *) zend_hash_find_ptr(&config->hosts, key);
+			
+			if (entry == NULL) {
+				entry = create_entry(0);
+				
+				zend_hash_add_new_ptr(&config->hosts, key, entry);
+			}
+			
+			entry_add_address(entry, &addr.addr);
+			
+			zend_string_release(key);
+		}
+	}
+	
+	fclose(fp);
+}
+
+/* Loads name servers, search domains and options from resolv.conf and static host names. */
+static async_dns_config *get_config()
 {
-	async_uv_op *op;
+	async_dns_config *config;
+	char *servers;
+	char *token;
+	char *last;
+	
+	if (ASYNC_G(dns_config) != NULL) {
+		return ASYNC_G(dns_config);
+	}
+	
+	config = emalloc(sizeof(async_dns_config));
+	ZEND_SECURE_ZERO(config, sizeof(async_dns_config));
+	
+	config->ndots = 1;
+	config->timeout = ASYNC_DNS_DEFAULT_TIMEOUT;
+	config->attempts = ASYNC_DNS_DEFAULT_ATTEMPTS;
+	
+	zend_hash_init(&config->hosts, 0, NULL, cache_entry_dtor, 0);
+	
+	servers = ASYNC_G(dns_nameservers);
+	
+	if (servers != NULL && *servers != '\0') {
+		servers = estrdup(servers);
+		
+		for (token = php_strtok_r(servers, ", \t", &last); token != NULL; token = php_strtok_r(NULL, ", \t", &last)) {
+			add_server(config, token);
+		}
+		
+		efree(servers);
+		
+		parse_resolv_conf(config, 0);
+	} else {
+		parse_resolv_conf(config, 1);
+	}
+	
+	if (config->count == 0) {
+		uv_ip4_addr("127.0.0.1", ASYNC_DNS_PORT, &config->servers[config->count++].ipv4);
+	}
+	
+	parse_hosts(config);
+	
+	ASYNC_G(dns_config) = config;
+	
+	return config;
+}
+
+static void free_config(async_dns_config *config)
+{
+	while (config->search_count > 0) {
+		zend_string_release(config->search[--config->search_count]);
+	}
+	
+	zend_hash_destroy(&config->hosts);
+	
+	efree(config);
+}
+
+/* Reads a (possibly compressed) domain name, offset is moved behind the name within the record. */
+static int read_name(const unsigned char *msg, size_t len, size_t *offset, char *name, size_t size)
+{
+	zend_bool jumped;
+	size_t pos;
+	size_t n;
+	int jumps;
+	
+	jumped = 0;
+	jumps = 0;
+	pos = *offset;
+	n = 0;
+	
+	while (1) {
+		if (pos >= len) {
+			return FAILURE;
+		}
+		
+		if ((msg[pos] & 0xC0) == 0xC0) {
+			if (pos + 1 >= len || ++jumps > ASYNC_DNS_MAX_POINTERS) {
+				return FAILURE;
+			}
+			
+			if (!jumped) {
+				*offset = pos + 2;
+				jumped = 1;
+			}
+			
+			pos = ((msg[pos] & 0x3F) << 8) | msg[pos + 1];
+			
+			continue;
+		}
+		
+		if (msg[pos] & 0xC0) {
+			return FAILURE;
+		}
+		
+		if (msg[pos] == 0) {
+			pos++;
+			
+			break;
+		}
+		
+		if (pos + 1 + msg[pos] > len || n + msg[pos] + 1 >= size) {
+			return FAILURE;
+		}
+		
+		if (n > 0) {
+			name[n++] = '.';
+		}
+		
+		memcpy(name + n, msg + pos + 1, msg[pos]);
+		
+		n += msg[pos];
+		pos += 1 + msg[pos];
+	}
+	
+	if (!jumped) {
+		*offset = pos;
+	}
+	
+	name[n] = '\0';
+	
+	return SUCCESS;
+}
+
+static zend_always_inline uint16_t read_uint16(const unsigned char *p)
+{
+	return (uint16_t) ((p[0] << 8) | p[1]);
+}
+
+static zend_always_inline uint32_t read_uint32(const unsigned char *p)
+{
+	return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) | ((uint32_t) p[2] << 8) | (uint32_t) p[3];
+}
+
+static zend_always_inline void write_uint16(unsigned char *p, uint16_t v)
+{
+	p[0] = (unsigned char) (v >> 8);
+	p[1] = (unsigned char) v;
+}
+
+/* Encodes a query for the current candidate name (recursion desired, EDNS0 OPT record). */
+static int encode_query(async_dns_query *query)
+{
+	zend_string *name;
+	unsigned char *p;
+	char *label;
+	char *end;
+	char *dot;
+	
+	size_t len;
+	
+	name = query->names[query->name];
+	
+	if (ZSTR_LEN(name) == 0 || ZSTR_LEN(name) > 253) {
+		return UV_EAI_NONAME;
+	}
+	
+	p = query->packet;
+	
+	write_uint16(p, query->id);
+	write_uint16(p + 2, 0x0100);
+	write_uint16(p + 4, 1);
+	write_uint16(p + 6, 0);
+	write_uint16(p + 8, 0);
+	write_uint16(p + 10, 1);
+	
+	p += 12;
+	
+	label = ZSTR_VAL(name);
+	end = label + ZSTR_LEN(name);
+	
+	while (label < end) {
+		dot = memchr(label, '.', end - label);
+		len = ((dot == NULL) ? end : dot) - label;
+		
+		if (len == 0 || len > 63) {
+			return UV_EAI_NONAME;
+		}
+		
+		*p++ = (unsigned char) len;
+		memcpy(p, label, len);
+		
+		p += len;
+		label += len + 1;
+	}
+	
+	*p++ = 0;
+	
+	write_uint16(p, query->type);
+	write_uint16(p + 2, ASYNC_DNS_CLASS_IN);
+	
+	p += 4;
+	
+	// EDNS0: root name, type OPT, class holds the UDP payload size, no extended flags.
+	*p++ = 0;
+	
+	write_uint16(p, ASYNC_DNS_TYPE_OPT);
+	write_uint16(p + 2, ASYNC_DNS_UDP_SIZE);
+	memset(p + 4, 0, 6);
+	
+	p += 10;
+	
+	query->length = p - query->packet;
+	
+	return 0;
+}
+
+static void free_records(async_dns_query *query)
+{
+	uint32_t i;
+	
+	for (i = 0; i < query->count; i++) {
+		if (query->records[i].data != NULL) {
+			zend_string_release(query->records[i].data);
+		}
+	}
+	
+	if (query->records != NULL) {
+		efree(query->records);
+	}
+	
+	query->records = NULL;
+	query->count = 0;
+}
+
+/* Decodes record data of supported types, unsupported types keep raw record data. */
+static int decode_record(const unsigned char *msg, size_t len, size_t offset, uint16_t rdlen, async_dns_record *record)
+{
+	char name[ASYNC_DNS_MAX_NAME];
+	size_t pos;
+	size_t n;
+	
+	switch (record->type) {
+	case ASYNC_DNS_TYPE_A:
+		if (rdlen != 4) {
+			return FAILURE;
+		}
+		
+		record->address.ipv4.sin_family = AF_INET;
+		memcpy(&record->address.ipv4.sin_addr, msg + offset, 4);
+		break;
+	case ASYNC_DNS_TYPE_AAAA:
+		if (rdlen != 16) {
+			return FAILURE;
+		}
+		
+		record->address.ipv6.sin6_family = AF_INET6;
+		memcpy(&record->address.ipv6.sin6_addr, msg + offset, 16);
+		break;
+	case ASYNC_DNS_TYPE_SRV:
+		if (rdlen < 7) {
+			return FAILURE;
+		}
+		
+		record->priority = read_uint16(msg + offset);
+		record->weight = read_uint16(msg + offset + 2);
+		record->port = read_uint16(msg + offset + 4);
+		
+		pos = offset + 6;
+		
+		if (FAILURE == read_name(msg, len, &pos, name, sizeof(name))) {
+			return FAILURE;
+		}
+		
+		record->data = zend_string_init(name, strlen(name), 0);
+		break;
+	case ASYNC_DNS_TYPE_MX:
+		if (rdlen < 3) {
+			return FAILURE;
+		}
+		
+		record->priority = read_uint16(msg + offset);
+		
+		pos = offset + 2;
+		
+		if (FAILURE == read_name(msg, len, &pos, name, sizeof(name))) {
+			return FAILURE;
+		}
+		
+		record->data = zend_string_init(name, strlen(name), 0);
+		break;
+	case ASYNC_DNS_TYPE_CNAME:
+	case ASYNC_DNS_TYPE_NS:
+	case ASYNC_DNS_TYPE_PTR:
+		pos = offset;
+		
+		if (FAILURE == read_name(msg, len, &pos, name, sizeof(name))) {
+			return FAILURE;
+		}
+		
+		record->data = zend_string_init(name, strlen(name), 0);
+		break;
+	case ASYNC_DNS_TYPE_TXT:
+		// Character strings of a TXT record are concatenated (RFC 7208 section 3.3).
+		record->data = zend_string_alloc(rdlen, 0);
+		
+		for (pos = offset, n = 0; pos < offset + rdlen; pos += 1 + msg[pos]) {
+			if (pos + 1 + msg[pos] > offset + rdlen) {
+				zend_string_release(record->data);
+				record->data = NULL;
+				
+				return FAILURE;
+			}
+			
+			memcpy(ZSTR_VAL(record->data) + n, msg + pos + 1, msg[pos]);
+			n += msg[pos];
+		}
+		
+		ZSTR_VAL(record->data)[n] = '\0';
+		ZSTR_LEN(record->data) = n;
+		break;
+	default:
+		record->data = zend_string_init((const char *) msg + offset, rdlen, 0);
+	}
+	
+	return SUCCESS;
+}
+
+/* Parses a response, returns FAILURE if the message is not a valid response to the given query. */
+static int parse_response(async_dns_query *query, const unsigned char *msg, size_t len, int *rcode, zend_bool *truncated)
+{
+	async_dns_record *record;
+	zend_string *qname;
+	
+	char name[ASYNC_DNS_MAX_NAME];
+	size_t offset;
+	uint16_t flags;
+	uint16_t answers;
+	uint16_t rdlen;
+	uint16_t type;
+	uint16_t i;
+	
+	if (len < 12 || read_uint16(msg) != query->id) {
+		return FAILURE;
+	}
+	
+	flags = read_uint16(msg + 2);
+	
+	if (!(flags & 0x8000) || read_uint16(msg + 4) != 1) {
+		return FAILURE;
+	}
+	
+	offset = 12;
+	
+	if (FAILURE == read_name(msg, len, &offset, name, sizeof(name)) || offset + 4 > len) {
+		return FAILURE;
+	}
+	
+	qname = query->names[query->name];
+	
+	if (strlen(name) != ZSTR_LEN(qname) || strncasecmp(name, ZSTR_VAL(qname), ZSTR_LEN(qname)) != 0) {
+		return FAILURE;
+	}
+	
+	if (read_uint16(msg + offset) != query->type || read_uint16(msg + offset + 2) != ASYNC_DNS_CLASS_IN) {
+		return FAILURE;
+	}
+	
+	offset += 4;
+	
+	*rcode = flags & 0x000F;
+	*truncated = (flags & 0x0200) ? 1 : 0;
+	
+	if (*truncated || *rcode != 0) {
+		return SUCCESS;
+	}
+	
+	answers = read_uint16(msg + 6);
+	
+	free_records(query);
+	
+	if (answers == 0) {
+		return SUCCESS;
+	}
+	
+	query->records = emalloc(sizeof(async_dns_record) * answers);
+	query->ttl = UINT32_MAX;
+	
+	// CNAME records are followed implicitly, the recursive resolver places the target records in the answer.
+	for (i = 0; i < answers; i++) {
+		if (FAILURE == read_name(msg, len, &offset, name, sizeof(name)) || offset + 10 > len) {
+			return FAILURE;
+		}
+		
+		type = read_uint16(msg + offset);
+		rdlen = read_uint16(msg + offset + 8);
+		
+		if (offset + 10 + rdlen > len) {
+			return FAILURE;
+		}
+		
+		if (type == query->type && read_uint16(msg + offset + 2) == ASYNC_DNS_CLASS_IN) {
+			record = &query->records[query->count];
+			ZEND_SECURE_ZERO(record, sizeof(async_dns_record));
+			
+			record->type = type;
+			record->ttl = read_uint32(msg + offset + 4) & 0x7FFFFFFF;
+			
+			if (SUCCESS == decode_record(msg, len, offset + 10, rdlen, record)) {
+				query->ttl = MIN(query->ttl, record->ttl);
+				query->count++;
+			}
+		}
+		
+		offset += 10 + rdlen;
+	}
+	
+	return SUCCESS;
+}
+
+static void free_query(async_dns_query *query)
+{
+	int i;
+	
+	free_records(query);
+	
+	for (i = 0; i < query->name_count; i++) {
+		zend_string_release(query->names[i]);
+	}
+	
+	efree(query);
+}
+
+static void close_query_cb(uv_handle_t *handle)
+{
+	free_query((async_dns_query *) handle->data);
+}
+
+static void close_tcp_cb(uv_handle_t *handle)
+{
+	async_dns_tcp *tcp;
+	
+	tcp = (async_dns_tcp *) handle->data;
+	
+	if (tcp->buffer != NULL) {
+		efree(tcp->buffer);
+	}
+	
+	efree(tcp);
+}
+
+static void close_tcp(async_dns_query *query)
+{
+	if (query->tcp != NULL) {
+		query->tcp->query = NULL;
+		
+		uv_close((uv_handle_t *) &query->tcp->handle, close_tcp_cb);
+		
+		query->tcp = NULL;
+	}
+}
+
+static void finish_query(async_dns_query *query, int code)
+{
+	zend_hash_index_del(&query->resolver->queries, query->id);
+	
+	uv_timer_stop(&query->timer);
+	
+	close_tcp(query);
+	
+	if (code < 0) {
+		free_records(query);
+	}
+	
+	query->callback(query, code);
+	
+	uv_close((uv_handle_t *) &query->timer, close_query_cb);
+}
+
+static uv_udp_t *get_socket(async_dns_resolver *resolver, int family);
+static void timeout_cb(uv_timer_t *timer);
+
+static void send_query(async_dns_query *query)
+{
+	async_dns_address *server;
+	uv_udp_t *udp;
+	uv_buf_t buf;
+	
+	server = &query->resolver->config->servers[query->server];
+	udp = get_socket(query->resolver, server->addr.sa_family);
+	
+	// Send errors are handled like lost packets, the query is retried when the timeout is reached.
+	if (udp != NULL) {
+		buf = uv_buf_init((char *) query->packet, (unsigned int) query->length);
+		
+		uv_udp_try_send(udp, &buf, 1, &server->addr);
+	}
+	
+	uv_timer_start(&query->timer, timeout_cb, query->resolver->config->timeout, 0);
+}
+
+/* Retries the query using the next name server, fails with the given code if all attempts have been used. */
+static void retry_query(async_dns_query *query, int code)
+{
+	async_dns_config *config;
+	
+	config = query->resolver->config;
+	
+	close_tcp(query);
+	
+	if (++query->tries >= config->attempts * config->count) {
+		finish_query(query, code);
+		
+		return;
+	}
+	
+	query->server = (query->server + 1) % config->count;
+	
+	send_query(query);
+}
+
+static void next_name(async_dns_query *query, int code)
+{
+	if (code == UV_EAI_NODATA) {
+		query->nodata = 1;
+	}
+
+	if (++query->name >= query->name_count) {
+		finish_query(query, query->nodata ? UV_EAI_NODATA : code);
+		
+		return;
+	}
+	
+	close_tcp(query);
+	
+	query->tries = 0;
+	
+	if (0 != encode_query(query)) {
+		next_name(query, UV_EAI_NONAME);
+	} else {
+		send_query(query);
+	}
+}
+
+static void start_tcp(async_dns_query *query);
+
+static void process_response(async_dns_query *query, const unsigned char *msg, size_t len, zend_bool tcp)
+{
+	zend_bool truncated;
+	int rcode;
+	
+	if (FAILURE == parse_response(query, msg, len, &rcode, &truncated)) {
+		free_records(query);
+		
+		// Invalid UDP responses are ignored (might be spoofed), the query times out if no valid response arrives.
+		if (tcp) {
+			retry_query(query, UV_EAI_FAIL);
+		}
+		
+		return;
+	}
+	
+	if (truncated && !tcp) {
+		start_tcp(query);
+		
+		return;
+	}
+	
+	switch (rcode) {
+	case ASYNC_DNS_RCODE_OK:
+		if (query->count > 0) {
+			finish_query(query, 0);
+		} else {
+			next_name(query, UV_EAI_NODATA);
+		}
+		break;
+	case ASYNC_DNS_RCODE_NXDOMAIN:
+		next_name(query, UV_EAI_NONAME);
+		break;
+	case ASYNC_DNS_RCODE_SERVFAIL:
+		retry_query(query, UV_EAI_AGAIN);
+		break;
+	default:
+		retry_query(query, UV_EAI_FAIL);
+	}
+}
+
+static void tcp_alloc_cb(uv_handle_t *handle, size_t suggested_size, uv_buf_t *buf)
+{
+	async_dns_tcp *tcp;
+	
+	tcp = (async_dns_tcp *) handle->data;
+	
+	if (tcp->buffer == NULL) {
+		tcp->buffer = emalloc(ASYNC_DNS_TCP_BUFFER_SIZE);
+	}
+	
+	buf->base = tcp->buffer + tcp->length;
+	buf->len = (unsigned int) (ASYNC_DNS_TCP_BUFFER_SIZE - tcp->length);
+}
+
+static void tcp_read_cb(uv_stream_t *stream, ssize_t nread, const uv_buf_t *buf)
+{
+	async_dns_tcp *tcp;
+	size_t len;
+	
+	tcp = (async_dns_tcp *) stream->data;
+	
+	if (tcp->query == NULL || nread == 0) {
+		return;
+	}
+	
+	if (nread < 0) {
+		retry_query(tcp->query, UV_EAI_AGAIN);
+		
+		return;
+	}
+	
+	tcp->length += nread;
+	
+	if (tcp->length < 2) {
+		return;
+	}
+	
+	len = read_uint16((unsigned char *) tcp->buffer);
+	
+	if (tcp->length >= len + 2) {
+		uv_read_stop(stream);
+		
+		process_response(tcp->query, (unsigned char *) tcp->buffer + 2, len, 1);
+	}
+}
+
+static void tcp_write_cb(uv_write_t *req, int status)
+{
+	async_dns_tcp *tcp;
+	
+	tcp = (async_dns_tcp *) req->data;
+	
+	if (tcp->query != NULL && status < 0) {
+		retry_query(tcp->query, UV_EAI_AGAIN);
+	}
+}
+
+static void tcp_connect_cb(uv_connect_t *req, int status)
+{
+	async_dns_tcp *tcp;
+	uv_buf_t bufs[2];
+	
+	tcp = (async_dns_tcp *) req->data;
+	
+	if (tcp->query == NULL) {
+		return;
+	}
+	
+	if (status < 0) {
+		retry_query(tcp->query, UV_EAI_AGAIN);
+		
+		return;
+	}
+	
+	write_uint16(tcp->prefix, (uint16_t) tcp->query->length);
+	
+	bufs[0] = uv_buf_init((char *) tcp->prefix, 2);
+	bufs[1] = uv_buf_init((char *) tcp->query->packet, (unsigned int) tcp->query->length);
+	
+	uv_write(&tcp->write, (uv_stream_t *) &tcp->handle, bufs, 2, tcp_write_cb);
+	uv_read_start((uv_stream_t *) &tcp->handle, tcp_alloc_cb, tcp_read_cb);
+}
+
+/* Repeats a truncated query using TCP (RFC 7766), the timeout is restarted for the TCP exchange. */
+static void start_tcp(async_dns_query *query)
+{
+	async_dns_tcp *tcp;
+	int code;
+	
+	tcp = emalloc(sizeof(async_dns_tcp));
+	ZEND_SECURE_ZERO(tcp, sizeof(async_dns_tcp));
+	
+	tcp->query = query;
+	tcp->handle.data = tcp;
+	tcp->connect.data = tcp;
+	tcp->write.data = tcp;
+	
+	uv_tcp_init(&query->resolver->scheduler->loop, &tcp->handle);
+	
+	query->tcp = tcp;
+	
+	code = uv_tcp_connect(&tcp->connect, &tcp->handle, &query->resolver->config->servers[query->server].addr, tcp_connect_cb);
+	
+	if (UNEXPECTED(code < 0)) {
+		retry_query(query, UV_EAI_AGAIN);
+		
+		return;
+	}
+	
+	uv_timer_start(&query->timer, timeout_cb, query->resolver->config->timeout, 0);
+}
+
+static void timeout_cb(uv_timer_t *timer)
+{
+	retry_query((async_dns_query *) timer->data, UV_EAI_AGAIN);
+}
+
+static void udp_alloc_cb(uv_handle_t *handle, size_t suggested_size, uv_buf_t *buf)
+{
+	async_dns_resolver *resolver;
+	
+	resolver = (async_dns_resolver *) handle->data;
+	
+	buf->base = resolver->buffer;
+	buf->len = sizeof(resolver->buffer);
+}
+
+static void udp_receive_cb(uv_udp_t *udp, ssize_t nread, const uv_buf_t *buf, const struct sockaddr *addr, unsigned flags)
+{
+	async_dns_resolver *resolver;
+	async_dns_query *query;
+	async_dns_address *server;
+	
+	const unsigned char *msg;
+	
+	resolver = (async_dns_resolver *) udp->data;
+	msg = (const unsigned char *) buf->base;
+	
+	if (nread < 12 || addr == NULL) {
+		return;
+	}
+	
+	query = (async_dns_query *) zend_hash_index_find_ptr(&resolver->queries, read_uint16(msg));
+	
+	if (query == NULL || query->tcp != NULL) {
+		return;
+	}
+	
+	server = &resolver->config->servers[query->server];
+	
+	if (!is_same_address(server, (struct sockaddr *) addr)) {
+		return;
+	}
+	
+	if (addr->sa_family == AF_INET && server->ipv4.sin_port != ((struct sockaddr_in *) addr)->sin_port) {
+		return;
+	}
+	
+	if (addr->sa_family == AF_INET6 && server->ipv6.sin6_port != ((struct sockaddr_in6 *) addr)->sin6_port) {
+		return;
+	}
+	
+	// A response that did not fit into the buffer is handled like a truncated response.
+	if (flags & UV_UDP_PARTIAL) {
+		start_tcp(query);
+	} else {
+		process_response(query, msg, (size_t) nread, 0);
+	}
+}
+
+static uv_udp_t *get_socket(async_dns_resolver *resolver, int family)
+{
+	async_dns_address addr;
+	uv_udp_t *udp;
+	
+	udp = (family == AF_INET6) ? &resolver->udp6 : &resolver->udp4;
+	
+	if (udp->data != NULL) {
+		return (resolver->failed & ASYNC_DNS_SOCKET_FLAG(family)) ? NULL : udp;
+	}
+	
+	if (family == AF_INET6) {
+		uv_ip6_addr("::", 0, &addr.ipv6);
+	} else {
+		uv_ip4_addr("0.0.0.0", 0, &addr.ipv4);
+	}
+	
+	uv_udp_init(&resolver->scheduler->loop, udp);
+	
+	udp->data = resolver;
+	resolver->handles++;
+	
+	if (0 != uv_udp_bind(udp, &addr.addr, 0) || 0 != uv_udp_recv_start(udp, udp_alloc_cb, udp_receive_cb)) {
+		resolver->failed |= ASYNC_DNS_SOCKET_FLAG(family);
+		
+		return NULL;
+	}
+	
+	// Pending queries keep the loop alive using their timers.
+	uv_unref((uv_handle_t *) udp);
+	
+	return udp;
+}
+
+static void close_resolver_cb(uv_handle_t *handle)
+{
+	async_dns_resolver *resolver;
+	
+	resolver = (async_dns_resolver *) handle->data;
+	
+	if (--resolver->handles == 0) {
+		zend_hash_destroy(&resolver->queries);
+		
+		efree(resolver);
+	}
+}
+
+static void shutdown_resolver(void *obj, zval *error)
+{
+	async_dns_resolver *resolver;
+	async_dns_query *query;
+	
+	resolver = (async_dns_resolver *) obj;
+	
+	resolver->cancel.func = NULL;
+	resolver->scheduler->resolver = NULL;
+	
+	while (zend_hash_num_elements(&resolver->queries) > 0) {
+		zend_hash_internal_pointer_reset(&resolver->queries);
+		
+		query = (async_dns_query *) zend_hash_get_current_data_ptr(&resolver->queries);
+		
+		finish_query(query, UV_ECANCELED);
+	}
+	
+	if (resolver->handles == 0) {
+		zend_hash_destroy(&resolver->queries);
+		
+		efree(resolver);
+		
+		return;
+	}
+	
+	if (resolver->udp4.data != NULL) {
+		uv_close((uv_handle_t *) &resolver->udp4, close_resolver_cb);
+	}
+	
+	if (resolver->udp6.data != NULL) {
+		uv_close((uv_handle_t *) &resolver->udp6, close_resolver_cb);
+	}
+}
+
+static async_dns_resolver *get_resolver()
+{
+	async_task_scheduler *scheduler;
+	async_dns_resolver *resolver;
+	
+	scheduler = async_task_scheduler_get();
+	
+	if (scheduler->resolver != NULL) {
+		return scheduler->resolver;
+	}
+	
+	resolver = emalloc(sizeof(async_dns_resolver));
+	ZEND_SECURE_ZERO(resolver, sizeof(async_dns_resolver));
+	
+	resolver->scheduler = scheduler;
+	resolver->config = get_config();
+	
+	zend_hash_init(&resolver->queries, 0, NULL, NULL, 0);
+	
+	resolver->cancel.object = resolver;
+	resolver->cancel.func = shutdown_resolver;
+	
+	ASYNC_Q_ENQUEUE(&scheduler->shutdown, &resolver->cancel);
+	
+	scheduler->resolver = resolver;
+	
+	return resolver;
+}
+
+/* Builds the list of names to be queried, search domains are applied to names with less than ndots dots. */
+static void init_names(async_dns_query *query, async_dns_config *config, const char *name)
+{
+	const char *p;
+	size_t len;
+	int dots;
+	int i;
+	
+	len = strlen(name);
+	
+	if (len > 0 && name[len - 1] == '.') {
+		query->names[query->name_count++] = zend_string_init(name, len - 1, 0);
+		
+		return;
+	}
+	
+	for (dots = 0, p = name; *p != '\0'; p++) {
+		if (*p == '.') {
+			dots++;
+		}
+	}
+	
+	if (dots >= config->ndots) {
+		query->names[query->name_count++] = zend_string_init(name, len, 0);
+	}
+	
+	for (i = 0; i < config->search_count; i++) {
+		query->names[query->name_count++] = strpprintf(0, "%s.%s", name, ZSTR_VAL(config->search[i]));
+	}
+	
+	if (dots < config->ndots) {
+		query->names[query->name_count++] = zend_string_init(name, len, 0);
+	}
+}
+
+/* Starts a query, the callback is never invoked before the function returns. */
+static int start_query(const char *name, uint16_t type, async_dns_query_cb callback, void *data, async_dns_query **result)
+{
+	async_dns_resolver *resolver;
+	async_dns_query *query;
+	
+	uint16_t id;
+	int code;
+	
+	resolver = get_resolver();
+	
+	if (UNEXPECTED(zend_hash_num_elements(&resolver->queries) >= ASYNC_DNS_MAX_QUERIES)) {
+		return UV_EAI_AGAIN;
+	}
+	
+	// Random query IDs make it harder to spoof responses.
+	do {
+		if (FAILURE == php_random_bytes_silent(&id, sizeof(id))) {
+			return UV_EAI_FAIL;
+		}
+	} while (zend_hash_index_exists(&resolver->queries, id));
+	
+	query = emalloc(sizeof(async_dns_query));
+	ZEND_SECURE_ZERO(query, sizeof(async_dns_query));
+	
+	query->resolver = resolver;
+	query->id = id;
+	query->type = type;
+	query->callback = callback;
+	query->data = data;
+	
+	init_names(query, resolver->config, name);
+	
+	while (0 != (code = encode_query(query))) {
+		if (++query->name >= query->name_count) {
+			free_query(query);
+			
+			return code;
+		}
+	}
+	
+	uv_timer_init(&resolver->scheduler->loop, &query->timer);
+	query->timer.data = query;
+	
+	zend_hash_index_add_new_ptr(&resolver->queries, id, query);
+	
+	send_query(query);
+	
+	if (result != NULL) {
+		*result = query;
+	}
+	
+	return 0;
+}
+
+/* Caches the result of a lookup and resumes all waiting tasks. */
+static void finish_lookup(async_dns_lookup *lookup, async_dns_entry *entry, zend_long ttl)
+{
+	async_dns_lookup_op *op;
+	
+	// Remove the lookup first, tasks that are continued might resolve the same name again.
+	zend_hash_del(&ASYNC_G(dns_pending), lookup->key);
+	
+	cache_entry(lookup->key, entry, ttl);
+	
+	while (lookup->waiters.first != NULL) {
+		ASYNC_DEQUEUE_CUSTOM_OP(&lookup->waiters, op, async_dns_lookup_op);
+		
+		op->code = entry->code;
+		op->entry = entry;
+		
+		entry->refcount++;
+		
+		ASYNC_FINISH_OP(op);
+	}
+	
+	release_entry(entry);
+	
+	zend_string_release(lookup->key);
+	efree(lookup);
+}
+
+static void dns_lookup_cb(uv_getaddrinfo_t *req, int status, struct addrinfo *addr)
+{
+	async_dns_lookup *lookup;
+	async_dns_entry *entry;
+	
+	lookup = (async_dns_lookup *) req->data;
+	
+	ZEND_ASSERT(lookup != NULL);
 	
-	op = (async_uv_op *) req->data;
+	async_thread_pool_release(ASYNC_THREAD_POOL_DNS);
 	
-	ZEND_ASSERT(op != NULL);
+	// Cancelled lookups have already been removed from the pending table.
+	if (status == UV_EAI_CANCELED) {
+		ZEND_ASSERT(lookup->waiters.first == NULL);
 	
-	if (status == UV_ECANCELED) {
-		ASYNC_FREE_OP(op);
-	} else {	
-		op->code = status;
+		zend_string_release(lookup->key);
+		efree(lookup);
 		
-		ASYNC_FINISH_OP(op);
+		return;
+	}
+	
+	if (status == 0) {
+		entry = create_entry_from_addrinfo(addr);
+	} else {
+		entry = create_entry(0);
+		entry->code = status;
 	}
+	
+	uv_freeaddrinfo(addr);
+	
+	finish_lookup(lookup, entry, (status == 0) ? ASYNC_G(dns_cache_ttl) : ASYNC_G(dns_cache_negative_ttl));
 }
 
-static int dns_gethostbyname(uv_getaddrinfo_t *req, char *name, int proto)
+static void dns_native_lookup_cb(async_dns_query *query, int code)
 {
-	async_task_scheduler *scheduler;
-	async_uv_op *op;
-	
-	struct addrinfo hints;
-	int code;
+	async_dns_lookup *lookup;
+	async_dns_entry *entry;
+	uint32_t i;
 	
-	op = NULL;
-	scheduler = async_task_scheduler_get();
+	lookup = (async_dns_lookup *) query->data;
 	
-	if (async_cli) {
-		ASYNC_ALLOC_CUSTOM_OP(op, sizeof(async_uv_op));
+	if (code == 0) {
+		for (i = 0; i < query->count; i++) {
+			entry_add_address(lookup->entry, &query->records[i].address.addr);
+		}
 		
-		req->data = op;
+		lookup->ttl = MIN(lookup->ttl, query->ttl);
+	} else if (lookup->code == 0 || query->type == ASYNC_DNS_TYPE_A) {
+		lookup->code = code;
 	}
 	
-	ZEND_SECURE_ZERO(&hints, sizeof(struct addrinfo));
+	if (--lookup->pending > 0) {
+		return;
+	}
 	
-	if (proto > 0) {
-		hints.ai_protocol = proto;
+	entry = lookup->entry;
+	lookup->entry = NULL;
+	
+	if (entry->count == 0) {
+		entry->code = (lookup->code < 0) ? lookup->code : UV_EAI_NODATA;
+		
+		// Queries cancelled during scheduler shutdown are not cached.
+		finish_lookup(lookup, entry, (entry->code == UV_ECANCELED) ? 0 : ASYNC_G(dns_cache_negative_ttl));
+	} else {
+		finish_lookup(lookup, entry, MIN((zend_long) lookup->ttl, ASYNC_G(dns_cache_ttl)));
 	}
+}
 
-	code = uv_getaddrinfo(&scheduler->loop, req, async_cli ? dns_gethostbyname_cb : NULL, name, NULL, &hints);
+/* Queries A and AAAA records of the name in parallel using the native resolver. */
+static int dns_native_lookup(async_dns_lookup *lookup, const char *name)
+{
+	int code;
 	
-	if (UNEXPECTED(code < 0)) {
-		if (async_cli) {
-			ASYNC_FREE_OP(op);
-		}
+	lookup->native = 1;
+	lookup->entry = create_entry(0);
+	lookup->ttl = UINT32_MAX;
 	
-		uv_freeaddrinfo(req->addrinfo);
+	code = start_query(name, ASYNC_DNS_TYPE_A, dns_native_lookup_cb, lookup, NULL);
+	
+	if (code < 0) {
+		release_entry(lookup->entry);
 		
 		return code;
 	}
 	
-	if (async_cli) {
-		if (async_await_op((async_op *) op) == FAILURE) {
-			ASYNC_FORWARD_OP_ERROR(op);
-			
-			if (0 == uv_cancel((uv_req_t *) req)) {
-				ASYNC_FREE_OP(op);
-			} else {
-				op->base.status = ASYNC_STATUS_FAILED;
-			}
+	lookup->pending++;
+	
+	if (0 == start_query(name, ASYNC_DNS_TYPE_AAAA, dns_native_lookup_cb, lookup, NULL)) {
+		lookup->pending++;
+	}
+	
+	return 0;
+}
 
+/* Joins a pending lookup of the same name or starts a new lookup (thread pool or native resolver). */
+static int dns_lookup(zend_string *key, char *name, int proto, async_dns_entry **result)
+{
+	async_dns_lookup *lookup;
+	async_dns_lookup_op *op;
+	
+	struct addrinfo hints;
+	int code;
+	
+	lookup = (async_dns_lookup *) zend_hash_find_ptr(&ASYNC_G(dns_pending), key);
+	
+	if (lookup == NULL && !ASYNC_G(dns_native)) {
+		if (async_thread_pool_acquire(ASYNC_THREAD_POOL_DNS) == FAILURE) {
 			return FAILURE;
 		}
 		
-		code = op->code;
-
-		ASYNC_FREE_OP(op);
+		// Another task might have started a lookup of the same name while waiting for a thread pool slot.
+		lookup = (async_dns_lookup *) zend_hash_find_ptr(&ASYNC_G(dns_pending), key);
+		
+		if (lookup != NULL) {
+			async_thread_pool_release(ASYNC_THREAD_POOL_DNS);
+		}
+	}
+	
+	if (lookup == NULL) {
+		ZEND_SECURE_ZERO(&hints, sizeof(struct addrinfo));
+		
+		if (proto > 0) {
+			hints.ai_protocol = proto;
+		}
+		
+		lookup = emalloc(sizeof(async_dns_lookup));
+		ZEND_SECURE_ZERO(lookup, sizeof(async_dns_lookup));
+		
+		lookup->req.data = lookup;
+		
+		if (ASYNC_G(dns_native)) {
+			code = dns_native_lookup(lookup, name);
+		} else {
+			code = uv_getaddrinfo(&async_task_scheduler_get()->loop, &lookup->req, dns_lookup_cb, name, NULL, &hints);
+		}
 		
 		if (UNEXPECTED(code < 0)) {
-			uv_freeaddrinfo(req->addrinfo);
+			if (!lookup->native) {
+				async_thread_pool_release(ASYNC_THREAD_POOL_DNS);
+			}
+			
+			efree(lookup);
 			
 			return code;
 		}
+		
+		lookup->key = zend_string_copy(key);
+		
+		zend_hash_add_new_ptr(&ASYNC_G(dns_pending), key, lookup);
+		
+		ASYNC_G(dns_misses)++;
+	} else {
+		ASYNC_G(dns_coalesced)++;
 	}
 	
-	return 0;
+	ASYNC_ALLOC_CUSTOM_OP(op, sizeof(async_dns_lookup_op));
+	ASYNC_ENQUEUE_OP(&lookup->waiters, op);
+	
+	if (async_await_op((async_op *) op) == FAILURE) {
+		ASYNC_FORWARD_OP_ERROR(op);
+		ASYNC_FREE_OP(op);
+		
+		// Lookup is still pending because the op has not been finished, cancel it if nobody is waiting.
+		if (lookup->waiters.first == NULL && !lookup->native && uv_cancel((uv_req_t *) &lookup->req) == 0) {
+			zend_hash_del(&ASYNC_G(dns_pending), lookup->key);
+		}
+		
+		return FAILURE;
+	}
+	
+	code = op->code;
+	*result = op->entry;
+	
+	ASYNC_FREE_OP(op);
+	
+	if (code < 0) {
+		release_entry(*result);
+	}
+	
+	return code;
 }
 
-int async_dns_lookup_ipv4(char *name, struct sockaddr_in *dest, int proto)
+/* Resolves all addresses of the given host name, the returned entry must be released by the caller. */
+static int dns_resolve(char *name, int proto, async_dns_entry **result)
 {
+	async_dns_entry *entry;
 	uv_getaddrinfo_t req;
-	struct addrinfo *info;
+	
+	zend_string *key;
 	int code;
 	
+	if (NULL != (entry = create_entry_from_ip(name))) {
+		*result = entry;
+		
+		return 0;
+	}
+	
+	key = zend_string_init(name, strlen(name), 0);
+	zend_str_tolower(ZSTR_VAL(key), ZSTR_LEN(key));
+	
+	// The native resolver has to handle static host names, getaddrinfo() already takes care of them.
+	if (async_cli && ASYNC_G(dns_native)) {
+		entry = (async_dns_entry *) zend_hash_find_ptr(&get_config()->hosts, key);
+		
+		if (entry != NULL) {
+			zend_string_release(key);
+			
+			entry->refcount++;
+			*result = entry;
+			
+			return 0;
+		}
+	}
+	
+	entry = (async_dns_entry *) zend_hash_find_ptr(&ASYNC_G(dns_cache), key);
+	
+	if (entry != NULL) {
+		if (entry->expires > dns_now()) {
+			zend_string_release(key);
+			
+			if (entry->code < 0) {
+				ASYNC_G(dns_negative_hits)++;
+				
+				return entry->code;
+			}
+			
+			ASYNC_G(dns_hits)++;
+			
+			entry->refcount++;
+			*result = entry;
+			
+			return 0;
+		}
+		
+		zend_hash_del(&ASYNC_G(dns_cache), key);
+	}
+	
+	if (async_cli) {
+		code = dns_lookup(key, name, proto, result);
+		
+		zend_string_release(key);
+		
+		return code;
+	}
+	
+	ASYNC_G(dns_misses)++;
+	
 	code = dns_gethostbyname(&req, name, proto);
 	
 	if (code != 0) {
+		entry = create_entry(0);
+		entry->code = code;
+		
+		cache_entry(key, entry, ASYNC_G(dns_cache_negative_ttl));
+		release_entry(entry);
+		
+		zend_string_release(key);
+		
 		return code;
 	}
 	
-	info = req.addrinfo;
+	entry = create_entry_from_addrinfo(req.addrinfo);
+	
+	uv_freeaddrinfo(req.addrinfo);
+	
+	cache_entry(key, entry, ASYNC_G(dns_cache_ttl));
+	
+	zend_string_release(key);
+	
+	*result = entry;
 	
-	while (info != NULL) {
-		if (info->ai_family == AF_INET && (info->ai_protocol == proto || proto == 0)) {
-			memcpy(dest, info->ai_addr, sizeof(struct sockaddr_in));
+	return 0;
+}
+
+int async_dns_lookup_ipv4(char *name, struct sockaddr_in *dest, int proto)
+{
+	async_dns_entry *entry;
+	uint32_t i;
+	int code;
+	
+	code = dns_resolve(name, proto, &entry);
+	
+	if (code != 0) {
+		return code;
+	}
+	
+	for (i = 0; i < entry->count; i++) {
+		if (entry->addresses[i].addr.sa_family == AF_INET) {
+			memcpy(dest, &entry->addresses[i].ipv4, sizeof(struct sockaddr_in));
 			
-			uv_freeaddrinfo(req.addrinfo);
+			release_entry(entry);
 			
 			return 0;
 		}
-		
-		info = info->ai_next;
 	}
 	
-	uv_freeaddrinfo(req.addrinfo);
+	release_entry(entry);
 	
 	return UV_EAI_NODATA;
 }
 
 int async_dns_lookup_ipv6(char *name, struct sockaddr_in6 *dest, int proto)
 {
-	uv_getaddrinfo_t req;
-	struct addrinfo *info;
+	async_dns_entry *entry;
+	uint32_t i;
 	int code;
 
-	code = dns_gethostbyname(&req, name, proto);
+	code = dns_resolve(name, proto, &entry);
 
 	if (code != 0) {
 		return code;
 	}
 
-	info = req.addrinfo;
-
-	while (info != NULL) {
-		if (info->ai_family == AF_INET6 && (info->ai_protocol == proto || proto == 0)) {
-			memcpy(dest, info->ai_addr, sizeof(struct sockaddr_in6));
+	for (i = 0; i < entry->count; i++) {
+		if (entry->addresses[i].addr.sa_family == AF_INET6) {
+			memcpy(dest, &entry->addresses[i].ipv6, sizeof(struct sockaddr_in6));
 
-			uv_freeaddrinfo(req.addrinfo);
+			release_entry(entry);
 
 			return 0;
 		}
-
-		info = info->ai_next;
 	}
 
-	uv_freeaddrinfo(req.addrinfo);
+	release_entry(entry);
 
 	return UV_EAI_NODATA;
 }
@@ -173,8 +1914,7 @@ static PHP_FUNCTION(asyncgethostbyname)
 	char *name;
 	size_t len;
 	
-	uv_getaddrinfo_t req;
-	struct addrinfo *info;
+	struct sockaddr_in addr;
 	char ip[16];
 	int code;
 
@@ -191,26 +1931,15 @@ static PHP_FUNCTION(asyncgethostbyname)
 		return;
 	}
 	
-	code = dns_gethostbyname(&req, name, 0);
+	code = async_dns_lookup_ipv4(name, &addr, 0);
 	
 	if (code != 0) {
 		RETURN_STRINGL(name, len);
 	}
 	
-	info = req.addrinfo;
-	
-	while (info != NULL) {
-		if (info->ai_family == AF_INET) {
-			uv_ip4_name((struct sockaddr_in *) info->ai_addr, ip, info->ai_addrlen);
-			uv_freeaddrinfo(req.addrinfo);
-			
-			RETURN_STRING(ip);
-		}
-		
-		info = info->ai_next;
-	}
+	uv_ip4_name(&addr, ip, sizeof(ip));
 	
-	uv_freeaddrinfo(req.addrinfo);
+	RETURN_STRING(ip);
 }
 
 static PHP_FUNCTION(asyncgethostbynamel)
@@ -218,11 +1947,9 @@ static PHP_FUNCTION(asyncgethostbynamel)
 	char *name;
 	size_t len;
 	
-	zval tmp;
-	zend_string *k;
+	async_dns_entry *entry;
+	uint32_t i;
 	
-	uv_getaddrinfo_t req;
-	struct addrinfo *info;
 	char ip[16];
 	int code;
 
@@ -239,41 +1966,315 @@ static PHP_FUNCTION(asyncgethostbynamel)
 		return;
 	}
 	
-	code = dns_gethostbyname(&req, name, 0);
+	code = dns_resolve(name, 0, &entry);
 	
 	if (code != 0) {
 		RETURN_FALSE;
 	}
-
-	info = req.addrinfo;
 	
-	array_init(&tmp);
+	array_init(return_value);
 	
-	while (info != NULL) {
-		if (info->ai_family == AF_INET) {
-			uv_ip4_name((struct sockaddr_in *) info->ai_addr, ip, info->ai_addrlen);
+	for (i = 0; i < entry->count; i++) {
+		if (entry->addresses[i].addr.sa_family == AF_INET) {
+			uv_ip4_name(&entry->addresses[i].ipv4, ip, sizeof(ip));
 			
-			add_assoc_bool_ex(&tmp, ip, strlen(ip), 1);
+			add_next_index_string(return_value, ip);
+		}
+	}
+	
+	release_entry(entry);
+}
+
+
+static void add_entry_addresses(zval *addresses, async_dns_entry *entry)
+{
+	char ip[64];
+	uint32_t i;
+	
+	for (i = 0; i < entry->count; i++) {
+		if (entry->addresses[i].addr.sa_family == AF_INET) {
+			uv_ip4_name(&entry->addresses[i].ipv4, ip, sizeof(ip));
+		} else {
+			uv_ip6_name(&entry->addresses[i].ipv6, ip, sizeof(ip));
 		}
 		
-		info = info->ai_next;
+		add_next_index_string(addresses, ip);
 	}
+}
+
+static void add_record(zval *records, async_dns_record *record)
+{
+	char ip[64];
+	zval item;
+	
+	array_init(&item);
+	
+	add_assoc_long(&item, "type", record->type);
+	add_assoc_long(&item, "ttl", record->ttl);
+	
+	switch (record->type) {
+	case ASYNC_DNS_TYPE_A:
+		uv_ip4_name(&record->address.ipv4, ip, sizeof(ip));
+		add_assoc_string(&item, "address", ip);
+		break;
+	case ASYNC_DNS_TYPE_AAAA:
+		uv_ip6_name(&record->address.ipv6, ip, sizeof(ip));
+		add_assoc_string(&item, "address", ip);
+		break;
+	case ASYNC_DNS_TYPE_SRV:
+		add_assoc_long(&item, "priority", record->priority);
+		add_assoc_long(&item, "weight", record->weight);
+		add_assoc_long(&item, "port", record->port);
+		add_assoc_str(&item, "target", zend_string_copy(record->data));
+		break;
+	case ASYNC_DNS_TYPE_MX:
+		add_assoc_long(&item, "priority", record->priority);
+		add_assoc_str(&item, "target", zend_string_copy(record->data));
+		break;
+	case ASYNC_DNS_TYPE_CNAME:
+	case ASYNC_DNS_TYPE_NS:
+	case ASYNC_DNS_TYPE_PTR:
+		add_assoc_str(&item, "target", zend_string_copy(record->data));
+		break;
+	case ASYNC_DNS_TYPE_TXT:
+		add_assoc_str(&item, "text", zend_string_copy(record->data));
+		break;
+	default:
+		add_assoc_str(&item, "data", zend_string_copy(record->data));
+	}
+	
+	add_next_index_zval(records, &item);
+}
+
+static void dns_query_cb(async_dns_query *query, int code)
+{
+	async_dns_query_op *op;
+	uint32_t i;
+	
+	op = (async_dns_query_op *) query->data;
+	
+	// Op has been disposed due to cancellation.
+	if (op == NULL) {
+		return;
+	}
+	
+	// Query is freed after the callback returns.
+	op->query = NULL;
+	
+	// Task has been cancelled but not resumed yet, the op is disposed by the task.
+	if (op->base.status == ASYNC_STATUS_FAILED) {
+		return;
+	}
+	
+	op->code = code;
+	
+	if (code == 0) {
+		array_init_size(&op->base.result, query->count);
+		
+		for (i = 0; i < query->count; i++) {
+			add_record(&op->base.result, &query->records[i]);
+		}
+	}
+	
+	ASYNC_FINISH_OP(op);
+}
+
+ZEND_METHOD(Dns, resolve)
+{
+	async_dns_query_op *op;
+	zend_string *name;
+	zend_long type;
+	
+	int code;
+	
+	ZEND_PARSE_PARAMETERS_START_EX(ZEND_PARSE_PARAMS_THROW, 2, 2)
+		Z_PARAM_STR(name)
+		Z_PARAM_LONG(type)
+	ZEND_PARSE_PARAMETERS_END();
+	
+	ASYNC_CHECK_ERROR(!async_cli, "DNS queries require PHP running in CLI mode");
+	ASYNC_CHECK_ERROR(type < 1 || type > 65535 || type == ASYNC_DNS_TYPE_OPT, "Invalid DNS record type: %d", (int) type);
+	
+	ASYNC_ALLOC_CUSTOM_OP(op, sizeof(async_dns_query_op));
+	
+	code = start_query(ZSTR_VAL(name), (uint16_t) type, dns_query_cb, op, &op->query);
+	
+	if (UNEXPECTED(code < 0)) {
+		ASYNC_FREE_OP(op);
+		
+		zend_throw_exception_ex(async_socket_exception_ce, 0, "Failed to resolve %s: %s", ZSTR_VAL(name), uv_strerror(code));
+		return;
+	}
+	
+	if (async_await_op((async_op *) op) == FAILURE) {
+		if (op->query != NULL) {
+			op->query->data = NULL;
+		}
+		
+		ASYNC_FORWARD_OP_ERROR(op);
+		ASYNC_FREE_OP(op);
+		
+		return;
+	}
+	
+	code = op->code;
+	
+	if (code == 0) {
+		ZVAL_COPY(return_value, &op->base.result);
+	}
+	
+	ASYNC_FREE_OP(op);
+	
+	// A name without records of the requested type is not an error.
+	if (code == UV_EAI_NODATA) {
+		RETURN_EMPTY_ARRAY();
+	}
+	
+	ASYNC_CHECK_EXCEPTION(code < 0, async_socket_exception_ce, "Failed to resolve %s: %s", ZSTR_VAL(name), uv_strerror(code));
+}
+
+ZEND_METHOD(Dns, flushCache)
+{
+	zend_string *name;
+	zend_string *key;
+	
+	name = NULL;
+	
+	ZEND_PARSE_PARAMETERS_START_EX(ZEND_PARSE_PARAMS_THROW, 0, 1)
+		Z_PARAM_OPTIONAL
+		Z_PARAM_STR_EX(name, 1, 0)
+	ZEND_PARSE_PARAMETERS_END();
+	
+	if (name == NULL) {
+		zend_hash_clean(&ASYNC_G(dns_cache));
+	} else {
+		key = zend_string_tolower(name);
+		zend_hash_del(&ASYNC_G(dns_cache), key);
+		zend_string_release(key);
+	}
+}
+
+ZEND_METHOD(Dns, getCacheStats)
+{
+	ZEND_PARSE_PARAMETERS_NONE();
 	
-	uv_freeaddrinfo(req.addrinfo);
-			
 	array_init(return_value);
 	
-	ZEND_HASH_FOREACH_STR_KEY(Z_ARRVAL_P(&tmp), k) {
-		add_next_index_str(return_value, zend_string_copy(k));
-	} ZEND_HASH_FOREACH_END();
+	add_assoc_long(return_value, "size", zend_hash_num_elements(&ASYNC_G(dns_cache)));
+	add_assoc_long(return_value, "hits", ASYNC_G(dns_hits));
+	add_assoc_long(return_value, "negative_hits", ASYNC_G(dns_negative_hits));
+	add_assoc_long(return_value, "misses", ASYNC_G(dns_misses));
+	add_assoc_long(return_value, "coalesced", ASYNC_G(dns_coalesced));
+	add_assoc_long(return_value, "pending", zend_hash_num_elements(&ASYNC_G(dns_pending)));
+	add_assoc_long(return_value, "evictions", ASYNC_G(dns_evictions));
+}
+
+ZEND_METHOD(Dns, getCacheEntries)
+{
+	async_dns_entry *entry;
+	zend_string *key;
+	
+	zval item;
+	zval addresses;
+	uint64_t now;
+	
+	ZEND_PARSE_PARAMETERS_NONE();
+	
+	array_init(return_value);
+	
+	now = dns_now();
 	
-	zval_ptr_dtor(&tmp);
+	ZEND_HASH_FOREACH_STR_KEY_PTR(&ASYNC_G(dns_cache), key, entry) {
+		if (entry->expires <= now) {
+			continue;
+		}
+		
+		array_init(&item);
+		array_init_size(&addresses, entry->count);
+		
+		add_entry_addresses(&addresses, entry);
+		
+		add_assoc_zval(&item, "addresses", &addresses);
+		add_assoc_long(&item, "ttl", (zend_long) ((entry->expires - now + 999) / 1000));
+		
+		if (entry->code < 0) {
+			add_assoc_string(&item, "error", (char *) uv_strerror(entry->code));
+		} else {
+			add_assoc_null(&item, "error");
+		}
+		
+		zend_hash_update(Z_ARRVAL_P(return_value), key, &item);
+	} ZEND_HASH_FOREACH_END();
 }
 
+ZEND_BEGIN_ARG_WITH_RETURN_TYPE_INFO_EX(arginfo_dns_flush_cache, 0, 0, IS_VOID, 0)
+	ZEND_ARG_TYPE_INFO(0, name, IS_STRING, 1)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_WITH_RETURN_TYPE_INFO_EX(arginfo_dns_get_cache_stats, 0, 0, IS_ARRAY, 0)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_WITH_RETURN_TYPE_INFO_EX(arginfo_dns_get_cache_entries, 0, 0, IS_ARRAY, 0)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_WITH_RETURN_TYPE_INFO_EX(arginfo_dns_resolve, 0, 2, IS_ARRAY, 0)
+	ZEND_ARG_TYPE_INFO(0, name, IS_STRING, 0)
+	ZEND_ARG_TYPE_INFO(0, type, IS_LONG, 0)
+ZEND_END_ARG_INFO()
+
+static const zend_function_entry async_dns_functions[] = {
+	ZEND_ME(Dns, resolve, arginfo_dns_resolve, ZEND_ACC_PUBLIC | ZEND_ACC_STATIC)
+	ZEND_ME(Dns, flushCache, arginfo_dns_flush_cache, ZEND_ACC_PUBLIC | ZEND_ACC_STATIC)
+	ZEND_ME(Dns, getCacheStats, arginfo_dns_get_cache_stats, ZEND_ACC_PUBLIC | ZEND_ACC_STATIC)
+	ZEND_ME(Dns, getCacheEntries, arginfo_dns_get_cache_entries, ZEND_ACC_PUBLIC | ZEND_ACC_STATIC)
+	ZEND_FE_END
+};
+
 
 void async_dns_ce_register()
 {
-	// TODO: Create a contract for a userdefined DNS resolver that works in non-blocking mode.
+	zend_class_entry ce;
+
+	INIT_CLASS_ENTRY(ce, "Concurrent\\Network\\Dns", async_dns_functions);
+	async_dns_ce = zend_register_internal_class(&ce);
+	async_dns_ce->ce_flags |= ZEND_ACC_FINAL;
+	async_dns_ce->serialize = zend_class_serialize_deny;
+	async_dns_ce->unserialize = zend_class_unserialize_deny;
+	
+	ASYNC_DNS_CONST("A", ASYNC_DNS_TYPE_A);
+	ASYNC_DNS_CONST("NS", ASYNC_DNS_TYPE_NS);
+	ASYNC_DNS_CONST("CNAME", ASYNC_DNS_TYPE_CNAME);
+	ASYNC_DNS_CONST("PTR", ASYNC_DNS_TYPE_PTR);
+	ASYNC_DNS_CONST("MX", ASYNC_DNS_TYPE_MX);
+	ASYNC_DNS_CONST("TXT", ASYNC_DNS_TYPE_TXT);
+	ASYNC_DNS_CONST("AAAA", ASYNC_DNS_TYPE_AAAA);
+	ASYNC_DNS_CONST("SRV", ASYNC_DNS_TYPE_SRV);
+}
+
+void async_dns_cache_init()
+{
+	zend_hash_init(&ASYNC_G(dns_cache), 0, NULL, cache_entry_dtor, 0);
+	zend_hash_init(&ASYNC_G(dns_pending), 0, NULL, NULL, 0);
+	
+	ASYNC_G(dns_hits) = 0;
+	ASYNC_G(dns_negative_hits) = 0;
+	ASYNC_G(dns_misses) = 0;
+	ASYNC_G(dns_coalesced) = 0;
+	ASYNC_G(dns_evictions) = 0;
+	
+	ASYNC_G(dns_config) = NULL;
+}
+
+void async_dns_cache_shutdown()
+{
+	zend_hash_destroy(&ASYNC_G(dns_cache));
+	zend_hash_destroy(&ASYNC_G(dns_pending));
+	
+	if (ASYNC_G(dns_config) != NULL) {
+		free_config(ASYNC_G(dns_config));
+		
+		ASYNC_G(dns_config) = NULL;
+	}
 }
 
 void async_dns_init()
@@ -0,0 +1,447 @@
+/*
+  +----------------------------------------------------------------------+
+  | PHP Version 7                                                        |
+  +----------------------------------------------------------------------+
+  | Copyright (c) 1997-2018 The PHP Group                                |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 3.01 of the PHP license,      |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available through the world-wide-web at the following url:           |
+  | http://www.php.net/license/3_01.txt                                  |
+  | If you did not receive a copy of the PHP license and are unable to   |
+  | obtain it through the world-wide-web, please send a note to          |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+  | Authors: Martin Schröder <m.schroeder2007@gmail.com>                 |
+  +----------------------------------------------------------------------+
+*/
+
+#include "php_async.h"
+
+#include "async_task.h"
+
+zend_class_entry *async_file_watcher_ce;
+
+static zend_object_handlers async_file_watcher_handlers;
+
+#define ASYNC_FILE_WATCHER_CONST(const_name, value) \
+	zend_declare_class_constant_long(async_file_watcher_ce, const_name, sizeof(const_name)-1, (zend_long)value);
+
+#define ASYNC_FILE_WATCHER_DEFAULT_LATENCY 10
+
+
+typedef struct {
+	/* PHP object handle. */
+	zend_object std;
+	
+	/* Error being set as the watcher was closed (undef by default). */
+	zval error;
+	
+	/* Watched path (expanded). */
+	zend_string *path;
+	
+	/* Changes that have not been delivered yet, maps file names to UV_RENAME / UV_CHANGE flags. */
+	HashTable changes;
+	
+	/* Number of milliseconds changes are collected before observers are resumed. */
+	uint64_t latency;
+	
+	uv_fs_event_t handle;
+	
+	/* Delays delivery of changes, events being reported in the meantime are merged. */
+	uv_timer_t timer;
+	
+	async_op_queue observers;
+	
+	zend_uchar ref_count;
+	
+	async_task_scheduler *scheduler;
+	
+	async_cancel_cb cancel;
+} async_file_watcher;
+
+static void deliver_changes(uv_timer_t *timer)
+{
+	async_file_watcher *watcher;
+	async_op *op;
+	async_op *last;
+	zend_bool cont;
+	
+	zval changes;
+	
+	watcher = (async_file_watcher *) timer->data;
+	
+	ZEND_ASSERT(watcher != NULL);
+	
+	// Changes are kept until the next call to awaitChange() if nobody is waiting.
+	if (watcher->observers.first == NULL || zend_hash_num_elements(&watcher->changes) == 0) {
+		return;
+	}
+	
+	ZVAL_ARR(&changes, zend_array_dup(&watcher->changes));
+	
+	zend_hash_clean(&watcher->changes);
+	
+	last = watcher->observers.last;
+	cont = 1;
+	
+	while (cont && watcher->observers.first != NULL) {
+		ASYNC_DEQUEUE_OP(&watcher->observers, op);
+		
+		cont = (op != last);
+		
+		ASYNC_RESOLVE_OP(op, &changes);
+	}
+	
+	zval_ptr_dtor(&changes);
+}
+
+static void trigger_change(uv_fs_event_t *handle, const char *filename, int events, int status)
+{
+	async_file_watcher *watcher;
+	async_op *op;
+	
+	zval *entry;
+	zval tmp;
+	
+	watcher = (async_file_watcher *) handle->data;
+	
+	ZEND_ASSERT(watcher != NULL);
+	
+	if (status < 0) {
+		if (Z_TYPE_P(&watcher->error) == IS_UNDEF) {
+			ASYNC_PREPARE_ERROR(&watcher->error, "Failed to watch %s: %s", ZSTR_VAL(watcher->path), uv_strerror(status));
+		}
+		
+		uv_fs_event_stop(handle);
+		
+		while (watcher->observers.first != NULL) {
+			ASYNC_DEQUEUE_OP(&watcher->observers, op);
+			ASYNC_FAIL_OP(op, &watcher->error);
+		}
+		
+		return;
+	}
+	
+	// Watching a file reports its name, changes without a name refer to the watched path itself.
+	if (filename == NULL) {
+		filename = ZSTR_VAL(watcher->path);
+	}
+	
+	if (NULL != (entry = zend_hash_str_find(&watcher->changes, filename, strlen(filename)))) {
+		Z_LVAL_P(entry) |= events;
+	} else {
+		ZVAL_LONG(&tmp, events);
+		zend_hash_str_add(&watcher->changes, filename, strlen(filename), &tmp);
+	}
+	
+	if (watcher->observers.first != NULL && !uv_is_active((uv_handle_t *) &watcher->timer)) {
+		uv_timer_start(&watcher->timer, deliver_changes, watcher->latency, 0);
+	}
+}
+
+static void close_watcher(uv_handle_t *handle)
+{
+	async_file_watcher *watcher;
+	
+	watcher = (async_file_watcher *) handle->data;
+	
+	ZEND_ASSERT(watcher != NULL);
+	
+	ASYNC_DELREF(&watcher->std);
+}
+
+static void shutdown_watcher(void *obj, zval *error)
+{
+	async_file_watcher *watcher;
+	async_op *op;
+	
+	watcher = (async_file_watcher *) obj;
+	
+	ZEND_ASSERT(watcher != NULL);
+	
+	watcher->cancel.func = NULL;
+	
+	if (error != NULL && Z_TYPE_P(&watcher->error) == IS_UNDEF) {
+		ZVAL_COPY(&watcher->error, error);
+	}
+	
+	if (!uv_is_closing((uv_handle_t *) &watcher->handle)) {
+		ASYNC_ADDREF(&watcher->std);
+		ASYNC_ADDREF(&watcher->std);
+		
+		uv_close((uv_handle_t *) &watcher->handle, close_watcher);
+		uv_close((uv_handle_t *) &watcher->timer, close_watcher);
+	}
+	
+	if (error != NULL) {
+		while (watcher->observers.first != NULL) {
+			ASYNC_DEQUEUE_OP(&watcher->observers, op);
+			ASYNC_FAIL_OP(op, &watcher->error);
+		}
+	}
+}
+
+
+static zend_object *async_file_watcher_object_create(zend_class_entry *ce)
+{
+	async_file_watcher *watcher;
+	
+	watcher = emalloc(sizeof(async_file_watcher));
+	ZEND_SECURE_ZERO(watcher, sizeof(async_file_watcher));
+	
+	zend_object_std_init(&watcher->std, ce);
+	watcher->std.handlers = &async_file_watcher_handlers;
+	
+	ZVAL_UNDEF(&watcher->error);
+	
+	zend_hash_init(&watcher->changes, 8, NULL, NULL, 0);
+	
+	watcher->scheduler = async_task_scheduler_get();
+	
+	ASYNC_ADDREF(&watcher->scheduler->std);
+	
+	watcher->cancel.object = watcher;
+	
+	return &watcher->std;
+}
+
+static void async_file_watcher_object_dtor(zend_object *object)
+{
+	async_file_watcher *watcher;
+	
+	watcher = (async_file_watcher *) object;
+	
+	if (watcher->cancel.func != NULL) {
+		ASYNC_Q_DETACH(&watcher->scheduler->shutdown, &watcher->cancel);
+		
+		watcher->cancel.func(watcher, NULL);
+	}
+}
+
+static void async_file_watcher_object_destroy(zend_object *object)
+{
+	async_file_watcher *watcher;
+	
+	watcher = (async_file_watcher *) object;
+	
+	zval_ptr_dtor(&watcher->error);
+	
+	zend_hash_destroy(&watcher->changes);
+	
+	if (watcher->path != NULL) {
+		zend_string_release(watcher->path);
+	}
+	
+	ASYNC_DELREF(&watcher->scheduler->std);
+	
+	zend_object_std_dtor(&watcher->std);
+}
+
+ZEND_METHOD(FileWatcher, __construct)
+{
+	async_file_watcher *watcher;
+	zend_string *path;
+	zend_bool recursive;
+	zend_long latency;
+	
+	char buf[MAXPATHLEN];
+	int code;
+	
+	recursive = 0;
+	latency = ASYNC_FILE_WATCHER_DEFAULT_LATENCY;
+	
+	ZEND_PARSE_PARAMETERS_START_EX(ZEND_PARSE_PARAMS_THROW, 1, 3)
+		Z_PARAM_PATH_STR(path)
+		Z_PARAM_OPTIONAL
+		Z_PARAM_BOOL(recursive)
+		Z_PARAM_LONG(latency)
+	ZEND_PARSE_PARAMETERS_END();
+	
+	ASYNC_CHECK_ERROR(!async_cli, "File watchers require PHP running in CLI mode");
+	ASYNC_CHECK_ERROR(latency < 0, "Latency must not be negative");
+	
+	watcher = (async_file_watcher *) Z_OBJ_P(getThis());
+	
+	// The path is kept until the object is destroyed, handles must not be initialized twice.
+	ASYNC_CHECK_ERROR(watcher->path != NULL, "File watcher has already been initialized");
+	
+	if (expand_filepath(ZSTR_VAL(path), buf) == NULL) {
+		zend_throw_error(NULL, "Invalid path: %s", ZSTR_VAL(path));
+		return;
+	}
+	
+	if (php_check_open_basedir(buf)) {
+		return;
+	}
+	
+	watcher->path = zend_string_init(buf, strlen(buf), 0);
+	watcher->latency = (uint64_t) latency;
+	
+	uv_fs_event_init(&watcher->scheduler->loop, &watcher->handle);
+	uv_timer_init(&watcher->scheduler->loop, &watcher->timer);
+	
+	uv_unref((uv_handle_t *) &watcher->handle);
+	uv_unref((uv_handle_t *) &watcher->timer);
+	
+	watcher->handle.data = watcher;
+	watcher->timer.data = watcher;
+	
+	// Handles are closed on shutdown only if they have been initialized.
+	watcher->cancel.func = shutdown_watcher;
+	
+	ASYNC_Q_ENQUEUE(&watcher->scheduler->shutdown, &watcher->cancel);
+	
+	// Watching starts right away, changes are collected until they are consumed by awaitChange().
+	code = uv_fs_event_start(&watcher->handle, trigger_change, buf, recursive ? UV_FS_EVENT_RECURSIVE : 0);
+	
+	if (UNEXPECTED(code < 0)) {
+		ASYNC_Q_DETACH(&watcher->scheduler->shutdown, &watcher->cancel);
+		
+		watcher->cancel.func(watcher, NULL);
+		
+		zend_throw_error(NULL, "Failed to watch %s: %s", buf, uv_strerror(code));
+	}
+}
+
+ZEND_METHOD(FileWatcher, close)
+{
+	async_file_watcher *watcher;
+	
+	zval error;
+	zval *val;
+	
+	val = NULL;
+	
+	ZEND_PARSE_PARAMETERS_START_EX(ZEND_PARSE_PARAMS_THROW, 0, 1)
+		Z_PARAM_OPTIONAL
+		Z_PARAM_ZVAL(val)
+	ZEND_PARSE_PARAMETERS_END();
+	
+	watcher = (async_file_watcher *) Z_OBJ_P(getThis());
+	
+	if (watcher->cancel.func == NULL) {
+		return;
+	}
+	
+	ASYNC_PREPARE_ERROR(&error, "File watcher has been closed");
+	
+	if (val != NULL && Z_TYPE_P(val) != IS_NULL) {
+		zend_exception_set_previous(Z_OBJ_P(&error), Z_OBJ_P(val));
+		GC_ADDREF(Z_OBJ_P(val));
+	}
+	
+	ASYNC_Q_DETACH(&watcher->scheduler->shutdown, &watcher->cancel);
+	
+	watcher->cancel.func(watcher, &error);
+	
+	zval_ptr_dtor(&error);
+}
+
+ZEND_METHOD(FileWatcher, getPath)
+{
+	async_file_watcher *watcher;
+	
+	ZEND_PARSE_PARAMETERS_NONE();
+	
+	watcher = (async_file_watcher *) Z_OBJ_P(getThis());
+	
+	RETURN_STR_COPY(watcher->path);
+}
+
+ZEND_METHOD(FileWatcher, awaitChange)
+{
+	async_file_watcher *watcher;
+	async_op *op;
+	async_context *context;
+	
+	ZEND_PARSE_PARAMETERS_NONE();
+	
+	watcher = (async_file_watcher *) Z_OBJ_P(getThis());
+	
+	if (Z_TYPE_P(&watcher->error) != IS_UNDEF) {
+		Z_ADDREF_P(&watcher->error);
+		
+		execute_data->opline--;
+		zend_throw_exception_internal(&watcher->error);
+		execute_data->opline++;
+		
+		return;
+	}
+	
+	// Changes that occurred while no task was waiting are returned immediately.
+	if (zend_hash_num_elements(&watcher->changes) > 0) {
+		RETVAL_ARR(zend_array_dup(&watcher->changes));
+		
+		zend_hash_clean(&watcher->changes);
+		
+		return;
+	}
+	
+	context = async_context_get();
+	
+	ASYNC_ALLOC_OP(op);
+	ASYNC_ENQUEUE_OP(&watcher->observers, op);
+	
+	ASYNC_UNREF_ENTER(context, watcher);
+	
+	if (async_await_op(op) == FAILURE) {
+		ASYNC_FORWARD_OP_ERROR(op);
+	} else {
+		ZVAL_COPY(return_value, &op->result);
+	}
+	
+	ASYNC_UNREF_EXIT(context, watcher);
+	ASYNC_FREE_OP(op);
+}
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_file_watcher_ctor, 0, 0, 1)
+	ZEND_ARG_TYPE_INFO(0, path, IS_STRING, 0)
+	ZEND_ARG_TYPE_INFO(0, recursive, _IS_BOOL, 0)
+	ZEND_ARG_TYPE_INFO(0, latency, IS_LONG, 0)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_WITH_RETURN_TYPE_INFO_EX(arginfo_file_watcher_close, 0, 0, IS_VOID, 0)
+	ZEND_ARG_OBJ_INFO(0, error, Throwable, 1)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_WITH_RETURN_TYPE_INFO_EX(arginfo_file_watcher_get_path, 0, 0, IS_STRING, 0)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_WITH_RETURN_TYPE_INFO_EX(arginfo_file_watcher_await_change, 0, 0, IS_ARRAY, 0)
+ZEND_END_ARG_INFO()
+
+static const zend_function_entry async_file_watcher_functions[] = {
+	ZEND_ME(FileWatcher, __construct, arginfo_file_watcher_ctor, ZEND_ACC_PUBLIC)
+	ZEND_ME(FileWatcher, close, arginfo_file_watcher_close, ZEND_ACC_PUBLIC)
+	ZEND_ME(FileWatcher, getPath, arginfo_file_watcher_get_path, ZEND_ACC_PUBLIC)
+	ZEND_ME(FileWatcher, awaitChange, arginfo_file_watcher_await_change, ZEND_ACC_PUBLIC)
+	ZEND_FE_END
+};
+
+
+void async_file_watcher_ce_register()
+{
+	zend_class_entry ce;
+	
+	INIT_CLASS_ENTRY(ce, "Concurrent\\FileWatcher", async_file_watcher_functions);
+	async_file_watcher_ce = zend_register_internal_class(&ce);
+	async_file_watcher_ce->ce_flags |= ZEND_ACC_FINAL;
+	async_file_watcher_ce->create_object = async_file_watcher_object_create;
+	async_file_watcher_ce->serialize = zend_class_serialize_deny;
+	async_file_watcher_ce->unserialize = zend_class_unserialize_deny;
+	
+	memcpy(&async_file_watcher_handlers, &std_object_handlers, sizeof(zend_object_handlers));
+	async_file_watcher_handlers.free_obj = async_file_watcher_object_destroy;
+	async_file_watcher_handlers.dtor_obj = async_file_watcher_object_dtor;
+	async_file_watcher_handlers.clone_obj = NULL;
+	
+	ASYNC_FILE_WATCHER_CONST("RENAME", UV_RENAME);
+	ASYNC_FILE_WATCHER_CONST("CHANGE", UV_CHANGE);
+}
+
+
+/*
+ * vim: sw=4 ts=4
+ * vim600: fdm=marker
+ */
@@ -26,6 +26,10 @@
 #include <sys/file.h>
 #endif
 
+#ifndef PHP_WIN32
+#include <dirent.h>
+#endif
+
 #define ASYNC_STRIP_FILE_SCHEME(url) do { \
 	if (strncasecmp(url, "file://", sizeof("file://") - 1) == 0) { \
 		url += sizeof("file://") - 1; \
@@ -34,26 +38,33 @@
 
 #define ASYNC_FS_CALL(data, req, func, ...) do { \
 	async_uv_op *op; \
+	uint64_t start; \
 	int code; \
 	op = NULL; \
 	if ((data)->scheduler->flags & ASYNC_TASK_SCHEDULER_FLAG_DISPOSED) { \
 		(data)->async = 0; \
 	} \
 	if ((data)->async) { \
+		if (async_thread_pool_acquire(ASYNC_THREAD_POOL_FS) == FAILURE) { \
+			memset(req, 0, sizeof(*(req))); \
+			(req)->result = UV_ECANCELED; \
+			break; \
+		} \
 		ASYNC_ALLOC_CUSTOM_OP(op, sizeof(async_uv_op)); \
 		(req)->data = op;\
 	} \
+	start = (data)->include ? uv_hrtime() : 0; \
 	code = (func)(&(data)->scheduler->loop, req, __VA_ARGS__, (data)->async ? dummy_cb : NULL); \
+	if (start) { \
+		ASYNC_G(fs_include_sync_time) += uv_hrtime() - start; \
+	} \
 	if (code >= 0) { \
 		if ((data)->async) { \
 			if (async_await_op((async_op *) op) == FAILURE) { \
 				ASYNC_FORWARD_OP_ERROR(op); \
 				(req)->result = -1; \
-				if (0 == uv_cancel((uv_req_t *) req)) { \
-					ASYNC_FREE_OP(op); \
-				} else { \
-					((async_op *) op)->status = ASYNC_STATUS_FAILED; \
-				} \
+				((async_op *) op)->status = ASYNC_STATUS_FAILED; \
+				uv_cancel((uv_req_t *) req); \
 			} else { \
 				code = op->code; \
 				ASYNC_FREE_OP(op); \
@@ -63,6 +74,7 @@
 		(req)->result = code; \
 		if ((data)->async) { \
 			ASYNC_FREE_OP(op); \
+			async_thread_pool_release(ASYNC_THREAD_POOL_FS); \
 		} \
 	} \
 } while (0)
@@ -74,6 +86,11 @@
 	op = NULL; \
 	scheduler = async_task_scheduler_get(); \
 	if (async) { \
+		if (async_thread_pool_acquire(ASYNC_THREAD_POOL_FS) == FAILURE) { \
+			memset(req, 0, sizeof(*(req))); \
+			(req)->result = UV_ECANCELED; \
+			break; \
+		} \
 		ASYNC_ALLOC_CUSTOM_OP(op, sizeof(async_uv_op)); \
 		(req)->data = op; \
 	} \
@@ -83,11 +100,8 @@
 			if (async_await_op((async_op *) op) == FAILURE) { \
 				ASYNC_FORWARD_OP_ERROR(op); \
 				(req)->result = -1; \
-				if (0 == uv_cancel((uv_req_t *) req)) { \
-					ASYNC_FREE_OP(op); \
-				} else { \
-					((async_op *) op)->status = ASYNC_STATUS_FAILED; \
-				} \
+				((async_op *) op)->status = ASYNC_STATUS_FAILED; \
+				uv_cancel((uv_req_t *) req); \
 			} else { \
 				code = op->code; \
 				ASYNC_FREE_OP(op); \
@@ -97,41 +111,188 @@
 		(req)->result = code; \
 		if (async) { \
 			ASYNC_FREE_OP(op); \
+			async_thread_pool_release(ASYNC_THREAD_POOL_FS); \
 		} \
 	} \
 } while (0)
 
-static php_stream_wrapper orig_file_wrapper;
+#define ASYNC_FS_READ_BUFFER_MIN 8192
+#define ASYNC_FS_READAHEAD_THRESHOLD 2
+#define ASYNC_FS_READAHEAD_MAX 0x100000
+#define ASYNC_FS_WRITE_BUFFER_MAX 0x1000000
+#define ASYNC_FS_WRITE_BEHIND_DELAY 100
+#define ASYNC_FS_DIR_BATCH_MAX 0x10000
+#define ASYNC_FS_LOCK_BACKOFF_MIN 1
+#define ASYNC_FS_LOCK_BACKOFF_MAX 100
 
-typedef struct _async_dirstream_entry async_dirstream_entry;
+static php_stream_wrapper orig_file_wrapper;
 
-struct _async_dirstream_entry {
-	async_dirstream_entry *prev;
-	async_dirstream_entry *next;
+/* Directory handles are only accessed by worker threads (or the loop thread if no job is running). */
+#ifdef PHP_WIN32
+typedef struct {
+	HANDLE find;
+	WIN32_FIND_DATAW entry;
+	
+	/* Set if entry holds the (unread) result of FindFirstFileW(). */
+	zend_bool pending;
+	
+	/* Search pattern (path followed by "\\*"), uses the struct hack. */
+	wchar_t pattern[1];
+} async_dir_handle;
+#else
+typedef DIR async_dir_handle;
+#endif
 
-	/* Uses the struct hack to avoid additional memory allocations. */
-	char name[1];
-};
+/*
+ * Reads a batch of directory entries in the thread pool, names are packed into a single buffer
+ * allocated using malloc() (separated by NUL bytes).
+ */
+typedef struct {
+	async_op base;
+	uv_work_t req;
+	
+	/* Directory handle, owned by the job while it is running. */
+	async_dir_handle *dir;
+	
+	/* Path of the directory to be opened (malloc), NULL if the handle is already open. */
+	char *path;
+	
+	/* Rewind the directory before reading entries. */
+	zend_bool rewind;
+	
+	/* Max number of entries to be read. */
+	uint32_t max;
+	uint32_t count;
+	
+	char *names;
+	size_t len;
+	size_t size;
+	
+	zend_bool eof;
+	int error;
+} async_dir_op;
 
 typedef struct {
-	async_dirstream_entry *first;
-	async_dirstream_entry *last;
-	async_dirstream_entry *entry;
+	/* Directory handle, NULL if reading has failed or has been cancelled. */
+	async_dir_handle *dir;
+	
+	/* Current batch of entries and read position. */
+	char *batch;
+	size_t len;
+	size_t pos;
+	
+	/* Max number of entries per batch. */
+	uint32_t batch_size;
+	
+	zend_bool eof;
+	zend_bool rewind;
+	
+	/* Number of entries returned since the directory has been opened or rewound. */
 	zend_off_t offset;
-	zend_off_t size;
+	
+	/* Number of entries to be skipped by the next read (seeking). */
+	zend_off_t skip;
+	
 	async_task_scheduler *scheduler;
 } async_dirstream_data;
 
+typedef struct _async_filestream_data async_filestream_data;
+
 typedef struct {
+	uv_fs_t req;
+	
+	/* Owning stream, NULL if the stream has been closed while the read was in flight. */
+	async_filestream_data *data;
+	
+	/* Set if the readahead has been discarded while the read was in flight, it is released on completion. */
+	zend_bool discarded;
+	
+	/* Buffer being filled by the read, offset refers to the file position of the first byte. */
+	char *buf;
+	size_t size;
+	int64_t offset;
+	
+	/* Number of bytes read (or error code) and number of bytes consumed by the stream. */
+	ssize_t result;
+	size_t pos;
+	
+	/* Set while the read is in flight. */
+	zend_bool active;
+	
+	/* Set if the file has to be closed after the read completed (stream closed by a cancelled task). */
+	zend_bool close;
+	uv_file file;
+	
+	/* Detached background write that closes the file, the close is handed over if the read completes last. */
+	struct _async_filestream_writer *writer;
+	
+	/* Operation of a task waiting for the read to complete. */
+	async_op *op;
+} async_filestream_readahead;
+
+typedef struct _async_filestream_writer {
+	/* Owning stream, NULL after the stream has been closed. */
+	async_filestream_data *data;
+	
+	/* Timer that triggers a background flush of buffered data. */
+	uv_timer_t timer;
+	
+	/* Background write of buffered data started by the timer. */
+	uv_fs_t req;
+	uv_buf_t buf;
+	zend_bool active;
+	
+	/* Operation of a task waiting for the background write to complete. */
+	async_op *op;
+	
+	/* Data that has to be written before the file is closed (stream closed by a cancelled task). */
+	zend_bool close;
+	uv_file file;
+	uv_buf_t pending;
+	int64_t offset;
+	
+	/* Detached readahead that is still in flight, the file is closed by the readahead if it completes last. */
+	async_filestream_readahead *ahead;
+} async_filestream_writer;
+
+struct _async_filestream_data {
 	uv_file file;
 	int mode;
 	int lock_flag;
 	zend_bool async;
 	zend_bool finished;
+	
+	/* Set if the file is included using blocking reads, time spent in file operations is measured. */
+	zend_bool include;
+	
 	int64_t rpos;
 	int64_t wpos;
 	async_task_scheduler *scheduler;
-} async_filestream_data;
+	
+	/* Number of consecutive reads without a seek or write in between. */
+	uint32_t sequential;
+	
+	/* Size of the next readahead, doubled whenever a readahead has been consumed. */
+	size_t ahead_size;
+	
+	/* Read being performed ahead of the consumer, NULL if access is not sequential. */
+	async_filestream_readahead *ahead;
+	
+	/* Discarded readahead that is still in flight, the file must not be closed before it completes. */
+	async_filestream_readahead *detached;
+	
+	/* Write-behind buffer, wbuf_offset is the file position of the first buffered byte. */
+	char *wbuf;
+	size_t wbuf_size;
+	size_t wbuf_len;
+	int64_t wbuf_offset;
+	
+	/* Error of a failed background write, reported by the next write or close. */
+	int write_error;
+	
+	/* Flush timer and background write, NULL if writes are not buffered. */
+	async_filestream_writer *writer;
+};
 
 
 static void dummy_cb(uv_fs_t* req)
@@ -142,7 +303,10 @@ static void dummy_cb(uv_fs_t* req)
 	
 	ZEND_ASSERT(op != NULL);
 	
-	if (req->result == UV_ECANCELED) {
+	async_thread_pool_release(ASYNC_THREAD_POOL_FS);
+	
+	// Op is disposed if the awaiting task has been cancelled.
+	if (req->result == UV_ECANCELED || op->base.status == ASYNC_STATUS_FAILED) {
 		ASYNC_FREE_OP(op);
 	} else {
 		op->code = 0;
@@ -253,80 +417,355 @@ static inline int parse_open_mode(const char *mode, int *mods)
 }
 
 
-static size_t async_dirstream_read(php_stream *stream, char *buf, size_t count)
+#ifdef PHP_WIN32
+static int dir_open(async_dir_handle **handle, const char *path)
 {
-	async_dirstream_data *data;
-	php_stream_dirent *ent;
-
-	data = (async_dirstream_data *) stream->abstract;
-	ent = (php_stream_dirent *) buf;
+	async_dir_handle *dir;
+	int len;
+	int code;
 	
-	if (data->entry == NULL) {
-		return 0;
+	len = MultiByteToWideChar(CP_UTF8, 0, path, -1, NULL, 0);
+	
+	if (len == 0) {
+		return uv_translate_sys_error(GetLastError());
 	}
+	
+	dir = malloc(sizeof(async_dir_handle) + (len + 2) * sizeof(wchar_t));
+	
+	if (dir == NULL) {
+		return UV_ENOMEM;
+	}
+	
+	MultiByteToWideChar(CP_UTF8, 0, path, -1, dir->pattern, len);
+	wcscat(dir->pattern, L"\\*");
+	
+	dir->find = FindFirstFileW(dir->pattern, &dir->entry);
+	
+	if (dir->find == INVALID_HANDLE_VALUE) {
+		code = uv_translate_sys_error(GetLastError());
+		
+		free(dir);
+		
+		return code;
+	}
+	
+	dir->pending = 1;
+	*handle = dir;
+	
+	return 0;
+}
 
-	strcpy(ent->d_name, data->entry->name);
-
-	data->entry = data->entry->next;
-	data->offset++;
+static int dir_next(async_dir_handle *dir, char *name, size_t size)
+{
+	if (dir->find == INVALID_HANDLE_VALUE) {
+		return UV_EOF;
+	}
+	
+	if (dir->pending) {
+		dir->pending = 0;
+	} else if (!FindNextFileW(dir->find, &dir->entry)) {
+		return (GetLastError() == ERROR_NO_MORE_FILES) ? UV_EOF : uv_translate_sys_error(GetLastError());
+	}
+	
+	if (0 == WideCharToMultiByte(CP_UTF8, 0, dir->entry.cFileName, -1, name, (int) size, NULL, NULL)) {
+		return uv_translate_sys_error(GetLastError());
+	}
+	
+	return 0;
+}
 
-	return sizeof(php_stream_dirent);
+static void dir_rewind(async_dir_handle *dir)
+{
+	if (dir->find != INVALID_HANDLE_VALUE) {
+		FindClose(dir->find);
+	}
+	
+	dir->find = FindFirstFileW(dir->pattern, &dir->entry);
+	dir->pending = 1;
 }
 
-static int async_dirstream_rewind(php_stream *stream, zend_off_t offset, int whence, zend_off_t *newoffs)
+static void dir_close(async_dir_handle *dir)
 {
-	async_dirstream_data *data;
-	async_dirstream_entry *entry;
+	if (dir->find != INVALID_HANDLE_VALUE) {
+		FindClose(dir->find);
+	}
+	
+	free(dir);
+}
+#else
+static int dir_open(async_dir_handle **handle, const char *path)
+{
+	*handle = opendir(path);
+	
+	return (*handle == NULL) ? uv_translate_sys_error(errno) : 0;
+}
 
-	zend_off_t i;
+static int dir_next(async_dir_handle *dir, char *name, size_t size)
+{
+	struct dirent *entry;
+	
+	errno = 0;
+	entry = readdir(dir);
+	
+	if (entry == NULL) {
+		return (errno == 0) ? UV_EOF : uv_translate_sys_error(errno);
+	}
+	
+	strlcpy(name, entry->d_name, size);
+	
+	return 0;
+}
 
-	data = (async_dirstream_data *) stream->abstract;
+static void dir_rewind(async_dir_handle *dir)
+{
+	rewinddir(dir);
+}
 
-	switch (whence) {
-	case SEEK_SET:
-		entry = data->first;
+static void dir_close(async_dir_handle *dir)
+{
+	closedir(dir);
+}
+#endif
 
-		for (i = 0; i < offset; i++) {
-			if (entry != NULL) {
-				entry = entry->next;
+static void dir_work_cb(uv_work_t *req)
+{
+	async_dir_op *op;
+	char name[MAXPATHLEN];
+	char *buf;
+	size_t len;
+	int code;
+	
+	op = (async_dir_op *) req->data;
+	
+	if (op->path != NULL) {
+		if (0 > (code = dir_open(&op->dir, op->path))) {
+			op->error = code;
+			
+			return;
+		}
+	} else if (op->rewind) {
+		dir_rewind(op->dir);
+	}
+	
+	while (op->count < op->max) {
+		code = dir_next(op->dir, name, sizeof(name));
+		
+		if (code == UV_EOF) {
+			op->eof = 1;
+			break;
+		}
+		
+		if (code < 0) {
+			op->error = code;
+			break;
+		}
+		
+		// Dot entries are always returned first by the dir stream.
+		if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+			continue;
+		}
+		
+		len = strlen(name) + 1;
+		
+		if (op->len + len > op->size) {
+			buf = realloc(op->names, MAX(op->size * 2, MAX(4096, op->len + len)));
+			
+			if (buf == NULL) {
+				op->error = UV_ENOMEM;
+				break;
 			}
+			
+			op->names = buf;
+			op->size = MAX(op->size * 2, MAX(4096, op->len + len));
 		}
+		
+		memcpy(op->names + op->len, name, len);
+		
+		op->len += len;
+		op->count++;
+	}
+}
 
-		data->entry = entry;
-		data->offset = offset;
+static void free_dir_op(async_dir_op *op)
+{
+	if (op->dir != NULL) {
+		dir_close(op->dir);
+	}
+	
+	free(op->path);
+	free(op->names);
+	
+	ASYNC_FREE_OP(op);
+}
 
-		break;
-	case SEEK_CUR:
-		entry = data->first;
+static void dir_after_work_cb(uv_work_t *req, int status)
+{
+	async_dir_op *op;
+	
+	op = (async_dir_op *) req->data;
+	
+	async_thread_pool_release(ASYNC_THREAD_POOL_FS);
+	
+	// The reading task has been cancelled, the directory handle is closed.
+	if (op->base.status == ASYNC_STATUS_FAILED) {
+		free_dir_op(op);
+	} else {
+		ASYNC_FINISH_OP(op);
+	}
+}
 
-		for (i = 0; i < offset; i++) {
-			if (entry != NULL) {
-				entry = entry->next;
-			}
-		}
+/* Reads the next batch of entries, the op is freed if FAILURE is returned. */
+static int run_dir_job(async_dir_op *op)
+{
+	int code;
+	
+	op->req.data = op;
+	
+	if (!async_cli) {
+		dir_work_cb(&op->req);
+		
+		return SUCCESS;
+	}
+	
+	if (async_thread_pool_acquire(ASYNC_THREAD_POOL_FS) == FAILURE) {
+		free_dir_op(op);
+		
+		return FAILURE;
+	}
+	
+	code = uv_queue_work(&async_task_scheduler_get()->loop, &op->req, dir_work_cb, dir_after_work_cb);
+	
+	if (UNEXPECTED(code < 0)) {
+		async_thread_pool_release(ASYNC_THREAD_POOL_FS);
+		free_dir_op(op);
+		
+		return FAILURE;
+	}
+	
+	if (async_await_op((async_op *) op) == FAILURE) {
+		ASYNC_FORWARD_OP_ERROR(op);
+		
+		op->base.status = ASYNC_STATUS_FAILED;
+		
+		uv_cancel((uv_req_t *) &op->req);
+		
+		return FAILURE;
+	}
+	
+	return SUCCESS;
+}
+
+static int read_dir_batch(async_dirstream_data *data)
+{
+	async_dir_op *op;
+	
+	ASYNC_ALLOC_CUSTOM_OP(op, sizeof(async_dir_op));
+	
+	op->dir = data->dir;
+	op->rewind = data->rewind;
+	op->max = data->batch_size;
+	
+	free(data->batch);
+	
+	// The handle is owned by the job until it has completed.
+	data->dir = NULL;
+	data->batch = NULL;
+	data->len = 0;
+	data->pos = 0;
+	data->rewind = 0;
+	
+	if (run_dir_job(op) == FAILURE) {
+		return FAILURE;
+	}
+	
+	if (op->error < 0) {
+		php_error_docref(NULL, E_WARNING, "Failed to read dir: %s", uv_strerror(op->error));
+	}
+	
+	data->dir = op->dir;
+	data->batch = op->names;
+	data->len = op->len;
+	data->eof = op->eof || (op->error < 0);
+	
+	op->dir = NULL;
+	op->names = NULL;
+	
+	free_dir_op(op);
+	
+	return SUCCESS;
+}
 
-		data->entry = entry;
-		data->offset += offset;
+static const char *next_dir_entry(async_dirstream_data *data)
+{
+	const char *name;
+	
+	// Emulate entries filtered by the batch reader.
+	if (data->offset < 2) {
+		return (data->offset++ == 0) ? "." : "..";
+	}
+	
+	while (data->pos >= data->len) {
+		if (data->eof || data->dir == NULL || read_dir_batch(data) == FAILURE) {
+			return NULL;
+		}
+	}
+	
+	name = data->batch + data->pos;
+	
+	data->pos += strlen(name) + 1;
+	data->offset++;
+	
+	return name;
+}
 
-		break;
-	case SEEK_END:
-		entry = data->last;
+static size_t async_dirstream_read(php_stream *stream, char *buf, size_t count)
+{
+	async_dirstream_data *data;
+	php_stream_dirent *ent;
+	const char *name;
 
-		for (i = 0; i < offset; i++) {
-			if (entry != NULL) {
-				entry = entry->prev;
-			}
+	data = (async_dirstream_data *) stream->abstract;
+	ent = (php_stream_dirent *) buf;
+	
+	for (; data->skip > 0; data->skip--) {
+		if (next_dir_entry(data) == NULL) {
+			data->skip = 0;
+			
+			return 0;
 		}
+	}
+	
+	if (NULL == (name = next_dir_entry(data))) {
+		return 0;
+	}
 
-		data->entry = entry;
-		data->offset = data->size - offset;
+	strlcpy(ent->d_name, name, sizeof(ent->d_name));
 
-		break;
-	default:
+	return sizeof(php_stream_dirent);
+}
+
+/* Only absolute positions are supported, the directory is rewound and entries are skipped by the next read. */
+static int async_dirstream_rewind(php_stream *stream, zend_off_t offset, int whence, zend_off_t *newoffs)
+{
+	async_dirstream_data *data;
+
+	data = (async_dirstream_data *) stream->abstract;
+
+	if (whence != SEEK_SET || offset < 0 || data->dir == NULL) {
 		return -1;
 	}
+	
+	free(data->batch);
+	
+	data->batch = NULL;
+	data->len = 0;
+	data->pos = 0;
+	data->eof = 0;
+	data->rewind = 1;
+	data->offset = 0;
+	data->skip = offset;
 
-	*newoffs = data->offset;
+	*newoffs = offset;
 
 	return 0;
 }
@@ -334,19 +773,15 @@ static int async_dirstream_rewind(php_stream *stream, zend_off_t offset, int whe
 static int async_dirstream_close(php_stream *stream, int close_handle)
 {
 	async_dirstream_data *data;
-	async_dirstream_entry *entry;
-	async_dirstream_entry *prev;
 	
 	data = (async_dirstream_data *) stream->abstract;
-	entry = data->first;
 	
-	while (entry != NULL) {
-		prev = entry;
-		entry = entry->next;
-
-		efree(prev);
+	if (data->dir != NULL) {
+		dir_close(data->dir);
 	}
 	
+	free(data->batch);
+	
 	OBJ_RELEASE(&data->scheduler->std);
 	
 	efree(data);
@@ -367,86 +802,731 @@ static php_stream_ops async_dirstream_ops = {
 };
 
 
-static size_t async_filestream_write(php_stream *stream, const char *buf, size_t count)
+/* Returns the io_uring instance to be used for file operations, NULL if the thread pool is used. */
+static inline async_uring *get_uring(async_filestream_data *data)
 {
-	async_filestream_data *data;
-	uv_fs_t req;
-	uv_buf_t bufs[1];
+	if (!data->async) {
+		return NULL;
+	}
 	
-	data = (async_filestream_data *) stream->abstract;
+	return async_uring_get(data->scheduler);
+}
+
+static void free_readahead(async_filestream_readahead *ahead)
+{
+	efree(ahead->buf);
+	efree(ahead);
+}
+
+static void readahead_cb(uv_fs_t *req)
+{
+	async_filestream_readahead *ahead;
+	async_op *op;
+	
+	ahead = (async_filestream_readahead *) req->data;
+	
+	async_thread_pool_release(ASYNC_THREAD_POOL_FS);
+	
+	ahead->active = 0;
+	ahead->result = req->result;
+	
+	uv_fs_req_cleanup(req);
+	
+	if (ahead->writer != NULL) {
+		ahead->writer->ahead = NULL;
+	} else if (ahead->close) {
+		uv_fs_close(req->loop, req, ahead->file, NULL);
+		uv_fs_req_cleanup(req);
+	}
+	
+	op = ahead->op;
+	ahead->op = NULL;
+	
+	if (ahead->discarded && ahead->data != NULL) {
+		ahead->data->detached = NULL;
+	}
+	
+	if (ahead->data == NULL || ahead->discarded) {
+		free_readahead(ahead);
+	}
+	
+	if (op != NULL) {
+		ASYNC_FINISH_OP(op);
+	}
+}
+
+/* Starts reading the next chunk of the file in the background, skipped if no thread is available right away. */
+static void start_readahead(async_filestream_data *data)
+{
+	async_filestream_readahead *ahead;
+	uv_buf_t bufs[1];
+	
+	// Only a single discarded read may be in flight, close has to wait for it.
+	if (data->detached != NULL || (data->scheduler->flags & ASYNC_TASK_SCHEDULER_FLAG_DISPOSED)) {
+		return;
+	}
+	
+	if (async_thread_pool_try_acquire(ASYNC_THREAD_POOL_FS) == FAILURE) {
+		return;
+	}
+	
+	ahead = data->ahead;
+	
+	if (ahead == NULL) {
+		ahead = ecalloc(1, sizeof(async_filestream_readahead));
+		ahead->data = data;
+		
+		data->ahead = ahead;
+	}
+	
+	if (ahead->size != data->ahead_size) {
+		if (ahead->buf != NULL) {
+			efree(ahead->buf);
+		}
+		
+		ahead->buf = emalloc(data->ahead_size);
+		ahead->size = data->ahead_size;
+	}
+	
+	ahead->offset = data->rpos;
+	ahead->result = 0;
+	ahead->pos = 0;
+	ahead->active = 1;
+	ahead->req.data = ahead;
+	
+	bufs[0] = uv_buf_init(ahead->buf, (unsigned int) ahead->size);
+	
+	if (uv_fs_read(&data->scheduler->loop, &ahead->req, data->file, bufs, 1, ahead->offset, readahead_cb) < 0) {
+		async_thread_pool_release(ASYNC_THREAD_POOL_FS);
+		
+		data->ahead = NULL;
+		free_readahead(ahead);
+	}
+}
+
+/* Drops buffered readahead data, an in-flight read is detached from the stream and released on completion. */
+static void discard_readahead(async_filestream_data *data)
+{
+	async_filestream_readahead *ahead;
+	
+	data->sequential = 0;
+	
+	if (NULL == (ahead = data->ahead)) {
+		return;
+	}
+	
+	data->ahead = NULL;
+	
+	if (ahead->active) {
+		ahead->discarded = 1;
+		
+		data->detached = ahead;
+	} else {
+		free_readahead(ahead);
+	}
+}
+
+/* Waits for an in-flight readahead, returns FAILURE if the waiting task has been cancelled. */
+static int await_readahead(async_filestream_readahead *ahead)
+{
+	async_op *op;
+	
+	if (!ahead->active) {
+		return SUCCESS;
+	}
+	
+	ASYNC_ALLOC_OP(op);
+	
+	ahead->op = op;
+	
+	if (async_await_op(op) == FAILURE) {
+		ASYNC_FORWARD_OP_ERROR(op);
+		ASYNC_FREE_OP(op);
+		
+		ahead->op = NULL;
+		
+		return FAILURE;
+	}
+	
+	ASYNC_FREE_OP(op);
+	
+	return SUCCESS;
+}
+
+/* Serves a read from the readahead buffer, returns -1 if the buffer cannot be used. */
+static ssize_t read_ahead(php_stream *stream, async_filestream_data *data, char *buf, size_t count)
+{
+	async_filestream_readahead *ahead;
+	size_t len;
+	
+	ahead = data->ahead;
+	
+	if (ahead->offset + (int64_t) ahead->pos != data->rpos) {
+		discard_readahead(data);
+		
+		return -1;
+	}
+	
+	if (await_readahead(ahead) == FAILURE) {
+		return 0;
+	}
+	
+	if (ahead->result < 0) {
+		discard_readahead(data);
+		
+		return -1;
+	}
+	
+	len = MIN(count, (size_t) ahead->result - ahead->pos);
+	
+	memcpy(buf, ahead->buf + ahead->pos, len);
+	
+	ahead->pos += len;
+	data->rpos += len;
+	
+	if (ahead->pos < (size_t) ahead->result) {
+		return len;
+	}
+	
+	// A short read marks the end of the file.
+	if ((size_t) ahead->result < ahead->size) {
+		data->finished = 1;
+		stream->eof = 1;
+		
+		return len;
+	}
+	
+	data->ahead_size = MIN(data->ahead_size * 2, ASYNC_FS_READAHEAD_MAX);
+	
+	start_readahead(data);
+	
+	return len;
+}
+
+static void close_writer_cb(uv_handle_t *handle)
+{
+	async_filestream_writer *writer;
+	
+	writer = (async_filestream_writer *) handle->data;
+	
+	writer->timer.data = NULL;
+	
+	if (!writer->active) {
+		efree(writer);
+	}
+}
+
+/* Result of a write that completed after the stream has been closed is reported as a warning. */
+static void report_writer_error(uv_fs_t *req, size_t len)
+{
+	if (req->result < 0 || (size_t) req->result < len) {
+		php_error_docref(NULL, E_WARNING, "Failed to write buffered data: %s", uv_strerror((req->result < 0) ? (int) req->result : UV_EIO));
+	}
+}
+
+/* Closes the file of a stream that has been closed by a cancelled task, a readahead in flight takes over. */
+static void close_writer_file(async_filestream_writer *writer, uv_loop_t *loop)
+{
+	uv_fs_t req;
+	
+	if (writer->ahead != NULL) {
+		writer->ahead->writer = NULL;
+		writer->ahead->file = writer->file;
+		writer->ahead->close = 1;
+	} else {
+		uv_fs_close(loop, &req, writer->file, NULL);
+		uv_fs_req_cleanup(&req);
+	}
+	
+	writer->active = 0;
+	
+	if (writer->timer.data == NULL) {
+		efree(writer);
+	}
+}
+
+static void writer_flush_cb(uv_fs_t *req)
+{
+	async_filestream_writer *writer;
+	
+	writer = (async_filestream_writer *) req->data;
+	
+	async_thread_pool_release(ASYNC_THREAD_POOL_FS);
+	
+	report_writer_error(req, writer->pending.len);
+	
+	uv_fs_req_cleanup(req);
+	efree(writer->pending.base);
+	
+	close_writer_file(writer, req->loop);
+}
+
+static void writer_cb(uv_fs_t *req)
+{
+	async_filestream_writer *writer;
+	async_op *op;
+	
+	int code;
+	
+	writer = (async_filestream_writer *) req->data;
+	
+	if (writer->data != NULL && writer->data->write_error == 0) {
+		if (req->result < 0) {
+			writer->data->write_error = (int) req->result;
+		} else if ((size_t) req->result < writer->buf.len) {
+			writer->data->write_error = UV_EIO;
+		}
+	}
+	
+	if (writer->close) {
+		report_writer_error(req, writer->buf.len);
+	}
+	
+	uv_fs_req_cleanup(req);
+	efree(writer->buf.base);
+	
+	// Data buffered by a closed stream is written in the background, the thread pool slot is reused.
+	if (writer->close && writer->pending.len > 0) {
+		code = uv_fs_write(req->loop, req, writer->file, &writer->pending, 1, writer->offset, writer_flush_cb);
+		
+		if (code == 0) {
+			return;
+		}
+		
+		php_error_docref(NULL, E_WARNING, "Failed to write buffered data: %s", uv_strerror(code));
+		
+		efree(writer->pending.base);
+	}
+	
+	async_thread_pool_release(ASYNC_THREAD_POOL_FS);
+	
+	if (writer->close) {
+		close_writer_file(writer, req->loop);
+		
+		return;
+	}
+	
+	writer->active = 0;
+	
+	if (writer->op != NULL) {
+		op = writer->op;
+		writer->op = NULL;
+		
+		ASYNC_FINISH_OP(op);
+	} else if (writer->data == NULL && writer->timer.data == NULL) {
+		efree(writer);
+	}
+}
+
+/* Hands buffered data over to a background write, the timer is restarted if no thread is available. */
+static void write_behind_cb(uv_timer_t *timer)
+{
+	async_filestream_writer *writer;
+	async_filestream_data *data;
+	int code;
+	
+	writer = (async_filestream_writer *) timer->data;
+	data = writer->data;
+	
+	if (data == NULL || writer->active || data->wbuf_len == 0) {
+		return;
+	}
+	
+	if (async_thread_pool_try_acquire(ASYNC_THREAD_POOL_FS) == FAILURE) {
+		uv_timer_start(timer, write_behind_cb, ASYNC_FS_WRITE_BEHIND_DELAY, 0);
+		
+		return;
+	}
+	
+	writer->buf = uv_buf_init(data->wbuf, (unsigned int) data->wbuf_len);
+	writer->req.data = writer;
+	
+	code = uv_fs_write(timer->loop, &writer->req, data->file, &writer->buf, 1, data->wbuf_offset, writer_cb);
+	
+	if (code < 0) {
+		async_thread_pool_release(ASYNC_THREAD_POOL_FS);
+		
+		data->write_error = code;
+	} else {
+		writer->active = 1;
+		
+		data->wbuf = NULL;
+		data->wbuf_offset += data->wbuf_len;
+		data->wbuf_len = 0;
+	}
+}
+
+/* Waits for a background write, returns FAILURE if the waiting task has been cancelled. */
+static int await_writer(async_filestream_writer *writer)
+{
+	async_op *op;
+	
+	if (!writer->active) {
+		return SUCCESS;
+	}
+	
+	ASYNC_ALLOC_OP(op);
+	
+	writer->op = op;
+	
+	if (async_await_op(op) == FAILURE) {
+		ASYNC_FORWARD_OP_ERROR(op);
+		ASYNC_FREE_OP(op);
+		
+		writer->op = NULL;
+		
+		return FAILURE;
+	}
+	
+	ASYNC_FREE_OP(op);
+	
+	return SUCCESS;
+}
+
+/* Reports (and clears) the error of a failed background write. */
+static int check_write_error(async_filestream_data *data)
+{
+	int code;
+	
+	if (data->write_error == 0) {
+		return SUCCESS;
+	}
+	
+	code = data->write_error;
+	data->write_error = 0;
+	
+	php_error_docref(NULL, E_WARNING, "Failed to write buffered data: %s", uv_strerror(code));
+	
+	return FAILURE;
+}
+
+/* Writes buffered data followed by the given data using a single vectored write. */
+static int flush_write_buffer(async_filestream_data *data, const char *extra, size_t len)
+{
+	uv_fs_t req;
+	uv_buf_t bufs[2];
+	unsigned int count;
+	size_t total;
+	
+	if (data->writer == NULL) {
+		return SUCCESS;
+	}
+	
+	if (await_writer(data->writer) == FAILURE) {
+		return FAILURE;
+	}
+	
+	if (check_write_error(data) == FAILURE) {
+		return FAILURE;
+	}
+	
+	if (data->wbuf_len == 0 && len == 0) {
+		return SUCCESS;
+	}
+	
+	uv_timer_stop(&data->writer->timer);
+	
+	count = 0;
+	total = data->wbuf_len + len;
+	
+	if (data->wbuf_len > 0) {
+		bufs[count++] = uv_buf_init(data->wbuf, (unsigned int) data->wbuf_len);
+	}
+	
+	if (len > 0) {
+		bufs[count++] = uv_buf_init((char *) extra, (unsigned int) len);
+	}
 	
 	if (data->scheduler->flags & ASYNC_TASK_SCHEDULER_FLAG_DISPOSED) {
 		data->async = 0;
 	}
 	
-	bufs[0] = uv_buf_init((char *) buf, count);
-	
-	ASYNC_FS_CALL(data, &req, uv_fs_write, data->file, bufs, 1, data->wpos);
+	ASYNC_FS_CALL(data, &req, uv_fs_write, data->file, bufs, count, data->wbuf_offset);
 	
 	uv_fs_req_cleanup(&req);
 	
-	if (req.result < 0) {
+	if (req.result < 0 || (size_t) req.result < total) {
+		php_error_docref(NULL, E_WARNING, "Failed to write buffered data: %s", uv_strerror((req.result < 0) ? (int) req.result : UV_EIO));
+		
+		data->wbuf_len = 0;
+		
+		return FAILURE;
+	}
+	
+	data->wbuf_offset += total;
+	data->wbuf_len = 0;
+	
+	return SUCCESS;
+}
+
+/* Appends data to the write-behind buffer, the buffer is flushed if the data does not fit. */
+static size_t buffered_write(async_filestream_data *data, const char *buf, size_t count)
+{
+	if (count == 0) {
 		return 0;
 	}
 	
-	data->wpos += req.result;
+	if (check_write_error(data) == FAILURE) {
+		return 0;
+	}
+	
+	if (data->wbuf_len == 0) {
+		data->wbuf_offset = data->wpos;
+	}
+	
+	if (data->wbuf_len + count > data->wbuf_size) {
+		if (flush_write_buffer(data, buf, count) == FAILURE) {
+			return 0;
+		}
+		
+		data->wpos += count;
+		
+		return count;
+	}
+	
+	if (data->wbuf == NULL) {
+		data->wbuf = emalloc(data->wbuf_size);
+	}
+	
+	if (data->wbuf_len == 0) {
+		uv_timer_start(&data->writer->timer, write_behind_cb, ASYNC_FS_WRITE_BEHIND_DELAY, 0);
+	}
+	
+	memcpy(data->wbuf + data->wbuf_len, buf, count);
+	
+	data->wbuf_len += count;
+	data->wpos += count;
+	
+	return count;
+}
 
-	return (size_t) req.result;
+static void create_writer(async_filestream_data *data)
+{
+	data->writer = ecalloc(1, sizeof(async_filestream_writer));
+	data->writer->data = data;
+	
+	uv_timer_init(&data->scheduler->loop, &data->writer->timer);
+	
+	data->writer->timer.data = data->writer;
+}
+
+/*
+ * Flushes buffered data and releases the writer, the timer handle is freed by the event loop. Detached is set
+ * if the file will be closed by the writer because the background write could not be awaited.
+ */
+static int close_writer(async_filestream_data *data, zend_bool *detached)
+{
+	async_filestream_writer *writer;
+	int result;
+	
+	writer = data->writer;
+	
+	*detached = 0;
+	
+	uv_timer_stop(&writer->timer);
+	
+	// Buffered data has to be written after the background write, the file is closed by the write callback.
+	if (await_writer(writer) == FAILURE) {
+		writer->close = 1;
+		writer->file = data->file;
+		writer->offset = data->wbuf_offset;
+		
+		if (data->wbuf_len > 0) {
+			writer->pending = uv_buf_init(data->wbuf, (unsigned int) data->wbuf_len);
+			data->wbuf = NULL;
+		}
+		
+		*detached = 1;
+		result = FAILURE;
+	} else {
+		result = flush_write_buffer(data, NULL, 0);
+	}
+	
+	if (data->wbuf != NULL) {
+		efree(data->wbuf);
+		data->wbuf = NULL;
+	}
+	
+	writer->data = NULL;
+	data->writer = NULL;
+	
+	uv_close((uv_handle_t *) &writer->timer, close_writer_cb);
+	
+	return result;
+}
+
+static size_t async_filestream_write(php_stream *stream, const char *buf, size_t count)
+{
+	async_filestream_data *data;
+	async_uring *ring;
+	uv_fs_t req;
+	uv_buf_t bufs[1];
+	ssize_t result;
+	
+	data = (async_filestream_data *) stream->abstract;
+	
+	if (data->scheduler->flags & ASYNC_TASK_SCHEDULER_FLAG_DISPOSED) {
+		data->async = 0;
+	}
+	
+	discard_readahead(data);
+	
+	if (data->writer != NULL) {
+		return buffered_write(data, buf, count);
+	}
+	
+	ring = get_uring(data);
+	result = (ring == NULL) ? UV_ENOBUFS : async_uring_write(ring, data->file, buf, count, data->wpos);
+	
+	// The thread pool is used if io_uring is not available or its submission queue is full.
+	if (result == UV_ENOBUFS) {
+		bufs[0] = uv_buf_init((char *) buf, count);
+		
+		ASYNC_FS_CALL(data, &req, uv_fs_write, data->file, bufs, 1, data->wpos);
+		
+		uv_fs_req_cleanup(&req);
+		
+		result = req.result;
+	}
+	
+	if (result < 0) {
+		return 0;
+	}
+	
+	data->wpos += result;
+
+	return (size_t) result;
 }
 
 static size_t async_filestream_read(php_stream *stream, char *buf, size_t count)
 {
 	async_filestream_data *data;
+	async_uring *ring;
 	uv_fs_t req;
 	uv_buf_t bufs[1];
+	ssize_t result;
 
 	data = (async_filestream_data *) stream->abstract;
 	
-	if (data->finished || count < 8192) {
+	if (data->finished || count < ASYNC_FS_READ_BUFFER_MIN) {
 		return 0;
 	}
 	
-	bufs[0] = uv_buf_init(buf, count);
-	
-	ASYNC_FS_CALL(data, &req, uv_fs_read, data->file, bufs, 1, data->rpos);
-	
-	uv_fs_req_cleanup(&req);
-	
-	if (req.result < 0) {
+	// Buffered data must be visible to reads of the same stream.
+	if (data->writer != NULL && flush_write_buffer(data, NULL, 0) == FAILURE) {
+		return 0;
+	}
+	
+	if (data->ahead != NULL) {
+		if ((result = read_ahead(stream, data, buf, count)) >= 0) {
+			return (size_t) result;
+		}
+	}
+	
+	ring = get_uring(data);
+	result = (ring == NULL) ? UV_ENOBUFS : async_uring_read(ring, data->file, buf, count, data->rpos);
+	
+	// The thread pool is used if io_uring is not available or its submission queue is full.
+	if (result == UV_ENOBUFS) {
+		bufs[0] = uv_buf_init(buf, count);
+		
+		ASYNC_FS_CALL(data, &req, uv_fs_read, data->file, bufs, 1, data->rpos);
+		
+		uv_fs_req_cleanup(&req);
+		
+		result = req.result;
+	}
+	
+	if (result < 0) {
 		return 0;
 	}
 	
-	if (req.result < count) {
+	if (result < count) {
 		data->finished = 1;
 		stream->eof = 1;
 	}
 	
-	data->rpos += req.result;
+	data->rpos += result;
+	
+	// Sequential reads through the thread pool keep a larger read in flight ahead of the consumer.
+	if (ring == NULL && data->async && !data->finished && ++data->sequential >= ASYNC_FS_READAHEAD_THRESHOLD) {
+		data->ahead_size = MIN(MAX(data->ahead_size, count * 2), ASYNC_FS_READAHEAD_MAX);
+		
+		start_readahead(data);
+	}
 
-	return (size_t) req.result;
+	return (size_t) result;
 }
 
 static int async_filestream_close(php_stream *stream, int close_handle)
 {
 	async_filestream_data *data;
+	async_filestream_writer *writer;
+	async_uring *ring;
 	uv_fs_t req;
+	ssize_t result;
+	zend_bool detached;
 	
 	data = (async_filestream_data *) stream->abstract;
+	writer = data->writer;
+	
+	discard_readahead(data);
+	
+	// The background write closes the file, a readahead that is still in flight takes over if it completes last.
+	if (writer != NULL && close_writer(data, &detached) == FAILURE && detached) {
+		if (data->detached != NULL) {
+			data->detached->data = NULL;
+			data->detached->writer = writer;
+			
+			writer->ahead = data->detached;
+		}
+		
+		OBJ_RELEASE(&data->scheduler->std);
+		
+		efree(data);
+		
+		return 0;
+	}
+	
+	// File descriptor must not be closed (and possibly reused) while a readahead is in flight.
+	if (data->detached != NULL && await_readahead(data->detached) == FAILURE) {
+		data->detached->data = NULL;
+		data->detached->file = data->file;
+		data->detached->close = 1;
+		
+		OBJ_RELEASE(&data->scheduler->std);
+		
+		efree(data);
+		
+		return 0;
+	}
 
-	ASYNC_FS_CALL(data, &req, uv_fs_close, data->file);
+	ring = get_uring(data);
+	result = (ring == NULL) ? UV_ENOBUFS : async_uring_close(ring, data->file);
 	
-	uv_fs_req_cleanup(&req);
+	// The thread pool is used if io_uring is not available or its submission queue is full.
+	if (result == UV_ENOBUFS) {
+		ASYNC_FS_CALL(data, &req, uv_fs_close, data->file);
+		
+		uv_fs_req_cleanup(&req);
+		
+		result = req.result;
+	}
 		
 	OBJ_RELEASE(&data->scheduler->std);
 	
 	efree(data);
 	
-	return (req.result < 1) ? 1 : 0;
+	return (result < 1) ? 1 : 0;
 }
 
 static int async_filestream_flush(php_stream *stream)
 {
-	return 0;
+	async_filestream_data *data;
+	
+	data = (async_filestream_data *) stream->abstract;
+	
+	return (flush_write_buffer(data, NULL, 0) == SUCCESS) ? 0 : -1;
 }
 
 static int async_filestream_cast(php_stream *stream, int castas, void **ret)
@@ -457,15 +1537,30 @@ static int async_filestream_cast(php_stream *stream, int castas, void **ret)
 static int async_filestream_stat(php_stream *stream, php_stream_statbuf *ssb)
 {
 	async_filestream_data *data;
+	async_uring *ring;
 	uv_fs_t req;
+	int code;
 
 	data = (async_filestream_data *) stream->abstract;
 	
-	ASYNC_FS_CALL(data, &req, uv_fs_fstat, data->file);
+	// Reported size has to include buffered data.
+	if (data->writer != NULL && flush_write_buffer(data, NULL, 0) == FAILURE) {
+		return 1;
+	}
 	
-	uv_fs_req_cleanup(&req);
-
-	if (req.result < 0) {
+	ring = get_uring(data);
+	code = (ring == NULL) ? UV_ENOBUFS : async_uring_fstat(ring, data->file, &req.statbuf);
+	
+	// The thread pool is used if io_uring is not available or its submission queue is full.
+	if (code == UV_ENOBUFS) {
+		ASYNC_FS_CALL(data, &req, uv_fs_fstat, data->file);
+		
+		uv_fs_req_cleanup(&req);
+		
+		code = (int) req.result;
+	}
+	
+	if (code < 0) {
 		return 1;
 	}
 
@@ -481,6 +1576,8 @@ static int async_filestream_seek(php_stream *stream, zend_off_t offset, int when
 
 	data = (async_filestream_data *) stream->abstract;
 	
+	discard_readahead(data);
+	
 	if (0 != async_filestream_stat(stream, &ssb)) {
 		return -1;
 	}
@@ -516,6 +1613,12 @@ static int async_filestream_seek(php_stream *stream, zend_off_t offset, int when
 static int async_truncate(async_filestream_data *data, int64_t nsize)
 {
 	uv_fs_t req;
+	
+	discard_readahead(data);
+	
+	if (flush_write_buffer(data, NULL, 0) == FAILURE) {
+		return FAILURE;
+	}
 
 	ASYNC_FS_CALL(data, &req, uv_fs_ftruncate, data->file, nsize);
 
@@ -524,6 +1627,74 @@ static int async_truncate(async_filestream_data *data, int64_t nsize)
 	return (req.result < 0) ? FAILURE : SUCCESS;
 }
 
+static void close_lock_timer_cb(uv_handle_t *handle)
+{
+	efree(handle);
+}
+
+static void lock_timer_cb(uv_timer_t *timer)
+{
+	ASYNC_FINISH_OP((async_op *) timer->data);
+}
+
+/* Acquires a file lock without blocking the event loop, contended locks are retried with exponential backoff. */
+static int async_lock(async_filestream_data *data, int operation)
+{
+	uv_timer_t *timer;
+	async_op *op;
+	uint64_t delay;
+	int code;
+	
+	if (data->scheduler->flags & ASYNC_TASK_SCHEDULER_FLAG_DISPOSED) {
+		data->async = 0;
+	}
+	
+	// Unlocking and non-blocking attempts are completed immediately.
+	if (!data->async || (operation & (LOCK_NB | LOCK_UN))) {
+		return flock((int) data->file, operation);
+	}
+	
+	code = flock((int) data->file, operation | LOCK_NB);
+	
+	if (code == 0 || errno != EWOULDBLOCK) {
+		return code;
+	}
+	
+	// A blocking flock() in the thread pool could not be cancelled, polling allows the context to abort the wait.
+	timer = emalloc(sizeof(uv_timer_t));
+	
+	uv_timer_init(&data->scheduler->loop, timer);
+	
+	delay = ASYNC_FS_LOCK_BACKOFF_MIN;
+	
+	do {
+		ASYNC_ALLOC_OP(op);
+		
+		timer->data = op;
+		
+		uv_timer_start(timer, lock_timer_cb, delay, 0);
+		
+		if (async_await_op(op) == FAILURE) {
+			ASYNC_FORWARD_OP_ERROR(op);
+			ASYNC_FREE_OP(op);
+			
+			uv_timer_stop(timer);
+			
+			code = -1;
+			break;
+		}
+		
+		ASYNC_FREE_OP(op);
+		
+		code = flock((int) data->file, operation | LOCK_NB);
+		delay = MIN(delay * 2, ASYNC_FS_LOCK_BACKOFF_MAX);
+	} while (code != 0 && errno == EWOULDBLOCK);
+	
+	uv_close((uv_handle_t *) timer, close_lock_timer_cb);
+	
+	return code;
+}
+
 static int async_filestream_set_option(php_stream *stream, int option, int value, void *ptrparam)
 {
 	async_filestream_data *data;
@@ -549,13 +1720,34 @@ static int async_filestream_set_option(php_stream *stream, int option, int value
 	 	}
 	 	
 	 	return PHP_STREAM_OPTION_RETURN_OK;
+	case PHP_STREAM_OPTION_WRITE_BUFFER:
+		if (!data->async || (data->mode & (UV_FS_O_WRONLY | UV_FS_O_RDWR)) == 0) {
+			return PHP_STREAM_OPTION_RETURN_NOTIMPL;
+		}
+		
+		if (flush_write_buffer(data, NULL, 0) == FAILURE) {
+			return PHP_STREAM_OPTION_RETURN_ERR;
+		}
+		
+		if (data->wbuf != NULL) {
+			efree(data->wbuf);
+			data->wbuf = NULL;
+		}
+		
+		// Writes bypass the (empty) buffer if the size is 0.
+		data->wbuf_size = (value == PHP_STREAM_BUFFER_NONE) ? 0 : MIN(*((size_t *) ptrparam), ASYNC_FS_WRITE_BUFFER_MAX);
+		
+		if (data->wbuf_size > 0 && data->writer == NULL) {
+			create_writer(data);
+		}
+		
+		return PHP_STREAM_OPTION_RETURN_OK;
 	case PHP_STREAM_OPTION_LOCKING:
 		if ((zend_uintptr_t) ptrparam == PHP_STREAM_LOCK_SUPPORTED) {
 			return PHP_STREAM_OPTION_RETURN_OK;
 		}
 		
-		// TODO: Check if non-blocking locks can be implemented...
-		if (!flock((int) data->file, value)) {
+		if (!async_lock(data, value)) {
 			data->lock_flag = value;
 			return PHP_STREAM_OPTION_RETURN_OK;
 		}
@@ -601,13 +1793,81 @@ ASYNC_API const php_stream_ops async_filestream_ops = {
 };
 
 
+/* Read buffer size is taken from the "read_buffer_size" file context option or the INI setting. */
+static size_t get_read_buffer_size(php_stream_context *context)
+{
+	zend_long size;
+	zval *val;
+	
+	size = ASYNC_G(fs_read_buffer_size);
+	
+	if (context != NULL && NULL != (val = php_stream_context_get_option(context, "file", "read_buffer_size"))) {
+		size = zval_get_long(val);
+	}
+	
+	return (size_t) MAX(ASYNC_FS_READ_BUFFER_MIN, MIN(size, ASYNC_FS_READAHEAD_MAX));
+}
+
+/* Write-behind buffer size is taken from the "write_buffer_size" file context option or the INI setting. */
+static size_t get_write_buffer_size(php_stream_context *context)
+{
+	zend_long size;
+	zval *val;
+	
+	size = ASYNC_G(fs_write_buffer_size);
+	
+	if (context != NULL && NULL != (val = php_stream_context_get_option(context, "file", "write_buffer_size"))) {
+		size = zval_get_long(val);
+	}
+	
+	return (size_t) MAX(0, MIN(size, ASYNC_FS_WRITE_BUFFER_MAX));
+}
+
+/*
+ * Included files are read in the thread pool if enabled and the include is performed by a task, the loop
+ * keeps running while the task is suspended. Includes outside of tasks (bootstrapping) use blocking reads.
+ *
+ * include_once and require_once register the file in EG(included_files) before it is opened, suspending
+ * the task would let other tasks skip the file before it has been compiled, these includes always block.
+ */
+static zend_bool is_async_include()
+{
+	async_fiber *fiber;
+	zend_execute_data *exec;
+	
+	if (!ASYNC_G(fs_include)) {
+		return 0;
+	}
+	
+	fiber = ASYNC_G(current_fiber);
+	
+	if (fiber == NULL || fiber->type != ASYNC_FIBER_TYPE_TASK) {
+		return 0;
+	}
+	
+	exec = EG(current_execute_data);
+	
+	if (exec != NULL && exec->func != NULL && ZEND_USER_CODE(exec->func->type)) {
+		if (exec->opline->opcode == ZEND_INCLUDE_OR_EVAL) {
+			if (exec->opline->extended_value == ZEND_INCLUDE_ONCE || exec->opline->extended_value == ZEND_REQUIRE_ONCE) {
+				return 0;
+			}
+		}
+	}
+	
+	return (((async_task *) fiber)->scheduler->flags & ASYNC_TASK_SCHEDULER_FLAG_DISPOSED) ? 0 : 1;
+}
+
 static php_stream *async_filestream_wrapper_open(php_stream_wrapper *wrapper, const char *path, const char *mode,
 int options, zend_string **opened_path, php_stream_context *context STREAMS_DC)
 {
 	async_filestream_data *data;
+	async_uring *ring;
 	zend_bool async;
 	
 	uv_fs_t req;
+	ssize_t result;
+	uint64_t start;
 
 	php_stream *stream;
 	char realpath[MAXPATHLEN];
@@ -630,7 +1890,17 @@ int options, zend_string **opened_path, php_stream_context *context STREAMS_DC)
 		return NULL;
 	}
 
-	async = async_cli && ((options & STREAM_OPEN_FOR_INCLUDE) == 0);
+	if (options & STREAM_OPEN_FOR_INCLUDE) {
+		async = async_cli && is_async_include();
+		
+		if (async) {
+			ASYNC_G(fs_include_async)++;
+		} else {
+			ASYNC_G(fs_include_sync)++;
+		}
+	} else {
+		async = async_cli;
+	}
 
 	if (options & STREAM_ASSUME_REALPATH) {
 		strlcpy(realpath, path, MAXPATHLEN);
@@ -640,11 +1910,25 @@ int options, zend_string **opened_path, php_stream_context *context STREAMS_DC)
 		}
 	}
 
-	ASYNC_FS_CALLW(async, &req, uv_fs_open, realpath, flags, 0666);
+	ring = async ? async_uring_get(async_task_scheduler_get()) : NULL;
+	result = (ring == NULL) ? UV_ENOBUFS : async_uring_open(ring, realpath, flags, 0666);
 
-	uv_fs_req_cleanup(&req);
+	// The thread pool is used if io_uring is not available or its submission queue is full.
+	if (result == UV_ENOBUFS) {
+		start = (options & STREAM_OPEN_FOR_INCLUDE) ? uv_hrtime() : 0;
+		
+		ASYNC_FS_CALLW(async, &req, uv_fs_open, realpath, flags, 0666);
+
+		uv_fs_req_cleanup(&req);
+		
+		result = req.result;
+		
+		if (start && !async) {
+			ASYNC_G(fs_include_sync_time) += uv_hrtime() - start;
+		}
+	}
 	
-	if (req.result < 0) {
+	if (result < 0) {
 		if (options & REPORT_ERRORS) {
 			php_error_docref(NULL, E_WARNING, "Failed to open file: %s", realpath);
 		}
@@ -663,51 +1947,52 @@ int options, zend_string **opened_path, php_stream_context *context STREAMS_DC)
 		return NULL;
 	}
 	
-	// TODO: Configure default read buffer size using an INI option?
-	
-	stream->readbuflen = 0x8000;
+	stream->readbuflen = get_read_buffer_size(context);
  	stream->readbuf = perealloc(stream->readbuf, stream->readbuflen, stream->is_persistent);
 	
-	data->file = req.result;
+	data->file = (uv_file) result;
 	data->mode = flags;
 	data->lock_flag = LOCK_UN;
 	data->async = async;
+	data->include = !async && (options & STREAM_OPEN_FOR_INCLUDE);
 	data->scheduler = async_task_scheduler_get();
 	
 	ASYNC_ADDREF(&data->scheduler->std);
+	
+	if (async && (flags & (UV_FS_O_WRONLY | UV_FS_O_RDWR))) {
+		data->wbuf_size = get_write_buffer_size(context);
+		
+		if (data->wbuf_size > 0) {
+			create_writer(data);
+		}
+	}
 
 	return stream;
 }
 
-static inline async_dirstream_entry *create_dir_entry(async_dirstream_entry *prev, const char *name)
+/* Number of entries per batch is taken from the "dir_batch_size" file context option or the INI setting. */
+static uint32_t get_dir_batch_size(php_stream_context *context)
 {
-	async_dirstream_entry *entry;
-
-	entry = emalloc(sizeof(async_dirstream_entry) + strlen(name));
-	entry->prev = prev;
-	entry->next = NULL;
-
-	strcpy(entry->name, name);
-
-	if (prev != NULL) {
-		prev->next = entry;
+	zend_long size;
+	zval *val;
+	
+	size = ASYNC_G(fs_dir_batch_size);
+	
+	if (context != NULL && NULL != (val = php_stream_context_get_option(context, "file", "dir_batch_size"))) {
+		size = zval_get_long(val);
 	}
-
-	return entry;
+	
+	return (uint32_t) MAX(1, MIN(size, ASYNC_FS_DIR_BATCH_MAX));
 }
 
 static php_stream *async_filestream_wrapper_opendir(php_stream_wrapper *wrapper, const char *path, const char *mode,
 int options, zend_string **opened_path, php_stream_context *context STREAMS_DC)
 {
 	async_dirstream_data *data;
-	async_dirstream_entry *prev;
-
-	uv_fs_t req;
-	uv_dirent_t tmp;
+	async_dir_op *op;
 
 	php_stream *stream;
 	char realpath[MAXPATHLEN];
-	int code;
 
 	if (((options & STREAM_DISABLE_OPEN_BASEDIR) == 0) && php_check_open_basedir(path)) {
 		return NULL;
@@ -720,15 +2005,29 @@ int options, zend_string **opened_path, php_stream_context *context STREAMS_DC)
 			return NULL;
 		}
 	}
+	
+	ASYNC_ALLOC_CUSTOM_OP(op, sizeof(async_dir_op));
+	
+	// Opening the directory and reading the first batch of entries are performed by the same job.
+	op->path = strdup(realpath);
+	op->max = get_dir_batch_size(context);
+
+	if (UNEXPECTED(op->path == NULL)) {
+		free_dir_op(op);
+		
+		return NULL;
+	}
 
-	ASYNC_FS_CALLW(async_cli, &req, uv_fs_scandir, realpath, 0);
+	if (run_dir_job(op) == FAILURE) {
+		return NULL;
+	}
 	
-	if (req.result < 0) {
+	if (op->dir == NULL) {
 		if (options & REPORT_ERRORS) {
-			php_error_docref(NULL, E_WARNING, "Failed to open dir %s: %s", realpath, uv_strerror(req.result));
+			php_error_docref(NULL, E_WARNING, "Failed to open dir %s: %s", realpath, uv_strerror(op->error));
 		}
 		
-		uv_fs_req_cleanup(&req);
+		free_dir_op(op);
 	
 		return NULL;
 	}
@@ -740,36 +2039,25 @@ int options, zend_string **opened_path, php_stream_context *context STREAMS_DC)
 	
 	if (UNEXPECTED(stream == NULL)) {
 		efree(data);
-		uv_fs_req_cleanup(&req);
+		free_dir_op(op);
 		
 		return NULL;
 	}
 
-	data->offset = 0;
-	data->size = 2;
-
-	prev = create_dir_entry(NULL, ".");
-
-	data->first = prev;
-	data->entry = prev;
-
-	prev = create_dir_entry(prev, "..");
-
-	while (1) {
-		code = uv_fs_scandir_next(&req, &tmp);
-
-		if (code == UV_EOF) {
-			data->last = prev;
-
-			break;
-		}
-
-		prev = create_dir_entry(prev, tmp.name);
-
-		data->size++;
+	if (op->error < 0) {
+		php_error_docref(NULL, E_WARNING, "Failed to read dir %s: %s", realpath, uv_strerror(op->error));
 	}
-
-	uv_fs_req_cleanup(&req);
+	
+	data->dir = op->dir;
+	data->batch = op->names;
+	data->len = op->len;
+	data->eof = op->eof || (op->error < 0);
+	data->batch_size = op->max;
+	
+	op->dir = NULL;
+	op->names = NULL;
+	
+	free_dir_op(op);
 
 	data->scheduler = async_task_scheduler_get();
 	
@@ -1117,6 +2405,107 @@ static php_stream_wrapper async_filestream_wrapper = {
 };
 
 
+/* Returns the file descriptor of a file stream, buffered data of async file streams is written first. */
+int async_filesystem_get_file(php_stream *stream, uv_file *file)
+{
+	async_filestream_data *data;
+	int fd;
+	
+	if (stream->ops == &async_filestream_ops) {
+		data = (async_filestream_data *) stream->abstract;
+		
+		if (flush_write_buffer(data, NULL, 0) == FAILURE) {
+			return FAILURE;
+		}
+		
+		*file = data->file;
+		
+		return SUCCESS;
+	}
+	
+	if (FAILURE == php_stream_cast(stream, PHP_STREAM_AS_FD, (void **) &fd, 0)) {
+		return FAILURE;
+	}
+	
+	*file = (uv_file) fd;
+	
+	return SUCCESS;
+}
+
+/* Opens a file (relative to PHP's working directory, open_basedir is checked), returns the file descriptor or a negative error code. */
+int async_filesystem_open(const char *path, int flags, int mode)
+{
+	uv_fs_t req;
+	char realpath[MAXPATHLEN];
+	
+	ASYNC_STRIP_FILE_SCHEME(path);
+	
+	if (expand_filepath(path, realpath) == NULL) {
+		return UV_ENOENT;
+	}
+	
+	if (php_check_open_basedir(realpath)) {
+		return UV_EACCES;
+	}
+	
+	ASYNC_FS_CALLW(async_cli, &req, uv_fs_open, realpath, flags, mode);
+	
+	uv_fs_req_cleanup(&req);
+	
+	return (int) req.result;
+}
+
+int async_filesystem_fstat(uv_file file, uv_stat_t *stat)
+{
+	uv_fs_t req;
+	
+	ASYNC_FS_CALLW(async_cli, &req, uv_fs_fstat, file);
+	
+	uv_fs_req_cleanup(&req);
+	
+	if (req.result >= 0) {
+		memcpy(stat, &req.statbuf, sizeof(uv_stat_t));
+	}
+	
+	return (int) req.result;
+}
+
+int async_filesystem_read(uv_file file, uv_buf_t bufs[], unsigned int nbufs, int64_t offset)
+{
+	uv_fs_t req;
+	
+	ASYNC_FS_CALLW(async_cli, &req, uv_fs_read, file, bufs, nbufs, offset);
+	
+	uv_fs_req_cleanup(&req);
+	
+	return (int) req.result;
+}
+
+/* Copies data from a file to a socket (or file) in the kernel, returns the number of bytes sent. */
+int async_filesystem_sendfile(uv_file out, uv_file in, int64_t offset, size_t length)
+{
+	uv_fs_t req;
+	
+	ASYNC_FS_CALLW(async_cli, &req, uv_fs_sendfile, out, in, offset, length);
+	
+	uv_fs_req_cleanup(&req);
+	
+	return (int) req.result;
+}
+
+/* Closes a file without suspending the task, cleanup must not fail due to a cancelled context. */
+int async_filesystem_close(uv_file file)
+{
+	uv_fs_t req;
+	int code;
+	
+	code = uv_fs_close(&async_task_scheduler_get()->loop, &req, file, NULL);
+	
+	uv_fs_req_cleanup(&req);
+	
+	return code;
+}
+
 void async_filesystem_init()
 {
 	// This works starting with PHP 7.3.0RC5.
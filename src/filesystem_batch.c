@@ -0,0 +1,554 @@
+/*
+  +----------------------------------------------------------------------+
+  | PHP Version 7                                                        |
+  +----------------------------------------------------------------------+
+  | Copyright (c) 1997-2018 The PHP Group                                |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 3.01 of the PHP license,      |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available through the world-wide-web at the following url:           |
+  | http://www.php.net/license/3_01.txt                                  |
+  | If you did not receive a copy of the PHP license and are unable to   |
+  | obtain it through the world-wide-web, please send a note to          |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+  | Authors: Martin Schröder <m.schroeder2007@gmail.com>                 |
+  +----------------------------------------------------------------------+
+*/
+
+#include "php_async.h"
+
+#include "async_task.h"
+
+#include "ext/standard/php_filestat.h"
+
+zend_class_entry *async_filesystem_ce;
+
+#define ASYNC_FS_BATCH_STAT 0
+#define ASYNC_FS_BATCH_UNLINK 1
+#define ASYNC_FS_BATCH_RENAME 2
+#define ASYNC_FS_BATCH_MKDIR 3
+
+/* Result code of entries that have not been submitted due to open_basedir restrictions. */
+#define ASYNC_FS_BATCH_DENIED INT_MIN
+
+/* Cancellation flag is set by the loop thread while the worker thread is processing entries. */
+#ifdef PHP_WIN32
+#define ASYNC_FS_BATCH_CANCEL(op) InterlockedExchange(&(op)->cancelled, 1)
+#define ASYNC_FS_BATCH_IS_CANCELLED(op) (InterlockedCompareExchange(&(op)->cancelled, 0, 0) != 0)
+#else
+#define ASYNC_FS_BATCH_CANCEL(op) __atomic_store_n(&(op)->cancelled, 1, __ATOMIC_RELEASE)
+#define ASYNC_FS_BATCH_IS_CANCELLED(op) (__atomic_load_n(&(op)->cancelled, __ATOMIC_ACQUIRE) != 0)
+#endif
+
+typedef struct {
+	/* Path as passed by userland code, used as key of the result. */
+	zend_string *key;
+	
+	/* Expanded path (and rename target), NULL if the entry is not processed. */
+	char *path;
+	char *target;
+	
+	/* Result of the operation (0 or a negative libuv error code). */
+	int result;
+	
+	uv_stat_t stat;
+} async_fs_batch_entry;
+
+/*
+ * All operations of a batch are executed by a single worker thread using synchronous libuv calls. Entries
+ * are allocated by the loop thread, the worker only writes results and does not allocate memory.
+ */
+typedef struct {
+	async_op base;
+	uv_work_t req;
+	
+	/* Loop being passed to libuv, it is not accessed by synchronous fs calls. */
+	uv_loop_t *loop;
+	
+	/* Operation (ASYNC_FS_BATCH_*). */
+	int type;
+	
+	/* Mkdir options. */
+	int mode;
+	zend_bool recursive;
+	
+	uint32_t count;
+	async_fs_batch_entry *entries;
+	
+	/* Set if the task has been cancelled, remaining entries are skipped by the worker. */
+#ifdef PHP_WIN32
+	volatile LONG cancelled;
+#else
+	int cancelled;
+#endif
+} async_fs_batch_op;
+
+static int batch_mkdir(uv_loop_t *loop, char *path, int mode, zend_bool recursive)
+{
+	uv_fs_t req;
+	char *p;
+	char c;
+	int code;
+	
+	code = uv_fs_mkdir(loop, &req, path, mode, NULL);
+	uv_fs_req_cleanup(&req);
+	
+	if (code != UV_ENOENT || !recursive) {
+		return code;
+	}
+	
+	// Create missing parent directories from top to bottom, errors are reported by the last mkdir call.
+	for (p = path + 1; *p != '\0'; p++) {
+		if (*p != '/' && *p != DEFAULT_SLASH) {
+			continue;
+		}
+		
+		c = *p;
+		*p = '\0';
+		
+		uv_fs_mkdir(loop, &req, path, mode, NULL);
+		uv_fs_req_cleanup(&req);
+		
+		*p = c;
+	}
+	
+	code = uv_fs_mkdir(loop, &req, path, mode, NULL);
+	uv_fs_req_cleanup(&req);
+	
+	return code;
+}
+
+static void batch_work_cb(uv_work_t *req)
+{
+	async_fs_batch_op *op;
+	async_fs_batch_entry *entry;
+	
+	uv_fs_t tmp;
+	uint32_t i;
+	
+	op = (async_fs_batch_op *) req->data;
+	
+	ZEND_ASSERT(op != NULL);
+	
+	for (i = 0; i < op->count; i++) {
+		entry = &op->entries[i];
+		
+		// The task has been cancelled, remaining operations are skipped.
+		if (ASYNC_FS_BATCH_IS_CANCELLED(op)) {
+			break;
+		}
+		
+		if (entry->path == NULL) {
+			continue;
+		}
+		
+		switch (op->type) {
+		case ASYNC_FS_BATCH_STAT:
+			entry->result = uv_fs_stat(op->loop, &tmp, entry->path, NULL);
+			
+			if (entry->result >= 0) {
+				memcpy(&entry->stat, &tmp.statbuf, sizeof(uv_stat_t));
+			}
+			
+			uv_fs_req_cleanup(&tmp);
+			break;
+		case ASYNC_FS_BATCH_UNLINK:
+			entry->result = uv_fs_unlink(op->loop, &tmp, entry->path, NULL);
+			uv_fs_req_cleanup(&tmp);
+			break;
+		case ASYNC_FS_BATCH_RENAME:
+			entry->result = uv_fs_rename(op->loop, &tmp, entry->path, entry->target, NULL);
+			uv_fs_req_cleanup(&tmp);
+			break;
+		case ASYNC_FS_BATCH_MKDIR:
+			entry->result = batch_mkdir(op->loop, entry->path, op->mode, op->recursive);
+			break;
+		}
+	}
+}
+
+static void free_batch_op(async_fs_batch_op *op)
+{
+	uint32_t i;
+	
+	for (i = 0; i < op->count; i++) {
+		zend_string_release(op->entries[i].key);
+		
+		if (op->entries[i].path != NULL) {
+			efree(op->entries[i].path);
+		}
+		
+		if (op->entries[i].target != NULL) {
+			efree(op->entries[i].target);
+		}
+	}
+	
+	if (op->entries != NULL) {
+		efree(op->entries);
+	}
+	
+	ASYNC_FREE_OP(op);
+}
+
+static void batch_after_work_cb(uv_work_t *req, int status)
+{
+	async_fs_batch_op *op;
+	
+	op = (async_fs_batch_op *) req->data;
+	
+	ZEND_ASSERT(op != NULL);
+	
+	async_thread_pool_release(ASYNC_THREAD_POOL_FS);
+	
+	if (op->base.status == ASYNC_STATUS_FAILED) {
+		free_batch_op(op);
+	} else {
+		ASYNC_FINISH_OP(op);
+	}
+}
+
+static async_fs_batch_op *create_batch_op(int type, uint32_t count)
+{
+	async_fs_batch_op *op;
+	
+	ASYNC_ALLOC_CUSTOM_OP(op, sizeof(async_fs_batch_op));
+	
+	op->type = type;
+	op->loop = &async_task_scheduler_get()->loop;
+	
+	if (count > 0) {
+		op->entries = ecalloc(count, sizeof(async_fs_batch_entry));
+	}
+	
+	return op;
+}
+
+/* Expands a path and checks open_basedir restrictions, returns NULL if the path must not be accessed. */
+static char *prepare_path(zend_string *path)
+{
+	char buf[MAXPATHLEN];
+	
+	if (ZSTR_LEN(path) == 0 || ZSTR_LEN(path) != strlen(ZSTR_VAL(path))) {
+		return NULL;
+	}
+	
+	if (expand_filepath(ZSTR_VAL(path), buf) == NULL || php_check_open_basedir_ex(buf, 0)) {
+		return NULL;
+	}
+	
+	return estrdup(buf);
+}
+
+static void add_entry(async_fs_batch_op *op, zend_string *path, zend_string *target)
+{
+	async_fs_batch_entry *entry;
+	
+	entry = &op->entries[op->count++];
+	entry->key = zend_string_copy(path);
+	entry->path = prepare_path(path);
+	
+	if (target != NULL && entry->path != NULL) {
+		entry->target = prepare_path(target);
+		
+		if (entry->target == NULL) {
+			efree(entry->path);
+			entry->path = NULL;
+		}
+	}
+	
+	if (entry->path == NULL) {
+		entry->result = ASYNC_FS_BATCH_DENIED;
+	}
+}
+
+/* Submits the batch to the thread pool, the op is freed if FAILURE is returned. */
+static int submit_batch(async_fs_batch_op *op)
+{
+	int code;
+	
+	if (!async_cli) {
+		batch_work_cb(&op->req);
+		
+		return SUCCESS;
+	}
+	
+	if (async_thread_pool_acquire(ASYNC_THREAD_POOL_FS) == FAILURE) {
+		free_batch_op(op);
+		
+		return FAILURE;
+	}
+	
+	code = uv_queue_work(op->loop, &op->req, batch_work_cb, batch_after_work_cb);
+	
+	if (UNEXPECTED(code < 0)) {
+		async_thread_pool_release(ASYNC_THREAD_POOL_FS);
+		free_batch_op(op);
+		
+		zend_throw_error(NULL, "Failed to queue work: %s", uv_strerror(code));
+		
+		return FAILURE;
+	}
+	
+	if (async_await_op((async_op *) op) == FAILURE) {
+		ASYNC_FORWARD_OP_ERROR(op);
+		
+		op->base.status = ASYNC_STATUS_FAILED;
+		
+		ASYNC_FS_BATCH_CANCEL(op);
+		
+		uv_cancel((uv_req_t *) &op->req);
+		
+		return FAILURE;
+	}
+	
+	return SUCCESS;
+}
+
+static int run_batch(async_fs_batch_op *op)
+{
+	int type;
+	int code;
+	
+	op->req.data = op;
+	
+	if (op->count == 0) {
+		return SUCCESS;
+	}
+	
+	type = op->type;
+	code = submit_batch(op);
+	
+	// Paths might have been modified even if the task has been cancelled.
+	if (type != ASYNC_FS_BATCH_STAT) {
+		php_clear_stat_cache(1, NULL, 0);
+	}
+	
+	return code;
+}
+
+static void stat_to_array(uv_stat_t *stat, zval *result)
+{
+	array_init_size(result, 13);
+	
+	add_assoc_long(result, "dev", (zend_long) stat->st_dev);
+	add_assoc_long(result, "ino", (zend_long) stat->st_ino);
+	add_assoc_long(result, "mode", (zend_long) stat->st_mode);
+	add_assoc_long(result, "nlink", (zend_long) stat->st_nlink);
+	add_assoc_long(result, "uid", (zend_long) stat->st_uid);
+	add_assoc_long(result, "gid", (zend_long) stat->st_gid);
+	add_assoc_long(result, "rdev", (zend_long) stat->st_rdev);
+	add_assoc_long(result, "size", (zend_long) stat->st_size);
+	add_assoc_long(result, "atime", (zend_long) stat->st_atim.tv_sec);
+	add_assoc_long(result, "mtime", (zend_long) stat->st_mtim.tv_sec);
+	add_assoc_long(result, "ctime", (zend_long) stat->st_ctim.tv_sec);
+	add_assoc_long(result, "blksize", (zend_long) stat->st_blksize);
+	add_assoc_long(result, "blocks", (zend_long) stat->st_blocks);
+}
+
+/* Results are keyed by path, failed operations are reported using an error message. */
+static void assemble_results(async_fs_batch_op *op, zval *return_value)
+{
+	async_fs_batch_entry *entry;
+	uint32_t i;
+	
+	zval tmp;
+	
+	array_init_size(return_value, op->count);
+	
+	for (i = 0; i < op->count; i++) {
+		entry = &op->entries[i];
+		
+		if (entry->result == ASYNC_FS_BATCH_DENIED) {
+			ZVAL_STRING(&tmp, "access denied or invalid path");
+		} else if (entry->result < 0) {
+			ZVAL_STRING(&tmp, uv_strerror(entry->result));
+		} else if (op->type == ASYNC_FS_BATCH_STAT) {
+			stat_to_array(&entry->stat, &tmp);
+		} else {
+			ZVAL_TRUE(&tmp);
+		}
+		
+		zend_symtable_update(Z_ARRVAL_P(return_value), entry->key, &tmp);
+	}
+}
+
+static void run_paths(INTERNAL_FUNCTION_PARAMETERS, int type, HashTable *paths, int mode, zend_bool recursive)
+{
+	async_fs_batch_op *op;
+	HashTable seen;
+	zval *entry;
+	
+	op = create_batch_op(type, zend_hash_num_elements(paths));
+	op->mode = mode;
+	op->recursive = recursive;
+	
+	zend_hash_init(&seen, zend_hash_num_elements(paths), NULL, NULL, 0);
+	
+	ZEND_HASH_FOREACH_VAL(paths, entry) {
+		if (Z_TYPE_P(entry) != IS_STRING) {
+			zend_hash_destroy(&seen);
+			free_batch_op(op);
+			
+			zend_throw_error(NULL, "Paths must be strings, %s given", zend_zval_type_name(entry));
+			
+			return;
+		}
+		
+		// Results are keyed by path, duplicates would overwrite the result of the first operation.
+		if (zend_hash_add_empty_element(&seen, Z_STR_P(entry)) != NULL) {
+			add_entry(op, Z_STR_P(entry), NULL);
+		}
+	} ZEND_HASH_FOREACH_END();
+	
+	zend_hash_destroy(&seen);
+	
+	if (run_batch(op) == FAILURE) {
+		return;
+	}
+	
+	assemble_results(op, return_value);
+	
+	free_batch_op(op);
+}
+
+ZEND_METHOD(Filesystem, stat)
+{
+	HashTable *paths;
+	
+	ZEND_PARSE_PARAMETERS_START_EX(ZEND_PARSE_PARAMS_THROW, 1, 1)
+		Z_PARAM_ARRAY_HT(paths)
+	ZEND_PARSE_PARAMETERS_END();
+	
+	run_paths(INTERNAL_FUNCTION_PARAM_PASSTHRU, ASYNC_FS_BATCH_STAT, paths, 0, 0);
+}
+
+ZEND_METHOD(Filesystem, unlink)
+{
+	HashTable *paths;
+	
+	ZEND_PARSE_PARAMETERS_START_EX(ZEND_PARSE_PARAMS_THROW, 1, 1)
+		Z_PARAM_ARRAY_HT(paths)
+	ZEND_PARSE_PARAMETERS_END();
+	
+	run_paths(INTERNAL_FUNCTION_PARAM_PASSTHRU, ASYNC_FS_BATCH_UNLINK, paths, 0, 0);
+}
+
+ZEND_METHOD(Filesystem, mkdir)
+{
+	HashTable *paths;
+	zend_long mode;
+	zend_bool recursive;
+	
+	mode = 0777;
+	recursive = 0;
+	
+	ZEND_PARSE_PARAMETERS_START_EX(ZEND_PARSE_PARAMS_THROW, 1, 3)
+		Z_PARAM_ARRAY_HT(paths)
+		Z_PARAM_OPTIONAL
+		Z_PARAM_LONG(mode)
+		Z_PARAM_BOOL(recursive)
+	ZEND_PARSE_PARAMETERS_END();
+	
+	run_paths(INTERNAL_FUNCTION_PARAM_PASSTHRU, ASYNC_FS_BATCH_MKDIR, paths, (int) mode, recursive);
+}
+
+ZEND_METHOD(Filesystem, rename)
+{
+	async_fs_batch_op *op;
+	HashTable *paths;
+	zend_string *from;
+	zend_string *key;
+	zend_ulong num;
+	zval *to;
+	
+	ZEND_PARSE_PARAMETERS_START_EX(ZEND_PARSE_PARAMS_THROW, 1, 1)
+		Z_PARAM_ARRAY_HT(paths)
+	ZEND_PARSE_PARAMETERS_END();
+	
+	op = create_batch_op(ASYNC_FS_BATCH_RENAME, zend_hash_num_elements(paths));
+	
+	ZEND_HASH_FOREACH_KEY_VAL(paths, num, from, to) {
+		if (Z_TYPE_P(to) != IS_STRING) {
+			free_batch_op(op);
+			
+			zend_throw_error(NULL, "Renames must be given as an array of source path => target path");
+			
+			return;
+		}
+		
+		// Numeric source paths are stored as integer keys.
+		key = (from == NULL) ? zend_long_to_str((zend_long) num) : zend_string_copy(from);
+		
+		add_entry(op, key, Z_STR_P(to));
+		
+		zend_string_release(key);
+	} ZEND_HASH_FOREACH_END();
+	
+	if (run_batch(op) == FAILURE) {
+		return;
+	}
+	
+	assemble_results(op, return_value);
+	
+	free_batch_op(op);
+}
+
+ZEND_METHOD(Filesystem, getIncludeStats)
+{
+	ZEND_PARSE_PARAMETERS_NONE();
+	
+	array_init(return_value);
+	
+	add_assoc_long(return_value, "async", ASYNC_G(fs_include_async));
+	add_assoc_long(return_value, "sync", ASYNC_G(fs_include_sync));
+	add_assoc_double(return_value, "sync_time", ((double) ASYNC_G(fs_include_sync_time)) / 1000000000.0);
+}
+
+ZEND_BEGIN_ARG_WITH_RETURN_TYPE_INFO_EX(arginfo_filesystem_stat, 0, 1, IS_ARRAY, 0)
+	ZEND_ARG_TYPE_INFO(0, paths, IS_ARRAY, 0)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_WITH_RETURN_TYPE_INFO_EX(arginfo_filesystem_unlink, 0, 1, IS_ARRAY, 0)
+	ZEND_ARG_TYPE_INFO(0, paths, IS_ARRAY, 0)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_WITH_RETURN_TYPE_INFO_EX(arginfo_filesystem_rename, 0, 1, IS_ARRAY, 0)
+	ZEND_ARG_TYPE_INFO(0, paths, IS_ARRAY, 0)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_WITH_RETURN_TYPE_INFO_EX(arginfo_filesystem_mkdir, 0, 1, IS_ARRAY, 0)
+	ZEND_ARG_TYPE_INFO(0, paths, IS_ARRAY, 0)
+	ZEND_ARG_TYPE_INFO(0, mode, IS_LONG, 0)
+	ZEND_ARG_TYPE_INFO(0, recursive, _IS_BOOL, 0)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_WITH_RETURN_TYPE_INFO_EX(arginfo_filesystem_get_include_stats, 0, 0, IS_ARRAY, 0)
+ZEND_END_ARG_INFO()
+
+static const zend_function_entry async_filesystem_functions[] = {
+	ZEND_ME(Filesystem, stat, arginfo_filesystem_stat, ZEND_ACC_PUBLIC | ZEND_ACC_STATIC)
+	ZEND_ME(Filesystem, unlink, arginfo_filesystem_unlink, ZEND_ACC_PUBLIC | ZEND_ACC_STATIC)
+	ZEND_ME(Filesystem, rename, arginfo_filesystem_rename, ZEND_ACC_PUBLIC | ZEND_ACC_STATIC)
+	ZEND_ME(Filesystem, mkdir, arginfo_filesystem_mkdir, ZEND_ACC_PUBLIC | ZEND_ACC_STATIC)
+	ZEND_ME(Filesystem, getIncludeStats, arginfo_filesystem_get_include_stats, ZEND_ACC_PUBLIC | ZEND_ACC_STATIC)
+	ZEND_FE_END
+};
+
+
+void async_filesystem_ce_register()
+{
+	zend_class_entry ce;
+	
+	INIT_CLASS_ENTRY(ce, "Concurrent\\Filesystem", async_filesystem_functions);
+	async_filesystem_ce = zend_register_internal_class(&ce);
+	async_filesystem_ce->ce_flags |= ZEND_ACC_FINAL;
+	async_filesystem_ce->serialize = zend_class_serialize_deny;
+	async_filesystem_ce->unserialize = zend_class_unserialize_deny;
+}
+
+
+/*
+ * vim: sw=4 ts=4
+ * vim600: fdm=marker
+ */
@@ -0,0 +1,630 @@
+/*
+  +----------------------------------------------------------------------+
+  | PHP Version 7                                                        |
+  +----------------------------------------------------------------------+
+  | Copyright (c) 1997-2018 The PHP Group                                |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 3.01 of the PHP license,      |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available through the world-wide-web at the following url:           |
+  | http://www.php.net/license/3_01.txt                                  |
+  | If you did not receive a copy of the PHP license and are unable to   |
+  | obtain it through the world-wide-web, please send a note to          |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+  | Authors: Martin Schröder <m.schroeder2007@gmail.com>                 |
+  +----------------------------------------------------------------------+
+*/
+
+#include "php_async.h"
+
+#include "async_task.h"
+
+#ifdef PHP_WIN32
+#include <io.h>
+#else
+#include <sys/mman.h>
+#endif
+
+zend_class_entry *async_mapped_file_ce;
+
+static zend_object_handlers async_mapped_file_handlers;
+
+#define ASYNC_MAPPED_FILE_CONST(const_name, value) \
+	zend_declare_class_constant_long(async_mapped_file_ce, const_name, sizeof(const_name)-1, (zend_long)value);
+
+#define ASYNC_MAPPED_FILE_ADVICE_NORMAL 0
+#define ASYNC_MAPPED_FILE_ADVICE_SEQUENTIAL 1
+#define ASYNC_MAPPED_FILE_ADVICE_RANDOM 2
+#define ASYNC_MAPPED_FILE_ADVICE_WILLNEED 3
+#define ASYNC_MAPPED_FILE_ADVICE_DONTNEED 4
+
+typedef struct {
+	/* PHP object handle. */
+	zend_object std;
+	
+	/* Start address of the mapping, NULL if the file is empty or has been closed. */
+	char *addr;
+	
+	/* Size of the mapped file. */
+	size_t size;
+	
+	/* Set if the mapping has been closed. */
+	zend_bool closed;
+
+#ifdef PHP_WIN32
+	/* File mapping object backing the view. */
+	HANDLE mapping;
+#endif
+} async_mapped_file;
+
+/*
+ * Mapping a file (and applying the initial advice) may block on disk IO, it is performed by a worker
+ * thread that also closes the file descriptor, the mapping stays valid after the file has been closed.
+ */
+typedef struct {
+	async_op base;
+	uv_work_t req;
+	
+	/* File to be mapped, set to -1 as soon as the descriptor has been closed. */
+	uv_file file;
+	
+	size_t size;
+	int advice;
+	
+	char *addr;
+
+#ifdef PHP_WIN32
+	HANDLE mapping;
+#endif
+
+	/* libuv error code of a failed mapping. */
+	int error;
+} async_mmap_op;
+
+static int map_advice(int advice)
+{
+#ifdef PHP_WIN32
+	return 0;
+#else
+	switch (advice) {
+	case ASYNC_MAPPED_FILE_ADVICE_SEQUENTIAL:
+		return MADV_SEQUENTIAL;
+	case ASYNC_MAPPED_FILE_ADVICE_RANDOM:
+		return MADV_RANDOM;
+	case ASYNC_MAPPED_FILE_ADVICE_WILLNEED:
+		return MADV_WILLNEED;
+	case ASYNC_MAPPED_FILE_ADVICE_DONTNEED:
+		return MADV_DONTNEED;
+	}
+	
+	return MADV_NORMAL;
+#endif
+}
+
+/* Applies an advice to a range of the mapping, the start of the range is aligned to the page size. */
+static int apply_advice(char *addr, size_t offset, size_t length, int advice)
+{
+#ifdef PHP_WIN32
+	return 0;
+#else
+	size_t page;
+	size_t delta;
+	
+	if (addr == NULL || length == 0) {
+		return 0;
+	}
+	
+	page = (size_t) sysconf(_SC_PAGESIZE);
+	delta = offset % page;
+	
+	if (madvise(addr + offset - delta, length + delta, map_advice(advice)) != 0) {
+		return uv_translate_sys_error(errno);
+	}
+	
+	return 0;
+#endif
+}
+
+static void unmap_file(char *addr, size_t size)
+{
+	if (addr == NULL) {
+		return;
+	}
+
+#ifdef PHP_WIN32
+	UnmapViewOfFile(addr);
+#else
+	munmap(addr, size);
+#endif
+}
+
+static void close_file(uv_file file)
+{
+#ifdef PHP_WIN32
+	_close(file);
+#else
+	close(file);
+#endif
+}
+
+static void mmap_work_cb(uv_work_t *req)
+{
+	async_mmap_op *op;
+	
+	op = (async_mmap_op *) req->data;
+	
+	ZEND_ASSERT(op != NULL);
+	
+	if (op->size > 0) {
+#ifdef PHP_WIN32
+		op->mapping = CreateFileMapping((HANDLE) uv_get_osfhandle(op->file), NULL, PAGE_READONLY, 0, 0, NULL);
+		
+		if (op->mapping == NULL) {
+			op->error = uv_translate_sys_error(GetLastError());
+		} else {
+			op->addr = MapViewOfFile(op->mapping, FILE_MAP_READ, 0, 0, op->size);
+			
+			if (op->addr == NULL) {
+				op->error = uv_translate_sys_error(GetLastError());
+				
+				CloseHandle(op->mapping);
+				op->mapping = NULL;
+			}
+		}
+#else
+		op->addr = mmap(NULL, op->size, PROT_READ, MAP_SHARED, op->file, 0);
+		
+		if (op->addr == MAP_FAILED) {
+			op->error = uv_translate_sys_error(errno);
+			op->addr = NULL;
+		} else if (op->advice != ASYNC_MAPPED_FILE_ADVICE_NORMAL) {
+			apply_advice(op->addr, 0, op->size, op->advice);
+		}
+#endif
+	}
+	
+	close_file(op->file);
+	op->file = -1;
+}
+
+static void free_mmap_op(async_mmap_op *op)
+{
+	if (op->file >= 0) {
+		close_file(op->file);
+	}
+	
+	unmap_file(op->addr, op->size);
+
+#ifdef PHP_WIN32
+	if (op->mapping != NULL) {
+		CloseHandle(op->mapping);
+	}
+#endif
+
+	ASYNC_FREE_OP(op);
+}
+
+static void mmap_after_work_cb(uv_work_t *req, int status)
+{
+	async_mmap_op *op;
+	
+	op = (async_mmap_op *) req->data;
+	
+	ZEND_ASSERT(op != NULL);
+	
+	async_thread_pool_release(ASYNC_THREAD_POOL_FS);
+	
+	// The awaiting task has been cancelled, the mapping is not needed anymore.
+	if (op->base.status == ASYNC_STATUS_FAILED) {
+		free_mmap_op(op);
+	} else {
+		ASYNC_FINISH_OP(op);
+	}
+}
+
+/* Maps the file in the thread pool, the file descriptor is closed in any case. */
+static async_mmap_op *map_file(uv_file file, size_t size, int advice)
+{
+	async_mmap_op *op;
+	int code;
+	
+	ASYNC_ALLOC_CUSTOM_OP(op, sizeof(async_mmap_op));
+	
+	op->file = file;
+	op->size = size;
+	op->advice = advice;
+	op->req.data = op;
+	
+	if (async_thread_pool_acquire(ASYNC_THREAD_POOL_FS) == FAILURE) {
+		free_mmap_op(op);
+		
+		return NULL;
+	}
+	
+	code = uv_queue_work(&async_task_scheduler_get()->loop, &op->req, mmap_work_cb, mmap_after_work_cb);
+	
+	if (UNEXPECTED(code < 0)) {
+		async_thread_pool_release(ASYNC_THREAD_POOL_FS);
+		free_mmap_op(op);
+		
+		zend_throw_error(NULL, "Failed to queue work: %s", uv_strerror(code));
+		
+		return NULL;
+	}
+	
+	if (async_await_op((async_op *) op) == FAILURE) {
+		ASYNC_FORWARD_OP_ERROR(op);
+		
+		op->base.status = ASYNC_STATUS_FAILED;
+		
+		uv_cancel((uv_req_t *) &op->req);
+		
+		return NULL;
+	}
+	
+	return op;
+}
+
+static int check_advice(zend_long advice)
+{
+	switch (advice) {
+	case ASYNC_MAPPED_FILE_ADVICE_NORMAL:
+	case ASYNC_MAPPED_FILE_ADVICE_SEQUENTIAL:
+	case ASYNC_MAPPED_FILE_ADVICE_RANDOM:
+	case ASYNC_MAPPED_FILE_ADVICE_WILLNEED:
+	case ASYNC_MAPPED_FILE_ADVICE_DONTNEED:
+		return SUCCESS;
+	}
+	
+	zend_throw_error(NULL, "Unsupported advice: %d", (int) advice);
+	
+	return FAILURE;
+}
+
+/* Validates a range and replaces a NULL length with the number of bytes until the end of the file. */
+static int check_range(async_mapped_file *file, zend_long offset, zval *len, size_t *length)
+{
+	zend_long num;
+	
+	if (UNEXPECTED(file->closed)) {
+		zend_throw_error(NULL, "Cannot access a closed mapped file");
+		
+		return FAILURE;
+	}
+	
+	if (UNEXPECTED(offset < 0 || (size_t) offset > file->size)) {
+		zend_throw_error(NULL, "Offset %d is out of range", (int) offset);
+		
+		return FAILURE;
+	}
+	
+	if (len == NULL || Z_TYPE_P(len) == IS_NULL) {
+		*length = file->size - (size_t) offset;
+		
+		return SUCCESS;
+	}
+	
+	num = zval_get_long(len);
+	
+	if (UNEXPECTED(num < 0)) {
+		zend_throw_error(NULL, "Length must not be negative");
+		
+		return FAILURE;
+	}
+	
+	*length = MIN((size_t) num, file->size - (size_t) offset);
+	
+	return SUCCESS;
+}
+
+static void close_mapping(async_mapped_file *file)
+{
+	unmap_file(file->addr, file->size);
+
+#ifdef PHP_WIN32
+	if (file->mapping != NULL) {
+		CloseHandle(file->mapping);
+		file->mapping = NULL;
+	}
+#endif
+
+	file->addr = NULL;
+	file->closed = 1;
+}
+
+static void async_mapped_file_object_destroy(zend_object *object)
+{
+	async_mapped_file *file;
+	
+	file = (async_mapped_file *) object;
+	
+	close_mapping(file);
+	
+	zend_object_std_dtor(&file->std);
+}
+
+ZEND_METHOD(MappedFile, __construct)
+{
+	ZEND_PARSE_PARAMETERS_NONE();
+	
+	zend_throw_error(NULL, "Mapped files must be created using MappedFile::open()");
+}
+
+ZEND_METHOD(MappedFile, open)
+{
+	async_mapped_file *file;
+	async_mmap_op *op;
+	zend_string *path;
+	zend_long advice;
+	
+	uv_stat_t stat;
+	uv_file fd;
+	int code;
+	
+	advice = ASYNC_MAPPED_FILE_ADVICE_NORMAL;
+	
+	ZEND_PARSE_PARAMETERS_START_EX(ZEND_PARSE_PARAMS_THROW, 1, 2)
+		Z_PARAM_PATH_STR(path)
+		Z_PARAM_OPTIONAL
+		Z_PARAM_LONG(advice)
+	ZEND_PARSE_PARAMETERS_END();
+	
+	if (check_advice(advice) == FAILURE) {
+		return;
+	}
+	
+	code = async_filesystem_open(ZSTR_VAL(path), UV_FS_O_RDONLY, 0);
+	
+	if (code < 0) {
+		ASYNC_CHECK_ERROR(EG(exception) == NULL, "Failed to open file %s: %s", ZSTR_VAL(path), uv_strerror(code));
+		
+		return;
+	}
+	
+	fd = (uv_file) code;
+	code = async_filesystem_fstat(fd, &stat);
+	
+	if (code < 0 || (stat.st_mode & S_IFMT) != S_IFREG || stat.st_size > SIZE_MAX) {
+		async_filesystem_close(fd);
+		
+		if (EG(exception) == NULL) {
+			if (code < 0) {
+				zend_throw_error(NULL, "Failed to stat file %s: %s", ZSTR_VAL(path), uv_strerror(code));
+			} else {
+				zend_throw_error(NULL, "Cannot map %s, only regular files can be mapped", ZSTR_VAL(path));
+			}
+		}
+		
+		return;
+	}
+	
+	op = map_file(fd, (size_t) stat.st_size, (int) advice);
+	
+	if (op == NULL) {
+		return;
+	}
+	
+	if (op->error < 0) {
+		zend_throw_error(NULL, "Failed to map file %s: %s", ZSTR_VAL(path), uv_strerror(op->error));
+		
+		free_mmap_op(op);
+		
+		return;
+	}
+	
+	file = emalloc(sizeof(async_mapped_file));
+	ZEND_SECURE_ZERO(file, sizeof(async_mapped_file));
+	
+	zend_object_std_init(&file->std, async_mapped_file_ce);
+	file->std.handlers = &async_mapped_file_handlers;
+	
+	// Ownership of the mapping is transferred to the object.
+	file->addr = op->addr;
+	file->size = op->size;
+	
+	op->addr = NULL;
+
+#ifdef PHP_WIN32
+	file->mapping = op->mapping;
+	op->mapping = NULL;
+#endif
+
+	free_mmap_op(op);
+	
+	RETURN_OBJ(&file->std);
+}
+
+ZEND_METHOD(MappedFile, getSize)
+{
+	async_mapped_file *file;
+	
+	ZEND_PARSE_PARAMETERS_NONE();
+	
+	file = (async_mapped_file *) Z_OBJ_P(getThis());
+	
+	RETURN_LONG((zend_long) file->size);
+}
+
+ZEND_METHOD(MappedFile, read)
+{
+	async_mapped_file *file;
+	zend_long offset;
+	zval *len;
+	
+	size_t length;
+	
+	len = NULL;
+	
+	ZEND_PARSE_PARAMETERS_START_EX(ZEND_PARSE_PARAMS_THROW, 1, 2)
+		Z_PARAM_LONG(offset)
+		Z_PARAM_OPTIONAL
+		Z_PARAM_ZVAL(len)
+	ZEND_PARSE_PARAMETERS_END();
+	
+	file = (async_mapped_file *) Z_OBJ_P(getThis());
+	
+	if (check_range(file, offset, len, &length) == FAILURE) {
+		return;
+	}
+	
+	if (length == 0) {
+		RETURN_EMPTY_STRING();
+	}
+	
+	// Only the requested range is copied into PHP memory.
+	RETURN_STRINGL(file->addr + offset, length);
+}
+
+ZEND_METHOD(MappedFile, find)
+{
+	async_mapped_file *file;
+	zend_string *needle;
+	zend_long offset;
+	zval *len;
+	
+	const char *pos;
+	size_t length;
+	
+	offset = 0;
+	len = NULL;
+	
+	ZEND_PARSE_PARAMETERS_START_EX(ZEND_PARSE_PARAMS_THROW, 1, 3)
+		Z_PARAM_STR(needle)
+		Z_PARAM_OPTIONAL
+		Z_PARAM_LONG(offset)
+		Z_PARAM_ZVAL(len)
+	ZEND_PARSE_PARAMETERS_END();
+	
+	file = (async_mapped_file *) Z_OBJ_P(getThis());
+	
+	if (check_range(file, offset, len, &length) == FAILURE) {
+		return;
+	}
+	
+	ASYNC_CHECK_ERROR(ZSTR_LEN(needle) == 0, "Needle must not be empty");
+	
+	if (length < ZSTR_LEN(needle)) {
+		RETURN_NULL();
+	}
+	
+	pos = zend_memnstr(file->addr + offset, ZSTR_VAL(needle), ZSTR_LEN(needle), file->addr + offset + length);
+	
+	if (pos == NULL) {
+		RETURN_NULL();
+	}
+	
+	RETURN_LONG((zend_long) (pos - file->addr));
+}
+
+ZEND_METHOD(MappedFile, advise)
+{
+	async_mapped_file *file;
+	zend_long advice;
+	zend_long offset;
+	zval *len;
+	
+	size_t length;
+	int code;
+	
+	offset = 0;
+	len = NULL;
+	
+	ZEND_PARSE_PARAMETERS_START_EX(ZEND_PARSE_PARAMS_THROW, 1, 3)
+		Z_PARAM_LONG(advice)
+		Z_PARAM_OPTIONAL
+		Z_PARAM_LONG(offset)
+		Z_PARAM_ZVAL(len)
+	ZEND_PARSE_PARAMETERS_END();
+	
+	file = (async_mapped_file *) Z_OBJ_P(getThis());
+	
+	if (check_advice(advice) == FAILURE || check_range(file, offset, len, &length) == FAILURE) {
+		return;
+	}
+	
+	code = apply_advice(file->addr, (size_t) offset, length, (int) advice);
+	
+	ASYNC_CHECK_ERROR(code < 0, "Failed to apply advice: %s", uv_strerror(code));
+}
+
+ZEND_METHOD(MappedFile, close)
+{
+	async_mapped_file *file;
+	
+	ZEND_PARSE_PARAMETERS_NONE();
+	
+	file = (async_mapped_file *) Z_OBJ_P(getThis());
+	
+	close_mapping(file);
+}
+
+ZEND_BEGIN_ARG_INFO(arginfo_mapped_file_ctor, 0)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_WITH_RETURN_OBJ_INFO_EX(arginfo_mapped_file_open, 0, 1, Concurrent\\MappedFile, 0)
+	ZEND_ARG_TYPE_INFO(0, path, IS_STRING, 0)
+	ZEND_ARG_TYPE_INFO(0, advice, IS_LONG, 0)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_WITH_RETURN_TYPE_INFO_EX(arginfo_mapped_file_get_size, 0, 0, IS_LONG, 0)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_WITH_RETURN_TYPE_INFO_EX(arginfo_mapped_file_read, 0, 1, IS_STRING, 0)
+	ZEND_ARG_TYPE_INFO(0, offset, IS_LONG, 0)
+	ZEND_ARG_TYPE_INFO(0, length, IS_LONG, 1)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_WITH_RETURN_TYPE_INFO_EX(arginfo_mapped_file_find, 0, 1, IS_LONG, 1)
+	ZEND_ARG_TYPE_INFO(0, needle, IS_STRING, 0)
+	ZEND_ARG_TYPE_INFO(0, offset, IS_LONG, 0)
+	ZEND_ARG_TYPE_INFO(0, length, IS_LONG, 1)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_WITH_RETURN_TYPE_INFO_EX(arginfo_mapped_file_advise, 0, 1, IS_VOID, 0)
+	ZEND_ARG_TYPE_INFO(0, advice, IS_LONG, 0)
+	ZEND_ARG_TYPE_INFO(0, offset, IS_LONG, 0)
+	ZEND_ARG_TYPE_INFO(0, length, IS_LONG, 1)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_WITH_RETURN_TYPE_INFO_EX(arginfo_mapped_file_close, 0, 0, IS_VOID, 0)
+ZEND_END_ARG_INFO()
+
+static const zend_function_entry async_mapped_file_functions[] = {
+	ZEND_ME(MappedFile, __construct, arginfo_mapped_file_ctor, ZEND_ACC_PRIVATE)
+	ZEND_ME(MappedFile, open, arginfo_mapped_file_open, ZEND_ACC_PUBLIC | ZEND_ACC_STATIC)
+	ZEND_ME(MappedFile, getSize, arginfo_mapped_file_get_size, ZEND_ACC_PUBLIC)
+	ZEND_ME(MappedFile, read, arginfo_mapped_file_read, ZEND_ACC_PUBLIC)
+	ZEND_ME(MappedFile, find, arginfo_mapped_file_find, ZEND_ACC_PUBLIC)
+	ZEND_ME(MappedFile, advise, arginfo_mapped_file_advise, ZEND_ACC_PUBLIC)
+	ZEND_ME(MappedFile, close, arginfo_mapped_file_close, ZEND_ACC_PUBLIC)
+	ZEND_FE_END
+};
+
+
+void async_mapped_file_ce_register()
+{
+	zend_class_entry ce;
+	
+	INIT_CLASS_ENTRY(ce, "Concurrent\\MappedFile", async_mapped_file_functions);
+	async_mapped_file_ce = zend_register_internal_class(&ce);
+	async_mapped_file_ce->ce_flags |= ZEND_ACC_FINAL;
+	async_mapped_file_ce->serialize = zend_class_serialize_deny;
+	async_mapped_file_ce->unserialize = zend_class_unserialize_deny;
+	
+	memcpy(&async_mapped_file_handlers, &std_object_handlers, sizeof(zend_object_handlers));
+	async_mapped_file_handlers.free_obj = async_mapped_file_object_destroy;
+	async_mapped_file_handlers.clone_obj = NULL;
+	
+	ASYNC_MAPPED_FILE_CONST("ADVICE_NORMAL", ASYNC_MAPPED_FILE_ADVICE_NORMAL);
+	ASYNC_MAPPED_FILE_CONST("ADVICE_SEQUENTIAL", ASYNC_MAPPED_FILE_ADVICE_SEQUENTIAL);
+	ASYNC_MAPPED_FILE_CONST("ADVICE_RANDOM", ASYNC_MAPPED_FILE_ADVICE_RANDOM);
+	ASYNC_MAPPED_FILE_CONST("ADVICE_WILLNEED", ASYNC_MAPPED_FILE_ADVICE_WILLNEED);
+	ASYNC_MAPPED_FILE_CONST("ADVICE_DONTNEED", ASYNC_MAPPED_FILE_ADVICE_DONTNEED);
+}
+
+
+/*
+ * vim: sw=4 ts=4
+ * vim600: fdm=marker
+ */
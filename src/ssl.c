@@ -19,6 +19,8 @@
 #include "php_async.h"
 #include "async_ssl.h"
 
+#include "zend_smart_str.h"
+
 zend_class_entry *async_tls_client_encryption_ce;
 zend_class_entry *async_tls_server_encryption_ce;
 
@@ -37,6 +39,15 @@ static zend_object_handlers async_tls_server_encryption_handlers;
 #undef X509_EXTENSIONS
 #endif
 
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+#include <openssl/core_names.h>
+#else
+#include <openssl/hmac.h>
+#endif
+
 #define ASYNC_SSL_RETURN_VERIFY_ERROR(ctx) do { \
 	X509_STORE_CTX_set_error(ctx, X509_V_ERR_APPLICATION_VERIFICATION); \
 	return 0; \
@@ -86,9 +97,9 @@ static int ssl_servername_cb(SSL *ssl, int *ad, void *arg)
 {
 	async_tls_cert_queue *q;
 	async_tls_cert *cert;
-	zend_string *key;
 
 	const char *name;
+	size_t len;
 
 	if (ssl == NULL) {
 		return SSL_TLSEXT_ERR_NOACK;
@@ -101,12 +112,13 @@ static int ssl_servername_cb(SSL *ssl, int *ad, void *arg)
 	}
 
 	q = (async_tls_cert_queue *) arg;
-	key = zend_string_init(name, strlen(name), 0);
+	len = strlen(name);
 
 	cert = q->first;
 
+	// Must not allocate memory, the callback is invoked by a worker thread if handshakes are offloaded.
 	while (cert != NULL) {
-		if (zend_string_equals(key, cert->host)) {
+		if (len == ZSTR_LEN(cert->host) && memcmp(name, ZSTR_VAL(cert->host), len) == 0) {
 			SSL_set_SSL_CTX(ssl, cert->ctx);
 			break;
 		}
@@ -114,10 +126,28 @@ static int ssl_servername_cb(SSL *ssl, int *ad, void *arg)
 		cert = cert->next;
 	}
 
-	zend_string_release(key);
+	return SSL_TLSEXT_ERR_OK;
+}
+
+#ifdef ASYNC_TLS_ALPN
+static int ssl_alpn_select_cb(SSL *ssl, const unsigned char **out, unsigned char *outlen, const unsigned char *in, unsigned int inlen, void *arg)
+{
+	async_ssl_settings *settings;
+
+	settings = (async_ssl_settings *) SSL_get_ex_data(ssl, async_index);
+
+	if (settings == NULL || settings->alpn == NULL) {
+		return SSL_TLSEXT_ERR_NOACK;
+	}
+
+	// Server preference, selects the first protocol of the server list that is supported by the client.
+	if (OPENSSL_NPN_NEGOTIATED != SSL_select_next_proto((unsigned char **) out, outlen, (const unsigned char *) ZSTR_VAL(settings->alpn), (unsigned int) ZSTR_LEN(settings->alpn), in, inlen)) {
+		return SSL_TLSEXT_ERR_NOACK;
+	}
 
 	return SSL_TLSEXT_ERR_OK;
 }
+#endif
 
 static zend_bool async_ssl_match_hostname(const char *subjectname, const char *certname)
 {
@@ -287,6 +317,15 @@ SSL_CTX *async_ssl_create_context()
 
 	SSL_CTX_set_default_passwd_cb(ctx, ssl_cert_passphrase_cb);
 
+	// Sessions are only cached if session resumption is enabled.
+	SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_OFF);
+	SSL_CTX_set_session_id_context(ctx, (const unsigned char *) "async", sizeof("async") - 1);
+
+#ifdef ASYNC_TLS_ALPN
+	// Needs to be registered with every context because SNI may switch to a different context.
+	SSL_CTX_set_alpn_select_cb(ctx, ssl_alpn_select_cb, NULL);
+#endif
+
 	return ctx;
 }
 
@@ -531,6 +570,12 @@ void async_ssl_setup_verify_callback(SSL_CTX *ctx, async_ssl_settings *settings)
 
 int async_ssl_setup_encryption(SSL *ssl, async_ssl_settings *settings)
 {
+#ifdef ASYNC_TLS_ALPN
+	if (settings->mode == ASYNC_SSL_MODE_CLIENT && settings->alpn != NULL) {
+		SSL_set_alpn_protos(ssl, (const unsigned char *) ZSTR_VAL(settings->alpn), (unsigned int) ZSTR_LEN(settings->alpn));
+	}
+#endif
+
 	return SSL_set_ex_data(ssl, async_index, settings);
 }
 
@@ -540,7 +585,311 @@ void async_ssl_setup_sni(SSL_CTX *ctx, async_tls_server_encryption *encryption)
 	SSL_CTX_set_tlsext_servername_arg(ctx, &encryption->certs);
 }
 
+static void rotate_ticket_keys(async_ssl_session_cache *cache, int lifetime)
+{
+	time_t now;
+
+	now = time(NULL);
+
+	uv_mutex_lock(&cache->lock);
+
+	if ((now - cache->rotated) >= lifetime) {
+		// Keep the previous key to accept tickets that have been issued shortly before rotation.
+		if ((now - cache->rotated) < (2 * (time_t) lifetime)) {
+			memcpy(&cache->keys[1], &cache->keys[0], sizeof(async_ssl_ticket_key));
+		} else {
+			RAND_bytes((unsigned char *) &cache->keys[1], sizeof(async_ssl_ticket_key));
+		}
+
+		RAND_bytes((unsigned char *) &cache->keys[0], sizeof(async_ssl_ticket_key));
+
+		cache->rotated = now;
+	}
+
+	uv_mutex_unlock(&cache->lock);
+}
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+static int init_ticket_hmac(EVP_MAC_CTX *hctx, async_ssl_ticket_key *key)
+{
+	OSSL_PARAM params[3];
+
+	params[0] = OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY, key->hmac, sizeof(key->hmac));
+	params[1] = OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, "sha256", 0);
+	params[2] = OSSL_PARAM_construct_end();
+
+	return EVP_MAC_CTX_set_params(hctx, params);
+}
+
+static int ssl_ticket_key_cb(SSL *ssl, unsigned char *name, unsigned char *iv, EVP_CIPHER_CTX *ectx, EVP_MAC_CTX *hctx, int enc)
+#else
+static int init_ticket_hmac(HMAC_CTX *hctx, async_ssl_ticket_key *key)
+{
+	return HMAC_Init_ex(hctx, key->hmac, sizeof(key->hmac), EVP_sha256(), NULL);
+}
+
+static int ssl_ticket_key_cb(SSL *ssl, unsigned char *name, unsigned char *iv, EVP_CIPHER_CTX *ectx, HMAC_CTX *hctx, int enc)
 #endif
+{
+	async_ssl_settings *settings;
+	async_ssl_ticket_key key;
+
+	int result;
+	int i;
+
+	settings = (async_ssl_settings *) SSL_get_ex_data(ssl, async_index);
+
+	if (settings == NULL || settings->sessions == NULL || settings->ticket_lifetime < 1) {
+		return 0;
+	}
+
+	// Offloaded handshakes run in worker threads, keys are rotated by the event loop thread in this case.
+	if (!settings->offload) {
+		rotate_ticket_keys(settings->sessions, settings->ticket_lifetime);
+	}
+
+	// Work on a copy of the key, name and key material must not change due to a concurrent rotation.
+	uv_mutex_lock(&settings->sessions->lock);
+
+	for (i = 0; i < 2; i++) {
+		if (enc || memcmp(name, settings->sessions->keys[i].name, sizeof(settings->sessions->keys[i].name)) == 0) {
+			memcpy(&key, &settings->sessions->keys[i], sizeof(async_ssl_ticket_key));
+			break;
+		}
+	}
+
+	uv_mutex_unlock(&settings->sessions->lock);
+
+	if (i == 2) {
+		return 0;
+	}
+
+	if (enc) {
+		if (RAND_bytes(iv, EVP_CIPHER_iv_length(EVP_aes_256_cbc())) != 1) {
+			result = -1;
+		} else {
+			memcpy(name, key.name, sizeof(key.name));
+
+			result = EVP_EncryptInit_ex(ectx, EVP_aes_256_cbc(), NULL, key.aes, iv) ? 1 : -1;
+		}
+	} else {
+		// Issue a new ticket if the client presented a ticket encrypted with the previous key.
+		result = EVP_DecryptInit_ex(ectx, EVP_aes_256_cbc(), NULL, key.aes, iv) ? ((i == 0) ? 1 : 2) : -1;
+	}
+
+	if (result > 0 && !init_ticket_hmac(hctx, &key)) {
+		result = -1;
+	}
+
+	ZEND_SECURE_ZERO(&key, sizeof(async_ssl_ticket_key));
+
+	return result;
+}
+
+static int ssl_new_session_cb(SSL *ssl, SSL_SESSION *session)
+{
+	async_ssl_settings *settings;
+	HashTable *sessions;
+	HashPosition pos;
+
+	zend_string *key;
+	zend_ulong index;
+
+	settings = (async_ssl_settings *) SSL_get_ex_data(ssl, async_index);
+
+	if (settings == NULL || settings->sessions == NULL || settings->session_key == NULL) {
+		return 0;
+	}
+
+	sessions = &settings->sessions->sessions;
+
+	if (zend_hash_num_elements(sessions) >= ASYNC_SSL_MAX_CLIENT_SESSIONS && !zend_hash_exists(sessions, settings->session_key)) {
+		zend_hash_internal_pointer_reset_ex(sessions, &pos);
+
+		if (HASH_KEY_IS_STRING == zend_hash_get_current_key_ex(sessions, &key, &index, &pos)) {
+			key = zend_string_copy(key);
+			zend_hash_del(sessions, key);
+			zend_string_release(key);
+		}
+	}
+
+	zend_hash_update_ptr(sessions, settings->session_key, session);
+
+	return 1;
+}
+
+void async_ssl_setup_server_sessions(SSL_CTX *ctx, async_ssl_settings *settings)
+{
+	if (settings->sessions == NULL) {
+#ifdef TLS1_3_VERSION
+		SSL_CTX_set_num_tickets(ctx, 0);
+#endif
+		return;
+	}
+
+	if (settings->cache_size > 0) {
+		SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+		SSL_CTX_sess_set_cache_size(ctx, settings->cache_size);
+		SSL_CTX_set_timeout(ctx, settings->cache_timeout);
+	}
+
+	if (settings->ticket_lifetime > 0) {
+		SSL_CTX_clear_options(ctx, SSL_OP_NO_TICKET);
+
+		if (settings->cache_size < 1) {
+			SSL_CTX_set_timeout(ctx, settings->ticket_lifetime);
+		}
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+		SSL_CTX_set_tlsext_ticket_key_evp_cb(ctx, ssl_ticket_key_cb);
+#else
+		SSL_CTX_set_tlsext_ticket_key_cb(ctx, ssl_ticket_key_cb);
+#endif
+	}
+}
+
+void async_ssl_setup_client_session(SSL_CTX *ctx, SSL *ssl, async_ssl_settings *settings)
+{
+	SSL_SESSION *session;
+
+	if (settings->sessions == NULL || settings->session_key == NULL) {
+		return;
+	}
+
+	SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+	SSL_CTX_sess_set_new_cb(ctx, ssl_new_session_cb);
+
+	SSL_clear_options(ssl, SSL_OP_NO_TICKET);
+
+	session = (SSL_SESSION *) zend_hash_find_ptr(&settings->sessions->sessions, settings->session_key);
+
+	if (session != NULL) {
+		SSL_set_session(ssl, session);
+	}
+}
+
+void async_ssl_update_session_stats(SSL *ssl, async_ssl_settings *settings)
+{
+	if (settings == NULL || settings->sessions == NULL) {
+		return;
+	}
+
+	if (SSL_session_reused(ssl)) {
+		settings->sessions->resumed++;
+	} else {
+		settings->sessions->full++;
+	}
+}
+
+void async_ssl_rotate_ticket_keys(async_ssl_settings *settings)
+{
+	if (settings->sessions != NULL && settings->ticket_lifetime > 0) {
+		rotate_ticket_keys(settings->sessions, settings->ticket_lifetime);
+	}
+}
+
+static void session_cache_dtor(zval *data)
+{
+	SSL_SESSION_free((SSL_SESSION *) Z_PTR_P(data));
+}
+
+#endif
+
+static async_ssl_session_cache *create_session_cache()
+{
+	async_ssl_session_cache *cache;
+
+	cache = emalloc(sizeof(async_ssl_session_cache));
+	ZEND_SECURE_ZERO(cache, sizeof(async_ssl_session_cache));
+
+	cache->refcount = 1;
+	cache->rotated = time(NULL);
+
+	uv_mutex_init(&cache->lock);
+
+#ifdef HAVE_ASYNC_SSL
+	zend_hash_init(&cache->sessions, 0, NULL, session_cache_dtor, 0);
+
+	RAND_bytes((unsigned char *) cache->keys, sizeof(cache->keys));
+#else
+	zend_hash_init(&cache->sessions, 0, NULL, NULL, 0);
+#endif
+
+	return cache;
+}
+
+static void release_session_cache(async_ssl_session_cache *cache)
+{
+	if (--cache->refcount > 0) {
+		return;
+	}
+
+	zend_hash_destroy(&cache->sessions);
+
+	uv_mutex_destroy(&cache->lock);
+
+	ZEND_SECURE_ZERO(cache->keys, sizeof(cache->keys));
+
+	efree(cache);
+}
+
+static zend_string *encode_alpn_protocols(HashTable *protocols)
+{
+	smart_str str = {0};
+	zval *entry;
+
+	ZEND_HASH_FOREACH_VAL(protocols, entry) {
+		if (Z_TYPE_P(entry) != IS_STRING) {
+			smart_str_free(&str);
+			zend_throw_error(zend_ce_type_error, "ALPN protocol must be a string, %s given", zend_zval_type_name(entry));
+			return NULL;
+		}
+
+		if (Z_STRLEN_P(entry) < 1 || Z_STRLEN_P(entry) > 255) {
+			smart_str_free(&str);
+			zend_throw_error(NULL, "ALPN protocol name must be between 1 and 255 bytes long");
+			return NULL;
+		}
+
+		smart_str_appendc(&str, (unsigned char) Z_STRLEN_P(entry));
+		smart_str_append(&str, Z_STR_P(entry));
+	} ZEND_HASH_FOREACH_END();
+
+	smart_str_0(&str);
+
+	return str.s;
+}
+
+static void copy_settings(async_ssl_settings *dest, async_ssl_settings *src)
+{
+	dest->cache_size = src->cache_size;
+	dest->cache_timeout = src->cache_timeout;
+	dest->ticket_lifetime = src->ticket_lifetime;
+	dest->ktls = src->ktls;
+	dest->offload = src->offload;
+
+	if (src->alpn != NULL) {
+		dest->alpn = zend_string_copy(src->alpn);
+	}
+
+	if (src->sessions != NULL) {
+		dest->sessions = src->sessions;
+		dest->sessions->refcount++;
+	}
+}
+
+static void get_session_stats(async_ssl_settings *settings, zval *return_value)
+{
+	array_init(return_value);
+
+	if (settings->sessions == NULL) {
+		add_assoc_long(return_value, "full", 0);
+		add_assoc_long(return_value, "resumed", 0);
+	} else {
+		add_assoc_long(return_value, "full", (zend_long) settings->sessions->full);
+		add_assoc_long(return_value, "resumed", (zend_long) settings->sessions->resumed);
+	}
+}
 
 
 static zend_object *async_tls_client_encryption_object_create(zend_class_entry *ce)
@@ -570,6 +919,8 @@ async_tls_client_encryption *async_clone_client_encryption(async_tls_client_encr
 		result->settings.peer_name = zend_string_copy(encryption->settings.peer_name);
 	}
 
+	copy_settings(&result->settings, &encryption->settings);
+
 	return result;
 }
 
@@ -583,6 +934,18 @@ static void async_tls_client_encryption_object_destroy(zend_object *object)
 		zend_string_release(encryption->settings.peer_name);
 	}
 
+	if (encryption->settings.session_key != NULL) {
+		zend_string_release(encryption->settings.session_key);
+	}
+
+	if (encryption->settings.alpn != NULL) {
+		zend_string_release(encryption->settings.alpn);
+	}
+
+	if (encryption->settings.sessions != NULL) {
+		release_session_cache(encryption->settings.sessions);
+	}
+
 	zend_object_std_dtor(&encryption->std);
 }
 
@@ -645,6 +1008,88 @@ ZEND_METHOD(TlsClientEncryption, withPeerName)
 	RETURN_ZVAL(&obj, 1, 1);
 }
 
+ZEND_METHOD(TlsClientEncryption, withSessionReuse)
+{
+	async_tls_client_encryption *encryption;
+
+	zend_bool reuse;
+	zval obj;
+
+	ZEND_PARSE_PARAMETERS_START_EX(ZEND_PARSE_PARAMS_THROW, 1, 1)
+		Z_PARAM_BOOL(reuse)
+	ZEND_PARSE_PARAMETERS_END();
+
+	encryption = async_clone_client_encryption((async_tls_client_encryption *) Z_OBJ_P(getThis()));
+
+	if (reuse && encryption->settings.sessions == NULL) {
+		encryption->settings.sessions = create_session_cache();
+	} else if (!reuse && encryption->settings.sessions != NULL) {
+		release_session_cache(encryption->settings.sessions);
+		encryption->settings.sessions = NULL;
+	}
+
+	ZVAL_OBJ(&obj, &encryption->std);
+
+	RETURN_ZVAL(&obj, 1, 1);
+}
+
+ZEND_METHOD(TlsClientEncryption, withKernelTls)
+{
+	async_tls_client_encryption *encryption;
+
+	zend_bool enable;
+	zval obj;
+
+	ZEND_PARSE_PARAMETERS_START_EX(ZEND_PARSE_PARAMS_THROW, 1, 1)
+		Z_PARAM_BOOL(enable)
+	ZEND_PARSE_PARAMETERS_END();
+
+	encryption = async_clone_client_encryption((async_tls_client_encryption *) Z_OBJ_P(getThis()));
+	encryption->settings.ktls = enable;
+
+	ZVAL_OBJ(&obj, &encryption->std);
+
+	RETURN_ZVAL(&obj, 1, 1);
+}
+
+ZEND_METHOD(TlsClientEncryption, withAlpnProtocols)
+{
+	async_tls_client_encryption *encryption;
+
+	zend_string *alpn;
+	zval *protocols;
+	zval obj;
+
+	ZEND_PARSE_PARAMETERS_START_EX(ZEND_PARSE_PARAMS_THROW, 1, 1)
+		Z_PARAM_ARRAY(protocols)
+	ZEND_PARSE_PARAMETERS_END();
+
+	alpn = encode_alpn_protocols(Z_ARRVAL_P(protocols));
+
+	if (UNEXPECTED(EG(exception))) {
+		return;
+	}
+
+	encryption = async_clone_client_encryption((async_tls_client_encryption *) Z_OBJ_P(getThis()));
+
+	if (encryption->settings.alpn != NULL) {
+		zend_string_release(encryption->settings.alpn);
+	}
+
+	encryption->settings.alpn = alpn;
+
+	ZVAL_OBJ(&obj, &encryption->std);
+
+	RETURN_ZVAL(&obj, 1, 1);
+}
+
+ZEND_METHOD(TlsClientEncryption, getSessionStats)
+{
+	ZEND_PARSE_PARAMETERS_NONE();
+
+	get_session_stats(&((async_tls_client_encryption *) Z_OBJ_P(getThis()))->settings, return_value);
+}
+
 ZEND_BEGIN_ARG_WITH_RETURN_OBJ_INFO_EX(arginfo_tls_client_encryption_with_allow_self_signed, 0, 1, Concurrent\\Network\\TlsClientEncryption, 0)
 	ZEND_ARG_TYPE_INFO(0, allow, _IS_BOOL, 0)
 ZEND_END_ARG_INFO()
@@ -657,10 +1102,29 @@ ZEND_BEGIN_ARG_WITH_RETURN_OBJ_INFO_EX(arginfo_tls_client_encryption_with_peer_n
 	ZEND_ARG_TYPE_INFO(0, name, IS_STRING, 0)
 ZEND_END_ARG_INFO()
 
+ZEND_BEGIN_ARG_WITH_RETURN_OBJ_INFO_EX(arginfo_tls_client_encryption_with_kernel_tls, 0, 1, Concurrent\\Network\\TlsClientEncryption, 0)
+	ZEND_ARG_TYPE_INFO(0, enable, _IS_BOOL, 0)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_WITH_RETURN_OBJ_INFO_EX(arginfo_tls_client_encryption_with_alpn_protocols, 0, 1, Concurrent\\Network\\TlsClientEncryption, 0)
+	ZEND_ARG_TYPE_INFO(0, protocols, IS_ARRAY, 0)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_WITH_RETURN_OBJ_INFO_EX(arginfo_tls_client_encryption_with_session_reuse, 0, 1, Concurrent\\Network\\TlsClientEncryption, 0)
+	ZEND_ARG_TYPE_INFO(0, reuse, _IS_BOOL, 0)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_WITH_RETURN_TYPE_INFO_EX(arginfo_tls_client_encryption_get_session_stats, 0, 0, IS_ARRAY, 0)
+ZEND_END_ARG_INFO()
+
 static const zend_function_entry async_tls_client_encryption_functions[] = {
 	ZEND_ME(TlsClientEncryption, withAllowSelfSigned, arginfo_tls_client_encryption_with_allow_self_signed, ZEND_ACC_PUBLIC)
 	ZEND_ME(TlsClientEncryption, withVerifyDepth, arginfo_tls_client_encryption_with_verify_depth, ZEND_ACC_PUBLIC)
 	ZEND_ME(TlsClientEncryption, withPeerName, arginfo_tls_client_encryption_with_peer_name, ZEND_ACC_PUBLIC)
+	ZEND_ME(TlsClientEncryption, withKernelTls, arginfo_tls_client_encryption_with_kernel_tls, ZEND_ACC_PUBLIC)
+	ZEND_ME(TlsClientEncryption, withAlpnProtocols, arginfo_tls_client_encryption_with_alpn_protocols, ZEND_ACC_PUBLIC)
+	ZEND_ME(TlsClientEncryption, withSessionReuse, arginfo_tls_client_encryption_with_session_reuse, ZEND_ACC_PUBLIC)
+	ZEND_ME(TlsClientEncryption, getSessionStats, arginfo_tls_client_encryption_get_session_stats, ZEND_ACC_PUBLIC)
 	ZEND_FE_END
 };
 
@@ -675,6 +1139,9 @@ static zend_object *async_tls_server_encryption_object_create(zend_class_entry *
 	zend_object_std_init(&encryption->std, ce);
 	encryption->std.handlers = &async_tls_server_encryption_handlers;
 
+	encryption->settings.mode = ASYNC_SSL_MODE_SERVER;
+	encryption->settings.cache_timeout = ASYNC_SSL_DEFAULT_SESSION_TIMEOUT;
+
 	return &encryption->std;
 }
 
@@ -696,6 +1163,8 @@ static async_tls_server_encryption *clone_server_encryption(async_tls_server_enc
 		result->cert.passphrase = zend_string_copy(encryption->cert.passphrase);
 	}
 
+	copy_settings(&result->settings, &encryption->settings);
+
 	return result;
 }
 
@@ -723,6 +1192,14 @@ static void async_tls_server_encryption_object_destroy(zend_object *object)
 	}
 #endif
 
+	if (encryption->settings.alpn != NULL) {
+		zend_string_release(encryption->settings.alpn);
+	}
+
+	if (encryption->settings.sessions != NULL) {
+		release_session_cache(encryption->settings.sessions);
+	}
+
 	zend_object_std_dtor(&encryption->std);
 }
 
@@ -821,6 +1298,146 @@ ZEND_METHOD(TlsServerEncryption, withCertificate)
 	RETURN_ZVAL(&obj, 1, 1);
 }
 
+ZEND_METHOD(TlsServerEncryption, withKernelTls)
+{
+	async_tls_server_encryption *encryption;
+
+	zend_bool enable;
+	zval obj;
+
+	ZEND_PARSE_PARAMETERS_START_EX(ZEND_PARSE_PARAMS_THROW, 1, 1)
+		Z_PARAM_BOOL(enable)
+	ZEND_PARSE_PARAMETERS_END();
+
+	encryption = clone_server_encryption((async_tls_server_encryption *) Z_OBJ_P(getThis()));
+	encryption->settings.ktls = enable;
+
+	ZVAL_OBJ(&obj, &encryption->std);
+
+	RETURN_ZVAL(&obj, 1, 1);
+}
+
+ZEND_METHOD(TlsServerEncryption, withHandshakeOffload)
+{
+	async_tls_server_encryption *encryption;
+
+	zend_bool enable;
+	zval obj;
+
+	ZEND_PARSE_PARAMETERS_START_EX(ZEND_PARSE_PARAMS_THROW, 1, 1)
+		Z_PARAM_BOOL(enable)
+	ZEND_PARSE_PARAMETERS_END();
+
+	encryption = clone_server_encryption((async_tls_server_encryption *) Z_OBJ_P(getThis()));
+	encryption->settings.offload = enable;
+
+	ZVAL_OBJ(&obj, &encryption->std);
+
+	RETURN_ZVAL(&obj, 1, 1);
+}
+
+ZEND_METHOD(TlsServerEncryption, withAlpnProtocols)
+{
+	async_tls_server_encryption *encryption;
+
+	zend_string *alpn;
+	zval *protocols;
+	zval obj;
+
+	ZEND_PARSE_PARAMETERS_START_EX(ZEND_PARSE_PARAMS_THROW, 1, 1)
+		Z_PARAM_ARRAY(protocols)
+	ZEND_PARSE_PARAMETERS_END();
+
+	alpn = encode_alpn_protocols(Z_ARRVAL_P(protocols));
+
+	if (UNEXPECTED(EG(exception))) {
+		return;
+	}
+
+	encryption = clone_server_encryption((async_tls_server_encryption *) Z_OBJ_P(getThis()));
+
+	if (encryption->settings.alpn != NULL) {
+		zend_string_release(encryption->settings.alpn);
+	}
+
+	encryption->settings.alpn = alpn;
+
+	ZVAL_OBJ(&obj, &encryption->std);
+
+	RETURN_ZVAL(&obj, 1, 1);
+}
+
+ZEND_METHOD(TlsServerEncryption, withSessionCache)
+{
+	async_tls_server_encryption *encryption;
+
+	zend_long size;
+	zend_long timeout;
+
+	zval obj;
+
+	timeout = ASYNC_SSL_DEFAULT_SESSION_TIMEOUT;
+
+	ZEND_PARSE_PARAMETERS_START_EX(ZEND_PARSE_PARAMS_THROW, 1, 2)
+		Z_PARAM_LONG(size)
+		Z_PARAM_OPTIONAL
+		Z_PARAM_LONG(timeout)
+	ZEND_PARSE_PARAMETERS_END();
+
+	ASYNC_CHECK_ERROR(size < 0, "Session cache size must not be negative");
+	ASYNC_CHECK_ERROR(timeout < 1, "Session cache timeout must not be less than 1 second");
+
+	encryption = clone_server_encryption((async_tls_server_encryption *) Z_OBJ_P(getThis()));
+	encryption->settings.cache_size = (int) size;
+	encryption->settings.cache_timeout = (int) timeout;
+
+	if (encryption->settings.sessions == NULL) {
+		encryption->settings.sessions = create_session_cache();
+	}
+
+	ZVAL_OBJ(&obj, &encryption->std);
+
+	RETURN_ZVAL(&obj, 1, 1);
+}
+
+ZEND_METHOD(TlsServerEncryption, withSessionTickets)
+{
+	async_tls_server_encryption *encryption;
+
+	zend_bool enable;
+	zend_long lifetime;
+
+	zval obj;
+
+	lifetime = ASYNC_SSL_DEFAULT_TICKET_LIFETIME;
+
+	ZEND_PARSE_PARAMETERS_START_EX(ZEND_PARSE_PARAMS_THROW, 1, 2)
+		Z_PARAM_BOOL(enable)
+		Z_PARAM_OPTIONAL
+		Z_PARAM_LONG(lifetime)
+	ZEND_PARSE_PARAMETERS_END();
+
+	ASYNC_CHECK_ERROR(lifetime < 1, "Ticket key lifetime must not be less than 1 second");
+
+	encryption = clone_server_encryption((async_tls_server_encryption *) Z_OBJ_P(getThis()));
+	encryption->settings.ticket_lifetime = enable ? (int) lifetime : 0;
+
+	if (encryption->settings.sessions == NULL) {
+		encryption->settings.sessions = create_session_cache();
+	}
+
+	ZVAL_OBJ(&obj, &encryption->std);
+
+	RETURN_ZVAL(&obj, 1, 1);
+}
+
+ZEND_METHOD(TlsServerEncryption, getSessionStats)
+{
+	ZEND_PARSE_PARAMETERS_NONE();
+
+	get_session_stats(&((async_tls_server_encryption *) Z_OBJ_P(getThis()))->settings, return_value);
+}
+
 ZEND_BEGIN_ARG_WITH_RETURN_OBJ_INFO_EX(arginfo_tls_server_encryption_with_default_certificate, 0, 2, Concurrent\\Network\\TlsServerEncryption, 0)
 	ZEND_ARG_TYPE_INFO(0, cert, IS_STRING, 0)
 	ZEND_ARG_TYPE_INFO(0, key, IS_STRING, 0)
@@ -834,9 +1451,40 @@ ZEND_BEGIN_ARG_WITH_RETURN_OBJ_INFO_EX(arginfo_tls_server_encryption_with_certif
 	ZEND_ARG_TYPE_INFO(0, passphrase, IS_STRING, 1)
 ZEND_END_ARG_INFO()
 
+ZEND_BEGIN_ARG_WITH_RETURN_OBJ_INFO_EX(arginfo_tls_server_encryption_with_kernel_tls, 0, 1, Concurrent\\Network\\TlsServerEncryption, 0)
+	ZEND_ARG_TYPE_INFO(0, enable, _IS_BOOL, 0)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_WITH_RETURN_OBJ_INFO_EX(arginfo_tls_server_encryption_with_handshake_offload, 0, 1, Concurrent\\Network\\TlsServerEncryption, 0)
+	ZEND_ARG_TYPE_INFO(0, enable, _IS_BOOL, 0)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_WITH_RETURN_OBJ_INFO_EX(arginfo_tls_server_encryption_with_alpn_protocols, 0, 1, Concurrent\\Network\\TlsServerEncryption, 0)
+	ZEND_ARG_TYPE_INFO(0, protocols, IS_ARRAY, 0)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_WITH_RETURN_OBJ_INFO_EX(arginfo_tls_server_encryption_with_session_cache, 0, 1, Concurrent\\Network\\TlsServerEncryption, 0)
+	ZEND_ARG_TYPE_INFO(0, size, IS_LONG, 0)
+	ZEND_ARG_TYPE_INFO(0, timeout, IS_LONG, 0)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_WITH_RETURN_OBJ_INFO_EX(arginfo_tls_server_encryption_with_session_tickets, 0, 1, Concurrent\\Network\\TlsServerEncryption, 0)
+	ZEND_ARG_TYPE_INFO(0, enable, _IS_BOOL, 0)
+	ZEND_ARG_TYPE_INFO(0, lifetime, IS_LONG, 0)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_WITH_RETURN_TYPE_INFO_EX(arginfo_tls_server_encryption_get_session_stats, 0, 0, IS_ARRAY, 0)
+ZEND_END_ARG_INFO()
+
 static const zend_function_entry async_tls_server_encryption_functions[] = {
 	ZEND_ME(TlsServerEncryption, withDefaultCertificate, arginfo_tls_server_encryption_with_default_certificate, ZEND_ACC_PUBLIC)
 	ZEND_ME(TlsServerEncryption, withCertificate, arginfo_tls_server_encryption_with_certificate, ZEND_ACC_PUBLIC)
+	ZEND_ME(TlsServerEncryption, withKernelTls, arginfo_tls_server_encryption_with_kernel_tls, ZEND_ACC_PUBLIC)
+	ZEND_ME(TlsServerEncryption, withHandshakeOffload, arginfo_tls_server_encryption_with_handshake_offload, ZEND_ACC_PUBLIC)
+	ZEND_ME(TlsServerEncryption, withAlpnProtocols, arginfo_tls_server_encryption_with_alpn_protocols, ZEND_ACC_PUBLIC)
+	ZEND_ME(TlsServerEncryption, withSessionCache, arginfo_tls_server_encryption_with_session_cache, ZEND_ACC_PUBLIC)
+	ZEND_ME(TlsServerEncryption, withSessionTickets, arginfo_tls_server_encryption_with_session_tickets, ZEND_ACC_PUBLIC)
+	ZEND_ME(TlsServerEncryption, getSessionStats, arginfo_tls_server_encryption_get_session_stats, ZEND_ACC_PUBLIC)
 	ZEND_FE_END
 };
 
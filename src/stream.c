@@ -190,6 +190,9 @@ void async_stream_shutdown(async_stream *stream, int how)
 
 #ifdef HAVE_ASYNC_SSL
 
+/* Writes need to be encrypted unless encryption has been offloaded to the kernel. */
+#define ASYNC_STREAM_SSL_ENCRYPT(stream) ((stream)->ssl.ssl != NULL && !(stream)->ssl.ktls)
+
 static inline int is_ssl_continue_error(SSL *ssl, int code)
 {	
 	switch (SSL_get_error(ssl, code)) {
@@ -592,35 +595,198 @@ int async_stream_read_string(async_stream *stream, zend_string **str, size_t len
 	return ZSTR_LEN(tmp);
 }
 
-static int try_write(async_stream *stream, char *buf, size_t len)
+#ifdef HAVE_ASYNC_SSL
+
+/* Each pooled buffer is large enough to hold a single encrypted TLS record. */
+#define ASYNC_STREAM_RECORD_SIZE (SSL3_RT_HEADER_LENGTH + SSL3_RT_MAX_PLAIN_LENGTH + SSL3_RT_MAX_ENCRYPTED_OVERHEAD)
+
+/* Max number of idle record buffers being kept in the pool. */
+#define ASYNC_STREAM_RECORD_POOL_SIZE 64
+
+static char *alloc_record()
 {
-	uv_buf_t bufs[1];
-	
-	int written;
+	char *record;
+
+	if (ASYNC_G(tls_records) == NULL) {
+		return emalloc(ASYNC_STREAM_RECORD_SIZE);
+	}
+
+	// Pooled buffers are linked using the first bytes of each buffer.
+	record = ASYNC_G(tls_records);
+
+	ASYNC_G(tls_records) = *(char **) record;
+	ASYNC_G(tls_record_count)--;
+
+	return record;
+}
+
+static void release_record(char *record)
+{
+	if (ASYNC_G(tls_record_count) >= ASYNC_STREAM_RECORD_POOL_SIZE) {
+		efree(record);
+		return;
+	}
+
+	*(char **) record = ASYNC_G(tls_records);
+
+	ASYNC_G(tls_records) = record;
+	ASYNC_G(tls_record_count)++;
+}
+
+static async_stream_write_op *encrypt_records(async_stream *stream, char *buf, size_t len)
+{
+	async_stream_write_op *op;
+	uv_buf_t *record;
+
+	unsigned int size;
+	size_t pending;
+	int offset;
+
+	ASYNC_ALLOC_CUSTOM_OP(op, sizeof(async_stream_write_op));
+
+	op->stream = stream;
+
+	/*
+	 * Every SSL_write() call encrypts at most one record, one more slot is reserved for pending
+	 * post-handshake messages. The array is twice as large because the write vector is placed
+	 * behind the used records, no allocations are needed in the common case.
+	 */
+	size = (unsigned int) (len / SSL3_RT_MAX_PLAIN_LENGTH) + 2;
+
+	op->records = emalloc(2 * size * sizeof(uv_buf_t));
+	record = NULL;
+
+	while (len > 0) {
+		ERR_clear_error();
+		offset = SSL_write(stream->ssl.ssl, buf, (int) MIN(len, SSL3_RT_MAX_PLAIN_LENGTH));
+
+		if (offset <= 0) {
+			zend_throw_error(NULL, "SSL error: %d", (int) SSL_get_error(stream->ssl.ssl, offset));
+			async_stream_dispose_write_op(op);
+			ASYNC_FREE_OP(op);
+
+			return NULL;
+		}
+
+		buf += offset;
+		len -= offset;
+
+		while ((pending = BIO_ctrl_pending(stream->ssl.wbio)) > 0) {
+			if (record == NULL || record->len == ASYNC_STREAM_RECORD_SIZE) {
+				if (op->nrecords == size) {
+					size *= 2;
+					op->records = erealloc(op->records, 2 * size * sizeof(uv_buf_t));
+				}
+
+				record = &op->records[op->nrecords++];
+				*record = uv_buf_init(alloc_record(), 0);
+			}
+
+			offset = BIO_read(stream->ssl.wbio, record->base + record->len, (int) MIN(pending, ASYNC_STREAM_RECORD_SIZE - record->len));
+
+			record->len += offset;
+		}
+	}
+
+	op->bufs = op->records + op->nrecords;
+	op->nbufs = op->nrecords;
+
+	memcpy(op->bufs, op->records, op->nrecords * sizeof(uv_buf_t));
+
+	return op;
+}
+
+#endif
+
+void async_stream_pool_shutdown()
+{
+	char *record;
+
+	while (ASYNC_G(tls_records) != NULL) {
+		record = ASYNC_G(tls_records);
+		ASYNC_G(tls_records) = *(char **) record;
+
+		efree(record);
+	}
+
+	ASYNC_G(tls_record_count) = 0;
+}
+
+static async_stream_write_op *create_write_op(async_stream *stream, char *buf, size_t len)
+{
+	async_stream_write_op *op;
+
+#ifdef HAVE_ASYNC_SSL
+	if (ASYNC_STREAM_SSL_ENCRYPT(stream)) {
+		return encrypt_records(stream, buf, len);
+	}
+#endif
+
+	ASYNC_ALLOC_CUSTOM_OP(op, sizeof(async_stream_write_op));
+
+	op->stream = stream;
+	op->buf = uv_buf_init(buf, (unsigned int) len);
+	op->bufs = &op->buf;
+	op->nbufs = 1;
+
+	return op;
+}
+
+void async_stream_dispose_write_op(async_stream_write_op *op)
+{
+#ifdef HAVE_ASYNC_SSL
+	unsigned int i;
+
+	if (op->records != NULL) {
+		for (i = 0; i < op->nrecords; i++) {
+			release_record(op->records[i].base);
+		}
+
+		efree(op->records);
+
+		op->records = NULL;
+		op->nrecords = 0;
+	}
+#endif
+
+	if (op->str != NULL) {
+		zend_string_release(op->str);
+		op->str = NULL;
+	}
+}
+
+static int try_write(async_stream *stream, async_stream_write_op *op)
+{
+	size_t len;
 	int code;
-	
-	bufs[0] = uv_buf_init(buf, len);
-	
-	written = 0;
-	
-	while (bufs[0].len > 0) {
-		code = uv_try_write(stream->handle, bufs, 1);
-		
+
+	while (op->nbufs > 0) {
+		code = uv_try_write(stream->handle, op->bufs, op->nbufs);
+
 		if (code == UV_EAGAIN) {
 			break;
 		}
-		
+
 		if (code < 0) {
 			return code;
 		}
-		
-		bufs[0].base += code;
-		bufs[0].len -= code;
-		
-		written += code;
+
+		while (code > 0) {
+			len = MIN((size_t) code, op->bufs[0].len);
+
+			op->bufs[0].base += len;
+			op->bufs[0].len -= len;
+
+			code -= (int) len;
+
+			if (op->bufs[0].len == 0) {
+				op->bufs++;
+				op->nbufs--;
+			}
+		}
 	}
-	
-	return written;
+
+	return SUCCESS;
 }
 
 static void write_cb(uv_write_t *req, int status)
@@ -633,14 +799,13 @@ static void write_cb(uv_write_t *req, int status)
 	
 	op->code = status;
 	
-#ifdef HAVE_ASYNC_SSL
-	if (op->stream->ssl.ssl != NULL) {
-		efree(op->data);
-	}
-#endif
+	async_stream_dispose_write_op(op);
 	
-	if (op->str != NULL) {
-		zend_string_release(op->str);
+	// The writing task has been cancelled, libuv was the last user of the buffers.
+	if (op->base.status == ASYNC_STATUS_FAILED) {
+		ASYNC_FREE_OP(op);
+		
+		return;
 	}
 	
 	ASYNC_FINISH_OP(op);
@@ -653,11 +818,32 @@ static void write_cb(uv_write_t *req, int status)
 	}
 }
 
-void async_stream_write(async_stream *stream, char *buf, size_t len)
+/* Suspends the calling task while a file is being sent, data must not be written into the middle of the file. */
+static int await_file_sent(async_stream *stream)
+{
+	async_op *op;
+	
+	while (stream->flags & ASYNC_STREAM_SENDING_FILE) {
+		ASYNC_ALLOC_OP(op);
+		ASYNC_ENQUEUE_OP(&stream->senders, op);
+		
+		if (await_op(stream, op) == FAILURE) {
+			ASYNC_FORWARD_OP_ERROR(op);
+			ASYNC_FREE_OP(op);
+			
+			return FAILURE;
+		}
+		
+		ASYNC_FREE_OP(op);
+	}
+	
+	return SUCCESS;
+}
+
+static void write_data(async_stream *stream, char *buf, size_t len)
 {
 	async_stream_write_op *op;
 	
-	char *base;
 	int code;
 	
 	ZEND_ASSERT(len > 0);
@@ -668,95 +854,44 @@ void async_stream_write(async_stream *stream, char *buf, size_t len)
 		return;
 	}
 	
-	base = NULL;
-	
-#ifdef HAVE_ASYNC_SSL
-	if (stream->ssl.ssl != NULL) {
-		int offset;
-		int blen;
-		
-		blen = 0;
-	
-		while (len > 0) {
-			ERR_clear_error();
-			offset = SSL_write(stream->ssl.ssl, buf, len);
-			
-			if (offset <= 0) {
-				efree(base);
-			
-				zend_throw_error(NULL, "SSL error: %d\n", (int) SSL_get_error(stream->ssl.ssl, offset));
-				return;
-			}
-			
-			buf += offset;
-			len -= offset;
-			
-			while ((offset = BIO_ctrl_pending(stream->ssl.wbio)) > 0) {
-				if (base == NULL) {
-					base = emalloc(blen + offset);
-				} else {
-					erealloc(base, blen + offset);
-				}
-				
-				offset = BIO_read(stream->ssl.wbio, base + blen, offset);
-								
-				blen += offset;
-			}
-		}
-		
-		buf = base;
-		len = blen;
+	if (NULL == (op = create_write_op(stream, buf, len))) {
+		return;
 	}
-#endif
 
 	if (stream->writes.first == NULL) {
-		code = try_write(stream, buf, len);
-		
-		if (code < 0) {
-			if (base != NULL) {
-				efree(base);
-			}
-		
-			zend_throw_error(NULL, "Write operation failed: %s", uv_strerror(code));
-			return;
-		}
-
-		buf += code;
-		len -= code;
+		code = try_write(stream, op);
 		
-		if (len == 0) {
-			if (base != NULL) {
-				efree(base);
+		if (code < 0 || op->nbufs == 0) {
+			async_stream_dispose_write_op(op);
+			ASYNC_FREE_OP(op);
+			
+			if (code < 0) {
+				zend_throw_error(NULL, "Write operation failed: %s", uv_strerror(code));
 			}
 			
 			return;
 		}
 	}
 
-	ASYNC_ALLOC_CUSTOM_OP(op, sizeof(async_stream_write_op));
 	ASYNC_ENQUEUE_OP(&stream->writes, op);
 	
-	op->bufs[0] = uv_buf_init(buf, len);
-	op->stream = stream;
-	op->data = base;
 	op->req.data = op;
 
-	code = uv_write(&op->req, stream->handle, op->bufs, 1, write_cb);
+	code = uv_write(&op->req, stream->handle, op->bufs, op->nbufs, write_cb);
 	
 	if (code < 0) {
-		if (base != NULL) {
-			efree(base);
-		}
-			
+		async_stream_dispose_write_op(op);
 		ASYNC_FREE_OP(op);
 		
 		zend_throw_error(NULL, "Write operation failed: %s", uv_strerror(code));
 		return;
 	}
 	
+	// Pending uv_write() still references the op and its pooled records, they are released by write_cb().
 	if (await_op(stream, (async_op *) op) == FAILURE) {
 		ASYNC_FORWARD_OP_ERROR(op);
-		ASYNC_FREE_OP(op);
+		
+		op->base.status = ASYNC_STATUS_FAILED;
 		
 		return;
 	}
@@ -770,15 +905,18 @@ void async_stream_write(async_stream *stream, char *buf, size_t len)
 	}
 }
 
+void async_stream_write(async_stream *stream, char *buf, size_t len)
+{
+	if (await_file_sent(stream) == SUCCESS) {
+		write_data(stream, buf, len);
+	}
+}
+
 void async_stream_async_write_string(async_stream *stream, zend_string *str, async_stream_write_cb cb, void *arg)
 {
 	async_stream_write_op *op;
 	
 	int code;
-	char *base;
-	
-	char *buf;
-	size_t len;
 	
 	ZEND_ASSERT(ZSTR_LEN(str) > 0);
 
@@ -788,91 +926,42 @@ void async_stream_async_write_string(async_stream *stream, zend_string *str, asy
 		return;
 	}
 	
-	base = NULL;
-	
-	buf = ZSTR_VAL(str);
-	len = ZSTR_LEN(str);
-	
-#ifdef HAVE_ASYNC_SSL
-	if (stream->ssl.ssl != NULL) {
-		int offset;
-		int blen;
+	// Async writes cannot wait for the file transfer to finish.
+	if (stream->flags & ASYNC_STREAM_SENDING_FILE) {
+		zend_throw_error(NULL, "Cannot write while a file is being sent");
 		
-		blen = 0;
+		return;
+	}
 	
-		while (len > 0) {
-			ERR_clear_error();
-			offset = SSL_write(stream->ssl.ssl, buf, len);
-			
-			if (offset <= 0) {
-				efree(base);
-			
-				zend_throw_error(NULL, "SSL error: %d\n", (int) SSL_get_error(stream->ssl.ssl, offset));
-				return;
-			}
-			
-			buf += offset;
-			len -= offset;
-			
-			while ((offset = BIO_ctrl_pending(stream->ssl.wbio)) > 0) {
-				if (base == NULL) {
-					base = emalloc(blen + offset);
-				} else {
-					erealloc(base, blen + offset);
-				}
-				
-				offset = BIO_read(stream->ssl.wbio, base + blen, offset);
-								
-				blen += offset;
-			}
-		}
-		
-		buf = base;
-		len = blen;
+	if (NULL == (op = create_write_op(stream, ZSTR_VAL(str), ZSTR_LEN(str)))) {
+		return;
 	}
-#endif
 	
 	if (stream->writes.first == NULL) {
-		code = try_write(stream, buf, len);
-		
-		if (code < 0) {
-			if (base != NULL) {
-				efree(base);
-			}
+		code = try_write(stream, op);
 		
-			zend_throw_error(NULL, "Write operation failed: %s", uv_strerror(code));
-			return;
-		}
-
-		buf += code;
-		len -= code;
-		
-		if (len == 0) {
-			if (base != NULL) {
-				efree(base);
-			}
+		if (code < 0 || op->nbufs == 0) {
+			async_stream_dispose_write_op(op);
+			ASYNC_FREE_OP(op);
 			
-			cb(arg);
+			if (code < 0) {
+				zend_throw_error(NULL, "Write operation failed: %s", uv_strerror(code));
+			} else {
+				cb(arg);
+			}
 			
 			return;
 		}
 	}
 
-	ASYNC_ALLOC_CUSTOM_OP(op, sizeof(async_stream_write_op));
 	ASYNC_ENQUEUE_OP(&stream->writes, op);
 	
-	op->bufs[0] = uv_buf_init(buf, len);
-	op->stream = stream;
-	op->data = base;
 	op->req.data = op;
 
-	code = uv_write(&op->req, stream->handle, op->bufs, 1, write_cb);
+	code = uv_write(&op->req, stream->handle, op->bufs, op->nbufs, write_cb);
 	
 	if (code < 0) {
-		if (base != NULL) {
-			efree(base);
-		}
-			
+		async_stream_dispose_write_op(op);
 		ASYNC_FREE_OP(op);
 		
 		zend_throw_error(NULL, "Write operation failed: %s", uv_strerror(code));
@@ -883,58 +972,410 @@ void async_stream_async_write_string(async_stream *stream, zend_string *str, asy
 	op->cb = cb;
 	op->arg = arg;
 	
-#ifdef HAVE_ASYNC_SSL
-	if (stream->ssl.ssl == NULL) {
+	// Unencrypted data is written from the string buffer, it must not be released until the write completes.
+	if (op->records == NULL) {
 		op->str = zend_string_copy(str);
 	}
-#else
-	op->str = zend_string_copy(str);
-#endif
 	
 	ASYNC_ADDREF(&op->context->std);
 }
 
-#ifdef HAVE_ASYNC_SSL
+/* Max number of bytes being passed to a single sendfile() call. */
+#define ASYNC_STREAM_SENDFILE_MAX 0x40000000
 
-static void receive_handshake_bytes_cb(uv_stream_t *handle, ssize_t nread, const uv_buf_t *buf)
+/* Number and size of the buffers being used to copy files into encrypted streams. */
+#define ASYNC_STREAM_COPY_CHUNKS 4
+#define ASYNC_STREAM_COPY_CHUNK_SIZE 16384
+
+#ifndef PHP_WIN32
+
+/* Waits until all queued writes have been sent, a zero-length write completes after all previous writes. */
+static int flush_writes(async_stream *stream)
 {
-	async_stream *stream;
-	async_ssl_op *op;
-	
-	stream = (async_stream *) handle->data;
+	async_stream_write_op *op;
 	
-	ZEND_ASSERT(stream != NULL);
-	ZEND_ASSERT(stream->ssl.handshake != NULL);
+	int code;
 	
-	if (nread == 0) {
-		return;
+	if (stream->writes.first == NULL && stream->handle->write_queue_size == 0) {
+		return SUCCESS;
 	}
 	
-	uv_read_stop(handle);
-	
-	op = stream->ssl.handshake;
+	ASYNC_ALLOC_CUSTOM_OP(op, sizeof(async_stream_write_op));
 	
-	if (nread < 0) {
-		op->uv_error = (int) nread;
-	} else {
-		op->ssl_error = process_input_bytes(stream, (int) nread);
-	}
+	op->stream = stream;
+	op->buf = uv_buf_init(NULL, 0);
+	op->bufs = &op->buf;
+	op->nbufs = 1;
 	
-	ASYNC_FINISH_OP(op);
-}
-
-static void receive_handshake_bytes_alloc_cb(uv_handle_t *handle, size_t suggested, uv_buf_t *buf)
-{
-	async_stream *stream;
+	ASYNC_ENQUEUE_OP(&stream->writes, op);
 	
-	stream = (async_stream *) handle->data;
+	op->req.data = op;
 	
-	ZEND_ASSERT(stream != NULL);
+	code = uv_write(&op->req, stream->handle, op->bufs, op->nbufs, write_cb);
 	
-	buf->base = stream->buffer.wpos;
-	buf->len = async_ring_buffer_write_len(&stream->buffer);
-}
-
+	if (code < 0) {
+		ASYNC_FREE_OP(op);
+		
+		zend_throw_error(NULL, "Write operation failed: %s", uv_strerror(code));
+		return FAILURE;
+	}
+	
+	if (await_op(stream, (async_op *) op) == FAILURE) {
+		ASYNC_FORWARD_OP_ERROR(op);
+		
+		op->base.status = ASYNC_STATUS_FAILED;
+		
+		return FAILURE;
+	}
+	
+	code = op->code;
+	
+	ASYNC_FREE_OP(op);
+	
+	if (code < 0) {
+		zend_throw_error(NULL, "Write operation failed: %s", uv_strerror(code));
+		return FAILURE;
+	}
+	
+	return SUCCESS;
+}
+
+typedef struct {
+	uv_poll_t handle;
+	
+	/* Duplicate of the socket descriptor (the original one is registered by the stream handle). */
+	int fd;
+	
+	/* Operation of the task waiting for the socket to become writable. */
+	async_op *op;
+} async_stream_poll;
+
+static void poll_writable_cb(uv_poll_t *handle, int status, int events)
+{
+	async_stream_poll *poll;
+	async_op *op;
+	
+	poll = (async_stream_poll *) handle->data;
+	
+	uv_poll_stop(handle);
+	
+	if (poll->op != NULL) {
+		op = poll->op;
+		poll->op = NULL;
+		
+		ASYNC_FINISH_OP(op);
+	}
+}
+
+static void close_poll_cb(uv_handle_t *handle)
+{
+	async_stream_poll *poll;
+	
+	poll = (async_stream_poll *) handle->data;
+	
+	close(poll->fd);
+	
+	efree(poll);
+}
+
+static void dispose_poll(async_stream_poll *poll)
+{
+	uv_close((uv_handle_t *) &poll->handle, close_poll_cb);
+}
+
+/* Suspends the calling task until the kernel socket buffer has room for more data. */
+static int await_writable(async_stream *stream, async_stream_poll **result)
+{
+	async_stream_poll *poll;
+	async_op *op;
+	
+	uv_os_fd_t fd;
+	int code;
+	
+	poll = *result;
+	
+	if (poll == NULL) {
+		if (0 > (code = uv_fileno((uv_handle_t *) stream->handle, &fd))) {
+			zend_throw_error(NULL, "Failed to access socket: %s", uv_strerror(code));
+			return FAILURE;
+		}
+		
+		poll = emalloc(sizeof(async_stream_poll));
+		poll->op = NULL;
+		poll->fd = dup(fd);
+		
+		if (poll->fd < 0) {
+			efree(poll);
+			
+			zend_throw_error(NULL, "Failed to access socket: %s", uv_strerror(uv_translate_sys_error(errno)));
+			return FAILURE;
+		}
+		
+		if (0 > (code = uv_poll_init(stream->handle->loop, &poll->handle, poll->fd))) {
+			close(poll->fd);
+			efree(poll);
+			
+			zend_throw_error(NULL, "Failed to poll socket: %s", uv_strerror(code));
+			return FAILURE;
+		}
+		
+		poll->handle.data = poll;
+		
+		*result = poll;
+	}
+	
+	if (0 > (code = uv_poll_start(&poll->handle, UV_WRITABLE, poll_writable_cb))) {
+		zend_throw_error(NULL, "Failed to poll socket: %s", uv_strerror(code));
+		return FAILURE;
+	}
+	
+	ASYNC_ALLOC_OP(op);
+	
+	poll->op = op;
+	
+	if (await_op(stream, op) == FAILURE) {
+		ASYNC_FORWARD_OP_ERROR(op);
+		ASYNC_FREE_OP(op);
+		
+		poll->op = NULL;
+		
+		uv_poll_stop(&poll->handle);
+		
+		return FAILURE;
+	}
+	
+	ASYNC_FREE_OP(op);
+	
+	return SUCCESS;
+}
+
+/* Sends file contents using sendfile() in the thread pool, the socket is non-blocking so partial sends are expected. */
+static int send_file(async_stream *stream, uv_file file, int64_t offset, size_t length, size_t *sent)
+{
+	async_stream_poll *poll;
+	
+	uv_os_fd_t fd;
+	int result;
+	int code;
+	
+	if (0 > (code = uv_fileno((uv_handle_t *) stream->handle, &fd))) {
+		zend_throw_error(NULL, "Failed to access socket: %s", uv_strerror(code));
+		return FAILURE;
+	}
+	
+	poll = NULL;
+	result = SUCCESS;
+	
+	while (length > 0) {
+		code = async_filesystem_sendfile((uv_file) fd, file, offset, MIN(length, ASYNC_STREAM_SENDFILE_MAX));
+		
+		if (code == UV_EAGAIN) {
+			if (await_writable(stream, &poll) == FAILURE) {
+				result = FAILURE;
+				break;
+			}
+			
+			continue;
+		}
+		
+		if (code < 0) {
+			if (EG(exception) == NULL) {
+				zend_throw_error(NULL, "Sendfile operation failed: %s", uv_strerror(code));
+			}
+			
+			result = FAILURE;
+			break;
+		}
+		
+		// File is shorter than requested.
+		if (code == 0) {
+			break;
+		}
+		
+		offset += code;
+		length -= code;
+		*sent += code;
+	}
+	
+	if (poll != NULL) {
+		dispose_poll(poll);
+	}
+	
+	return result;
+}
+
+#endif
+
+/* Copies file contents into the stream using pooled buffers, used if data has to be encrypted before it is sent. */
+static int copy_file(async_stream *stream, uv_file file, int64_t offset, size_t length, size_t *sent)
+{
+	uv_buf_t bufs[ASYNC_STREAM_COPY_CHUNKS];
+	unsigned int count;
+	unsigned int i;
+	size_t len;
+	int result;
+	int code;
+	
+	for (count = 0, len = length; count < ASYNC_STREAM_COPY_CHUNKS && len > 0; count++) {
+#ifdef HAVE_ASYNC_SSL
+		bufs[count] = uv_buf_init(alloc_record(), (unsigned int) MIN(len, ASYNC_STREAM_COPY_CHUNK_SIZE));
+#else
+		bufs[count] = uv_buf_init(emalloc(ASYNC_STREAM_COPY_CHUNK_SIZE), (unsigned int) MIN(len, ASYNC_STREAM_COPY_CHUNK_SIZE));
+#endif
+		len -= bufs[count].len;
+	}
+	
+	result = SUCCESS;
+	
+	while (length > 0) {
+		for (len = length, i = 0; i < count; i++) {
+			bufs[i].len = (unsigned int) MIN(len, ASYNC_STREAM_COPY_CHUNK_SIZE);
+			len -= bufs[i].len;
+		}
+		
+		code = async_filesystem_read(file, bufs, count, offset);
+		
+		if (code < 0) {
+			if (EG(exception) == NULL) {
+				zend_throw_error(NULL, "Failed to read file: %s", uv_strerror(code));
+			}
+			
+			result = FAILURE;
+			break;
+		}
+		
+		if (code == 0) {
+			break;
+		}
+		
+		offset += code;
+		length -= code;
+		
+		// Every chunk is written (and encrypted) separately, writes are awaited to apply backpressure.
+		for (len = code, i = 0; i < count && len > 0; i++) {
+			write_data(stream, bufs[i].base, MIN(len, bufs[i].len));
+			
+			if (UNEXPECTED(EG(exception))) {
+				result = FAILURE;
+				break;
+			}
+			
+			*sent += MIN(len, bufs[i].len);
+			len -= MIN(len, bufs[i].len);
+		}
+		
+		if (result == FAILURE) {
+			break;
+		}
+	}
+	
+	for (i = 0; i < count; i++) {
+#ifdef HAVE_ASYNC_SSL
+		release_record(bufs[i].base);
+#else
+		efree(bufs[i].base);
+#endif
+	}
+	
+	return result;
+}
+
+static int transfer_file(async_stream *stream, uv_file file, int64_t offset, size_t length, size_t *sent)
+{
+#ifdef HAVE_ASYNC_SSL
+	if (ASYNC_STREAM_SSL_ENCRYPT(stream)) {
+		return copy_file(stream, file, offset, length, sent);
+	}
+#endif
+
+#ifdef PHP_WIN32
+	return copy_file(stream, file, offset, length, sent);
+#else
+	if (flush_writes(stream) == FAILURE) {
+		return FAILURE;
+	}
+	
+	return send_file(stream, file, offset, length, sent);
+#endif
+}
+
+/* Sends part of a file, data that has been queued before is sent first. Other writes wait until the transfer has finished. */
+int async_stream_sendfile(async_stream *stream, uv_file file, int64_t offset, size_t length, size_t *sent)
+{
+	async_op *op;
+	int result;
+	
+	*sent = 0;
+	
+	if (await_file_sent(stream) == FAILURE) {
+		return FAILURE;
+	}
+	
+	if (stream->flags & ASYNC_STREAM_SHUT_WR) {
+		zend_throw_error(NULL, "Stream writer has been closed");
+		
+		return FAILURE;
+	}
+	
+	if (length == 0) {
+		return SUCCESS;
+	}
+	
+	stream->flags |= ASYNC_STREAM_SENDING_FILE;
+	
+	result = transfer_file(stream, file, offset, length, sent);
+	
+	stream->flags &= ~ASYNC_STREAM_SENDING_FILE;
+	
+	while (stream->senders.first != NULL) {
+		ASYNC_DEQUEUE_OP(&stream->senders, op);
+		ASYNC_FINISH_OP(op);
+	}
+	
+	return result;
+}
+
+#ifdef HAVE_ASYNC_SSL
+
+static void receive_handshake_bytes_cb(uv_stream_t *handle, ssize_t nread, const uv_buf_t *buf)
+{
+	async_stream *stream;
+	async_ssl_op *op;
+	
+	stream = (async_stream *) handle->data;
+	
+	ZEND_ASSERT(stream != NULL);
+	ZEND_ASSERT(stream->ssl.handshake != NULL);
+	
+	if (nread == 0) {
+		return;
+	}
+	
+	uv_read_stop(handle);
+	
+	op = stream->ssl.handshake;
+	
+	if (nread < 0) {
+		op->uv_error = (int) nread;
+	} else {
+		op->ssl_error = process_input_bytes(stream, (int) nread);
+	}
+	
+	ASYNC_FINISH_OP(op);
+}
+
+static void receive_handshake_bytes_alloc_cb(uv_handle_t *handle, size_t suggested, uv_buf_t *buf)
+{
+	async_stream *stream;
+	
+	stream = (async_stream *) handle->data;
+	
+	ZEND_ASSERT(stream != NULL);
+	
+	buf->base = stream->buffer.wpos;
+	buf->len = async_ring_buffer_write_len(&stream->buffer);
+}
+
 static int receive_handshake_bytes(async_stream *stream, async_ssl_handshake_data *data)
 {
 	async_ssl_op *op;
@@ -1070,15 +1511,254 @@ static int send_handshake_bytes(async_stream *stream, async_ssl_handshake_data *
 	return SUCCESS;
 }
 
+#ifdef ASYNC_TLS_OFFLOAD
+
+typedef struct {
+	async_op base;
+	uv_work_t req;
+	SSL *ssl;
+	zend_object *owner;
+	int status;
+	zend_bool failed;
+	unsigned long error;
+} async_ssl_work_op;
+
+static void handshake_work_cb(uv_work_t *req)
+{
+	async_ssl_work_op *op;
+
+	int code;
+
+	op = (async_ssl_work_op *) req->data;
+
+	ZEND_ASSERT(op != NULL);
+
+	// OpenSSL error queue is thread-local, errors must be fetched within the worker thread.
+	ERR_clear_error();
+
+	code = SSL_do_handshake(op->ssl);
+
+	op->status = SSL_get_error(op->ssl, code);
+
+	if (!is_ssl_continue_error(op->ssl, code)) {
+		op->failed = 1;
+		op->error = ERR_get_error();
+	}
+
+	ERR_clear_error();
+}
+
+static void handshake_after_work_cb(uv_work_t *req, int status)
+{
+	async_ssl_work_op *op;
+
+	op = (async_ssl_work_op *) req->data;
+
+	ZEND_ASSERT(op != NULL);
+
+	async_thread_pool_release(ASYNC_THREAD_POOL_WORK);
+
+	SSL_free(op->ssl);
+
+	if (op->owner != NULL) {
+		ASYNC_DELREF(op->owner);
+	}
+
+	// The awaiting task has been cancelled, nobody is waiting for the result.
+	if (op->base.status == ASYNC_STATUS_FAILED) {
+		ASYNC_FREE_OP(op);
+	} else {
+		ASYNC_FINISH_OP(op);
+	}
+}
+
+/*
+ * Runs a server handshake step (signing, key exchange) in the libuv thread pool. The SSL engine and the
+ * owner of its settings are referenced by the worker because the stream might be disposed if the awaiting
+ * task is cancelled.
+ */
+static int offload_handshake(async_stream *stream, async_ssl_handshake_data *data, int *status)
+{
+	async_ssl_work_op *op;
+
+	int code;
+
+	if (async_thread_pool_acquire(ASYNC_THREAD_POOL_WORK) == FAILURE) {
+		data->uv_error = UV_ECANCELED;
+
+		return FAILURE;
+	}
+
+	ASYNC_ALLOC_CUSTOM_OP(op, sizeof(async_ssl_work_op));
+
+	op->req.data = op;
+	op->ssl = stream->ssl.ssl;
+	op->owner = data->owner;
+
+	SSL_up_ref(op->ssl);
+
+	if (op->owner != NULL) {
+		ASYNC_ADDREF(op->owner);
+	}
+
+	code = uv_queue_work(stream->handle->loop, &op->req, handshake_work_cb, handshake_after_work_cb);
+
+	if (code < 0) {
+		async_thread_pool_release(ASYNC_THREAD_POOL_WORK);
+
+		SSL_free(op->ssl);
+
+		if (op->owner != NULL) {
+			ASYNC_DELREF(op->owner);
+		}
+
+		ASYNC_FREE_OP(op);
+
+		data->uv_error = code;
+
+		return FAILURE;
+	}
+
+	if (await_op(stream, (async_op *) op) == FAILURE) {
+		ASYNC_FORWARD_OP_ERROR(op);
+
+		uv_cancel((uv_req_t *) &op->req);
+
+		op->base.status = ASYNC_STATUS_FAILED;
+
+		return FAILURE;
+	}
+
+	*status = op->status;
+	code = op->failed ? FAILURE : SUCCESS;
+
+	if (code == FAILURE) {
+		data->ssl_error = op->error;
+	}
+
+	ASYNC_FREE_OP(op);
+
+	return code;
+}
+
+#endif
+
+static int do_handshake(async_stream *stream, async_ssl_handshake_data *data, int *status)
+{
+	int code;
+
+#ifdef ASYNC_TLS_OFFLOAD
+	if (data->offload) {
+		return offload_handshake(stream, data, status);
+	}
+#endif
+
+	ERR_clear_error();
+
+	code = SSL_do_handshake(stream->ssl.ssl);
+
+	if (!is_ssl_continue_error(stream->ssl.ssl, code)) {
+		data->ssl_error = ERR_get_error();
+
+		return FAILURE;
+	}
+
+	*status = SSL_get_error(stream->ssl.ssl, code);
+
+	return SUCCESS;
+}
+
+#ifdef ASYNC_TLS_KTLS
+
+/* Handshake records are written directly to the socket in kTLS mode, the socket is polled like during file transfers. */
+static int ktls_wait_writable(async_stream *stream)
+{
+	async_stream_poll *poll;
+	int result;
+
+	poll = NULL;
+	result = await_writable(stream, &poll);
+
+	if (poll != NULL) {
+		dispose_poll(poll);
+	}
+
+	return result;
+}
+
+static void ktls_enable(async_stream *stream)
+{
+	uv_os_fd_t fd;
+	BIO *bio;
+
+	// Never bypass writes that are still queued in libuv.
+	if (stream->writes.first != NULL || stream->handle->write_queue_size > 0) {
+		return;
+	}
+
+	if (uv_fileno((uv_handle_t *) stream->handle, &fd) != 0) {
+		return;
+	}
+
+	/*
+	 * OpenSSL can only install kTLS keys on socket BIOs. Writes go to the socket while reads keep
+	 * using the memory BIO fed by libuv, so only the send direction is offloaded (no control
+	 * records are ever returned by the kernel to libuv reads).
+	 */
+	if (NULL == (bio = BIO_new_socket((int) fd, BIO_NOCLOSE))) {
+		return;
+	}
+
+	SSL_set_options(stream->ssl.ssl, SSL_OP_ENABLE_KTLS);
+	SSL_set0_wbio(stream->ssl.ssl, bio);
+
+	stream->ssl.wbio = bio;
+}
+
+static void ktls_finish(async_stream *stream)
+{
+	BIO *bio;
+
+	if (BIO_get_ktls_send(stream->ssl.wbio)) {
+		stream->ssl.ktls = 1;
+
+		return;
+	}
+
+	// Kernel does not support kTLS (or the negotiated cipher), fall back to memory BIO.
+	bio = BIO_new(BIO_s_mem());
+	BIO_set_mem_eof_return(bio, -1);
+
+	SSL_set0_wbio(stream->ssl.ssl, bio);
+
+	stream->ssl.wbio = bio;
+}
+
+#endif
+
 int async_stream_ssl_handshake(async_stream *stream, async_ssl_handshake_data *data)
 {
 	X509 *cert;
 
 	long result;
+	int status;
 	int code;
 	
 	ZEND_ASSERT(stream->ssl.ssl != NULL);
 
+#ifdef ASYNC_TLS_KTLS
+	if (data->ktls) {
+		// Records are written to the socket directly from now on, data queued in libuv must be sent first.
+		if (SUCCESS != flush_writes(stream)) {
+			return FAILURE;
+		}
+
+		ktls_enable(stream);
+	}
+#endif
+
+	status = SSL_ERROR_WANT_READ;
+
 	if (data->host == NULL) {
 		SSL_set_accept_state(stream->ssl.ssl);
 	} else {
@@ -1087,14 +1767,8 @@ int async_stream_ssl_handshake(async_stream *stream, async_ssl_handshake_data *d
 #ifdef ASYNC_TLS_SNI
 		SSL_set_tlsext_host_name(stream->ssl.ssl, data->host);
 #endif
-		
-		ERR_clear_error();
-		
-		code = SSL_do_handshake(stream->ssl.ssl);
 
-		if (!is_ssl_continue_error(stream->ssl.ssl, code)) {
-			data->ssl_error = ERR_get_error();
-			
+		if (SUCCESS != do_handshake(stream, data, &status)) {
 			return FAILURE;
 		}
 	}
@@ -1110,17 +1784,21 @@ int async_stream_ssl_handshake(async_stream *stream, async_ssl_handshake_data *d
 			return FAILURE;
 		}
 
+#ifdef ASYNC_TLS_KTLS
+		if (status == SSL_ERROR_WANT_WRITE) {
+			if (SUCCESS != ktls_wait_writable(stream)) {
+				return FAILURE;
+			}
+		} else if (SUCCESS != receive_handshake_bytes(stream, data)) {
+			return FAILURE;
+		}
+#else
 		if (SUCCESS != receive_handshake_bytes(stream, data)) {
 			return FAILURE;
 		}
-		
-		ERR_clear_error();
-
-		code = SSL_do_handshake(stream->ssl.ssl);
+#endif
 
-		if (!is_ssl_continue_error(stream->ssl.ssl, code)) {
-			data->ssl_error = ERR_get_error();
-			
+		if (SUCCESS != do_handshake(stream, data, &status)) {
 			return FAILURE;
 		}
 	}
@@ -1138,6 +1816,12 @@ int async_stream_ssl_handshake(async_stream *stream, async_ssl_handshake_data *d
 	if (SUCCESS != send_handshake_bytes(stream, data)) {
 		return FAILURE;
 	}
+
+#ifdef ASYNC_TLS_KTLS
+	if (data->ktls) {
+		ktls_finish(stream);
+	}
+#endif
 	
 	if (data->host != NULL) {
 		char buffer[1024];
@@ -415,6 +415,10 @@ ZEND_METHOD(TcpSocket, connect)
 		if (socket->encryption->settings.peer_name == NULL) {
 			socket->encryption->settings.peer_name = zend_string_copy(socket->name);
 		}
+
+		if (socket->encryption->settings.sessions != NULL) {
+			socket->encryption->settings.session_key = strpprintf(0, "%s:%d", ZSTR_VAL(socket->name), (int) port);
+		}
 #else
 		zend_throw_exception_ex(async_socket_exception_ce, 0, "Socket encryption requires async extension to be compiled with SSL support");
 		ASYNC_DELREF(&socket->std);
@@ -550,6 +554,32 @@ ZEND_METHOD(TcpSocket, getRemotePort)
 	RETURN_LONG(socket->remote_port);
 }
 
+ZEND_METHOD(TcpSocket, getAlpnProtocol)
+{
+#if defined(HAVE_ASYNC_SSL) && defined(ASYNC_TLS_ALPN)
+	async_tcp_socket *socket;
+
+	const unsigned char *protocol;
+	unsigned int len;
+#endif
+
+	ZEND_PARSE_PARAMETERS_NONE();
+
+#if defined(HAVE_ASYNC_SSL) && defined(ASYNC_TLS_ALPN)
+	socket = (async_tcp_socket *) Z_OBJ_P(getThis());
+
+	if (socket->stream == NULL || socket->stream->ssl.ssl == NULL) {
+		return;
+	}
+
+	SSL_get0_alpn_selected(socket->stream->ssl.ssl, &protocol, &len);
+
+	if (len > 0) {
+		RETURN_STRINGL((const char *) protocol, len);
+	}
+#endif
+}
+
 ZEND_METHOD(TcpSocket, setOption)
 {
 	async_tcp_socket *socket;
@@ -709,6 +739,110 @@ ZEND_METHOD(TcpSocket, writeAsync)
 	}
 }
 
+ZEND_METHOD(TcpSocket, sendFile)
+{
+	async_tcp_socket *socket;
+	php_stream *stream;
+	
+	zval *file;
+	zend_long offset;
+	zval *len;
+	
+	uv_stat_t stat;
+	uv_file fd;
+	zend_bool opened;
+	size_t length;
+	size_t sent;
+	int code;
+	
+	offset = 0;
+	len = NULL;
+	
+	ZEND_PARSE_PARAMETERS_START_EX(ZEND_PARSE_PARAMS_THROW, 1, 3)
+		Z_PARAM_ZVAL(file)
+		Z_PARAM_OPTIONAL
+		Z_PARAM_LONG(offset)
+		Z_PARAM_ZVAL(len)
+	ZEND_PARSE_PARAMETERS_END();
+	
+	socket = (async_tcp_socket *) Z_OBJ_P(getThis());
+
+	if (Z_TYPE_P(&socket->write_error) != IS_UNDEF) {
+		Z_ADDREF_P(&socket->write_error);
+
+		execute_data->opline--;
+		zend_throw_exception_internal(&socket->write_error);
+		execute_data->opline++;
+
+		return;
+	}
+	
+	ASYNC_CHECK_EXCEPTION(offset < 0, async_socket_exception_ce, "Invalid file offset: %d", (int) offset);
+	
+	if (len != NULL && Z_TYPE_P(len) != IS_NULL) {
+		ASYNC_CHECK_EXCEPTION(zval_get_long(len) < 0, async_socket_exception_ce, "Invalid length: %d", (int) zval_get_long(len));
+	}
+	
+	if (Z_TYPE_P(file) == IS_RESOURCE) {
+		php_stream_from_zval(stream, file);
+		
+		if (async_filesystem_get_file(stream, &fd) == FAILURE) {
+			if (EG(exception) == NULL) {
+				zend_throw_exception_ex(async_socket_exception_ce, 0, "Stream cannot be used as a file");
+			}
+			
+			return;
+		}
+		
+		opened = 0;
+	} else {
+		ASYNC_CHECK_ERROR(Z_TYPE_P(file) != IS_STRING, "File must be a path or a stream resource");
+		
+		code = async_filesystem_open(Z_STRVAL_P(file), UV_FS_O_RDONLY, 0);
+		
+		if (code < 0) {
+			if (EG(exception) == NULL) {
+				zend_throw_exception_ex(async_socket_exception_ce, 0, "Failed to open file %s: %s", Z_STRVAL_P(file), uv_strerror(code));
+			}
+			
+			return;
+		}
+		
+		fd = (uv_file) code;
+		opened = 1;
+	}
+	
+	if (len == NULL || Z_TYPE_P(len) == IS_NULL) {
+		code = async_filesystem_fstat(fd, &stat);
+		
+		if (code < 0) {
+			if (EG(exception) == NULL) {
+				zend_throw_exception_ex(async_socket_exception_ce, 0, "Failed to stat file: %s", uv_strerror(code));
+			}
+			
+			length = 0;
+		} else {
+			length = ((int64_t) stat.st_size > offset) ? (size_t) (stat.st_size - offset) : 0;
+		}
+	} else {
+		length = (size_t) zval_get_long(len);
+	}
+	
+	sent = 0;
+	
+	if (EG(exception) == NULL) {
+		async_stream_sendfile(socket->stream, fd, (int64_t) offset, length, &sent);
+	}
+	
+	if (opened) {
+		async_filesystem_close(fd);
+	}
+	
+	if (EXPECTED(EG(exception) == NULL)) {
+		RETURN_LONG((zend_long) sent);
+	}
+}
+
 ZEND_METHOD(TcpSocket, getWriteQueueSize)
 {
 	async_tcp_socket *socket;
@@ -742,6 +876,7 @@ ZEND_METHOD(TcpSocket, encrypt)
 #else
 
 	async_tcp_socket *socket;
+	async_ssl_settings *settings;
 	async_ssl_handshake_data data;
 
 	char name[256];
@@ -752,20 +887,32 @@ ZEND_METHOD(TcpSocket, encrypt)
 	socket = (async_tcp_socket *) Z_OBJ_P(getThis());
 
 	if (socket->server == NULL) {
+		ASYNC_CHECK_EXCEPTION(socket->encryption == NULL, async_socket_exception_ce, "No encryption settings have been passed to TcpSocket::connect()");
+
+		settings = &socket->encryption->settings;
+
 		socket->stream->ssl.ctx = async_ssl_create_context();
 		
-		async_ssl_setup_verify_callback(socket->stream->ssl.ctx, &socket->encryption->settings);
+		async_ssl_setup_verify_callback(socket->stream->ssl.ctx, settings);
 	} else {
 		ASYNC_CHECK_EXCEPTION(socket->server->encryption == NULL, async_socket_exception_ce, "No encryption settings have been passed to TcpServer::listen()");
 
+		settings = &socket->server->encryption->settings;
+
 		socket->stream->ssl.ctx = socket->server->ctx;
 	}
 	
 	async_ssl_create_engine(&socket->stream->ssl);
-	async_ssl_setup_encryption(socket->stream->ssl.ssl, &socket->encryption->settings);
+	async_ssl_setup_encryption(socket->stream->ssl.ssl, settings);
+
+	if (socket->server == NULL) {
+		async_ssl_setup_client_session(socket->stream->ssl.ctx, socket->stream->ssl.ssl, settings);
+	}
 	
 	ZEND_SECURE_ZERO(&data, sizeof(async_ssl_handshake_data));
 
+	data.ktls = settings->ktls;
+
 	if (socket->server == NULL) {
 		if (socket->encryption != NULL && socket->encryption->settings.peer_name != NULL) {
 			strcpy(name, ZSTR_VAL(socket->encryption->settings.peer_name));
@@ -775,6 +922,11 @@ ZEND_METHOD(TcpSocket, encrypt)
 		
 		data.host = name;
 		data.allow_self_signed = socket->encryption->settings.allow_self_signed;
+	} else if (settings->offload) {
+		data.offload = 1;
+		data.owner = &socket->server->encryption->std;
+
+		async_ssl_rotate_ticket_keys(settings);
 	}
 	
 	uv_tcp_nodelay(&socket->handle, 1);
@@ -789,6 +941,11 @@ ZEND_METHOD(TcpSocket, encrypt)
 			zend_string_release(data.error);
 			return;
 		}
+		
+		// Cancellation of the task has already been forwarded as an error.
+		if (EG(exception) != NULL) {
+			return;
+		}
 	
 		if (data.uv_error < 0) {
 			zend_throw_exception_ex(async_socket_exception_ce, 0, "SSL handshake failed due to network error: %s", uv_strerror(data.uv_error));
@@ -799,11 +956,16 @@ ZEND_METHOD(TcpSocket, encrypt)
 			zend_throw_exception_ex(async_socket_exception_ce, 0, "SSL handshake failed [%d]: %s", data.ssl_error, ERR_reason_error_string(data.ssl_error));
 			return;
 		}
+		
+		zend_throw_exception_ex(async_socket_exception_ce, 0, "SSL handshake failed");
+		return;
 	}
 	
 	if (data.error != NULL) {
 		zend_string_release(data.error);
 	}
+
+	async_ssl_update_session_stats(socket->stream->ssl.ssl, settings);
 	
 #endif
 }
@@ -833,6 +995,9 @@ ZEND_END_ARG_INFO()
 ZEND_BEGIN_ARG_WITH_RETURN_TYPE_INFO_EX(arginfo_tcp_socket_get_remote_port, 0, 0, IS_LONG, 1)
 ZEND_END_ARG_INFO()
 
+ZEND_BEGIN_ARG_WITH_RETURN_TYPE_INFO_EX(arginfo_tcp_socket_get_alpn_protocol, 0, 0, IS_STRING, 1)
+ZEND_END_ARG_INFO()
+
 ZEND_BEGIN_ARG_WITH_RETURN_TYPE_INFO_EX(arginfo_tcp_socket_set_option, 0, 2, _IS_BOOL, 0)
 	ZEND_ARG_TYPE_INFO(0, option, IS_LONG, 0)
 	ZEND_ARG_INFO(0, value)
@@ -853,6 +1018,12 @@ ZEND_BEGIN_ARG_WITH_RETURN_TYPE_INFO_EX(arginfo_tcp_socket_write_async, 0, 1, IS
 	ZEND_ARG_TYPE_INFO(0, data, IS_STRING, 0)
 ZEND_END_ARG_INFO()
 
+ZEND_BEGIN_ARG_WITH_RETURN_TYPE_INFO_EX(arginfo_tcp_socket_send_file, 0, 1, IS_LONG, 0)
+	ZEND_ARG_INFO(0, file)
+	ZEND_ARG_TYPE_INFO(0, offset, IS_LONG, 0)
+	ZEND_ARG_TYPE_INFO(0, length, IS_LONG, 1)
+ZEND_END_ARG_INFO()
+
 ZEND_BEGIN_ARG_WITH_RETURN_TYPE_INFO_EX(arginfo_tcp_socket_get_write_queue_size, 0, 0, IS_LONG, 0)
 ZEND_END_ARG_INFO()
 
@@ -871,10 +1042,12 @@ static const zend_function_entry async_tcp_socket_functions[] = {
 	ZEND_ME(TcpSocket, setOption, arginfo_tcp_socket_set_option, ZEND_ACC_PUBLIC)
 	ZEND_ME(TcpSocket, getRemoteAddress, arginfo_tcp_socket_get_remote_address, ZEND_ACC_PUBLIC)
 	ZEND_ME(TcpSocket, getRemotePort, arginfo_tcp_socket_get_remote_port, ZEND_ACC_PUBLIC)
+	ZEND_ME(TcpSocket, getAlpnProtocol, arginfo_tcp_socket_get_alpn_protocol, ZEND_ACC_PUBLIC)
 	ZEND_ME(TcpSocket, read, arginfo_tcp_socket_read, ZEND_ACC_PUBLIC)
 	ZEND_ME(TcpSocket, getReadableStream, arginfo_tcp_socket_get_readable_stream, ZEND_ACC_PUBLIC)
 	ZEND_ME(TcpSocket, write, arginfo_tcp_socket_write, ZEND_ACC_PUBLIC)
 	ZEND_ME(TcpSocket, writeAsync, arginfo_tcp_socket_write_async, ZEND_ACC_PUBLIC)
+	ZEND_ME(TcpSocket, sendFile, arginfo_tcp_socket_send_file, ZEND_ACC_PUBLIC)
 	ZEND_ME(TcpSocket, getWriteQueueSize, arginfo_tcp_socket_get_write_queue_size, ZEND_ACC_PUBLIC)
 	ZEND_ME(TcpSocket, getWritableStream, arginfo_tcp_socket_get_writable_stream, ZEND_ACC_PUBLIC)
 	ZEND_ME(TcpSocket, encrypt, arginfo_tcp_socket_encrypt, ZEND_ACC_PUBLIC)
@@ -1210,6 +1383,7 @@ ZEND_METHOD(TcpServer, listen)
 		SSL_CTX_use_PrivateKey_file(server->ctx, ZSTR_VAL(server->encryption->cert.key), SSL_FILETYPE_PEM);
 
 		async_ssl_setup_sni(server->ctx, server->encryption);
+		async_ssl_setup_server_sessions(server->ctx, &server->encryption->settings);
 #else
 		zend_throw_exception_ex(async_socket_exception_ce, 0, "Server encryption requires async extension to be compiled with SSL support");
 		ASYNC_DELREF(&server->std);
@@ -0,0 +1,154 @@
+/*
+  +----------------------------------------------------------------------+
+  | PHP Version 7                                                        |
+  +----------------------------------------------------------------------+
+  | Copyright (c) 1997-2018 The PHP Group                                |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 3.01 of the PHP license,      |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available through the world-wide-web at the following url:           |
+  | http://www.php.net/license/3_01.txt                                  |
+  | If you did not receive a copy of the PHP license and are unable to   |
+  | obtain it through the world-wide-web, please send a note to          |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+  | Authors: Martin Schröder <m.schroeder2007@gmail.com>                 |
+  +----------------------------------------------------------------------+
+*/
+
+#include "php_async.h"
+
+#define ASYNC_THREAD_POOL_DEFAULT_SIZE 4
+#define ASYNC_THREAD_POOL_MAX_SIZE 128
+
+/* Min default limit of DNS lookups and filesystem operations, a single slow job must not serialize all others. */
+#define ASYNC_THREAD_POOL_MIN_LIMIT 2
+
+/*
+ * Libuv uses a single process-wide thread pool for DNS lookups, filesystem operations and work requests.
+ * Each class of work is assigned a max number of concurrently running jobs, jobs exceeding the limit
+ * are queued by the extension instead of occupying all threads of the pool. By default the pool
+ * is partitioned so that a slow class of work (e.g. stat calls on a network filesystem) cannot block
+ * the other classes. Limits are not reservations, their sum may exceed the size of small pools.
+ */
+
+static int get_pool_size()
+{
+	const char *val;
+	int size;
+	
+	size = (int) ASYNC_G(threadpool_size);
+	
+	if (size < 1) {
+		val = getenv("UV_THREADPOOL_SIZE");
+		size = (val == NULL) ? ASYNC_THREAD_POOL_DEFAULT_SIZE : atoi(val);
+	}
+	
+	return MAX(1, MIN(ASYNC_THREAD_POOL_MAX_SIZE, size));
+}
+
+/* Size of the libuv thread pool has to be configured before the pool is used for the first time. */
+void async_thread_pool_startup()
+{
+	char size[16];
+	
+	if (ASYNC_G(threadpool_size) < 1) {
+		return;
+	}
+	
+	snprintf(size, sizeof(size), "%d", get_pool_size());
+	
+#ifdef PHP_WIN32
+	_putenv_s("UV_THREADPOOL_SIZE", size);
+#else
+	setenv("UV_THREADPOOL_SIZE", size, 1);
+#endif
+}
+
+void async_thread_pool_init()
+{
+	async_thread_pool *pools;
+	int size;
+	
+	pools = ASYNC_G(thread_pools);
+	size = get_pool_size();
+	
+	ZEND_SECURE_ZERO(pools, sizeof(async_thread_pool) * ASYNC_THREAD_POOL_COUNT);
+	
+	pools[ASYNC_THREAD_POOL_DNS].limit = (ASYNC_G(threadpool_dns) > 0) ? (uint32_t) ASYNC_G(threadpool_dns) : MAX(ASYNC_THREAD_POOL_MIN_LIMIT, size / 4);
+	pools[ASYNC_THREAD_POOL_WORK].limit = (ASYNC_G(threadpool_work) > 0) ? (uint32_t) ASYNC_G(threadpool_work) : MAX(1, size / 4);
+	
+	if (ASYNC_G(threadpool_fs) > 0) {
+		pools[ASYNC_THREAD_POOL_FS].limit = (uint32_t) ASYNC_G(threadpool_fs);
+	} else {
+		pools[ASYNC_THREAD_POOL_FS].limit = MAX(ASYNC_THREAD_POOL_MIN_LIMIT, size - (int) pools[ASYNC_THREAD_POOL_DNS].limit - (int) pools[ASYNC_THREAD_POOL_WORK].limit);
+	}
+}
+
+/* Reserves a job slot in the given pool, suspends the calling task until a slot becomes available. */
+int async_thread_pool_acquire(int pool)
+{
+	async_thread_pool *p;
+	async_op *op;
+	
+	p = &ASYNC_G(thread_pools)[pool];
+	
+	if (p->active < p->limit) {
+		p->active++;
+		
+		return SUCCESS;
+	}
+	
+	p->queued++;
+	
+	ASYNC_ALLOC_OP(op);
+	ASYNC_ENQUEUE_OP(&p->waiting, op);
+	
+	if (async_await_op(op) == FAILURE) {
+		ASYNC_FORWARD_OP_ERROR(op);
+		ASYNC_FREE_OP(op);
+		
+		return FAILURE;
+	}
+	
+	ASYNC_FREE_OP(op);
+	
+	return SUCCESS;
+}
+
+/* Reserves a job slot only if one is available right away, used by optional background jobs. */
+int async_thread_pool_try_acquire(int pool)
+{
+	async_thread_pool *p;
+	
+	p = &ASYNC_G(thread_pools)[pool];
+	
+	if (p->active < p->limit) {
+		p->active++;
+		
+		return SUCCESS;
+	}
+	
+	return FAILURE;
+}
+
+/* Releases a job slot, the slot is handed over to the next queued job. */
+void async_thread_pool_release(int pool)
+{
+	async_thread_pool *p;
+	async_op *op;
+	
+	p = &ASYNC_G(thread_pools)[pool];
+	
+	if (p->waiting.first == NULL) {
+		p->active--;
+	} else {
+		ASYNC_DEQUEUE_OP(&p->waiting, op);
+		ASYNC_FINISH_OP(op);
+	}
+}
+
+/*
+ * vim: sw=4 ts=4
+ * vim600: fdm=marker
+ */
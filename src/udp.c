@@ -16,13 +16,40 @@
   +----------------------------------------------------------------------+
 */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
 #include "php_async.h"
 
 #include "async_task.h"
 
+#if defined(__linux__) && defined(HAVE_SENDMMSG)
+#define ASYNC_UDP_MMSG 1
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#endif
+
 #define ASYNC_SOCKET_UDP_TTL 200
 #define ASYNC_SOCKET_UDP_MULTICAST_LOOP 250
 #define ASYNC_SOCKET_UDP_MULTICAST_TTL 251
+#define ASYNC_SOCKET_UDP_SEGMENTATION 252
+
+/* Max number of datagrams being passed to a single sendmmsg() call. */
+#define ASYNC_UDP_MAX_BATCH 64
+
+/* Max number of segments and payload size of a single GSO send. */
+#define ASYNC_UDP_MAX_SEGMENTS 64
+#define ASYNC_UDP_MAX_SEGMENTS_SIZE 65000
 
 zend_class_entry *async_udp_socket_ce;
 zend_class_entry *async_udp_datagram_ce;
@@ -36,6 +63,14 @@ static zend_object *async_udp_datagram_object_create(zend_class_entry *ce);
 	zend_declare_class_constant_long(async_udp_socket_ce, name, sizeof(name)-1, (zend_long)value);
 
 #define ASYNC_UDP_FLAG_RECEIVING 1
+#define ASYNC_UDP_FLAG_SEGMENTATION 2
+#define ASYNC_UDP_FLAG_CONNECTED 4
+
+/* Size of the receive buffer, large enough to hold the max UDP payload. */
+#define ASYNC_UDP_BUFFER_SIZE 65536
+
+/* Max number of cached peer address strings. */
+#define ASYNC_UDP_MAX_PEERS 256
 
 typedef struct {
 	zend_object std;
@@ -60,11 +95,32 @@ typedef struct {
 	zval error;
 	zend_uchar ref_count;
 	
+	/* Receive buffer, datagrams are copied into strings before the next read. */
+	char *buffer;
+	
+	/* Cached peer address strings indexed by IPv4 address. */
+	HashTable *peers;
+	
+	/* Remote peer of a connected socket. */
+	struct sockaddr_in peer;
+	zend_string *peer_address;
+	
 	async_op_queue receivers;
 	async_op_queue senders;
 	async_cancel_cb cancel;
 } async_udp_socket;
 
+typedef struct {
+	async_op base;
+	int code;
+	
+	/* Max number of datagrams to be received, 0 if a single datagram is requested. */
+	uint32_t max;
+	
+	/* Receive [data, address, port] tuples instead of datagram objects. */
+	zend_bool tuples;
+} async_udp_receive_op;
+
 typedef struct {
 	async_op base;
 	async_udp_socket *socket;
@@ -141,6 +197,11 @@ static void socket_shutdown(void *obj, zval *error)
 	if (error != NULL) {
 		while (socket->receivers.first != NULL) {
 			ASYNC_DEQUEUE_OP(&socket->receivers, op);
+			
+			// Release datagrams that have already been collected by receiveMany().
+			zval_ptr_dtor(&op->result);
+			ZVAL_UNDEF(&op->result);
+			
 			ASYNC_FAIL_OP(op, &socket->error);
 		}
 		
@@ -210,6 +271,19 @@ static void async_udp_socket_object_destroy(zend_object *object)
 		zend_string_release(socket->ip);
 	}
 	
+	if (socket->buffer != NULL) {
+		efree(socket->buffer);
+	}
+	
+	if (socket->peer_address != NULL) {
+		zend_string_release(socket->peer_address);
+	}
+	
+	if (socket->peers != NULL) {
+		zend_hash_destroy(socket->peers);
+		FREE_HASHTABLE(socket->peers);
+	}
+	
 	ASYNC_DELREF(&socket->scheduler->std);
 	
 	zend_object_std_dtor(&socket->std);
@@ -261,6 +335,85 @@ ZEND_METHOD(UdpSocket, bind)
 	RETURN_ZVAL(&obj, 1, 1);
 }
 
+ZEND_METHOD(UdpSocket, connect)
+{
+	async_udp_socket *socket;
+
+	zend_string *host;
+	zend_long port;
+	
+	zval obj;
+	
+	struct sockaddr_in dest;
+	struct sockaddr_in local;
+	uv_os_fd_t fd;
+	
+	char name[17] = { 0 };
+	int code;
+	
+	ZEND_PARSE_PARAMETERS_START_EX(ZEND_PARSE_PARAMS_THROW, 2, 2)
+		Z_PARAM_STR(host)
+		Z_PARAM_LONG(port)
+	ZEND_PARSE_PARAMETERS_END();
+	
+	code = async_dns_lookup_ipv4(ZSTR_VAL(host), &dest, IPPROTO_UDP);
+	
+	ASYNC_CHECK_EXCEPTION(code < 0, async_socket_exception_ce, "Failed to assemble IP address: %s", uv_strerror(code));
+	
+	dest.sin_port = htons(port);
+	
+	uv_ip4_addr("0.0.0.0", 0, &local);
+	
+	socket = async_udp_socket_object_create();
+	socket->name = zend_string_copy(host);
+	
+	code = uv_udp_bind(&socket->handle, (const struct sockaddr *) &local, 0);
+	
+	if (UNEXPECTED(code != 0)) {
+		zend_throw_exception_ex(async_socket_exception_ce, 0, "Failed to bind UDP socket: %s", uv_strerror(code));
+		ASYNC_DELREF(&socket->std);
+		return;
+	}
+	
+	// Bundled libuv does not provide uv_udp_connect(), the socket is connected using the OS handle.
+	code = uv_fileno((uv_handle_t *) &socket->handle, &fd);
+	
+	if (code == 0) {
+#ifdef PHP_WIN32
+		if (0 != connect((SOCKET) fd, (const struct sockaddr *) &dest, sizeof(struct sockaddr_in))) {
+			code = uv_translate_sys_error(WSAGetLastError());
+		}
+#else
+		if (0 != connect(fd, (const struct sockaddr *) &dest, sizeof(struct sockaddr_in))) {
+			code = uv_translate_sys_error(errno);
+		}
+#endif
+	}
+	
+	if (UNEXPECTED(code != 0)) {
+		zend_throw_exception_ex(async_socket_exception_ce, 0, "Failed to connect UDP socket: %s", uv_strerror(code));
+		ASYNC_DELREF(&socket->std);
+		return;
+	}
+	
+	uv_ip4_name(&dest, name, 16);
+	
+	socket->flags |= ASYNC_UDP_FLAG_CONNECTED;
+	socket->peer = dest;
+	socket->peer_address = zend_string_init(name, strlen(name), 0);
+	
+	assemble_peer(socket, return_value, execute_data);
+	
+	if (UNEXPECTED(EG(exception))) {
+		ASYNC_DELREF(&socket->std);
+		return;
+	}
+	
+	ZVAL_OBJ(&obj, &socket->std);
+
+	RETURN_ZVAL(&obj, 1, 1);
+}
+
 ZEND_METHOD(UdpSocket, multicast)
 {
 	async_udp_socket *socket;
@@ -373,6 +526,37 @@ ZEND_METHOD(UdpSocket, getPort)
 	RETURN_LONG(socket->port);
 }
 
+static int set_segmentation(async_udp_socket *socket, zend_bool enable)
+{
+#ifdef ASYNC_UDP_MMSG
+	uv_os_fd_t fd;
+	int size;
+
+	if (!enable) {
+		socket->flags &= ~ASYNC_UDP_FLAG_SEGMENTATION;
+
+		return 0;
+	}
+
+	if (uv_fileno((uv_handle_t *) &socket->handle, &fd) != 0) {
+		return UV_EBADF;
+	}
+
+	// Older kernels ignore the control message, probe for support to avoid sending a single huge datagram.
+	size = 0;
+
+	if (setsockopt(fd, SOL_UDP, UDP_SEGMENT, &size, sizeof(size)) != 0) {
+		return uv_translate_sys_error(errno);
+	}
+
+	socket->flags |= ASYNC_UDP_FLAG_SEGMENTATION;
+
+	return 0;
+#else
+	return enable ? UV_ENOTSUP : 0;
+#endif
+}
+
 ZEND_METHOD(UdpSocket, setOption)
 {
 	async_udp_socket *socket;
@@ -400,49 +584,101 @@ ZEND_METHOD(UdpSocket, setOption)
 	case ASYNC_SOCKET_UDP_MULTICAST_TTL:
 		code = uv_udp_set_multicast_ttl(&socket->handle, (int) Z_LVAL_P(val));
 		break;
+	case ASYNC_SOCKET_UDP_SEGMENTATION:
+		code = set_segmentation(socket, zend_is_true(val));
+		break;
 	}
 
 	RETURN_BOOL((code < 0) ? 0 : 1);
 }
 
+static zend_string *get_peer_address(async_udp_socket *socket, const struct sockaddr_in *addr)
+{
+	zend_string *str;
+	zval *entry;
+	zval tmp;
+	
+	char peer[17] = { 0 };
+	
+	if (socket->peers == NULL) {
+		ALLOC_HASHTABLE(socket->peers);
+		zend_hash_init(socket->peers, 16, NULL, ZVAL_PTR_DTOR, 0);
+	} else if (NULL != (entry = zend_hash_index_find(socket->peers, (zend_ulong) addr->sin_addr.s_addr))) {
+		return zend_string_copy(Z_STR_P(entry));
+	}
+	
+	if (zend_hash_num_elements(socket->peers) >= ASYNC_UDP_MAX_PEERS) {
+		zend_hash_clean(socket->peers);
+	}
+	
+	uv_ip4_name(addr, peer, 16);
+	
+	str = zend_string_init(peer, strlen(peer), 0);
+	
+	ZVAL_STR(&tmp, str);
+	zend_hash_index_add_new(socket->peers, (zend_ulong) addr->sin_addr.s_addr, &tmp);
+	
+	return zend_string_copy(str);
+}
+
 static void socket_received(uv_udp_t *udp, ssize_t nread, const uv_buf_t *buffer, const struct sockaddr* addr, unsigned int flags)
 {
 	async_udp_socket *socket;
 	async_udp_datagram *datagram;
-	async_uv_op *op;
+	async_udp_receive_op *op;
 	
-	char peer[17] = { 0 };
+	zval obj;
 	
 	socket = (async_udp_socket *) udp->data;
 	
 	ZEND_ASSERT(socket != NULL);
 	ZEND_ASSERT(socket->receivers.first != NULL);
 	
-	if (nread == 0) {
-		efree(buffer->base);
-		
-		return;
-	}
-	
-	ASYNC_DEQUEUE_CUSTOM_OP(&socket->receivers, op, async_uv_op);
+	op = (async_udp_receive_op *) socket->receivers.first;
 	
-	if (nread > 0) {
-		uv_ip4_name((struct sockaddr_in *) addr, peer, 16);
+	// libuv reports an empty read once the socket has been drained, a pending batch is complete.
+	if (nread == 0) {
+		if (op->max > 0 && Z_TYPE_P(&op->base.result) == IS_ARRAY) {
+			ASYNC_FINISH_OP(op);
+		}
+	} else if (nread < 0) {
+		// Deliver datagrams that have already been received in a batch, the error is dropped.
+		if (Z_TYPE_P(&op->base.result) != IS_ARRAY) {
+			op->code = (int) nread;
+		}
 		
-		datagram = (async_udp_datagram *) async_udp_datagram_object_create(async_udp_datagram_ce);
-		datagram->data = zend_string_init(buffer->base, (int) nread, 0);
-		datagram->address = zend_string_init(peer, strlen(peer), 0);
-		datagram->port = ntohs(((struct sockaddr_in *) addr)->sin_port);
+		ASYNC_FINISH_OP(op);
+	} else {
+		if (op->tuples) {
+			array_init_size(&obj, 3);
+			
+			add_next_index_str(&obj, zend_string_init(buffer->base, (int) nread, 0));
+			add_next_index_str(&obj, get_peer_address(socket, (const struct sockaddr_in *) addr));
+			add_next_index_long(&obj, ntohs(((const struct sockaddr_in *) addr)->sin_port));
+		} else {
+			datagram = (async_udp_datagram *) async_udp_datagram_object_create(async_udp_datagram_ce);
+			datagram->data = zend_string_init(buffer->base, (int) nread, 0);
+			datagram->address = get_peer_address(socket, (const struct sockaddr_in *) addr);
+			datagram->port = ntohs(((const struct sockaddr_in *) addr)->sin_port);
+			
+			ZVAL_OBJ(&obj, &datagram->std);
+		}
 		
-		efree(buffer->base);
+		if (op->max == 0) {
+			ZVAL_COPY_VALUE(&op->base.result, &obj);
+		} else {
+			if (Z_TYPE_P(&op->base.result) != IS_ARRAY) {
+				array_init_size(&op->base.result, MIN(op->max, 64));
+			}
+			
+			zend_hash_next_index_insert(Z_ARRVAL_P(&op->base.result), &obj);
+		}
 		
-		ZVAL_OBJ(&op->base.result, &datagram->std);
+		if (op->max == 0 || zend_hash_num_elements(Z_ARRVAL_P(&op->base.result)) >= op->max) {
+			ASYNC_FINISH_OP(op);
+		}
 	}
 	
-	op->code = (int) nread;
-	
-	ASYNC_FINISH_OP(op);
-	
 	if (socket->receivers.first == NULL) {
 		uv_udp_recv_stop(udp);
 		
@@ -452,22 +688,28 @@ static void socket_received(uv_udp_t *udp, ssize_t nread, const uv_buf_t *buffer
 
 static void socket_alloc_buffer(uv_handle_t *handle, size_t suggested_size, uv_buf_t *buffer)
 {
-	buffer->base = emalloc(8192);
-	buffer->len = 8192;
+	async_udp_socket *socket;
+	
+	socket = (async_udp_socket *) handle->data;
+	
+	ZEND_ASSERT(socket != NULL);
+	
+	// A single buffer is sufficient because received data is copied before libuv reads the next datagram.
+	if (socket->buffer == NULL) {
+		socket->buffer = emalloc(ASYNC_UDP_BUFFER_SIZE);
+	}
+	
+	buffer->base = socket->buffer;
+	buffer->len = ASYNC_UDP_BUFFER_SIZE;
 }
 
-ZEND_METHOD(UdpSocket, receive)
+static void receive_datagrams(async_udp_socket *socket, uint32_t max, zend_bool tuples, zval *return_value, zend_execute_data *execute_data)
 {
-	async_udp_socket *socket;
 	async_context *context;
-	async_uv_op *op;
+	async_udp_receive_op *op;
 	
 	int code;
 	
-	ZEND_PARSE_PARAMETERS_NONE();
-	
-	socket = (async_udp_socket *) Z_OBJ_P(getThis());
-	
 	if (Z_TYPE_P(&socket->error) != IS_UNDEF) {
 		Z_ADDREF_P(&socket->error);
 
@@ -488,9 +730,12 @@ ZEND_METHOD(UdpSocket, receive)
 	
 	context = async_context_get();
 	
-	ASYNC_ALLOC_CUSTOM_OP(op, sizeof(async_uv_op));
+	ASYNC_ALLOC_CUSTOM_OP(op, sizeof(async_udp_receive_op));
 	ASYNC_ENQUEUE_OP(&socket->receivers, op);
 	
+	op->max = max;
+	op->tuples = tuples;
+	
 	ASYNC_UNREF_ENTER(context, socket);
 	
 	if (async_await_op((async_op *) op) == FAILURE) {
@@ -502,7 +747,7 @@ ZEND_METHOD(UdpSocket, receive)
 	if (EXPECTED(EG(exception) == NULL)) {
 		if (op->code < 0) {
 			zend_throw_exception_ex(async_stream_exception_ce, 0,  "UDP receive error: %s", uv_strerror(op->code));
-		} else if (USED_RET()) {
+		} else {
 			ZVAL_COPY(return_value, &op->base.result);
 		}
 	}
@@ -510,6 +755,76 @@ ZEND_METHOD(UdpSocket, receive)
 	ASYNC_FREE_OP(op);
 }
 
+ZEND_METHOD(UdpSocket, receive)
+{
+	ZEND_PARSE_PARAMETERS_NONE();
+	
+	receive_datagrams((async_udp_socket *) Z_OBJ_P(getThis()), 0, 0, return_value, execute_data);
+}
+
+ZEND_METHOD(UdpSocket, receiveMany)
+{
+	zend_long max;
+	
+	ZEND_PARSE_PARAMETERS_START_EX(ZEND_PARSE_PARAMS_THROW, 1, 1)
+		Z_PARAM_LONG(max)
+	ZEND_PARSE_PARAMETERS_END();
+	
+	ASYNC_CHECK_ERROR(max < 1, "Max number of datagrams must be at least 1");
+	
+	receive_datagrams((async_udp_socket *) Z_OBJ_P(getThis()), (uint32_t) MIN(max, UINT32_MAX), 0, return_value, execute_data);
+}
+
+ZEND_METHOD(UdpSocket, receiveInto)
+{
+	zval *buffer;
+	zval *entry;
+	zval result;
+	
+	zend_long max;
+	uint32_t count;
+	
+	max = 1;
+	
+	ZEND_PARSE_PARAMETERS_START_EX(ZEND_PARSE_PARAMS_THROW, 1, 2)
+		Z_PARAM_ZVAL_DEREF(buffer)
+		Z_PARAM_OPTIONAL
+		Z_PARAM_LONG(max)
+	ZEND_PARSE_PARAMETERS_END();
+	
+	ASYNC_CHECK_ERROR(max < 1, "Max number of datagrams must be at least 1");
+	
+	ZVAL_NULL(&result);
+	
+	receive_datagrams((async_udp_socket *) Z_OBJ_P(getThis()), (uint32_t) MIN(max, UINT32_MAX), 1, &result, execute_data);
+	
+	if (Z_TYPE_P(&result) != IS_ARRAY) {
+		zval_ptr_dtor(&result);
+		
+		return;
+	}
+	
+	count = zend_hash_num_elements(Z_ARRVAL_P(&result));
+	
+	// Received datagrams are collected in the op result, the buffer is not touched before the task is resumed.
+	// It is read only at this point because another task might have changed the referenced array meanwhile.
+	if (Z_TYPE_P(buffer) != IS_ARRAY || zend_hash_num_elements(Z_ARRVAL_P(buffer)) == 0) {
+		zval_ptr_dtor(buffer);
+		ZVAL_COPY_VALUE(buffer, &result);
+	} else {
+		SEPARATE_ARRAY(buffer);
+		
+		ZEND_HASH_FOREACH_VAL(Z_ARRVAL_P(&result), entry) {
+			Z_ADDREF_P(entry);
+			zend_hash_next_index_insert(Z_ARRVAL_P(buffer), entry);
+		} ZEND_HASH_FOREACH_END();
+		
+		zval_ptr_dtor(&result);
+	}
+	
+	RETURN_LONG(count);
+}
+
 static void socket_sent(uv_udp_send_t *req, int status)
 {
 	async_udp_send_op *op;
@@ -530,13 +845,98 @@ static void socket_sent(uv_udp_send_t *req, int status)
 	}	
 }
 
+/* Determines payload and destination of a datagram, connected sockets also accept a string payload. */
+static int get_send_target(async_udp_socket *socket, zval *val, zend_string **data, struct sockaddr_in *dest)
+{
+	async_udp_datagram *datagram;
+	
+	int code;
+	
+	if (Z_TYPE_P(val) == IS_STRING) {
+		if (!(socket->flags & ASYNC_UDP_FLAG_CONNECTED)) {
+			zend_throw_exception_ex(async_socket_exception_ce, 0, "Cannot send data without a peer address using an unconnected UDP socket");
+			return FAILURE;
+		}
+		
+		*data = Z_STR_P(val);
+		*dest = socket->peer;
+		
+		return SUCCESS;
+	}
+	
+	if (Z_TYPE_P(val) != IS_OBJECT || Z_OBJCE_P(val) != async_udp_datagram_ce) {
+		zend_throw_error(zend_ce_type_error, "Data to be sent must be a UDP datagram or a string");
+		return FAILURE;
+	}
+	
+	datagram = (async_udp_datagram *) Z_OBJ_P(val);
+	
+	code = uv_ip4_addr(ZSTR_VAL(datagram->address), (int) datagram->port, dest);
+	
+	if (UNEXPECTED(code != 0)) {
+		zend_throw_exception_ex(async_socket_exception_ce, 0, "Failed to assemble remote IP address: %s", uv_strerror(code));
+		return FAILURE;
+	}
+	
+	*data = datagram->data;
+	
+	return SUCCESS;
+}
+
+/* Returns a datagram that can be referenced by a pending send operation. */
+static async_udp_datagram *get_send_datagram(async_udp_socket *socket, zval *val)
+{
+	async_udp_datagram *datagram;
+	
+	if (Z_TYPE_P(val) == IS_OBJECT) {
+		datagram = (async_udp_datagram *) Z_OBJ_P(val);
+		
+		ASYNC_ADDREF(&datagram->std);
+		
+		return datagram;
+	}
+	
+	datagram = (async_udp_datagram *) async_udp_datagram_object_create(async_udp_datagram_ce);
+	datagram->data = zend_string_copy(Z_STR_P(val));
+	datagram->address = zend_string_copy(socket->peer_address);
+	datagram->port = ntohs(socket->peer.sin_port);
+	
+	return datagram;
+}
+
+/* Attempts to send a datagram without allocating a send request, returns UV_EAGAIN if it has to be queued. */
+static int try_send(async_udp_socket *socket, uv_buf_t *buffer, struct sockaddr_in *dest)
+{
+#ifndef PHP_WIN32
+	uv_os_fd_t fd;
+	ssize_t len;
+	
+	// Connected sockets do not need a destination address, the kernel skips route lookup.
+	if ((socket->flags & ASYNC_UDP_FLAG_CONNECTED) && dest->sin_port == socket->peer.sin_port && dest->sin_addr.s_addr == socket->peer.sin_addr.s_addr) {
+		if (uv_fileno((uv_handle_t *) &socket->handle, &fd) == 0) {
+			do {
+				len = send(fd, buffer->base, buffer->len, 0);
+			} while (len < 0 && errno == EINTR);
+			
+			if (len < 0) {
+				return (errno == EAGAIN || errno == EWOULDBLOCK) ? UV_EAGAIN : uv_translate_sys_error(errno);
+			}
+			
+			return (int) len;
+		}
+	}
+#endif
+	
+	return uv_udp_try_send(&socket->handle, buffer, 1, (const struct sockaddr *) dest);
+}
+
 ZEND_METHOD(UdpSocket, send)
 {
 	async_udp_socket *socket;
-	async_udp_datagram *datagram;
 	async_udp_send_op *op;
 	
 	struct sockaddr_in dest;
+	zend_string *data;
 	uv_buf_t buffers[1];
 	int code;
 	
@@ -547,7 +947,6 @@ ZEND_METHOD(UdpSocket, send)
 	ZEND_PARSE_PARAMETERS_END();
 	
 	socket = (async_udp_socket *) Z_OBJ_P(getThis());
-	datagram = (async_udp_datagram *) Z_OBJ_P(val);
 	
 	if (Z_TYPE_P(&socket->error) != IS_UNDEF) {
 		Z_ADDREF_P(&socket->error);
@@ -559,14 +958,14 @@ ZEND_METHOD(UdpSocket, send)
 		return;
 	}
 	
-	code = uv_ip4_addr(ZSTR_VAL(datagram->address), (int) datagram->port, &dest);
-	
-	ASYNC_CHECK_EXCEPTION(code != 0, async_socket_exception_ce, "Failed to assemble remote IP address: %s", uv_strerror(code));
+	if (FAILURE == get_send_target(socket, val, &data, &dest)) {
+		return;
+	}
 	
-	buffers[0] = uv_buf_init(ZSTR_VAL(datagram->data), ZSTR_LEN(datagram->data));
+	buffers[0] = uv_buf_init(ZSTR_VAL(data), ZSTR_LEN(data));
 	
-	if (0 && socket->senders.first == NULL) {
-	    code = uv_udp_try_send(&socket->handle, buffers, 1, (const struct sockaddr *)&dest);
+	if (socket->senders.first == NULL) {
+	    code = try_send(socket, buffers, &dest);
 	    
 	    if (code >= 0) {
 	        return;
@@ -579,12 +978,13 @@ ZEND_METHOD(UdpSocket, send)
 	
 	op->req.data = op;
 	op->socket = socket;
-	op->datagram = datagram;
+	op->datagram = get_send_datagram(socket, val);
 	op->context = async_context_get();
 	
 	code = uv_udp_send(&op->req, &socket->handle, buffers, 1, (const struct sockaddr *)&dest, socket_sent);
 	
-	if (UNEXPECTED(code < 0)) {	
+	if (UNEXPECTED(code < 0)) {
+		ASYNC_DELREF(&op->datagram->std);
 		ASYNC_FREE_OP(op);
 		zend_throw_exception_ex(async_socket_exception_ce, 0, "Failed to send UDP data: %s", uv_strerror(code));
 		
@@ -592,7 +992,6 @@ ZEND_METHOD(UdpSocket, send)
 	}
 	
 	ASYNC_ADDREF(&socket->std);
-	ASYNC_ADDREF(&datagram->std);
 	
 	ASYNC_ENQUEUE_OP(&socket->senders, op);
 	ASYNC_UNREF_ENTER(op->context, socket);
@@ -608,6 +1007,168 @@ ZEND_METHOD(UdpSocket, send)
 	}
 }
 
+#ifdef ASYNC_UDP_MMSG
+
+/* Counts leading datagrams with the same peer and size that can be sent as segments of a single GSO send. */
+static int count_segments(struct sockaddr_in *addrs, uv_buf_t *bufs, int count)
+{
+	size_t size;
+	int i;
+
+	size = bufs[0].len;
+
+	if (size == 0 || count < 2) {
+		return 1;
+	}
+
+	for (i = 1; i < count && i < ASYNC_UDP_MAX_SEGMENTS && (size * (i + 1)) <= ASYNC_UDP_MAX_SEGMENTS_SIZE; i++) {
+		if (addrs[i].sin_port != addrs[0].sin_port || addrs[i].sin_addr.s_addr != addrs[0].sin_addr.s_addr) {
+			break;
+		}
+
+		// Only the last segment may be smaller than the segment size.
+		if (bufs[i].len != size) {
+			if (bufs[i].len > 0 && bufs[i].len < size) {
+				i++;
+			}
+
+			break;
+		}
+	}
+
+	return i;
+}
+
+static int send_segments(int fd, struct sockaddr_in *dest, uv_buf_t *bufs, int count)
+{
+	struct msghdr msg;
+	struct cmsghdr *cmsg;
+	struct iovec iov[ASYNC_UDP_MAX_SEGMENTS];
+
+	char control[CMSG_SPACE(sizeof(uint16_t))];
+	int code;
+	int i;
+
+	for (i = 0; i < count; i++) {
+		iov[i].iov_base = bufs[i].base;
+		iov[i].iov_len = bufs[i].len;
+	}
+
+	ZEND_SECURE_ZERO(&msg, sizeof(struct msghdr));
+	ZEND_SECURE_ZERO(control, sizeof(control));
+
+	msg.msg_name = dest;
+	msg.msg_namelen = sizeof(struct sockaddr_in);
+	msg.msg_iov = iov;
+	msg.msg_iovlen = count;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_UDP;
+	cmsg->cmsg_type = UDP_SEGMENT;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+
+	*((uint16_t *) CMSG_DATA(cmsg)) = (uint16_t) bufs[0].len;
+
+	do {
+		code = (int) sendmsg(fd, &msg, 0);
+	} while (code < 0 && errno == EINTR);
+
+	if (code < 0) {
+		return uv_translate_sys_error(errno);
+	}
+
+	return count;
+}
+
+/*
+ * Writes as many datagrams as possible directly to the socket using sendmmsg() (or GSO sends), returns the
+ * number of datagrams that have been sent. An error code is only returned if no datagram could be sent, after
+ * a partial send the caller continues from the returned offset. Must only be called if libuv has no pending
+ * send requests.
+ */
+static int try_send_batch(async_udp_socket *socket, struct sockaddr_in *addrs, uv_buf_t *bufs, int count)
+{
+	struct mmsghdr msgs[ASYNC_UDP_MAX_BATCH];
+	struct iovec iov[ASYNC_UDP_MAX_BATCH];
+
+	uv_os_fd_t fd;
+	int sent;
+	int len;
+	int code;
+	int i;
+
+	if (uv_fileno((uv_handle_t *) &socket->handle, &fd) != 0) {
+		return 0;
+	}
+
+	sent = 0;
+
+	while (sent < count) {
+		len = MIN(count - sent, ASYNC_UDP_MAX_BATCH);
+
+		if (socket->flags & ASYNC_UDP_FLAG_SEGMENTATION) {
+			i = count_segments(addrs + sent, bufs + sent, len);
+
+			if (i > 1) {
+				code = send_segments(fd, addrs + sent, bufs + sent, i);
+
+				if (code == UV_EAGAIN) {
+					break;
+				}
+
+				// Kernel or network device does not support UDP segmentation, retry without GSO.
+				if (code == UV_EIO || code == UV_EINVAL) {
+					socket->flags &= ~ASYNC_UDP_FLAG_SEGMENTATION;
+					continue;
+				}
+
+				if (code < 0) {
+					return (sent > 0) ? sent : code;
+				}
+
+				sent += i;
+				continue;
+			}
+		}
+
+		ZEND_SECURE_ZERO(msgs, sizeof(struct mmsghdr) * len);
+
+		for (i = 0; i < len; i++) {
+			iov[i].iov_base = bufs[sent + i].base;
+			iov[i].iov_len = bufs[sent + i].len;
+
+			msgs[i].msg_hdr.msg_name = &addrs[sent + i];
+			msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+			msgs[i].msg_hdr.msg_iov = &iov[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+		}
+
+		do {
+			code = sendmmsg(fd, msgs, len, 0);
+		} while (code < 0 && errno == EINTR);
+
+		if (code < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				break;
+			}
+
+			return (sent > 0) ? sent : uv_translate_sys_error(errno);
+		}
+
+		sent += code;
+
+		if (code < len) {
+			break;
+		}
+	}
+
+	return sent;
+}
+
+#endif
+
 static void socket_sent_async(uv_udp_send_t *req, int status)
 {
 	async_udp_send_op *op;
@@ -630,10 +1191,10 @@ static void socket_sent_async(uv_udp_send_t *req, int status)
 ZEND_METHOD(UdpSocket, sendAsync)
 {
 	async_udp_socket *socket;
-	async_udp_datagram *datagram;
 	async_udp_send_op *op;
 	
 	struct sockaddr_in dest;
+	zend_string *data;
 	uv_buf_t buffers[1];
 	int code;
 	
@@ -644,7 +1205,6 @@ ZEND_METHOD(UdpSocket, sendAsync)
 	ZEND_PARSE_PARAMETERS_END();
 	
 	socket = (async_udp_socket *) Z_OBJ_P(getThis());
-	datagram = (async_udp_datagram *) Z_OBJ_P(val);
 	
 	if (Z_TYPE_P(&socket->error) != IS_UNDEF) {
 		Z_ADDREF_P(&socket->error);
@@ -656,14 +1216,14 @@ ZEND_METHOD(UdpSocket, sendAsync)
 		return;
 	}
 	
-	code = uv_ip4_addr(ZSTR_VAL(datagram->address), (int) datagram->port, &dest);
-	
-	ASYNC_CHECK_EXCEPTION(code != 0, async_socket_exception_ce, "Failed to assemble remote IP address: %s", uv_strerror(code));
+	if (FAILURE == get_send_target(socket, val, &data, &dest)) {
+		return;
+	}
 	
-	buffers[0] = uv_buf_init(ZSTR_VAL(datagram->data), ZSTR_LEN(datagram->data));
+	buffers[0] = uv_buf_init(ZSTR_VAL(data), ZSTR_LEN(data));
 	
-	if (0 && socket->senders.first == NULL) {
-	    code = uv_udp_try_send(&socket->handle, buffers, 1, (const struct sockaddr *)&dest);
+	if (socket->senders.first == NULL) {
+	    code = try_send(socket, buffers, &dest);
 	    
 	    if (code >= 0) {
 	        RETURN_LONG(0);
@@ -676,12 +1236,13 @@ ZEND_METHOD(UdpSocket, sendAsync)
 	
 	op->req.data = op;
 	op->socket = socket;
-	op->datagram = datagram;
+	op->datagram = get_send_datagram(socket, val);
 	op->context = async_context_get();
 	
 	code = uv_udp_send(&op->req, &socket->handle, buffers, 1, (const struct sockaddr *)&dest, socket_sent_async);
 	
 	if (code != 0) {
+		ASYNC_DELREF(&op->datagram->std);
 		ASYNC_FREE_OP(op);		
 		zend_throw_exception_ex(async_socket_exception_ce, 0, "Failed to send UDP data: %s", uv_strerror(code));
 		
@@ -689,7 +1250,6 @@ ZEND_METHOD(UdpSocket, sendAsync)
 	}
 	
 	ASYNC_ADDREF(&socket->std);
-	ASYNC_ADDREF(&datagram->std);
 	ASYNC_ADDREF(&op->context->std);
 	
 	ASYNC_ENQUEUE_OP(&socket->senders, op);
@@ -698,11 +1258,141 @@ ZEND_METHOD(UdpSocket, sendAsync)
 	RETURN_LONG(socket->handle.send_queue_size);
 }
 
+ZEND_METHOD(UdpSocket, sendMany)
+{
+	async_udp_socket *socket;
+	async_udp_datagram **datagrams;
+	async_udp_send_op *op;
+	
+	struct sockaddr_in *addrs;
+	uv_buf_t *bufs;
+	
+	HashTable *batch;
+	zval *entry;
+	
+	uint32_t count;
+	int sent;
+	int code;
+	int i;
+	
+	ZEND_PARSE_PARAMETERS_START_EX(ZEND_PARSE_PARAMS_THROW, 1, 1)
+		Z_PARAM_ARRAY_HT(batch)
+	ZEND_PARSE_PARAMETERS_END();
+	
+	socket = (async_udp_socket *) Z_OBJ_P(getThis());
+	
+	if (Z_TYPE_P(&socket->error) != IS_UNDEF) {
+		Z_ADDREF_P(&socket->error);
+
+		execute_data->opline--;
+		zend_throw_exception_internal(&socket->error);
+		execute_data->opline++;
+
+		return;
+	}
+	
+	count = zend_hash_num_elements(batch);
+	
+	if (count == 0) {
+		return;
+	}
+	
+	datagrams = emalloc(sizeof(async_udp_datagram *) * count);
+	addrs = emalloc(sizeof(struct sockaddr_in) * count);
+	bufs = emalloc(sizeof(uv_buf_t) * count);
+	
+	i = 0;
+	
+	ZEND_HASH_FOREACH_VAL(batch, entry) {
+		if (Z_TYPE_P(entry) != IS_OBJECT || Z_OBJCE_P(entry) != async_udp_datagram_ce) {
+			zend_throw_error(zend_ce_type_error, "Batch must only contain UDP datagrams");
+			goto cleanup;
+		}
+		
+		datagrams[i] = (async_udp_datagram *) Z_OBJ_P(entry);
+		
+		code = uv_ip4_addr(ZSTR_VAL(datagrams[i]->address), (int) datagrams[i]->port, &addrs[i]);
+		
+		if (UNEXPECTED(code != 0)) {
+			zend_throw_exception_ex(async_socket_exception_ce, 0, "Failed to assemble remote IP address: %s", uv_strerror(code));
+			goto cleanup;
+		}
+		
+		bufs[i] = uv_buf_init(ZSTR_VAL(datagrams[i]->data), ZSTR_LEN(datagrams[i]->data));
+		
+		i++;
+	} ZEND_HASH_FOREACH_END();
+	
+	sent = 0;
+	
+#ifdef ASYNC_UDP_MMSG
+	if (socket->senders.first == NULL) {
+		sent = try_send_batch(socket, addrs, bufs, (int) count);
+		
+		if (UNEXPECTED(sent < 0)) {
+			zend_throw_exception_ex(async_socket_exception_ce, 0, "Failed to send UDP data: %s", uv_strerror(sent));
+			goto cleanup;
+		}
+	}
+#endif
+	
+	// Queue remaining datagrams in libuv, only the last send operation is awaited.
+	for (i = sent; i < (int) count; i++) {
+		ASYNC_ALLOC_CUSTOM_OP(op, sizeof(async_udp_send_op));
+		
+		op->req.data = op;
+		op->socket = socket;
+		op->datagram = datagrams[i];
+		op->context = async_context_get();
+		
+		code = uv_udp_send(&op->req, &socket->handle, &bufs[i], 1, (const struct sockaddr *) &addrs[i], (i + 1 < (int) count) ? socket_sent_async : socket_sent);
+		
+		if (UNEXPECTED(code < 0)) {
+			ASYNC_FREE_OP(op);
+			zend_throw_exception_ex(async_socket_exception_ce, 0, "Failed to send UDP data: %s", uv_strerror(code));
+			
+			goto cleanup;
+		}
+		
+		ASYNC_ADDREF(&socket->std);
+		ASYNC_ADDREF(&op->datagram->std);
+		
+		ASYNC_ENQUEUE_OP(&socket->senders, op);
+		ASYNC_UNREF_ENTER(op->context, socket);
+		
+		if (i + 1 < (int) count) {
+			ASYNC_ADDREF(&op->context->std);
+			
+			continue;
+		}
+		
+		if (async_await_op((async_op *) op) == FAILURE) {
+			ASYNC_FORWARD_OP_ERROR(op);
+		}
+		
+		ASYNC_UNREF_EXIT(op->context, socket);
+		
+		if (!(op->base.flags & ASYNC_OP_FLAG_CANCELLED)) {
+			ASYNC_FREE_OP(op);
+		}
+	}
+	
+cleanup:
+	efree(datagrams);
+	efree(addrs);
+	efree(bufs);
+}
+
 ZEND_BEGIN_ARG_WITH_RETURN_OBJ_INFO_EX(arginfo_udp_socket_bind, 0, 2, Concurrent\\Network\\UdpSocket, 0)
 	ZEND_ARG_TYPE_INFO(0, host, IS_STRING, 0)
 	ZEND_ARG_TYPE_INFO(0, port, IS_LONG, 0)
 ZEND_END_ARG_INFO()
 
+ZEND_BEGIN_ARG_WITH_RETURN_OBJ_INFO_EX(arginfo_udp_socket_connect, 0, 2, Concurrent\\Network\\UdpSocket, 0)
+	ZEND_ARG_TYPE_INFO(0, host, IS_STRING, 0)
+	ZEND_ARG_TYPE_INFO(0, port, IS_LONG, 0)
+ZEND_END_ARG_INFO()
+
 ZEND_BEGIN_ARG_WITH_RETURN_OBJ_INFO_EX(arginfo_udp_socket_multicast, 0, 2, Concurrent\\Network\\UdpSocket, 0)
 	ZEND_ARG_TYPE_INFO(0, group, IS_STRING, 0)
 	ZEND_ARG_TYPE_INFO(0, port, IS_LONG, 0)
@@ -726,24 +1416,41 @@ ZEND_END_ARG_INFO()
 ZEND_BEGIN_ARG_WITH_RETURN_OBJ_INFO_EX(arginfo_udp_socket_receive, 0, 0, Concurrent\\Network\\UdpDatagram, 0)
 ZEND_END_ARG_INFO()
 
+ZEND_BEGIN_ARG_WITH_RETURN_TYPE_INFO_EX(arginfo_udp_socket_receive_many, 0, 1, IS_ARRAY, 0)
+	ZEND_ARG_TYPE_INFO(0, max, IS_LONG, 0)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_WITH_RETURN_TYPE_INFO_EX(arginfo_udp_socket_receive_into, 0, 1, IS_LONG, 0)
+	ZEND_ARG_TYPE_INFO(1, datagrams, IS_ARRAY, 0)
+	ZEND_ARG_TYPE_INFO(0, max, IS_LONG, 0)
+ZEND_END_ARG_INFO()
+
 ZEND_BEGIN_ARG_WITH_RETURN_TYPE_INFO_EX(arginfo_udp_socket_send, 0, 1, IS_VOID, 0)
-	ZEND_ARG_OBJ_INFO(0, datagram, Concurrent\\Network\\UdpDatagram, 0)
+	ZEND_ARG_INFO(0, datagram)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_WITH_RETURN_TYPE_INFO_EX(arginfo_udp_socket_send_many, 0, 1, IS_VOID, 0)
+	ZEND_ARG_TYPE_INFO(0, datagrams, IS_ARRAY, 0)
 ZEND_END_ARG_INFO()
 
 ZEND_BEGIN_ARG_WITH_RETURN_TYPE_INFO_EX(arginfo_udp_socket_send_async, 0, 1, IS_LONG, 0)
-	ZEND_ARG_OBJ_INFO(0, datagram, Concurrent\\Network\\UdpDatagram, 0)
+	ZEND_ARG_INFO(0, datagram)
 ZEND_END_ARG_INFO()
 
 static const zend_function_entry async_udp_socket_functions[] = {
 	ZEND_ME(UdpSocket, bind, arginfo_udp_socket_bind, ZEND_ACC_PUBLIC | ZEND_ACC_STATIC)
+	ZEND_ME(UdpSocket, connect, arginfo_udp_socket_connect, ZEND_ACC_PUBLIC | ZEND_ACC_STATIC)
 	ZEND_ME(UdpSocket, multicast, arginfo_udp_socket_multicast, ZEND_ACC_PUBLIC | ZEND_ACC_STATIC)
 	ZEND_ME(UdpSocket, close, arginfo_udp_socket_close, ZEND_ACC_PUBLIC)
 	ZEND_ME(UdpSocket, getAddress, arginfo_udp_socket_get_address, ZEND_ACC_PUBLIC)
 	ZEND_ME(UdpSocket, getPort, arginfo_udp_socket_get_port, ZEND_ACC_PUBLIC)
 	ZEND_ME(UdpSocket, setOption, arginfo_udp_socket_set_option, ZEND_ACC_PUBLIC)
 	ZEND_ME(UdpSocket, receive, arginfo_udp_socket_receive, ZEND_ACC_PUBLIC)
+	ZEND_ME(UdpSocket, receiveMany, arginfo_udp_socket_receive_many, ZEND_ACC_PUBLIC)
+	ZEND_ME(UdpSocket, receiveInto, arginfo_udp_socket_receive_into, ZEND_ACC_PUBLIC)
 	ZEND_ME(UdpSocket, send, arginfo_udp_socket_send, ZEND_ACC_PUBLIC)
 	ZEND_ME(UdpSocket, sendAsync, arginfo_udp_socket_send_async, ZEND_ACC_PUBLIC)
+	ZEND_ME(UdpSocket, sendMany, arginfo_udp_socket_send_many, ZEND_ACC_PUBLIC)
 	ZEND_FE_END
 };
 
@@ -955,6 +1662,7 @@ void async_udp_socket_ce_register()
 	ASYNC_UDP_SOCKET_CONST("TTL", ASYNC_SOCKET_UDP_TTL);
 	ASYNC_UDP_SOCKET_CONST("MULTICAST_LOOP", ASYNC_SOCKET_UDP_MULTICAST_LOOP);
 	ASYNC_UDP_SOCKET_CONST("MULTICAST_TTL", ASYNC_SOCKET_UDP_MULTICAST_TTL);
+	ASYNC_UDP_SOCKET_CONST("SEGMENTATION", ASYNC_SOCKET_UDP_SEGMENTATION);
 
 	INIT_CLASS_ENTRY(ce, "Concurrent\\Network\\UdpDatagram", async_udp_datagram_functions);
 	async_udp_datagram_ce = zend_register_internal_class(&ce);
@@ -0,0 +1,672 @@
+/*
+  +----------------------------------------------------------------------+
+  | PHP Version 7                                                        |
+  +----------------------------------------------------------------------+
+  | Copyright (c) 1997-2018 The PHP Group                                |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 3.01 of the PHP license,      |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available through the world-wide-web at the following url:           |
+  | http://www.php.net/license/3_01.txt                                  |
+  | If you did not receive a copy of the PHP license and are unable to   |
+  | obtain it through the world-wide-web, please send a note to          |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+  | Authors: Martin Schröder <m.schroeder2007@gmail.com>                 |
+  +----------------------------------------------------------------------+
+*/
+
+#include "php_async.h"
+
+#ifdef HAVE_ASYNC_URING
+
+#include <liburing.h>
+#include <sys/eventfd.h>
+#include <sys/sysmacros.h>
+
+#define ASYNC_URING_ENTRIES 256
+
+/* Max time (in milliseconds) to wait for outstanding operations during shutdown. */
+#define ASYNC_URING_SHUTDOWN_TIMEOUT 1000
+
+/*
+ * File operations are submitted to an io_uring instance from the loop thread, completions are signaled
+ * using an eventfd that is polled by the event loop. Submission queue entries are collected while tasks
+ * are being run and submitted in a single syscall before the loop starts polling for IO.
+ */
+
+typedef struct _async_uring_op async_uring_op;
+
+struct _async_uring {
+	async_task_scheduler *scheduler;
+	async_cancel_cb cancel;
+	
+	struct io_uring ring;
+	
+	/* Eventfd being signaled by the kernel whenever a completion is posted. */
+	int efd;
+	
+	uv_poll_t poll;
+	uv_prepare_t prepare;
+	
+	/* Number of submitted operations that have not completed yet. */
+	uint32_t pending;
+	
+	/* List of submitted operations that have not completed yet. */
+	async_uring_op *first;
+	
+	/* Number of prepared entries that have not been submitted yet. */
+	uint32_t queued;
+	
+	/* Operations that completed while the completion queue was drained during shutdown. */
+	async_op_queue completed;
+	
+	/* Number of active libuv handles. */
+	int handles;
+};
+
+struct _async_uring_op {
+	async_op base;
+	
+	/* Links in the list of submitted operations. */
+	async_uring_op *prev;
+	async_uring_op *next;
+	
+	/* Result of the operation (negative error code on failure). */
+	int result;
+	
+	/* Set when the completion has been reaped. */
+	zend_bool done;
+	
+	/* Set if the awaiting task has been cancelled, the op is freed when its completion is reaped. */
+	zend_bool abandoned;
+	
+	/* File descriptor returned by an abandoned open has to be closed. */
+	zend_bool close_result;
+	
+	/* Data being read or written (or path being opened), the kernel may access it after the task has been cancelled. */
+	char *buf;
+	
+	/* Result buffer of fstat operations. */
+	struct statx statx;
+};
+
+static void free_op(async_uring_op *op)
+{
+	if (op->buf != NULL) {
+		efree(op->buf);
+	}
+	
+	ASYNC_FREE_OP(op);
+}
+
+static void unlink_op(async_uring *ring, async_uring_op *op)
+{
+	if (op->prev == NULL) {
+		ring->first = op->next;
+	} else {
+		op->prev->next = op->next;
+	}
+	
+	if (op->next != NULL) {
+		op->next->prev = op->prev;
+	}
+	
+	op->prev = NULL;
+	op->next = NULL;
+	
+	ring->pending--;
+}
+
+static void complete_op(async_uring *ring, async_uring_op *op, int result)
+{
+	unlink_op(ring, op);
+	
+	op->result = result;
+	op->done = 1;
+}
+
+static void finish_op(async_uring_op *op)
+{
+	if (!op->abandoned) {
+		ASYNC_FINISH_OP(op);
+		return;
+	}
+	
+	if (op->close_result && op->result >= 0) {
+		close(op->result);
+	}
+	
+	free_op(op);
+}
+
+static void process_completions(async_uring *ring)
+{
+	struct io_uring_cqe *cqe;
+	async_uring_op *op;
+	
+	while (io_uring_peek_cqe(&ring->ring, &cqe) == 0) {
+		op = (async_uring_op *) io_uring_cqe_get_data(cqe);
+		
+		// Completions of cancel requests do not carry an op.
+		if (op != NULL) {
+			complete_op(ring, op, cqe->res);
+		}
+		
+		io_uring_cqe_seen(&ring->ring, cqe);
+		
+		if (op != NULL) {
+			finish_op(op);
+		}
+	}
+	
+	if (ring->pending == 0 && ring->poll.data != NULL) {
+		uv_poll_stop(&ring->poll);
+	}
+}
+
+static void poll_cb(uv_poll_t *handle, int status, int events)
+{
+	async_uring *ring;
+	eventfd_t val;
+	
+	ring = (async_uring *) handle->data;
+	
+	eventfd_read(ring->efd, &val);
+	
+	process_completions(ring);
+}
+
+static void submit_entries(async_uring *ring)
+{
+	if (ring->queued > 0 && io_uring_submit(&ring->ring) >= 0) {
+		ring->queued = 0;
+	}
+}
+
+static void prepare_cb(uv_prepare_t *handle)
+{
+	async_uring *ring;
+	
+	ring = (async_uring *) handle->data;
+	
+	submit_entries(ring);
+	
+	// Keep the handle active to retry submission if the kernel could not accept all entries.
+	if (ring->queued == 0) {
+		uv_prepare_stop(handle);
+	}
+}
+
+/*
+ * Requests cancellation of an op whose task has been cancelled. The op (and the buffer it owns) is released
+ * when the kernel posts its completion, the loop thread does not wait for IO to finish.
+ */
+static void abandon_op(async_uring *ring, async_uring_op *op)
+{
+	struct io_uring_sqe *sqe;
+	
+	op->abandoned = 1;
+	
+	sqe = io_uring_get_sqe(&ring->ring);
+	
+	if (sqe != NULL) {
+		io_uring_prep_cancel(sqe, op, 0);
+		io_uring_sqe_set_data(sqe, NULL);
+		
+		if (ring->queued++ == 0) {
+			uv_prepare_start(&ring->prepare, prepare_cb);
+		}
+	}
+}
+
+static struct io_uring_sqe *get_sqe(async_uring *ring)
+{
+	struct io_uring_sqe *sqe;
+	
+	sqe = io_uring_get_sqe(&ring->ring);
+	
+	if (sqe == NULL) {
+		submit_entries(ring);
+		
+		sqe = io_uring_get_sqe(&ring->ring);
+	}
+	
+	return sqe;
+}
+
+static int run_op(async_uring *ring, async_uring_op *op, struct io_uring_sqe *sqe)
+{
+	io_uring_sqe_set_data(sqe, op);
+	
+	if (ring->queued++ == 0) {
+		uv_prepare_start(&ring->prepare, prepare_cb);
+	}
+	
+	if (ring->pending++ == 0) {
+		uv_poll_start(&ring->poll, UV_READABLE, poll_cb);
+	}
+	
+	op->next = ring->first;
+	
+	if (ring->first != NULL) {
+		ring->first->prev = op;
+	}
+	
+	ring->first = op;
+	
+	if (async_await_op((async_op *) op) == FAILURE) {
+		ASYNC_FORWARD_OP_ERROR(op);
+		
+		if (!op->done) {
+			abandon_op(ring, op);
+		}
+		
+		return UV_ECANCELED;
+	}
+	
+	return op->result;
+}
+
+/* Releases an op after it has been run, abandoned ops are released when the kernel completes them. */
+static void release_op(async_uring_op *op)
+{
+	if (!op->abandoned) {
+		free_op(op);
+	}
+}
+
+static void close_cb(uv_handle_t *handle)
+{
+	async_uring *ring;
+	
+	ring = (async_uring *) handle->data;
+	
+	if (--ring->handles == 0) {
+		io_uring_queue_exit(&ring->ring);
+		close(ring->efd);
+		
+		efree(ring);
+	}
+}
+
+/*
+ * Outstanding operations are cancelled and given a limited amount of time to complete, reads from FIFOs or
+ * network filesystems might never finish. Operations that did not complete are failed and their buffers are
+ * leaked because the kernel may still access them, pending requests are cancelled when the ring is closed.
+ */
+static void shutdown_uring(void *obj, zval *error)
+{
+	struct io_uring_sqe *sqe;
+	struct io_uring_cqe *cqe;
+	struct __kernel_timespec ts;
+	async_uring *ring;
+	async_uring_op *op;
+	
+	uint64_t deadline;
+	uint64_t now;
+	int code;
+	
+	ring = (async_uring *) obj;
+	
+	ring->cancel.func = NULL;
+	ring->scheduler->uring = NULL;
+	
+	// Request cancellation of all outstanding operations, matching by user data on kernels before 5.19.
+#ifdef IORING_ASYNC_CANCEL_ANY
+	if (ring->pending > 0 && NULL != (sqe = get_sqe(ring))) {
+		io_uring_prep_cancel(sqe, NULL, IORING_ASYNC_CANCEL_ANY);
+		io_uring_sqe_set_data(sqe, NULL);
+		
+		ring->queued++;
+	}
+#else
+	for (op = ring->first; op != NULL; op = op->next) {
+		if (NULL == (sqe = get_sqe(ring))) {
+			break;
+		}
+		
+		io_uring_prep_cancel(sqe, op, 0);
+		io_uring_sqe_set_data(sqe, NULL);
+		
+		ring->queued++;
+	}
+#endif
+	
+	submit_entries(ring);
+	
+	deadline = uv_hrtime() + (uint64_t) ASYNC_URING_SHUTDOWN_TIMEOUT * 1000000;
+	
+	while (ring->pending > 0) {
+		now = uv_hrtime();
+		
+		if (now >= deadline) {
+			break;
+		}
+		
+		ts.tv_sec = (long long) ((deadline - now) / 1000000000);
+		ts.tv_nsec = (long long) ((deadline - now) % 1000000000);
+		
+		code = io_uring_wait_cqe_timeout(&ring->ring, &cqe, &ts);
+		
+		if (code == -ETIME) {
+			break;
+		}
+		
+		if (code < 0) {
+			continue;
+		}
+		
+		op = (async_uring_op *) io_uring_cqe_get_data(cqe);
+		
+		if (op != NULL) {
+			complete_op(ring, op, cqe->res);
+			
+			if (op->abandoned) {
+				finish_op(op);
+			} else {
+				ASYNC_ENQUEUE_OP(&ring->completed, op);
+			}
+		}
+		
+		io_uring_cqe_seen(&ring->ring, cqe);
+	}
+	
+	while (ring->first != NULL) {
+		op = ring->first;
+		
+		unlink_op(ring, op);
+		
+		if (!op->abandoned) {
+			op->abandoned = 1;
+			op->result = UV_ECANCELED;
+			
+			ASYNC_ENQUEUE_OP(&ring->completed, op);
+		}
+	}
+	
+	while (ring->completed.first != NULL) {
+		ASYNC_DEQUEUE_CUSTOM_OP(&ring->completed, op, async_uring_op);
+		ASYNC_FINISH_OP(op);
+	}
+	
+	uv_close((uv_handle_t *) &ring->poll, close_cb);
+	uv_close((uv_handle_t *) &ring->prepare, close_cb);
+}
+
+/* Checks if the kernel supports all operations being used by the file stream wrapper. */
+static int check_support(struct io_uring *ring)
+{
+	struct io_uring_probe *probe;
+	int result;
+	
+	probe = io_uring_get_probe_ring(ring);
+	
+	if (probe == NULL) {
+		return FAILURE;
+	}
+	
+	result = io_uring_opcode_supported(probe, IORING_OP_OPENAT)
+		&& io_uring_opcode_supported(probe, IORING_OP_READ)
+		&& io_uring_opcode_supported(probe, IORING_OP_WRITE)
+		&& io_uring_opcode_supported(probe, IORING_OP_STATX)
+		&& io_uring_opcode_supported(probe, IORING_OP_CLOSE)
+		&& io_uring_opcode_supported(probe, IORING_OP_ASYNC_CANCEL);
+	
+	io_uring_free_probe(probe);
+	
+	return result ? SUCCESS : FAILURE;
+}
+
+async_uring *async_uring_get(async_task_scheduler *scheduler)
+{
+	async_uring *ring;
+	
+	if (scheduler->uring != NULL) {
+		return scheduler->uring;
+	}
+	
+	if (!ASYNC_G(fs_uring) || ASYNC_G(fs_uring_failed) || (scheduler->flags & ASYNC_TASK_SCHEDULER_FLAG_DISPOSED)) {
+		return NULL;
+	}
+	
+	ring = emalloc(sizeof(async_uring));
+	ZEND_SECURE_ZERO(ring, sizeof(async_uring));
+	
+	// Kernel lacks io_uring support (or it is disabled by a seccomp filter), use the thread pool instead.
+	if (io_uring_queue_init(ASYNC_URING_ENTRIES, &ring->ring, 0) < 0) {
+		ASYNC_G(fs_uring_failed) = 1;
+		
+		efree(ring);
+		
+		return NULL;
+	}
+	
+	ring->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	
+	if (ring->efd < 0 || check_support(&ring->ring) == FAILURE || io_uring_register_eventfd(&ring->ring, ring->efd) < 0) {
+		ASYNC_G(fs_uring_failed) = 1;
+		
+		if (ring->efd >= 0) {
+			close(ring->efd);
+		}
+		
+		io_uring_queue_exit(&ring->ring);
+		efree(ring);
+		
+		return NULL;
+	}
+	
+	ring->scheduler = scheduler;
+	
+	uv_poll_init(&scheduler->loop, &ring->poll, ring->efd);
+	uv_prepare_init(&scheduler->loop, &ring->prepare);
+	
+	ring->poll.data = ring;
+	ring->prepare.data = ring;
+	ring->handles = 2;
+	
+	ring->cancel.object = ring;
+	ring->cancel.func = shutdown_uring;
+	
+	ASYNC_Q_ENQUEUE(&scheduler->shutdown, &ring->cancel);
+	
+	scheduler->uring = ring;
+	
+	return ring;
+}
+
+int async_uring_open(async_uring *ring, const char *path, int flags, int mode)
+{
+	struct io_uring_sqe *sqe;
+	async_uring_op *op;
+	int code;
+	
+	if (NULL == (sqe = get_sqe(ring))) {
+		return UV_ENOBUFS;
+	}
+	
+	ASYNC_ALLOC_CUSTOM_OP(op, sizeof(async_uring_op));
+	
+	op->buf = estrdup(path);
+	op->close_result = 1;
+	
+	io_uring_prep_openat(sqe, AT_FDCWD, op->buf, flags | O_CLOEXEC, (mode_t) mode);
+	
+	code = run_op(ring, op, sqe);
+	
+	// Close the file if the task has been cancelled after the kernel opened it.
+	if (code == UV_ECANCELED && op->done && op->result >= 0) {
+		close(op->result);
+	}
+	
+	release_op(op);
+	
+	return code;
+}
+
+int async_uring_read(async_uring *ring, uv_file file, char *buf, size_t len, int64_t offset)
+{
+	struct io_uring_sqe *sqe;
+	async_uring_op *op;
+	int code;
+	
+	if (NULL == (sqe = get_sqe(ring))) {
+		return UV_ENOBUFS;
+	}
+	
+	len = MIN(len, INT_MAX);
+	
+	ASYNC_ALLOC_CUSTOM_OP(op, sizeof(async_uring_op));
+	
+	op->buf = emalloc(len);
+	
+	io_uring_prep_read(sqe, file, op->buf, (unsigned) len, (uint64_t) offset);
+	
+	code = run_op(ring, op, sqe);
+	
+	if (code > 0) {
+		memcpy(buf, op->buf, (size_t) code);
+	}
+	
+	release_op(op);
+	
+	return code;
+}
+
+int async_uring_write(async_uring *ring, uv_file file, const char *buf, size_t len, int64_t offset)
+{
+	struct io_uring_sqe *sqe;
+	async_uring_op *op;
+	int code;
+	
+	if (NULL == (sqe = get_sqe(ring))) {
+		return UV_ENOBUFS;
+	}
+	
+	len = MIN(len, INT_MAX);
+	
+	ASYNC_ALLOC_CUSTOM_OP(op, sizeof(async_uring_op));
+	
+	op->buf = emalloc(len);
+	
+	memcpy(op->buf, buf, len);
+	
+	io_uring_prep_write(sqe, file, op->buf, (unsigned) len, (uint64_t) offset);
+	
+	code = run_op(ring, op, sqe);
+	
+	release_op(op);
+	
+	return code;
+}
+
+static inline void map_statx(struct statx *stx, uv_stat_t *stat)
+{
+	ZEND_SECURE_ZERO(stat, sizeof(uv_stat_t));
+	
+	stat->st_dev = makedev(stx->stx_dev_major, stx->stx_dev_minor);
+	stat->st_mode = stx->stx_mode;
+	stat->st_nlink = stx->stx_nlink;
+	stat->st_uid = stx->stx_uid;
+	stat->st_gid = stx->stx_gid;
+	stat->st_rdev = makedev(stx->stx_rdev_major, stx->stx_rdev_minor);
+	stat->st_ino = stx->stx_ino;
+	stat->st_size = stx->stx_size;
+	stat->st_blksize = stx->stx_blksize;
+	stat->st_blocks = stx->stx_blocks;
+	
+	stat->st_atim.tv_sec = stx->stx_atime.tv_sec;
+	stat->st_atim.tv_nsec = stx->stx_atime.tv_nsec;
+	stat->st_mtim.tv_sec = stx->stx_mtime.tv_sec;
+	stat->st_mtim.tv_nsec = stx->stx_mtime.tv_nsec;
+	stat->st_ctim.tv_sec = stx->stx_ctime.tv_sec;
+	stat->st_ctim.tv_nsec = stx->stx_ctime.tv_nsec;
+	stat->st_birthtim.tv_sec = stx->stx_btime.tv_sec;
+	stat->st_birthtim.tv_nsec = stx->stx_btime.tv_nsec;
+}
+
+int async_uring_fstat(async_uring *ring, uv_file file, uv_stat_t *stat)
+{
+	struct io_uring_sqe *sqe;
+	async_uring_op *op;
+	int code;
+	
+	if (NULL == (sqe = get_sqe(ring))) {
+		return UV_ENOBUFS;
+	}
+	
+	ASYNC_ALLOC_CUSTOM_OP(op, sizeof(async_uring_op));
+	
+	io_uring_prep_statx(sqe, file, "", AT_EMPTY_PATH | AT_STATX_SYNC_AS_STAT, STATX_BASIC_STATS | STATX_BTIME, &op->statx);
+	
+	code = run_op(ring, op, sqe);
+	
+	if (code >= 0) {
+		map_statx(&op->statx, stat);
+	}
+	
+	release_op(op);
+	
+	return code;
+}
+
+int async_uring_close(async_uring *ring, uv_file file)
+{
+	struct io_uring_sqe *sqe;
+	async_uring_op *op;
+	int code;
+	
+	if (NULL == (sqe = get_sqe(ring))) {
+		return UV_ENOBUFS;
+	}
+	
+	ASYNC_ALLOC_CUSTOM_OP(op, sizeof(async_uring_op));
+	
+	io_uring_prep_close(sqe, file);
+	
+	code = run_op(ring, op, sqe);
+	
+	release_op(op);
+	
+	return code;
+}
+
+#else
+
+async_uring *async_uring_get(async_task_scheduler *scheduler)
+{
+	return NULL;
+}
+
+int async_uring_open(async_uring *ring, const char *path, int flags, int mode)
+{
+	return UV_ENOSYS;
+}
+
+int async_uring_read(async_uring *ring, uv_file file, char *buf, size_t len, int64_t offset)
+{
+	return UV_ENOSYS;
+}
+
+int async_uring_write(async_uring *ring, uv_file file, const char *buf, size_t len, int64_t offset)
+{
+	return UV_ENOSYS;
+}
+
+int async_uring_fstat(async_uring *ring, uv_file file, uv_stat_t *stat)
+{
+	return UV_ENOSYS;
+}
+
+int async_uring_close(async_uring *ring, uv_file file)
+{
+	return UV_ENOSYS;
+}
+
+#endif
+
+/*
+ * vim: sw=4 ts=4
+ * vim600: fdm=marker
+ */
@@ -0,0 +1,691 @@
+/*
+  +----------------------------------------------------------------------+
+  | PHP Version 7                                                        |
+  +----------------------------------------------------------------------+
+  | Copyright (c) 1997-2018 The PHP Group                                |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 3.01 of the PHP license,      |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available through the world-wide-web at the following url:           |
+  | http://www.php.net/license/3_01.txt                                  |
+  | If you did not receive a copy of the PHP license and are unable to   |
+  | obtain it through the world-wide-web, please send a note to          |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+  | Authors: Martin Schröder <m.schroeder2007@gmail.com>                 |
+  +----------------------------------------------------------------------+
+*/
+
+#include "php_async.h"
+
+#include "async_task.h"
+
+#ifdef HAVE_HASH_EXT
+#include "ext/hash/php_hash.h"
+#endif
+
+#ifdef HAVE_ASYNC_ZLIB
+#include <zlib.h>
+#endif
+
+#ifndef PHP_WIN32
+#include "ext/standard/php_random.h"
+#define ASYNC_WORKER_BCRYPT 1
+#endif
+
+zend_class_entry *async_worker_ce;
+
+#define ASYNC_WORKER_CONST(const_name, value) \
+	zend_declare_class_constant_long(async_worker_ce, const_name, sizeof(const_name)-1, (zend_long)value);
+
+#define ASYNC_WORKER_HASH 0
+#define ASYNC_WORKER_COMPRESS 1
+#define ASYNC_WORKER_DECOMPRESS 2
+#define ASYNC_WORKER_BCRYPT_HASH 3
+#define ASYNC_WORKER_BCRYPT_VERIFY 4
+
+#define ASYNC_WORKER_ENCODING_RAW -15
+#define ASYNC_WORKER_ENCODING_DEFLATE 15
+#define ASYNC_WORKER_ENCODING_GZIP 31
+
+#define ASYNC_WORKER_BCRYPT_LENGTH 60
+
+/*
+ * Jobs are executed by a libuv worker thread and must not call into the Zend engine, memory
+ * is allocated using malloc() and converted into PHP values after the job has completed.
+ */
+typedef struct {
+	async_op base;
+	uv_work_t req;
+	
+	/* Job type (ASYNC_WORKER_*). */
+	int type;
+	
+	/* Input data, the string is referenced until the job has completed. */
+	zend_string *input;
+	
+#ifdef HAVE_HASH_EXT
+	/* Hash algorithm. */
+	const php_hash_ops *ops;
+#endif
+	
+	/* Compression level and zlib window bits (encoding). */
+	int level;
+	int window;
+	
+	/* Max size of decompressed data, 0 if not limited. */
+	size_t max;
+	
+	/* Bcrypt setting (or hash to be verified) and computed hash. */
+	char setting[ASYNC_WORKER_BCRYPT_LENGTH + 1];
+	char bcrypt[ASYNC_WORKER_BCRYPT_LENGTH + 4];
+	
+	/* Output data allocated using malloc(). */
+	unsigned char *output;
+	size_t length;
+	
+	/* Static error message of a failed job. */
+	const char *error;
+} async_worker_op;
+
+#ifdef HAVE_HASH_EXT
+static void hash_work(async_worker_op *op)
+{
+	void *context;
+	
+	context = malloc(op->ops->context_size);
+	op->output = malloc(op->ops->digest_size);
+	
+	if (context == NULL || op->output == NULL) {
+		op->error = "Insufficient memory";
+	} else {
+		op->ops->hash_init(context);
+		op->ops->hash_update(context, (unsigned char *) ZSTR_VAL(op->input), ZSTR_LEN(op->input));
+		op->ops->hash_final(op->output, context);
+		
+		op->length = op->ops->digest_size;
+	}
+	
+	free(context);
+}
+#endif
+
+#ifdef HAVE_ASYNC_ZLIB
+/* Passes the next chunk of a buffer to zlib, lengths are limited to uInt. */
+static inline uInt next_chunk(size_t *remaining)
+{
+	uInt len;
+	
+	len = (uInt) MIN(*remaining, UINT_MAX);
+	*remaining -= len;
+	
+	return len;
+}
+
+static void compress_work(async_worker_op *op)
+{
+	z_stream strm;
+	size_t size;
+	size_t in;
+	size_t out;
+	int code;
+	
+	memset(&strm, 0, sizeof(z_stream));
+	
+	if (Z_OK != deflateInit2(&strm, op->level, Z_DEFLATED, op->window, 8, Z_DEFAULT_STRATEGY)) {
+		op->error = "Failed to initialize compression";
+		
+		return;
+	}
+	
+	size = deflateBound(&strm, (uLong) ZSTR_LEN(op->input));
+	op->output = malloc(size);
+	
+	if (op->output == NULL) {
+		op->error = "Insufficient memory";
+	} else {
+		strm.next_in = (Bytef *) ZSTR_VAL(op->input);
+		strm.next_out = op->output;
+		
+		in = ZSTR_LEN(op->input);
+		out = size;
+		
+		do {
+			if (strm.avail_in == 0) {
+				strm.avail_in = next_chunk(&in);
+			}
+			
+			if (strm.avail_out == 0) {
+				strm.avail_out = next_chunk(&out);
+			}
+			
+			code = deflate(&strm, (in == 0) ? Z_FINISH : Z_NO_FLUSH);
+		} while (code == Z_OK);
+		
+		if (code == Z_STREAM_END) {
+			op->length = (size_t) (strm.next_out - op->output);
+		} else {
+			op->error = (strm.msg == NULL) ? "Compression failed" : strm.msg;
+		}
+	}
+	
+	deflateEnd(&strm);
+}
+
+static void decompress_work(async_worker_op *op)
+{
+	z_stream strm;
+	unsigned char *buf;
+	size_t size;
+	size_t len;
+	size_t in;
+	int code;
+	
+	memset(&strm, 0, sizeof(z_stream));
+	
+	if (Z_OK != inflateInit2(&strm, op->window)) {
+		op->error = "Failed to initialize decompression";
+		
+		return;
+	}
+	
+	size = MAX(4096, ZSTR_LEN(op->input) * 4);
+	
+	if (op->max > 0) {
+		size = MIN(size, op->max + 1);
+	}
+	
+	op->output = malloc(size);
+	
+	strm.next_in = (Bytef *) ZSTR_VAL(op->input);
+	
+	in = ZSTR_LEN(op->input);
+	len = 0;
+	code = Z_OK;
+	
+	while (op->output != NULL) {
+		if (strm.avail_in == 0) {
+			strm.avail_in = next_chunk(&in);
+		}
+		
+		strm.next_out = op->output + len;
+		strm.avail_out = (uInt) MIN(size - len, UINT_MAX);
+		
+		code = inflate(&strm, Z_NO_FLUSH);
+		
+		len = (size_t) (strm.next_out - op->output);
+		
+		if (code == Z_STREAM_END || (code != Z_OK && code != Z_BUF_ERROR)) {
+			break;
+		}
+		
+		if (op->max > 0 && len > op->max) {
+			break;
+		}
+		
+		if (strm.avail_out > 0) {
+			if (in > 0) {
+				continue;
+			}
+			
+			// Input has been consumed without reaching the end of the stream.
+			code = Z_DATA_ERROR;
+			break;
+		}
+		
+		if (len < size) {
+			continue;
+		}
+		
+		size *= 2;
+		
+		if (op->max > 0) {
+			size = MIN(size, op->max + 1);
+		}
+		
+		buf = realloc(op->output, size);
+		
+		if (buf == NULL) {
+			free(op->output);
+			op->output = NULL;
+		} else {
+			op->output = buf;
+		}
+	}
+	
+	if (op->output == NULL) {
+		op->error = "Insufficient memory";
+	} else if (op->max > 0 && len > op->max) {
+		op->error = "Decompressed data exceeds the max length";
+	} else if (code != Z_STREAM_END) {
+		op->error = (strm.msg == NULL) ? "Invalid compressed data" : strm.msg;
+	} else {
+		op->length = len;
+	}
+	
+	inflateEnd(&strm);
+}
+#endif
+
+static void worker_work_cb(uv_work_t *req)
+{
+	async_worker_op *op;
+	
+	op = (async_worker_op *) req->data;
+	
+	ZEND_ASSERT(op != NULL);
+	
+	switch (op->type) {
+#ifdef HAVE_HASH_EXT
+	case ASYNC_WORKER_HASH:
+		hash_work(op);
+		break;
+#endif
+#ifdef HAVE_ASYNC_ZLIB
+	case ASYNC_WORKER_COMPRESS:
+		compress_work(op);
+		break;
+	case ASYNC_WORKER_DECOMPRESS:
+		decompress_work(op);
+		break;
+#endif
+#ifdef ASYNC_WORKER_BCRYPT
+	case ASYNC_WORKER_BCRYPT_HASH:
+		if (NULL == async_bcrypt(ZSTR_VAL(op->input), op->setting, op->bcrypt, sizeof(op->bcrypt))) {
+			op->error = "Failed to compute bcrypt hash";
+		}
+		break;
+	case ASYNC_WORKER_BCRYPT_VERIFY:
+		// A malformed hash cannot match any password, password_verify() returns false in this case.
+		if (NULL == async_bcrypt(ZSTR_VAL(op->input), op->setting, op->bcrypt, sizeof(op->bcrypt))) {
+			memset(op->bcrypt, 0, sizeof(op->bcrypt));
+		}
+		break;
+#endif
+	}
+}
+
+static void free_worker_op(async_worker_op *op)
+{
+	if (op->output != NULL) {
+		free(op->output);
+	}
+	
+	zend_string_release(op->input);
+	
+	ZEND_SECURE_ZERO(op->bcrypt, sizeof(op->bcrypt));
+	
+	ASYNC_FREE_OP(op);
+}
+
+static void worker_after_work_cb(uv_work_t *req, int status)
+{
+	async_worker_op *op;
+	
+	op = (async_worker_op *) req->data;
+	
+	ZEND_ASSERT(op != NULL);
+	
+	async_thread_pool_release(ASYNC_THREAD_POOL_WORK);
+	
+	// The awaiting task has been cancelled, nobody is waiting for the result.
+	if (op->base.status == ASYNC_STATUS_FAILED) {
+		free_worker_op(op);
+	} else {
+		ASYNC_FINISH_OP(op);
+	}
+}
+
+/* Runs the job in the thread pool, the op is freed by the caller if SUCCESS is returned. */
+static int run_job(async_worker_op *op)
+{
+	int code;
+	
+	if (async_thread_pool_acquire(ASYNC_THREAD_POOL_WORK) == FAILURE) {
+		free_worker_op(op);
+		
+		return FAILURE;
+	}
+	
+	op->req.data = op;
+	
+	code = uv_queue_work(&async_task_scheduler_get()->loop, &op->req, worker_work_cb, worker_after_work_cb);
+	
+	if (UNEXPECTED(code < 0)) {
+		async_thread_pool_release(ASYNC_THREAD_POOL_WORK);
+		free_worker_op(op);
+		
+		zend_throw_error(NULL, "Failed to queue work: %s", uv_strerror(code));
+		
+		return FAILURE;
+	}
+	
+	if (async_await_op((async_op *) op) == FAILURE) {
+		ASYNC_FORWARD_OP_ERROR(op);
+		
+		op->base.status = ASYNC_STATUS_FAILED;
+		
+		uv_cancel((uv_req_t *) &op->req);
+		
+		return FAILURE;
+	}
+	
+	if (op->error != NULL) {
+		zend_throw_error(NULL, "%s", op->error);
+		
+		free_worker_op(op);
+		
+		return FAILURE;
+	}
+	
+	return SUCCESS;
+}
+
+static async_worker_op *create_op(int type, zend_string *input)
+{
+	async_worker_op *op;
+	
+	ASYNC_ALLOC_CUSTOM_OP(op, sizeof(async_worker_op));
+	
+	op->type = type;
+	op->input = zend_string_copy(input);
+	
+	return op;
+}
+
+ZEND_METHOD(Worker, hash)
+{
+#ifdef HAVE_HASH_EXT
+	async_worker_op *op;
+	zend_string *algo;
+	zend_string *data;
+	zend_bool raw;
+	
+	const php_hash_ops *ops;
+	
+	raw = 0;
+	
+	ZEND_PARSE_PARAMETERS_START_EX(ZEND_PARSE_PARAMS_THROW, 2, 3)
+		Z_PARAM_STR(algo)
+		Z_PARAM_STR(data)
+		Z_PARAM_OPTIONAL
+		Z_PARAM_BOOL(raw)
+	ZEND_PARSE_PARAMETERS_END();
+	
+	ops = php_hash_fetch_ops(ZSTR_VAL(algo), ZSTR_LEN(algo));
+	
+	ASYNC_CHECK_ERROR(ops == NULL, "Unknown hashing algorithm: %s", ZSTR_VAL(algo));
+	
+	op = create_op(ASYNC_WORKER_HASH, data);
+	op->ops = ops;
+	
+	if (run_job(op) == FAILURE) {
+		return;
+	}
+	
+	if (raw) {
+		RETVAL_STRINGL((char *) op->output, op->length);
+	} else {
+		RETVAL_NEW_STR(zend_string_alloc(op->length * 2, 0));
+		
+		php_hash_bin2hex(Z_STRVAL_P(return_value), op->output, op->length);
+		
+		Z_STRVAL_P(return_value)[op->length * 2] = '\0';
+	}
+	
+	free_worker_op(op);
+#else
+	zend_throw_error(NULL, "Hashing requires the hash extension");
+#endif
+}
+
+#ifdef HAVE_ASYNC_ZLIB
+static int check_encoding(zend_long encoding)
+{
+	switch (encoding) {
+	case ASYNC_WORKER_ENCODING_RAW:
+	case ASYNC_WORKER_ENCODING_DEFLATE:
+	case ASYNC_WORKER_ENCODING_GZIP:
+		return SUCCESS;
+	}
+	
+	zend_throw_error(NULL, "Unsupported encoding: %d", (int) encoding);
+	
+	return FAILURE;
+}
+#endif
+
+ZEND_METHOD(Worker, compress)
+{
+#ifdef HAVE_ASYNC_ZLIB
+	async_worker_op *op;
+	zend_string *data;
+	zend_long encoding;
+	zend_long level;
+	
+	encoding = ASYNC_WORKER_ENCODING_DEFLATE;
+	level = -1;
+	
+	ZEND_PARSE_PARAMETERS_START_EX(ZEND_PARSE_PARAMS_THROW, 1, 3)
+		Z_PARAM_STR(data)
+		Z_PARAM_OPTIONAL
+		Z_PARAM_LONG(encoding)
+		Z_PARAM_LONG(level)
+	ZEND_PARSE_PARAMETERS_END();
+	
+	if (check_encoding(encoding) == FAILURE) {
+		return;
+	}
+	
+	ASYNC_CHECK_ERROR(level < -1 || level > 9, "Compression level must be between -1 and 9");
+	
+	op = create_op(ASYNC_WORKER_COMPRESS, data);
+	op->window = (int) encoding;
+	op->level = (int) level;
+	
+	if (run_job(op) == FAILURE) {
+		return;
+	}
+	
+	RETVAL_STRINGL((char *) op->output, op->length);
+	
+	free_worker_op(op);
+#else
+	zend_throw_error(NULL, "Compression requires async to be compiled with zlib support");
+#endif
+}
+
+ZEND_METHOD(Worker, decompress)
+{
+#ifdef HAVE_ASYNC_ZLIB
+	async_worker_op *op;
+	zend_string *data;
+	zend_long encoding;
+	zend_long max;
+	
+	encoding = ASYNC_WORKER_ENCODING_DEFLATE;
+	max = 0;
+	
+	ZEND_PARSE_PARAMETERS_START_EX(ZEND_PARSE_PARAMS_THROW, 1, 3)
+		Z_PARAM_STR(data)
+		Z_PARAM_OPTIONAL
+		Z_PARAM_LONG(encoding)
+		Z_PARAM_LONG(max)
+	ZEND_PARSE_PARAMETERS_END();
+	
+	if (check_encoding(encoding) == FAILURE) {
+		return;
+	}
+	
+	ASYNC_CHECK_ERROR(max < 0, "Max length must not be negative");
+	
+	op = create_op(ASYNC_WORKER_DECOMPRESS, data);
+	op->window = (int) encoding;
+	op->max = (size_t) max;
+	
+	if (run_job(op) == FAILURE) {
+		return;
+	}
+	
+	RETVAL_STRINGL((char *) op->output, op->length);
+	
+	free_worker_op(op);
+#else
+	zend_throw_error(NULL, "Compression requires async to be compiled with zlib support");
+#endif
+}
+
+#ifdef ASYNC_WORKER_BCRYPT
+static const char bcrypt_alphabet[] = "./ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789";
+#endif
+
+ZEND_METHOD(Worker, passwordHash)
+{
+#ifdef ASYNC_WORKER_BCRYPT
+	async_worker_op *op;
+	zend_string *password;
+	zend_long cost;
+	
+	unsigned char salt[22];
+	int i;
+	
+	cost = 10;
+	
+	ZEND_PARSE_PARAMETERS_START_EX(ZEND_PARSE_PARAMS_THROW, 1, 2)
+		Z_PARAM_STR(password)
+		Z_PARAM_OPTIONAL
+		Z_PARAM_LONG(cost)
+	ZEND_PARSE_PARAMETERS_END();
+	
+	ASYNC_CHECK_ERROR(cost < 4 || cost > 31, "Invalid bcrypt cost parameter specified: %d", (int) cost);
+	
+	if (FAILURE == php_random_bytes_throw(salt, sizeof(salt))) {
+		return;
+	}
+	
+	op = create_op(ASYNC_WORKER_BCRYPT_HASH, password);
+	
+	snprintf(op->setting, sizeof(op->setting), "$2y$%02d$", (int) cost);
+	
+	// 256 is a multiple of 64, mapping random bytes to the alphabet is not biased.
+	for (i = 0; i < 22; i++) {
+		op->setting[7 + i] = bcrypt_alphabet[salt[i] & 0x3F];
+	}
+	
+	op->setting[29] = '\0';
+	
+	if (run_job(op) == FAILURE) {
+		return;
+	}
+	
+	RETVAL_STRINGL(op->bcrypt, ASYNC_WORKER_BCRYPT_LENGTH);
+	
+	free_worker_op(op);
+#else
+	zend_throw_error(NULL, "Password hashing is not supported on this platform");
+#endif
+}
+
+ZEND_METHOD(Worker, passwordVerify)
+{
+#ifdef ASYNC_WORKER_BCRYPT
+	async_worker_op *op;
+	zend_string *password;
+	zend_string *hash;
+	
+	int status;
+	int i;
+	
+	ZEND_PARSE_PARAMETERS_START_EX(ZEND_PARSE_PARAMS_THROW, 2, 2)
+		Z_PARAM_STR(password)
+		Z_PARAM_STR(hash)
+	ZEND_PARSE_PARAMETERS_END();
+	
+	// Accept all bcrypt variants that are supported by password_verify().
+	if (ZSTR_LEN(hash) != ASYNC_WORKER_BCRYPT_LENGTH || strncmp(ZSTR_VAL(hash), "$2", 2) != 0) {
+		RETURN_FALSE;
+	}
+	
+	if (strchr("abxy", ZSTR_VAL(hash)[2]) == NULL || ZSTR_VAL(hash)[2] == '\0' || ZSTR_VAL(hash)[3] != '$') {
+		RETURN_FALSE;
+	}
+	
+	op = create_op(ASYNC_WORKER_BCRYPT_VERIFY, password);
+	
+	memcpy(op->setting, ZSTR_VAL(hash), ASYNC_WORKER_BCRYPT_LENGTH + 1);
+	
+	if (run_job(op) == FAILURE) {
+		return;
+	}
+	
+	// Compare in constant time to prevent timing attacks.
+	for (status = 0, i = 0; i < ASYNC_WORKER_BCRYPT_LENGTH; i++) {
+		status |= (op->bcrypt[i] ^ ZSTR_VAL(hash)[i]);
+	}
+	
+	free_worker_op(op);
+	
+	RETURN_BOOL(status == 0);
+#else
+	zend_throw_error(NULL, "Password hashing is not supported on this platform");
+#endif
+}
+
+ZEND_BEGIN_ARG_WITH_RETURN_TYPE_INFO_EX(arginfo_worker_hash, 0, 2, IS_STRING, 0)
+	ZEND_ARG_TYPE_INFO(0, algo, IS_STRING, 0)
+	ZEND_ARG_TYPE_INFO(0, data, IS_STRING, 0)
+	ZEND_ARG_TYPE_INFO(0, raw, _IS_BOOL, 0)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_WITH_RETURN_TYPE_INFO_EX(arginfo_worker_compress, 0, 1, IS_STRING, 0)
+	ZEND_ARG_TYPE_INFO(0, data, IS_STRING, 0)
+	ZEND_ARG_TYPE_INFO(0, encoding, IS_LONG, 0)
+	ZEND_ARG_TYPE_INFO(0, level, IS_LONG, 0)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_WITH_RETURN_TYPE_INFO_EX(arginfo_worker_decompress, 0, 1, IS_STRING, 0)
+	ZEND_ARG_TYPE_INFO(0, data, IS_STRING, 0)
+	ZEND_ARG_TYPE_INFO(0, encoding, IS_LONG, 0)
+	ZEND_ARG_TYPE_INFO(0, maxLength, IS_LONG, 0)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_WITH_RETURN_TYPE_INFO_EX(arginfo_worker_password_hash, 0, 1, IS_STRING, 0)
+	ZEND_ARG_TYPE_INFO(0, password, IS_STRING, 0)
+	ZEND_ARG_TYPE_INFO(0, cost, IS_LONG, 0)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_WITH_RETURN_TYPE_INFO_EX(arginfo_worker_password_verify, 0, 2, _IS_BOOL, 0)
+	ZEND_ARG_TYPE_INFO(0, password, IS_STRING, 0)
+	ZEND_ARG_TYPE_INFO(0, hash, IS_STRING, 0)
+ZEND_END_ARG_INFO()
+
+static const zend_function_entry async_worker_functions[] = {
+	ZEND_ME(Worker, hash, arginfo_worker_hash, ZEND_ACC_PUBLIC | ZEND_ACC_STATIC)
+	ZEND_ME(Worker, compress, arginfo_worker_compress, ZEND_ACC_PUBLIC | ZEND_ACC_STATIC)
+	ZEND_ME(Worker, decompress, arginfo_worker_decompress, ZEND_ACC_PUBLIC | ZEND_ACC_STATIC)
+	ZEND_ME(Worker, passwordHash, arginfo_worker_password_hash, ZEND_ACC_PUBLIC | ZEND_ACC_STATIC)
+	ZEND_ME(Worker, passwordVerify, arginfo_worker_password_verify, ZEND_ACC_PUBLIC | ZEND_ACC_STATIC)
+	ZEND_FE_END
+};
+
+
+void async_worker_ce_register()
+{
+	zend_class_entry ce;
+
+	INIT_CLASS_ENTRY(ce, "Concurrent\\Worker", async_worker_functions);
+	async_worker_ce = zend_register_internal_class(&ce);
+	async_worker_ce->ce_flags |= ZEND_ACC_FINAL;
+	async_worker_ce->serialize = zend_class_serialize_deny;
+	async_worker_ce->unserialize = zend_class_unserialize_deny;
+	
+	ASYNC_WORKER_CONST("ENCODING_RAW", ASYNC_WORKER_ENCODING_RAW);
+	ASYNC_WORKER_CONST("ENCODING_DEFLATE", ASYNC_WORKER_ENCODING_DEFLATE);
+	ASYNC_WORKER_CONST("ENCODING_GZIP", ASYNC_WORKER_ENCODING_GZIP);
+}
+
+
+/*
+ * vim: sw=4 ts=4
+ * vim600: fdm=marker
+ */
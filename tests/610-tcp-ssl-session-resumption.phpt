@@ -0,0 +1,77 @@
+--TEST--
+TCP socket SSL session resumption.
+--SKIPIF--
+<?php
+if (!extension_loaded('task')) echo 'Test requires the task extension to be loaded';
+?>
+--FILE--
+<?php
+
+namespace Concurrent\Network;
+
+use Concurrent\Task;
+
+$file = dirname(__DIR__) . '/examples/cert/localhost.';
+
+$tls = new TlsServerEncryption();
+$tls = $tls->withDefaultCertificate($file . 'crt', $file . 'key', 'localhost');
+$tls = $tls->withSessionCache(100);
+$tls = $tls->withSessionTickets(true);
+
+$client = new TlsClientEncryption();
+$client = $client->withPeerName('localhost');
+$client = $client->withAllowSelfSigned(true);
+$client = $client->withSessionReuse(true);
+
+$server = TcpServer::listen('127.0.0.1', 0, $tls);
+
+try {
+    for ($i = 0; $i < 3; $i++) {
+        $t = Task::async(function () use ($server, $client) {
+            $socket = TcpSocket::connect($server->getAddress(), $server->getPort(), $client);
+            
+            try {
+                $socket->encrypt();
+                
+                return $socket->read();
+            } finally {
+                $socket->close();
+            }
+        });
+        
+        $socket = $server->accept();
+        
+        try {
+            $socket->encrypt();
+            $socket->write('Hello');
+            
+            while (null !== $socket->read()) {}
+        } finally {
+            $socket->close();
+        }
+        
+        var_dump(Task::await($t));
+    }
+} finally {
+    $server->close();
+}
+
+var_dump($client->getSessionStats());
+var_dump($tls->getSessionStats());
+
+--EXPECT--
+string(5) "Hello"
+string(5) "Hello"
+string(5) "Hello"
+array(2) {
+  ["full"]=>
+  int(1)
+  ["resumed"]=>
+  int(2)
+}
+array(2) {
+  ["full"]=>
+  int(1)
+  ["resumed"]=>
+  int(2)
+}
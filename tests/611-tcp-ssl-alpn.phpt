@@ -0,0 +1,77 @@
+--TEST--
+TCP socket SSL ALPN negotiation.
+--SKIPIF--
+<?php
+if (!extension_loaded('task')) echo 'Test requires the task extension to be loaded';
+?>
+--FILE--
+<?php
+
+namespace Concurrent\Network;
+
+use Concurrent\Task;
+
+$file = dirname(__DIR__) . '/examples/cert/localhost.';
+
+$tls = new TlsServerEncryption();
+$tls = $tls->withDefaultCertificate($file . 'crt', $file . 'key', 'localhost');
+$tls = $tls->withAlpnProtocols(['h2', 'http/1.1']);
+
+$server = TcpServer::listen('127.0.0.1', 0, $tls);
+
+try {
+    foreach ([['http/1.1', 'h2'], ['http/1.1'], ['spdy/3'], []] as $protocols) {
+        $t = Task::async(function () use ($server, $protocols) {
+            $tls = new TlsClientEncryption();
+            $tls = $tls->withPeerName('localhost');
+            $tls = $tls->withAllowSelfSigned(true);
+            $tls = $tls->withAlpnProtocols($protocols);
+            
+            $socket = TcpSocket::connect($server->getAddress(), $server->getPort(), $tls);
+            
+            try {
+                $socket->encrypt();
+                $socket->read();
+                
+                return $socket->getAlpnProtocol();
+            } finally {
+                $socket->close();
+            }
+        });
+        
+        $socket = $server->accept();
+        
+        try {
+            $socket->encrypt();
+            
+            var_dump($socket->getAlpnProtocol());
+            
+            $socket->write('A');
+            
+            while (null !== $socket->read()) {}
+        } finally {
+            $socket->close();
+        }
+        
+        var_dump(Task::await($t));
+    }
+} finally {
+    $server->close();
+}
+
+try {
+    $tls->withAlpnProtocols(['']);
+} catch (\Error $e) {
+    var_dump($e->getMessage());
+}
+
+--EXPECT--
+string(2) "h2"
+string(2) "h2"
+string(8) "http/1.1"
+string(8) "http/1.1"
+NULL
+NULL
+NULL
+NULL
+string(55) "ALPN protocol name must be between 1 and 255 bytes long"
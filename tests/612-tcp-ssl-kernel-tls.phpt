@@ -0,0 +1,70 @@
+--TEST--
+TCP socket SSL connection with kernel TLS enabled.
+--SKIPIF--
+<?php
+if (!extension_loaded('task')) echo 'Test requires the task extension to be loaded';
+?>
+--FILE--
+<?php
+
+namespace Concurrent\Network;
+
+use Concurrent\Task;
+
+$file = dirname(__DIR__) . '/examples/cert/localhost.';
+
+$tls = new TlsServerEncryption();
+$tls = $tls->withDefaultCertificate($file . 'crt', $file . 'key', 'localhost');
+$tls = $tls->withKernelTls(true);
+
+$server = TcpServer::listen('127.0.0.1', 0, $tls);
+
+try {
+    $t = Task::async(function () use ($server) {
+        $tls = new TlsClientEncryption();
+        $tls = $tls->withPeerName('localhost');
+        $tls = $tls->withAllowSelfSigned(true);
+        $tls = $tls->withKernelTls(true);
+        
+        $socket = TcpSocket::connect($server->getAddress(), $server->getPort(), $tls);
+        $received = '';
+        
+        try {
+            $socket->encrypt();
+            $socket->write('Hello');
+            
+            while (null !== ($chunk = $socket->read())) {
+                $received .= $chunk;
+            }
+        } finally {
+            $socket->close();
+        }
+        
+        return $received;
+    });
+    
+    $socket = $server->accept();
+    
+    try {
+        $socket->encrypt();
+        
+        var_dump($socket->read());
+        
+        $socket->writeAsync(str_repeat('A', 100000));
+        $socket->write('B');
+    } finally {
+        $socket->close();
+    }
+    
+    $received = Task::await($t);
+    
+    var_dump(strlen($received));
+    var_dump(substr($received, -2));
+} finally {
+    $server->close();
+}
+
+--EXPECT--
+string(5) "Hello"
+int(100001)
+string(2) "AB"
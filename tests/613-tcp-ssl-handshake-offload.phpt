@@ -0,0 +1,83 @@
+--TEST--
+TCP socket SSL server handshakes offloaded to the thread pool.
+--SKIPIF--
+<?php
+if (!extension_loaded('task')) echo 'Test requires the task extension to be loaded';
+?>
+--FILE--
+<?php
+
+namespace Concurrent\Network;
+
+use Concurrent\Task;
+
+$file = dirname(__DIR__) . '/examples/cert/localhost.';
+
+$tls = new TlsServerEncryption();
+$tls = $tls->withDefaultCertificate($file . 'crt', $file . 'key', 'localhost');
+$tls = $tls->withAlpnProtocols(['h2', 'http/1.1']);
+$tls = $tls->withSessionTickets(true);
+$tls = $tls->withHandshakeOffload(true);
+
+$server = TcpServer::listen('127.0.0.1', 0, $tls);
+
+try {
+    $client = new TlsClientEncryption();
+    $client = $client->withPeerName('localhost');
+    $client = $client->withAllowSelfSigned(true);
+    $client = $client->withAlpnProtocols(['http/1.1']);
+    $client = $client->withSessionReuse(true);
+    
+    $t = Task::async(function () use ($server, $client) {
+        $received = [];
+        
+        for ($i = 0; $i < 3; $i++) {
+            $socket = TcpSocket::connect($server->getAddress(), $server->getPort(), $client);
+            
+            try {
+                $socket->encrypt();
+                $socket->write('Hello ' . $i);
+                
+                $received[] = $socket->read();
+            } finally {
+                $socket->close();
+            }
+        }
+        
+        return $received;
+    });
+    
+    for ($i = 0; $i < 3; $i++) {
+        $socket = $server->accept();
+        
+        try {
+            $socket->encrypt();
+            
+            var_dump($socket->getAlpnProtocol());
+            
+            $socket->write(strtoupper($socket->read()));
+        } finally {
+            $socket->close();
+        }
+    }
+    
+    print_r(Task::await($t));
+    
+    $stats = $client->getSessionStats();
+    
+    var_dump($stats['full'] + $stats['resumed']);
+} finally {
+    $server->close();
+}
+
+--EXPECT--
+string(8) "http/1.1"
+string(8) "http/1.1"
+string(8) "http/1.1"
+Array
+(
+    [0] => HELLO 0
+    [1] => HELLO 1
+    [2] => HELLO 2
+)
+int(3)
@@ -0,0 +1,110 @@
+--TEST--
+TCP socket can send files to plain and encrypted connections.
+--SKIPIF--
+<?php
+if (!extension_loaded('task')) echo 'Test requires the task extension to be loaded';
+?>
+--FILE--
+<?php
+
+namespace Concurrent\Network;
+
+use Concurrent\Task;
+
+$file = \tempnam(\sys_get_temp_dir(), 'async');
+$data = \random_bytes(1024 * 1024 * 3);
+
+\file_put_contents($file, $data);
+
+function receive(TcpSocket $socket): string
+{
+    $received = '';
+    
+    try {
+        while (null !== ($chunk = $socket->read())) {
+            $received .= $chunk;
+        }
+    } finally {
+        $socket->close();
+    }
+    
+    return $received;
+}
+
+try {
+    list ($a, $b) = TcpSocket::pair();
+    
+    $task = Task::async('Concurrent\Network\receive', $b);
+    
+    try {
+        $a->write('HEAD');
+        
+        var_dump($a->sendFile($file));
+        var_dump($a->sendFile($file, 100, 10));
+        
+        $fp = \fopen($file, 'rb');
+        
+        try {
+            var_dump($a->sendFile($fp, \strlen($data) - 5));
+        } finally {
+            \fclose($fp);
+        }
+    } finally {
+        $a->close();
+    }
+    
+    var_dump(Task::await($task) === 'HEAD' . $data . \substr($data, 100, 10) . \substr($data, -5));
+    
+    $cert = dirname(__DIR__) . '/examples/cert/localhost.';
+    
+    $tls = new TlsServerEncryption();
+    $tls = $tls->withDefaultCertificate($cert . 'crt', $cert . 'key', 'localhost');
+    
+    $server = TcpServer::listen('127.0.0.1', 0, $tls);
+    
+    $task = Task::async(function () use ($server) {
+        $tls = new TlsClientEncryption();
+        $tls = $tls->withPeerName('localhost');
+        $tls = $tls->withAllowSelfSigned(true);
+        
+        $socket = TcpSocket::connect($server->getAddress(), $server->getPort(), $tls);
+        $socket->encrypt();
+        
+        return receive($socket);
+    });
+    
+    $socket = $server->accept();
+    
+    try {
+        $socket->encrypt();
+        
+        var_dump($socket->sendFile($file, 1000));
+    } finally {
+        $socket->close();
+        $server->close();
+    }
+    
+    var_dump(Task::await($task) === \substr($data, 1000));
+    
+    list ($a, $b) = TcpSocket::pair();
+    
+    try {
+        $a->sendFile($file . '.missing');
+    } catch (SocketException $e) {
+        var_dump('FAILED');
+    } finally {
+        $a->close();
+        $b->close();
+    }
+} finally {
+    \unlink($file);
+}
+
+--EXPECT--
+int(3145728)
+int(10)
+int(5)
+bool(true)
+int(3144728)
+bool(true)
+string(6) "FAILED"
@@ -0,0 +1,66 @@
+--TEST--
+TCP socket writes of other tasks wait until a file has been sent.
+--SKIPIF--
+<?php
+if (!extension_loaded('task')) echo 'Test requires the task extension to be loaded';
+?>
+--FILE--
+<?php
+
+namespace Concurrent\Network;
+
+use Concurrent\Task;
+
+$file = \tempnam(\sys_get_temp_dir(), 'async');
+$data = \random_bytes(1024 * 1024 * 8);
+
+\file_put_contents($file, $data);
+
+try {
+    list ($a, $b) = TcpSocket::pair();
+    
+    $reader = Task::async(function () use ($b) {
+        $received = '';
+        
+        try {
+            while (null !== ($chunk = $b->read())) {
+                $received .= $chunk;
+            }
+        } finally {
+            $b->close();
+        }
+        
+        return $received;
+    });
+    
+    $writer = Task::async(function () use ($a) {
+        try {
+            $a->writeAsync('ASYNC');
+        } catch (\Throwable $e) {
+            var_dump($e->getMessage());
+        }
+        
+        $a->write('TAIL');
+    });
+    
+    $fp = \fopen($file, 'rb');
+    
+    try {
+        var_dump($a->sendFile($fp, 0, \strlen($data)));
+        
+        Task::await($writer);
+    } finally {
+        \fclose($fp);
+        
+        $a->close();
+    }
+    
+    var_dump(Task::await($reader) === $data . 'TAIL');
+} finally {
+    \unlink($file);
+}
+
+--EXPECT--
+string(39) "Cannot write while a file is being sent"
+int(8388608)
+bool(true)
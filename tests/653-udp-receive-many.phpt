@@ -0,0 +1,60 @@
+--TEST--
+UDP receive multiple datagrams per call.
+--SKIPIF--
+<?php
+if (!extension_loaded('task')) echo 'Test requires the task extension to be loaded';
+?>
+--FILE--
+<?php
+
+namespace Concurrent\Network;
+
+use Concurrent\Task;
+use Concurrent\Timer;
+
+$a = UdpSocket::bind('127.0.0.1', 0);
+$b = UdpSocket::bind('127.0.0.1', 0);
+
+try {
+    for ($i = 0; $i < 5; $i++) {
+        $b->send(new UdpDatagram((string) $i, $a->getAddress(), $a->getPort()));
+    }
+    
+    $b->send(new UdpDatagram(str_repeat('A', 20000), $a->getAddress(), $a->getPort()));
+    
+    (new Timer(50))->awaitTimeout();
+    
+    $received = $a->receiveMany(3);
+    
+    var_dump(count($received));
+    var_dump($received[0] instanceof UdpDatagram);
+    var_dump($received[0]->port == $b->getPort());
+    
+    foreach ($a->receiveMany(10) as $datagram) {
+        $received[] = $datagram;
+    }
+    
+    var_dump(count($received));
+    var_dump(strlen(array_pop($received)->data));
+    var_dump(implode(',', array_map(function ($datagram) {
+        return $datagram->data;
+    }, $received)));
+    
+    try {
+        $a->receiveMany(0);
+    } catch (\Error $e) {
+        var_dump($e->getMessage());
+    }
+} finally {
+    $a->close();
+    $b->close();
+}
+
+--EXPECT--
+int(3)
+bool(true)
+bool(true)
+int(6)
+int(20000)
+string(9) "0,1,2,3,4"
+string(42) "Max number of datagrams must be at least 1"
@@ -0,0 +1,64 @@
+--TEST--
+UDP send multiple datagrams per call.
+--SKIPIF--
+<?php
+if (!extension_loaded('task')) echo 'Test requires the task extension to be loaded';
+?>
+--FILE--
+<?php
+
+namespace Concurrent\Network;
+
+$a = UdpSocket::bind('127.0.0.1', 0);
+$b = UdpSocket::bind('127.0.0.1', 0);
+
+$datagram = new UdpDatagram('', $a->getAddress(), $a->getPort());
+
+try {
+    $b->sendMany([]);
+    $b->sendMany(array_map(function ($i) use ($datagram) {
+        return $datagram->withData((string) $i);
+    }, range(0, 4)));
+    
+    $received = [];
+    
+    while (count($received) < 5) {
+        foreach ($a->receiveMany(5) as $d) {
+            $received[] = $d->data;
+        }
+    }
+    
+    var_dump(implode(',', $received));
+    
+    // GSO is not available on every kernel, datagrams must arrive separately in both cases.
+    $b->setOption(UdpSocket::SEGMENTATION, true);
+    $b->sendMany([
+        $datagram->withData('AAAA'),
+        $datagram->withData('BBBB'),
+        $datagram->withData('CC')
+    ]);
+    
+    $received = [];
+    
+    while (count($received) < 3) {
+        foreach ($a->receiveMany(3) as $d) {
+            $received[] = $d->data;
+        }
+    }
+    
+    var_dump(implode(',', $received));
+    
+    try {
+        $b->sendMany(['foo']);
+    } catch (\TypeError $e) {
+        var_dump($e->getMessage());
+    }
+} finally {
+    $a->close();
+    $b->close();
+}
+
+--EXPECT--
+string(9) "0,1,2,3,4"
+string(12) "AAAA,BBBB,CC"
+string(38) "Batch must only contain UDP datagrams"
@@ -0,0 +1,60 @@
+--TEST--
+UDP receive datagrams as tuples into an array.
+--SKIPIF--
+<?php
+if (!extension_loaded('task')) echo 'Test requires the task extension to be loaded';
+?>
+--FILE--
+<?php
+
+namespace Concurrent\Network;
+
+use Concurrent\Timer;
+
+$a = UdpSocket::bind('127.0.0.1', 0);
+$b = UdpSocket::bind('127.0.0.1', 0);
+
+try {
+    for ($i = 0; $i < 4; $i++) {
+        $b->send(new UdpDatagram((string) $i, $a->getAddress(), $a->getPort()));
+    }
+    
+    (new Timer(50))->awaitTimeout();
+    
+    $buffer = [];
+    
+    var_dump($a->receiveInto($buffer));
+    
+    list ($data, $address, $port) = $buffer[0];
+    
+    var_dump($data);
+    var_dump($address);
+    var_dump($port == $b->getPort());
+    
+    $count = 1;
+    
+    while ($count < 4) {
+        $count += $a->receiveInto($buffer, 10);
+    }
+    
+    var_dump(count($buffer));
+    var_dump(implode(',', array_column($buffer, 0)));
+    var_dump(count(array_unique(array_column($buffer, 1))));
+    
+    $b->send(new UdpDatagram('X', $a->getAddress(), $a->getPort()));
+    
+    var_dump($a->receive()->address);
+} finally {
+    $a->close();
+    $b->close();
+}
+
+--EXPECT--
+int(1)
+string(1) "0"
+string(9) "127.0.0.1"
+bool(true)
+int(4)
+string(7) "0,1,2,3"
+int(1)
+string(9) "127.0.0.1"
@@ -0,0 +1,44 @@
+--TEST--
+UDP connected socket send and receive.
+--SKIPIF--
+<?php
+if (!extension_loaded('task')) echo 'Test requires the task extension to be loaded';
+?>
+--FILE--
+<?php
+
+namespace Concurrent\Network;
+
+$a = UdpSocket::bind('127.0.0.1', 0);
+$b = UdpSocket::connect('127.0.0.1', $a->getPort());
+
+try {
+    $b->send('Hello');
+    $b->sendAsync('World');
+    
+    $data = $a->receive();
+    
+    var_dump($data->data);
+    var_dump($data->port == $b->getPort());
+    var_dump($a->receive()->data);
+    
+    $a->send($data->withData('RECEIVED!'));
+    
+    var_dump($b->receive()->data);
+    
+    try {
+        $a->send('Test');
+    } catch (SocketException $e) {
+        var_dump($e->getMessage());
+    }
+} finally {
+    $a->close();
+    $b->close();
+}
+
+--EXPECT--
+string(5) "Hello"
+bool(true)
+string(5) "World"
+string(9) "RECEIVED!"
+string(71) "Cannot send data without a peer address using an unconnected UDP socket"
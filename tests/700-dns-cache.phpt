@@ -0,0 +1,74 @@
+--TEST--
+DNS cache stores resolved and failed lookups.
+--SKIPIF--
+<?php
+if (!extension_loaded('task')) echo 'Test requires the task extension to be loaded';
+?>
+--INI--
+async.dns=1
+async.dns_cache_size=2
+--FILE--
+<?php
+
+namespace Concurrent\Network;
+
+var_dump(gethostbyname('127.0.0.1'));
+var_dump(Dns::getCacheStats()['misses']);
+
+var_dump(gethostbyname('localhost'));
+var_dump(gethostbyname('LOCALHOST'));
+
+$stats = Dns::getCacheStats();
+
+var_dump($stats['size'], $stats['hits'], $stats['misses']);
+
+$entries = Dns::getCacheEntries();
+
+var_dump(in_array('127.0.0.1', $entries['localhost']['addresses']));
+var_dump($entries['localhost']['ttl'] > 0);
+var_dump($entries['localhost']['error']);
+
+var_dump(gethostbynamel('does-not-exist.invalid'));
+var_dump(gethostbynamel('does-not-exist.invalid'));
+
+$stats = Dns::getCacheStats();
+
+var_dump($stats['size'], $stats['negative_hits']);
+var_dump(is_string(Dns::getCacheEntries()['does-not-exist.invalid']['error']));
+
+gethostbyname('other-does-not-exist.invalid');
+
+$stats = Dns::getCacheStats();
+
+var_dump($stats['size'], $stats['evictions']);
+var_dump(isset(Dns::getCacheEntries()['localhost']));
+
+Dns::flushCache('other-does-not-exist.invalid');
+
+var_dump(Dns::getCacheStats()['size']);
+
+Dns::flushCache();
+
+var_dump(Dns::getCacheStats()['size']);
+
+--EXPECT--
+string(9) "127.0.0.1"
+int(0)
+string(9) "127.0.0.1"
+string(9) "127.0.0.1"
+int(1)
+int(1)
+int(1)
+bool(true)
+bool(true)
+NULL
+bool(false)
+bool(false)
+int(2)
+int(1)
+bool(true)
+int(2)
+int(1)
+bool(false)
+int(1)
+int(0)
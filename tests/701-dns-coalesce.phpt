@@ -0,0 +1,49 @@
+--TEST--
+DNS lookups of the same name share a single resolution.
+--SKIPIF--
+<?php
+if (!extension_loaded('task')) echo 'Test requires the task extension to be loaded';
+?>
+--INI--
+async.dns=1
+--FILE--
+<?php
+
+namespace Concurrent;
+
+use Concurrent\Network\Dns;
+
+$tasks = [];
+
+for ($i = 0; $i < 10; $i++) {
+    $tasks[] = Task::async(function () {
+        return gethostbyname('localhost');
+    });
+}
+
+var_dump(Dns::getCacheStats()['pending']);
+
+$results = array_map(function (Task $task) {
+    return Task::await($task);
+}, $tasks);
+
+var_dump(array_unique($results));
+
+$stats = Dns::getCacheStats();
+
+var_dump($stats['misses'], $stats['coalesced'], $stats['pending']);
+
+var_dump(gethostbyname('localhost'));
+var_dump(Dns::getCacheStats()['hits']);
+
+--EXPECT--
+int(0)
+array(1) {
+  [0]=>
+  string(9) "127.0.0.1"
+}
+int(1)
+int(9)
+int(0)
+string(9) "127.0.0.1"
+int(1)
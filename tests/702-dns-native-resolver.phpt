@@ -0,0 +1,122 @@
+--TEST--
+Native DNS resolver queries name servers using UDP and TCP.
+--SKIPIF--
+<?php
+if (!extension_loaded('task')) echo 'Test requires the task extension to be loaded';
+?>
+--INI--
+async.dns=1
+async.dns_native=1
+async.dns_nameservers=127.0.0.1:15353
+--FILE--
+<?php
+
+namespace Concurrent\Network;
+
+use Concurrent\Task;
+
+$records = [
+    'service.test' => ['10.0.0.1'],
+    'multi.test' => ['10.0.0.1', '10.0.0.2', '10.0.0.3']
+];
+
+function respond(string $query, array $records, bool $udp): string
+{
+    $labels = [];
+    
+    for ($i = 12; 0 < ($len = \ord($query[$i])); $i += $len + 1) {
+        $labels[] = \substr($query, $i + 1, $len);
+    }
+    
+    $name = \implode('.', $labels);
+    $type = \unpack('n', \substr($query, $i + 1, 2))[1];
+    
+    $flags = isset($records[$name]) ? 0x8180 : 0x8183;
+    $answers = ($type == 1) ? ($records[$name] ?? []) : [];
+    
+    // Large answers are truncated and have to be queried using TCP.
+    if ($udp && \count($answers) > 1) {
+        $flags |= 0x0200;
+        $answers = [];
+    }
+    
+    $response = \substr($query, 0, 2) . \pack('nnnnn', $flags, 1, \count($answers), 0, 0) . \substr($query, 12, $i - 7);
+    
+    foreach ($answers as $ip) {
+        $response .= \pack('nnnNn', 0xC00C, 1, 1, 30, 4) . \inet_pton($ip);
+    }
+    
+    return $response;
+}
+
+$udp = UdpSocket::bind('127.0.0.1', 15353);
+$tcp = TcpServer::listen('127.0.0.1', 15353);
+
+Task::async(function () use ($udp, $records) {
+    try {
+        while (true) {
+            $datagram = $udp->receive();
+            
+            $udp->send($datagram->withData(respond($datagram->data, $records, true)));
+        }
+    } catch (\Throwable $e) {}
+});
+
+Task::async(function () use ($tcp, $records) {
+    try {
+        while (true) {
+            $socket = $tcp->accept();
+            $buffer = '';
+            
+            try {
+                while (\strlen($buffer) < 2 || \strlen($buffer) < 2 + \unpack('n', $buffer)[1]) {
+                    $buffer .= $socket->read();
+                }
+                
+                $response = respond(\substr($buffer, 2), $records, false);
+                
+                $socket->write(\pack('n', \strlen($response)) . $response);
+            } finally {
+                $socket->close();
+            }
+            
+            var_dump('TCP');
+        }
+    } catch (\Throwable $e) {}
+});
+
+try {
+    var_dump(gethostbyname('service.test'));
+    
+    $ips = gethostbynamel('multi.test');
+    sort($ips);
+    
+    var_dump($ips);
+    var_dump(gethostbynamel('missing.test'));
+    
+    $entry = Dns::getCacheEntries()['service.test'];
+    
+    var_dump($entry['addresses']);
+    var_dump($entry['ttl'] > 0 && $entry['ttl'] <= 30);
+} finally {
+    $udp->close();
+    $tcp->close();
+}
+
+--EXPECT--
+string(8) "10.0.0.1"
+string(3) "TCP"
+array(3) {
+  [0]=>
+  string(8) "10.0.0.1"
+  [1]=>
+  string(8) "10.0.0.2"
+  [2]=>
+  string(8) "10.0.0.3"
+}
+bool(false)
+array(1) {
+  [0]=>
+  string(8) "10.0.0.1"
+}
+bool(true)
@@ -0,0 +1,103 @@
+--TEST--
+DNS records can be queried using the native resolver.
+--SKIPIF--
+<?php
+if (!extension_loaded('task')) echo 'Test requires the task extension to be loaded';
+?>
+--INI--
+async.dns_nameservers=127.0.0.1:15354
+--FILE--
+<?php
+
+namespace Concurrent\Network;
+
+use Concurrent\Task;
+
+function encode(string $name): string
+{
+    $result = '';
+    
+    foreach (\explode('.', $name) as $label) {
+        $result .= \chr(\strlen($label)) . $label;
+    }
+    
+    return $result . "\0";
+}
+
+$records = [
+    'service.test' => [
+        Dns::AAAA => [\inet_pton('::1'), \inet_pton('fe80::1')],
+        Dns::MX => [\pack('n', 10) . encode('mail.service.test')],
+        Dns::TXT => [\chr(6) . 'v=spf1' . \chr(5) . ' -all']
+    ],
+    '_http._tcp.service.test' => [
+        Dns::SRV => [\pack('nnn', 10, 60, 8080) . encode('a.service.test'), \pack('nnn', 20, 40, 8081) . encode('b.service.test')]
+    ]
+];
+
+$udp = UdpSocket::bind('127.0.0.1', 15354);
+
+Task::async(function () use ($udp, $records) {
+    try {
+        while (true) {
+            $datagram = $udp->receive();
+            $query = $datagram->data;
+            
+            $labels = [];
+    
+            for ($i = 12; 0 < ($len = \ord($query[$i])); $i += $len + 1) {
+                $labels[] = \substr($query, $i + 1, $len);
+            }
+            
+            $name = \implode('.', $labels);
+            $type = \unpack('n', \substr($query, $i + 1, 2))[1];
+            
+            $flags = isset($records[$name]) ? 0x8180 : 0x8183;
+            $answers = $records[$name][$type] ?? [];
+            
+            $response = \substr($query, 0, 2) . \pack('nnnnn', $flags, 1, \count($answers), 0, 0) . \substr($query, 12, $i - 7);
+            
+            foreach ($answers as $data) {
+                $response .= \pack('nnnNn', 0xC00C, $type, 1, 300, \strlen($data)) . $data;
+            }
+            
+            $udp->send($datagram->withData($response));
+        }
+    } catch (\Throwable $e) {}
+});
+
+try {
+    foreach (Dns::resolve('_http._tcp.service.test', Dns::SRV) as $record) {
+        echo \implode(' ', $record), "\n";
+    }
+    
+    foreach (Dns::resolve('service.test', Dns::AAAA) as $record) {
+        echo \implode(' ', $record), "\n";
+    }
+    
+    foreach (Dns::resolve('service.test', Dns::MX) as $record) {
+        echo \implode(' ', $record), "\n";
+    }
+    
+    var_dump(Dns::resolve('service.test', Dns::TXT)[0]['text']);
+    var_dump(Dns::resolve('service.test', Dns::A));
+    
+    try {
+        Dns::resolve('missing.test', Dns::A);
+    } catch (SocketException $e) {
+        var_dump($e->getMessage());
+    }
+} finally {
+    $udp->close();
+}
+
+--EXPECT--
+33 300 10 60 8080 a.service.test
+33 300 20 40 8081 b.service.test
+28 300 ::1
+28 300 fe80::1
+15 300 10 mail.service.test
+string(11) "v=spf1 -all"
+array(0) {
+}
+string(55) "Failed to resolve missing.test: unknown node or service"
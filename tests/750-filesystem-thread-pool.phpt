@@ -0,0 +1,43 @@
+--TEST--
+Filesystem operations are queued if the thread pool limit is reached.
+--SKIPIF--
+<?php
+if (!extension_loaded('task')) echo 'Test requires the task extension to be loaded';
+?>
+--INI--
+async.filesystem=1
+async.threadpool_fs=1
+--FILE--
+<?php
+
+namespace Concurrent;
+
+$file = \tempnam(\sys_get_temp_dir(), 'async');
+
+try {
+    \file_put_contents($file, 'Hello World');
+    
+    $tasks = [];
+    
+    for ($i = 0; $i < 5; $i++) {
+        $tasks[] = Task::async(function (int $i) use ($file) {
+            return $i . ': ' . \file_get_contents($file);
+        }, $i);
+    }
+    
+    foreach ($tasks as $task) {
+        var_dump(Task::await($task));
+    }
+    
+    var_dump(\ini_get('async.threadpool_fs'));
+} finally {
+    \unlink($file);
+}
+
+--EXPECT--
+string(14) "0: Hello World"
+string(14) "1: Hello World"
+string(14) "2: Hello World"
+string(14) "3: Hello World"
+string(14) "4: Hello World"
+string(1) "1"
@@ -0,0 +1,64 @@
+--TEST--
+Filesystem stream wrapper supports concurrent reads and writes using io_uring (or the thread pool fallback).
+--SKIPIF--
+<?php
+if (!extension_loaded('task')) echo 'Test requires the task extension to be loaded';
+?>
+--INI--
+async.filesystem=1
+async.filesystem_uring=1
+--FILE--
+<?php
+
+namespace Concurrent;
+
+$file = \tempnam(\sys_get_temp_dir(), 'async');
+
+try {
+    $fp = \fopen($file, 'wb');
+    
+    for ($i = 0; $i < 100; $i++) {
+        \fwrite($fp, \str_pad((string) $i, 1000, '.') . "\n");
+    }
+    
+    \fclose($fp);
+    
+    var_dump(\filesize($file));
+    
+    $tasks = [];
+    
+    for ($i = 0; $i < 5; $i++) {
+        $tasks[] = Task::async(function () use ($file) {
+            $fp = \fopen($file, 'rb');
+            
+            try {
+                \fseek($fp, 1001 * 42);
+                
+                return [
+                    \fstat($fp)['size'],
+                    \rtrim(\fgets($fp), ".\n"),
+                    \strlen(\stream_get_contents($fp))
+                ];
+            } finally {
+                \fclose($fp);
+            }
+        });
+    }
+    
+    foreach ($tasks as $task) {
+        var_dump(Task::await($task) === [100100, '42', 57057]);
+    }
+    
+    var_dump(@\fopen($file . '.missing', 'rb'));
+} finally {
+    \unlink($file);
+}
+
+--EXPECT--
+int(100100)
+bool(true)
+bool(true)
+bool(true)
+bool(true)
+bool(true)
+bool(false)
@@ -0,0 +1,71 @@
+--TEST--
+Filesystem stream wrapper reads ahead of sequential readers.
+--SKIPIF--
+<?php
+if (!extension_loaded('task')) echo 'Test requires the task extension to be loaded';
+?>
+--INI--
+async.filesystem=1
+async.filesystem_uring=0
+async.filesystem_read_buffer_size=16384
+--FILE--
+<?php
+
+namespace Concurrent;
+
+$file = \tempnam(\sys_get_temp_dir(), 'async');
+
+try {
+    $data = '';
+    
+    for ($i = 0; $i < 20000; $i++) {
+        $data .= \sprintf("%08d\n", $i);
+    }
+    
+    \file_put_contents($file, $data);
+    
+    $fp = \fopen($file, 'rb');
+    $read = '';
+    
+    while (!\feof($fp)) {
+        $read .= \fread($fp, 5000);
+    }
+    
+    var_dump($read === $data);
+    
+    \fseek($fp, 9 * 15000);
+    var_dump(\fgets($fp));
+    var_dump(\strlen(\stream_get_contents($fp)));
+    
+    \fclose($fp);
+    
+    $fp = \fopen($file, 'r+b');
+    
+    \fread($fp, 100000);
+    \fseek($fp, 0);
+    \fseek($fp, 100000);
+    \fwrite($fp, 'XXXXXXXX');
+    \fseek($fp, 100000);
+    
+    var_dump(\fread($fp, 8));
+    
+    \fclose($fp);
+    
+    $context = \stream_context_create([
+        'file' => [
+            'read_buffer_size' => 65536
+        ]
+    ]);
+    
+    var_dump(\strlen(\file_get_contents($file, false, $context)));
+} finally {
+    \unlink($file);
+}
+
+--EXPECT--
+bool(true)
+string(9) "00015000
+"
+int(44991)
+string(8) "XXXXXXXX"
+int(180000)
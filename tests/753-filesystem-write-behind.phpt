@@ -0,0 +1,71 @@
+--TEST--
+Filesystem stream wrapper aggregates writes using a write-behind buffer.
+--SKIPIF--
+<?php
+if (!extension_loaded('task')) echo 'Test requires the task extension to be loaded';
+?>
+--INI--
+async.filesystem=1
+async.filesystem_write_buffer_size=4096
+--FILE--
+<?php
+
+namespace Concurrent;
+
+$file = \tempnam(\sys_get_temp_dir(), 'async');
+
+try {
+    $fp = \fopen($file, 'wb');
+    
+    for ($i = 0; $i < 1000; $i++) {
+        \fwrite($fp, \sprintf("%04d\n", $i));
+    }
+    
+    var_dump(\fstat($fp)['size']);
+    
+    \fwrite($fp, 'A');
+    
+    (new Timer(250))->awaitTimeout();
+    
+    \clearstatcache();
+    var_dump(\filesize($file));
+    
+    \fwrite($fp, 'B');
+    \fwrite($fp, \str_repeat('C', 10000));
+    \fflush($fp);
+    
+    \clearstatcache();
+    var_dump(\filesize($file));
+    
+    \fwrite($fp, 'D');
+    \fclose($fp);
+    
+    $data = \file_get_contents($file);
+    
+    var_dump(\strlen($data), \substr($data, 4995, 7), \substr($data, -2));
+    
+    $fp = \fopen($file, 'r+b', false, \stream_context_create([
+        'file' => [
+            'write_buffer_size' => 0
+        ]
+    ]));
+    
+    \fwrite($fp, 'XX');
+    
+    \clearstatcache();
+    var_dump(\file_get_contents($file, false, null, 0, 4));
+    
+    \fclose($fp);
+} finally {
+    \unlink($file);
+}
+
+--EXPECT--
+int(5000)
+int(5001)
+int(15002)
+int(15003)
+string(7) "0999
+AB"
+string(2) "CD"
+string(4) "XX00"
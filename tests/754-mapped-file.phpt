@@ -0,0 +1,69 @@
+--TEST--
+Mapped file provides read-only access to ranges of a file.
+--SKIPIF--
+<?php
+if (!extension_loaded('task')) echo 'Test requires the task extension to be loaded';
+?>
+--FILE--
+<?php
+
+namespace Concurrent;
+
+$file = \tempnam(\sys_get_temp_dir(), 'async');
+\file_put_contents($file, \str_repeat('A', 10000) . 'needle' . \str_repeat('B', 10000));
+
+$map = Task::await(Task::async(function () use ($file) {
+    return MappedFile::open($file, MappedFile::ADVICE_RANDOM);
+}));
+
+var_dump($map->getSize());
+var_dump($map->read(9998, 10));
+var_dump($map->read(20004));
+var_dump($map->read(20000, 100));
+var_dump($map->find('needle'));
+var_dump($map->find('needle', 10001));
+var_dump($map->find('needle', 0, 10005));
+
+$map->advise(MappedFile::ADVICE_WILLNEED, 5000, 1000);
+
+// Data remains accessible after the file has been removed.
+\unlink($file);
+
+var_dump(\strlen($map->read(0)));
+
+$map->close();
+
+try {
+    $map->read(0, 1);
+} catch (\Error $e) {
+    var_dump($e->getMessage());
+}
+
+try {
+    MappedFile::open($file);
+} catch (\Error $e) {
+    var_dump('FAILED');
+}
+
+$file = \tempnam(\sys_get_temp_dir(), 'async');
+
+$map = MappedFile::open($file);
+
+var_dump($map->getSize());
+var_dump($map->read(0));
+
+\unlink($file);
+
+--EXPECT--
+int(20006)
+string(10) "AAneedleBB"
+string(2) "BB"
+string(6) "BBBBBB"
+int(10000)
+NULL
+NULL
+int(20006)
+string(34) "Cannot access a closed mapped file"
+string(6) "FAILED"
+int(0)
+string(0) ""
@@ -0,0 +1,114 @@
+--TEST--
+Filesystem stream wrapper reads directory entries in batches.
+--SKIPIF--
+<?php
+if (!extension_loaded('task')) echo 'Test requires the task extension to be loaded';
+?>
+--INI--
+async.filesystem=1
+async.filesystem_dir_batch_size=16
+--FILE--
+<?php
+
+namespace Concurrent;
+
+$dir = \sys_get_temp_dir() . '/async-dir-' . \getmypid();
+
+\mkdir($dir);
+
+try {
+    for ($i = 0; $i < 100; $i++) {
+        \touch($dir . '/file-' . $i);
+    }
+    
+    $expected = \array_merge(['.', '..'], \array_map(function ($i) {
+        return 'file-' . $i;
+    }, \range(0, 99)));
+    
+    \sort($expected);
+    
+    foreach ([1, 7, 1000] as $size) {
+        $context = \stream_context_create([
+            'file' => [
+                'dir_batch_size' => $size
+            ]
+        ]);
+        
+        $entries = Task::await(Task::async(function () use ($dir, $context) {
+            $entries = [];
+            $dh = \opendir($dir, $context);
+            
+            try {
+                while (false !== ($entry = \readdir($dh))) {
+                    $entries[] = $entry;
+                }
+            } finally {
+                \closedir($dh);
+            }
+            
+            return $entries;
+        }));
+        
+        var_dump(\array_slice($entries, 0, 2));
+        
+        \sort($entries);
+        
+        var_dump($entries === $expected);
+    }
+    
+    $dh = \opendir($dir);
+    
+    for ($i = 0; $i < 50; $i++) {
+        \readdir($dh);
+    }
+    
+    \rewinddir($dh);
+    
+    $entries = [];
+    
+    while (false !== ($entry = \readdir($dh))) {
+        $entries[] = $entry;
+    }
+    
+    \closedir($dh);
+    
+    var_dump(\count($entries));
+    
+    $entries = \scandir($dir);
+    
+    var_dump($entries === $expected);
+    
+    var_dump(@\opendir($dir . '/missing'));
+} finally {
+    foreach (\glob($dir . '/*') as $file) {
+        \unlink($file);
+    }
+    
+    \rmdir($dir);
+}
+
+--EXPECT--
+array(2) {
+  [0]=>
+  string(1) "."
+  [1]=>
+  string(2) ".."
+}
+bool(true)
+array(2) {
+  [0]=>
+  string(1) "."
+  [1]=>
+  string(2) ".."
+}
+bool(true)
+array(2) {
+  [0]=>
+  string(1) "."
+  [1]=>
+  string(2) ".."
+}
+bool(true)
+int(102)
+bool(true)
+bool(false)
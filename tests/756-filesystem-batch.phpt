@@ -0,0 +1,95 @@
+--TEST--
+Filesystem executes metadata operations on many paths in a single batch.
+--SKIPIF--
+<?php
+if (!extension_loaded('task')) echo 'Test requires the task extension to be loaded';
+?>
+--FILE--
+<?php
+
+namespace Concurrent;
+
+$dir = \sys_get_temp_dir() . '/async-batch-' . \getmypid();
+
+$result = Filesystem::mkdir([$dir . '/a/b', $dir . '/c'], 0755, true);
+
+var_dump($result[$dir . '/a/b'], $result[$dir . '/c']);
+var_dump(\is_dir($dir . '/a/b'));
+
+$result = Filesystem::mkdir([$dir . '/c']);
+
+var_dump(\is_string($result[$dir . '/c']));
+
+\file_put_contents($dir . '/a/file', 'Hello');
+
+$result = Task::await(Task::async(function () use ($dir) {
+    return Filesystem::stat([$dir . '/a/file', $dir . '/missing', $dir . '/c']);
+}));
+
+var_dump($result[$dir . '/a/file']['size']);
+var_dump(\is_string($result[$dir . '/missing']));
+var_dump(($result[$dir . '/c']['mode'] & 0170000) === 0040000);
+
+$result = Filesystem::rename([
+    $dir . '/a/file' => $dir . '/c/file',
+    $dir . '/missing' => $dir . '/c/missing'
+]);
+
+var_dump($result[$dir . '/a/file']);
+var_dump(\is_string($result[$dir . '/missing']));
+var_dump(\file_get_contents($dir . '/c/file'));
+
+var_dump(\file_exists($dir . '/c/file'));
+
+$result = Filesystem::unlink([$dir . '/c/file', $dir . '/c/file']);
+
+var_dump($result);
+var_dump(\file_exists($dir . '/c/file'));
+
+\chdir($dir . '/c');
+\file_put_contents('123', 'Hello');
+
+var_dump(Filesystem::rename(['123' => '456']));
+var_dump(\file_exists('456'));
+
+\unlink('456');
+\chdir(\sys_get_temp_dir());
+
+var_dump(Filesystem::unlink([]));
+
+try {
+    Filesystem::stat([1]);
+} catch (\Error $e) {
+    var_dump($e->getMessage());
+}
+
+\rmdir($dir . '/a/b');
+\rmdir($dir . '/a');
+\rmdir($dir . '/c');
+\rmdir($dir);
+
+--EXPECTF--
+bool(true)
+bool(true)
+bool(true)
+bool(true)
+int(5)
+bool(true)
+bool(true)
+bool(true)
+bool(true)
+string(5) "Hello"
+bool(true)
+array(1) {
+  ["%s/c/file"]=>
+  bool(true)
+}
+bool(false)
+array(1) {
+  [123]=>
+  bool(true)
+}
+bool(true)
+array(0) {
+}
+string(32) "Paths must be strings, int given"
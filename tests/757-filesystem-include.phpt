@@ -0,0 +1,52 @@
+--TEST--
+Filesystem stream wrapper reads files included by tasks in the thread pool.
+--SKIPIF--
+<?php
+if (!extension_loaded('task')) echo 'Test requires the task extension to be loaded';
+if (ini_get('opcache.enable_cli')) echo 'Test requires opcache to be disabled';
+?>
+--INI--
+async.filesystem=1
+async.filesystem_include=1
+--FILE--
+<?php
+
+namespace Concurrent;
+
+$file = \tempnam(\sys_get_temp_dir(), 'async');
+\file_put_contents($file, '<?php return $value * 2;');
+
+try {
+    $value = 1;
+    
+    var_dump(include $file);
+    
+    $tasks = [];
+    
+    for ($i = 0; $i < 5; $i++) {
+        $tasks[] = Task::async(function (int $value) use ($file) {
+            return include $file;
+        }, $i);
+    }
+    
+    foreach ($tasks as $task) {
+        var_dump(Task::await($task));
+    }
+    
+    $stats = Filesystem::getIncludeStats();
+    
+    var_dump($stats['async'], $stats['sync'] > 0, $stats['sync_time'] > 0);
+} finally {
+    \unlink($file);
+}
+
+--EXPECT--
+int(2)
+int(0)
+int(2)
+int(4)
+int(6)
+int(8)
+int(5)
+bool(true)
+bool(true)
@@ -0,0 +1,57 @@
+--TEST--
+File watcher reports coalesced changes within a watched directory.
+--SKIPIF--
+<?php
+if (!extension_loaded('task')) echo 'Test requires the task extension to be loaded';
+?>
+--FILE--
+<?php
+
+namespace Concurrent;
+
+$dir = sys_get_temp_dir() . '/async-file-watcher-' . getmypid();
+
+@mkdir($dir);
+
+$watcher = new FileWatcher($dir);
+
+var_dump($watcher->getPath() == $dir);
+
+try {
+    $watcher->__construct($dir);
+} catch (\Throwable $e) {
+    var_dump($e->getMessage());
+}
+
+Task::async(function () use ($dir) {
+    (new Timer(20))->awaitTimeout();
+
+    file_put_contents($dir . '/a.txt', 'A');
+    file_put_contents($dir . '/a.txt', 'B');
+});
+
+$changes = $watcher->awaitChange();
+
+var_dump(array_keys($changes));
+var_dump($changes['a.txt'] > 0);
+
+$watcher->close();
+
+try {
+    $watcher->awaitChange();
+} catch (\Throwable $e) {
+    var_dump($e->getMessage());
+}
+
+unlink($dir . '/a.txt');
+rmdir($dir);
+
+--EXPECT--
+bool(true)
+string(41) "File watcher has already been initialized"
+array(1) {
+  [0]=>
+  string(5) "a.txt"
+}
+bool(true)
+string(27) "File watcher has been closed"
@@ -0,0 +1,62 @@
+--TEST--
+Filesystem stream wrapper acquires contended file locks without blocking the event loop.
+--SKIPIF--
+<?php
+if (!extension_loaded('task')) echo 'Test requires the task extension to be loaded';
+?>
+--INI--
+async.filesystem=1
+--FILE--
+<?php
+
+namespace Concurrent;
+
+$file = sys_get_temp_dir() . '/async-flock-' . getmypid() . '.txt';
+
+file_put_contents($file, 'lock');
+
+$a = fopen($file, 'r');
+$b = fopen($file, 'r');
+
+var_dump(flock($a, LOCK_EX));
+var_dump(flock($b, LOCK_EX | LOCK_NB, $wouldblock), $wouldblock);
+
+Task::async(function () use ($a) {
+    (new Timer(50))->awaitTimeout();
+    
+    var_dump('UNLOCK');
+    
+    flock($a, LOCK_UN);
+});
+
+var_dump(flock($b, LOCK_EX));
+var_dump('LOCKED');
+
+$t = Task::asyncWithContext(Context::current()->withTimeout(50), function () use ($a) {
+    return flock($a, LOCK_SH);
+});
+
+try {
+    Task::await($t);
+} catch (\Throwable $e) {
+    var_dump($e->getMessage());
+}
+
+var_dump(flock($b, LOCK_UN));
+var_dump(flock($a, LOCK_SH));
+
+fclose($a);
+fclose($b);
+
+unlink($file);
+
+--EXPECT--
+bool(true)
+bool(false)
+int(1)
+string(6) "UNLOCK"
+bool(true)
+string(6) "LOCKED"
+string(17) "Context timed out"
+bool(true)
+bool(true)
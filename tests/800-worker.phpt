@@ -0,0 +1,83 @@
+--TEST--
+Worker offloads hashing, compression and password hashing to the thread pool.
+--SKIPIF--
+<?php
+if (!extension_loaded('task')) echo 'Test requires the task extension to be loaded';
+if (!extension_loaded('zlib')) echo 'Test requires the zlib extension to be loaded';
+?>
+--FILE--
+<?php
+
+namespace Concurrent;
+
+$data = \str_repeat('Hello World ', 1000);
+
+var_dump(Worker::hash('sha256', $data) === \hash('sha256', $data));
+var_dump(Worker::hash('md5', $data, true) === \md5($data, true));
+
+$tasks = [];
+
+foreach ([Worker::ENCODING_RAW, Worker::ENCODING_DEFLATE, Worker::ENCODING_GZIP] as $encoding) {
+    $tasks[] = Task::async(function () use ($data, $encoding) {
+        $compressed = Worker::compress($data, $encoding, 6);
+        
+        return \zlib_decode($compressed) === $data && Worker::decompress($compressed, $encoding) === $data;
+    });
+}
+
+foreach ($tasks as $task) {
+    var_dump(Task::await($task));
+}
+
+var_dump(\gzinflate(Worker::compress($data, Worker::ENCODING_RAW)) === $data);
+var_dump(Worker::decompress(\gzencode($data), Worker::ENCODING_GZIP) === $data);
+
+try {
+    Worker::decompress(Worker::compress($data), Worker::ENCODING_DEFLATE, 100);
+} catch (\Error $e) {
+    var_dump($e->getMessage());
+}
+
+try {
+    Worker::decompress('foo');
+} catch (\Error $e) {
+    var_dump('FAILED');
+}
+
+try {
+    Worker::hash('foo', $data);
+} catch (\Error $e) {
+    var_dump($e->getMessage());
+}
+
+$hash = Worker::passwordHash('secret', 4);
+
+var_dump(\strlen($hash), \substr($hash, 0, 7));
+var_dump(\password_verify('secret', $hash));
+var_dump(Worker::passwordVerify('secret', $hash));
+var_dump(Worker::passwordVerify('wrong', $hash));
+var_dump(Worker::passwordVerify('secret', \password_hash('secret', \PASSWORD_BCRYPT, ['cost' => 4])));
+var_dump(Worker::passwordVerify('secret', 'foo'));
+var_dump(Worker::passwordVerify('secret', '$2b$' . \substr($hash, 4)));
+var_dump(Worker::passwordVerify('secret', '$2y$99$' . \substr($hash, 7)));
+
+--EXPECT--
+bool(true)
+bool(true)
+bool(true)
+bool(true)
+bool(true)
+bool(true)
+bool(true)
+string(40) "Decompressed data exceeds the max length"
+string(6) "FAILED"
+string(30) "Unknown hashing algorithm: foo"
+int(60)
+string(7) "$2y$04$"
+bool(true)
+bool(true)
+bool(false)
+bool(true)
+bool(false)
+bool(true)
+bool(false)